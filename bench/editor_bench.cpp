@@ -0,0 +1,79 @@
+// Load and memory benchmark, run by hand: ./editor_bench [megabytes]
+//
+// Writes a synthetic log of the given size, opens it in the editor and
+// reports load time and the memory breakdown per MB of file, the numbers
+// memory budgets are set against.
+#ifndef TESTING
+#define TESTING
+#endif
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include "../src/QEditor.h"
+
+namespace {
+    std::string writeLog(const size_t megabytes) {
+        const auto path = (std::filesystem::temp_directory_path() / "qedit_bench.log").string();
+        std::ofstream out(path);
+
+        const size_t target = megabytes * 1024 * 1024;
+        size_t written = 0;
+        uint32_t seed = 12345;
+        char line[256];
+        for (size_t i = 0; written < target; ++i) {
+            seed = seed * 1103515245 + 12345;
+            const int n = std::snprintf(line, sizeof(line),
+                                        "2024-05-%02zu 12:%02zu:%02zu.%03zu INFO [worker-%zu] request id=%u "
+                                        "handled in %u ms status=200\n",
+                                        i % 28 + 1, i / 60 % 60, i % 60, i % 1000, i % 8, seed, seed % 500);
+            out.write(line, n);
+            written += static_cast<size_t>(n);
+        }
+        return path;
+    }
+
+    void row(const char* name, const size_t bytes, const double megabytes) {
+        std::printf("  %-14s %12zu bytes %10.0f bytes/MB\n", name, bytes, bytes / megabytes);
+    }
+}
+
+int main(int argc, char** argv) {
+    const size_t megabytes = argc > 1 ? std::stoul(argv[1]) : 64;
+    const std::string path = writeLog(megabytes);
+
+    double seconds;
+    Editor::MemoryUsage usage;
+    {
+        Editor editor;
+        editor.skipTerminalInit();
+
+        const auto start = std::chrono::steady_clock::now();
+        editor.loadFile(path);
+        editor.finishLoading();
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        usage = editor.memoryUsage();
+    }
+    std::filesystem::remove(path);
+
+    const auto& lines = usage.lines;
+    const double mb = static_cast<double>(megabytes);
+    std::printf("Loaded %zu MB, %zu lines in %.3f s (%.1f MB/s)\n", megabytes, lines.lines, seconds, mb / seconds);
+    row("text", lines.textBytes, mb);
+    row("strings", lines.stringBytes, mb);
+    row("slack", lines.slackBytes, mb);
+    row("packed", lines.packedBytes, mb);
+    row("block index", lines.indexBytes, mb);
+    row("store total", lines.residentBytes, mb);
+    row("as strings", lines.unpackedBytes, mb);
+    row("undo", usage.undo, mb);
+    row("render cache", usage.render, mb);
+    row("config", usage.config, mb);
+    row("heap live", usage.heap.liveBytes, mb);
+    row("heap peak", usage.heap.peakBytes, mb);
+    std::printf("  %-14s %12llu\n", "allocations", static_cast<unsigned long long>(usage.heap.allocations));
+    return 0;
+}
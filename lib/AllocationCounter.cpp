@@ -0,0 +1,71 @@
+#include "AllocationCounter.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#define QEDIT_USABLE_SIZE(p) malloc_usable_size(p)
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#define QEDIT_USABLE_SIZE(p) malloc_size(p)
+#else
+#define QEDIT_USABLE_SIZE(p) 0
+#endif
+
+namespace {
+    std::atomic<uint64_t> allocations{0};
+    std::atomic<uint64_t> frees{0};
+    std::atomic<uint64_t> liveBytes{0};
+    std::atomic<uint64_t> peakBytes{0};
+
+    void* allocate(std::size_t size) {
+        void* p = std::malloc(size ? size : 1);
+        if (!p) return nullptr;
+
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        const uint64_t usable = QEDIT_USABLE_SIZE(p);
+        const uint64_t live = liveBytes.fetch_add(usable, std::memory_order_relaxed) + usable;
+
+        uint64_t peak = peakBytes.load(std::memory_order_relaxed);
+        while (live > peak && !peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+        return p;
+    }
+
+    void release(void* p) {
+        if (!p) return;
+
+        frees.fetch_add(1, std::memory_order_relaxed);
+        liveBytes.fetch_sub(QEDIT_USABLE_SIZE(p), std::memory_order_relaxed);
+        std::free(p);
+    }
+
+    void* allocateOrThrow(const std::size_t size) {
+        void* p = allocate(size);
+        if (!p) throw std::bad_alloc();
+        return p;
+    }
+}
+
+namespace QEditor {
+    AllocationStats allocationStats() {
+        AllocationStats stats;
+        stats.allocations = allocations.load(std::memory_order_relaxed);
+        stats.frees = frees.load(std::memory_order_relaxed);
+        stats.liveBytes = liveBytes.load(std::memory_order_relaxed);
+        stats.peakBytes = peakBytes.load(std::memory_order_relaxed);
+        return stats;
+    }
+}
+
+void* operator new(const std::size_t size) { return allocateOrThrow(size); }
+void* operator new[](const std::size_t size) { return allocateOrThrow(size); }
+void* operator new(const std::size_t size, const std::nothrow_t&) noexcept { return allocate(size); }
+void* operator new[](const std::size_t size, const std::nothrow_t&) noexcept { return allocate(size); }
+
+void operator delete(void* p) noexcept { release(p); }
+void operator delete[](void* p) noexcept { release(p); }
+void operator delete(void* p, std::size_t) noexcept { release(p); }
+void operator delete[](void* p, std::size_t) noexcept { release(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { release(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { release(p); }
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+
+namespace QEditor {
+    struct AllocationStats {
+        uint64_t allocations = 0; // calls to operator new
+        uint64_t frees = 0;       // calls to operator delete
+        uint64_t liveBytes = 0;   // usable size of the blocks still allocated
+        uint64_t peakBytes = 0;
+    };
+
+    // Counters kept by the global operator new/delete replacements in
+    // AllocationCounter.cpp. Byte counts are only tracked where the C library
+    // can report a block's usable size (glibc, macOS).
+    [[nodiscard]] AllocationStats allocationStats();
+}
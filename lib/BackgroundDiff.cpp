@@ -0,0 +1,174 @@
+#include "BackgroundDiff.h"
+#include "EditorError.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <string_view>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+
+namespace QEditor {
+    BackgroundDiff::BackgroundDiff() {
+        int fds[2];
+        if (pipe(fds) == -1) {
+            throw EditorError(std::string("pipe: ") + std::strerror(errno));
+        }
+        wakeRead = fds[0];
+        wakeWrite = fds[1];
+        fcntl(wakeRead, F_SETFL, O_NONBLOCK);
+        fcntl(wakeRead, F_SETFD, FD_CLOEXEC);
+        fcntl(wakeWrite, F_SETFD, FD_CLOEXEC);
+
+        worker = std::thread([this] { work(); });
+    }
+
+    BackgroundDiff::~BackgroundDiff() {
+        {
+            std::lock_guard lock(mutex);
+            stopRequested = true;
+        }
+        wake.notify_all();
+        worker.join();
+        close(wakeRead);
+        close(wakeWrite);
+    }
+
+    void BackgroundDiff::request(LineSlice left, LineSlice right) {
+        {
+            std::lock_guard lock(mutex);
+            pending.emplace(std::move(left), std::move(right));
+        }
+        wake.notify_all();
+    }
+
+    std::optional<std::vector<DiffHunk>> BackgroundDiff::take() {
+        std::lock_guard lock(mutex);
+
+        char bytes[16];
+        while (read(wakeRead, bytes, sizeof(bytes)) > 0) {}
+
+        return std::exchange(result, std::nullopt);
+    }
+
+    void BackgroundDiff::wait() {
+        std::unique_lock lock(mutex);
+        idle.wait(lock, [this] { return !pending && !working; });
+    }
+
+    bool BackgroundDiff::isBusy() const {
+        std::lock_guard lock(mutex);
+        return pending || working;
+    }
+
+    void BackgroundDiff::work() {
+        while (true) {
+            std::pair<LineSlice, LineSlice> texts;
+            {
+                std::unique_lock lock(mutex);
+                wake.wait(lock, [this] { return stopRequested || pending; });
+                if (stopRequested) return;
+                texts = std::move(*pending);
+                pending.reset();
+                working = true;
+            }
+
+            const std::vector<uint64_t> left = hashLines(texts.first, leftCache);
+            const std::vector<uint64_t> right = hashLines(texts.second, rightCache);
+
+            // Dense ids for the diff, equal hashes meaning equal lines. An open
+            // addressing table, as std::unordered_map dominated the whole diff.
+            size_t capacity = 16;
+            while (capacity < 2 * (left.size() + right.size())) capacity *= 2;
+            std::vector<uint64_t> keys(capacity);
+            std::vector<uint32_t> slots(capacity, UINT32_MAX);
+            uint32_t nextId = 0;
+            auto intern = [&](const std::vector<uint64_t>& hashes) {
+                std::vector<uint32_t> out;
+                out.reserve(hashes.size());
+                for (const uint64_t hash : hashes) {
+                    size_t slot = hash & (capacity - 1);
+                    while (slots[slot] != UINT32_MAX && keys[slot] != hash) {
+                        slot = (slot + 1) & (capacity - 1);
+                    }
+                    if (slots[slot] == UINT32_MAX) {
+                        keys[slot] = hash;
+                        slots[slot] = nextId++;
+                    }
+                    out.push_back(slots[slot]);
+                }
+                return out;
+            };
+            const std::vector<uint32_t> a = intern(left);
+            const std::vector<uint32_t> b = intern(right);
+            std::vector<DiffHunk> hunks = diffSequences(a, b);
+
+            bool signal;
+            {
+                std::lock_guard lock(mutex);
+                signal = !result;
+                result = std::move(hunks);
+                working = false;
+            }
+            idle.notify_all();
+            if (signal) {
+                const char byte = 1;
+                [[maybe_unused]] const ssize_t n = write(wakeWrite, &byte, 1);
+            }
+        }
+    }
+
+    std::vector<uint64_t> BackgroundDiff::hashLines(const LineSlice& slice, std::vector<Piece>& cache) const {
+        // Shared blocks that were in the last snapshot keep their hashes
+        std::unordered_map<const void*, const Piece*> known;
+        for (const Piece& piece : cache) {
+            if (piece.key) known.emplace(piece.key.get(), &piece);
+        }
+
+        std::vector<Piece> next(slice.pieceCount());
+        std::vector<size_t> fresh;
+        for (size_t i = 0; i < slice.pieceCount(); ++i) {
+            next[i].key = slice.pieceKey(i);
+            const auto it = next[i].key ? known.find(next[i].key.get()) : known.end();
+            if (it != known.end()) {
+                next[i].hashes = it->second->hashes;
+            } else {
+                fresh.push_back(i);
+            }
+        }
+
+        // New blocks are decoded and hashed across the pool, straight out
+        // of the decoded text rather than a string per line
+        ThreadPool& pool = ThreadPool::shared();
+        const size_t parts = std::min(pool.size(), fresh.size());
+        pool.run(parts, [&](const size_t part) {
+            std::string text;
+            const std::hash<std::string_view> hash;
+            const size_t to = fresh.size() * (part + 1) / parts;
+            for (size_t f = fresh.size() * part / parts; f < to; ++f) {
+                Piece& piece = next[fresh[f]];
+                slice.pieceText(fresh[f], text);
+                piece.hashes.reserve(slice.pieceSize(fresh[f]));
+
+                const char* p = text.data();
+                const char* end = p + text.size();
+                while (p < end) {
+                    const auto* nl = static_cast<const char*>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+                    piece.hashes.push_back(hash(std::string_view(p, static_cast<size_t>(nl - p))));
+                    p = nl + 1;
+                }
+            }
+        });
+
+        std::vector<uint64_t> out;
+        out.reserve(slice.size());
+        for (const Piece& piece : next) {
+            out.insert(out.end(), piece.hashes.begin(), piece.hashes.end());
+        }
+
+        cache = std::move(next);
+        return out;
+    }
+}
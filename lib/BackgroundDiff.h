@@ -0,0 +1,64 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+#include "LineDiff.h"
+#include "LineStore.h"
+
+namespace QEditor {
+    // Diffs two texts on a worker thread. Lines are compared by 64-bit hash,
+    // and the hashes of each shared block are cached against the block, so
+    // after an edit only the blocks that changed are read and hashed again;
+    // the trimmed common prefix and suffix keep the diff itself local too.
+    class BackgroundDiff {
+    public:
+        BackgroundDiff();
+        ~BackgroundDiff();
+
+        BackgroundDiff(const BackgroundDiff&) = delete;
+        BackgroundDiff& operator=(const BackgroundDiff&) = delete;
+
+        // Readable once a result is waiting to be taken
+        [[nodiscard]] int getFd() const { return wakeRead; }
+
+        // Diff these snapshots, replacing any request not yet started
+        void request(LineSlice left, LineSlice right);
+
+        // The newest finished diff, if one arrived since the last take
+        std::optional<std::vector<DiffHunk>> take();
+
+        // Block until every request so far has been answered
+        void wait();
+
+        [[nodiscard]] bool isBusy() const;
+
+    private:
+        struct Piece {
+            std::shared_ptr<const void> key;
+            std::vector<uint64_t> hashes;
+        };
+
+        void work();
+        std::vector<uint64_t> hashLines(const LineSlice& slice, std::vector<Piece>& cache) const;
+
+        mutable std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable idle;
+        std::optional<std::pair<LineSlice, LineSlice>> pending;
+        std::optional<std::vector<DiffHunk>> result;
+        bool working = false;
+        bool stopRequested = false;
+
+        // Worker-only
+        std::vector<Piece> leftCache, rightCache;
+
+        int wakeRead = -1;
+        int wakeWrite = -1;
+        std::thread worker;
+    };
+}
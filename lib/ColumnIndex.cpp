@@ -0,0 +1,84 @@
+#include "ColumnIndex.h"
+#include "WrapCache.h"
+#include <algorithm>
+#include <iterator>
+
+namespace QEditor {
+    namespace {
+        bool continuation(const char c) {
+            return (static_cast<unsigned char>(c) & 0xc0) == 0x80;
+        }
+    }
+
+    const ColumnIndex::Entry& ColumnIndex::lookup(const size_t line, const std::string_view text) {
+        if (const auto it = entries.find(line); it != entries.end()) {
+            if (it->second.tabWidth == tabWidth && it->second.size == text.size()) {
+                return it->second;
+            }
+            entries.erase(it);
+        }
+
+        if (entries.size() >= MAX_LINES) {
+            entries.clear();
+        }
+
+        Entry& entry = entries[line];
+        entry.tabWidth = tabWidth;
+        entry.size = text.size();
+        entry.columns.reserve(text.size() / STEP + 1);
+
+        size_t column = 0;
+        for (size_t at = 0; at < text.size(); at += STEP) {
+            entry.columns.push_back(column);
+            column += WrapCache::cells(text, at, at + STEP, tabWidth);
+        }
+        return entry;
+    }
+
+    size_t ColumnIndex::column(const size_t line, const std::string_view text, size_t x) {
+        x = std::min(x, text.size());
+        if (text.size() < MIN_LENGTH) {
+            return WrapCache::cells(text, 0, x, tabWidth);
+        }
+
+        const Entry& entry = lookup(line, text);
+        const size_t checkpoint = std::min(x / STEP, entry.columns.size() - 1);
+        return entry.columns[checkpoint] + WrapCache::cells(text, checkpoint * STEP, x, tabWidth);
+    }
+
+    size_t ColumnIndex::byteAt(const size_t line, const std::string_view text, const size_t column) {
+        if (text.size() < MIN_LENGTH) {
+            return WrapCache::byteAt(text, 0, text.size(), column, tabWidth);
+        }
+
+        const Entry& entry = lookup(line, text);
+        const auto it = std::upper_bound(entry.columns.begin(), entry.columns.end(), column);
+        const auto checkpoint = static_cast<size_t>(std::distance(entry.columns.begin(), it)) - 1;
+        size_t x = WrapCache::byteAt(text, checkpoint * STEP, text.size(), column - entry.columns[checkpoint], tabWidth);
+
+        // A checkpoint can fall inside a character
+        while (x > 0 && x < text.size() && continuation(text[x])) --x;
+        return x;
+    }
+
+    void ColumnIndex::replace(const size_t at, const size_t count, const size_t newCount) {
+        entries.erase(entries.lower_bound(at), entries.lower_bound(at + count));
+        if (count == newCount) return;
+
+        std::map<size_t, Entry> moved;
+        for (auto it = entries.lower_bound(at + count); it != entries.end();) {
+            auto node = entries.extract(it++);
+            node.key() = node.key() - count + newCount;
+            moved.insert(std::move(node));
+        }
+        entries.merge(moved);
+    }
+
+    size_t ColumnIndex::memoryUsage() const {
+        size_t total = 0;
+        for (const auto& [line, entry] : entries) {
+            total += sizeof(entry) + 3 * sizeof(void*) + entry.columns.capacity() * sizeof(size_t);
+        }
+        return total;
+    }
+}
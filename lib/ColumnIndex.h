@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <string_view>
+#include <vector>
+
+namespace QEditor {
+    // Display columns of very long lines. The column is recorded every STEP
+    // bytes, so converting between a byte offset and a column costs a binary
+    // search and a walk of at most STEP bytes rather than a walk from the
+    // start of the line. Shorter lines are simply walked.
+    //
+    // Cells are counted as WrapCache counts them. Checkpoints are cached by
+    // line number and rebuilt when the tab width or line length changes.
+    class ColumnIndex {
+    public:
+        static constexpr size_t STEP = 1024;
+        static constexpr size_t MIN_LENGTH = 4 * STEP; // shorter lines aren't indexed
+        static constexpr size_t MAX_LINES = 256;
+
+        void setTabWidth(size_t tabWidth) { this->tabWidth = tabWidth; }
+
+        // Cells before byte x
+        [[nodiscard]] size_t column(size_t line, std::string_view text, size_t x);
+
+        // Start of the character covering the given column, or the end of
+        // the line when it is shorter than that
+        [[nodiscard]] size_t byteAt(size_t line, std::string_view text, size_t column);
+
+        // Lines [at, at + count) were replaced by newCount lines
+        void replace(size_t at, size_t count, size_t newCount);
+        void clear() { entries.clear(); }
+
+        [[nodiscard]] size_t cachedLines() const { return entries.size(); }
+        [[nodiscard]] size_t memoryUsage() const;
+
+    private:
+        struct Entry {
+            size_t tabWidth = 0;
+            size_t size = 0;
+            std::vector<size_t> columns; // columns[i] is the column of byte i * STEP
+        };
+
+        const Entry& lookup(size_t line, std::string_view text);
+
+        std::map<size_t, Entry> entries;
+        size_t tabWidth = 4;
+    };
+}
@@ -0,0 +1,376 @@
+#include "Compression.h"
+#include "EditorError.h"
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef QEDIT_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef QEDIT_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace QEditor {
+    namespace {
+        constexpr size_t INPUT_CHUNK = 256 * 1024;
+        constexpr size_t OUTPUT_CHUNK = 256 * 1024;
+
+        constexpr int GZIP_DEFAULT_LEVEL = 6;
+        constexpr int ZSTD_DEFAULT_LEVEL = 3;
+
+        bool endsWith(const std::string& s, const std::string& suffix) {
+            return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+        }
+
+        using Sink = void (*)(void* context, const char* data, size_t length);
+    }
+
+    class Decoder {
+    public:
+        virtual ~Decoder() = default;
+
+        // Decode from in[pos, in.size()) into out, advancing pos. Returns the
+        // number of bytes produced.
+        virtual size_t decode(const std::string& in, size_t& pos, char* out, size_t capacity) = 0;
+
+        // Start over on the next member/frame of a concatenated stream
+        virtual void reset() = 0;
+
+        bool ended = false;
+    };
+
+    class Encoder {
+    public:
+        virtual ~Encoder() = default;
+
+        // Compress in, passing output to sink. end finishes the stream.
+        virtual void encode(std::string_view in, bool end, Sink sink, void* context) = 0;
+    };
+
+    namespace {
+#ifdef QEDIT_HAVE_ZLIB
+        class GzipDecoder : public Decoder {
+        public:
+            explicit GzipDecoder(const std::string& path) : path(path) {
+                // 15 + 32: maximum window, auto-detect the gzip header
+                if (inflateInit2(&z, 15 + 32) != Z_OK) {
+                    throw FileOpenError(path);
+                }
+            }
+            ~GzipDecoder() override { inflateEnd(&z); }
+
+            size_t decode(const std::string& in, size_t& pos, char* out, const size_t capacity) override {
+                z.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data() + pos));
+                z.avail_in = static_cast<uInt>(in.size() - pos);
+                z.next_out = reinterpret_cast<Bytef*>(out);
+                z.avail_out = static_cast<uInt>(capacity);
+
+                const int ret = inflate(&z, Z_NO_FLUSH);
+                if (ret == Z_STREAM_END) {
+                    ended = true;
+                } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+                    throw FileError("Corrupt gzip data: " + path);
+                }
+
+                pos = in.size() - z.avail_in;
+                return capacity - z.avail_out;
+            }
+
+            void reset() override {
+                inflateReset(&z);
+                ended = false;
+            }
+
+        private:
+            std::string path;
+            z_stream z{};
+        };
+
+        class GzipEncoder : public Encoder {
+        public:
+            GzipEncoder(const std::string& path, const int level) {
+                // 15 + 16: maximum window, gzip wrapper
+                if (deflateInit2(&z, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+                    throw FileSaveError(path);
+                }
+            }
+            ~GzipEncoder() override { deflateEnd(&z); }
+
+            void encode(const std::string_view in, const bool end, const Sink sink, void* context) override {
+                z.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+                z.avail_in = static_cast<uInt>(in.size());
+
+                int ret;
+                do {
+                    z.next_out = reinterpret_cast<Bytef*>(buffer);
+                    z.avail_out = sizeof(buffer);
+                    ret = deflate(&z, end ? Z_FINISH : Z_NO_FLUSH);
+                    sink(context, buffer, sizeof(buffer) - z.avail_out);
+                } while (z.avail_out == 0 || (end && ret != Z_STREAM_END));
+            }
+
+        private:
+            z_stream z{};
+            char buffer[64 * 1024];
+        };
+#endif
+
+#ifdef QEDIT_HAVE_ZSTD
+        class ZstdDecoder : public Decoder {
+        public:
+            explicit ZstdDecoder(const std::string& path) : path(path), stream(ZSTD_createDStream()) {
+                if (!stream) {
+                    throw FileOpenError(path);
+                }
+                ZSTD_initDStream(stream);
+            }
+            ~ZstdDecoder() override { ZSTD_freeDStream(stream); }
+
+            size_t decode(const std::string& in, size_t& pos, char* out, const size_t capacity) override {
+                ZSTD_inBuffer input{in.data(), in.size(), pos};
+                ZSTD_outBuffer output{out, capacity, 0};
+
+                const size_t ret = ZSTD_decompressStream(stream, &output, &input);
+                if (ZSTD_isError(ret)) {
+                    throw FileError("Corrupt zstd data: " + path + " (" + ZSTD_getErrorName(ret) + ")");
+                }
+                if (ret == 0) {
+                    ended = true;
+                }
+
+                pos = input.pos;
+                return output.pos;
+            }
+
+            void reset() override {
+                // The stream continues with the next frame on its own
+                ended = false;
+            }
+
+        private:
+            std::string path;
+            ZSTD_DStream* stream;
+        };
+
+        class ZstdEncoder : public Encoder {
+        public:
+            ZstdEncoder(const std::string& path, const int level) : context(ZSTD_createCCtx()) {
+                if (!context) {
+                    throw FileSaveError(path);
+                }
+                ZSTD_CCtx_setParameter(context, ZSTD_c_compressionLevel, level);
+            }
+            ~ZstdEncoder() override { ZSTD_freeCCtx(context); }
+
+            void encode(const std::string_view in, const bool end, const Sink sink, void* sinkContext) override {
+                ZSTD_inBuffer input{in.data(), in.size(), 0};
+
+                size_t remaining;
+                do {
+                    ZSTD_outBuffer output{buffer, sizeof(buffer), 0};
+                    remaining = ZSTD_compressStream2(context, &output, &input, end ? ZSTD_e_end : ZSTD_e_continue);
+                    if (ZSTD_isError(remaining)) {
+                        throw FileError(std::string("zstd compression failed: ") + ZSTD_getErrorName(remaining));
+                    }
+                    sink(sinkContext, buffer, output.pos);
+                } while (end ? remaining != 0 : input.pos < input.size);
+            }
+
+        private:
+            ZSTD_CCtx* context;
+            char buffer[64 * 1024];
+        };
+#endif
+
+        void requireCodec(const Codec codec, const std::string& path) {
+            if (!codecAvailable(codec)) {
+                throw FileError(std::string(codecName(codec)) + " support is not compiled in: " + path);
+            }
+        }
+    }
+
+    Compression detectCompression(const std::string& path) {
+        const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) return {};
+
+        unsigned char magic[10] = {};
+        const ssize_t n = pread(fd, magic, sizeof(magic), 0);
+        close(fd);
+
+        if (n >= 10 && magic[0] == 0x1f && magic[1] == 0x8b) {
+            // XFL: 2 = maximum compression, 4 = fastest
+            int level = GZIP_DEFAULT_LEVEL;
+            if (magic[8] == 2) level = 9;
+            else if (magic[8] == 4) level = 1;
+            return {Codec::Gzip, level};
+        }
+        if (n >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd) {
+            return {Codec::Zstd, ZSTD_DEFAULT_LEVEL};
+        }
+        return {};
+    }
+
+    Compression compressionForName(const std::string& path) {
+        if (endsWith(path, ".gz")) return {Codec::Gzip, GZIP_DEFAULT_LEVEL};
+        if (endsWith(path, ".zst")) return {Codec::Zstd, ZSTD_DEFAULT_LEVEL};
+        return {};
+    }
+
+    const char* codecName(const Codec codec) {
+        switch (codec) {
+            case Codec::Gzip: return "gzip";
+            case Codec::Zstd: return "zstd";
+            default: return "none";
+        }
+    }
+
+    bool codecAvailable(const Codec codec) {
+        switch (codec) {
+            case Codec::None: return true;
+#ifdef QEDIT_HAVE_ZLIB
+            case Codec::Gzip: return true;
+#endif
+#ifdef QEDIT_HAVE_ZSTD
+            case Codec::Zstd: return true;
+#endif
+            default: return false;
+        }
+    }
+
+    Decompressor::Decompressor(const std::string& path, const Codec codec) : path(path), codec(codec) {
+        requireCodec(codec, path);
+
+        fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            throw FileOpenError(path);
+        }
+
+        struct stat st{};
+        if (fstat(fd, &st) == 0) {
+            size = static_cast<uint64_t>(st.st_size);
+        }
+
+        try {
+            switch (codec) {
+#ifdef QEDIT_HAVE_ZLIB
+                case Codec::Gzip: decoder = std::make_unique<GzipDecoder>(path); break;
+#endif
+#ifdef QEDIT_HAVE_ZSTD
+                case Codec::Zstd: decoder = std::make_unique<ZstdDecoder>(path); break;
+#endif
+                default: throw FileOpenError(path);
+            }
+        } catch (...) {
+            close(fd);
+            throw;
+        }
+    }
+
+    Decompressor::~Decompressor() {
+        if (fd != -1) {
+            close(fd);
+        }
+    }
+
+    bool Decompressor::fill() {
+        input.resize(INPUT_CHUNK);
+        const ssize_t n = ::read(fd, input.data(), input.size());
+        if (n < 0) {
+            throw FileOpenError(path);
+        }
+
+        input.resize(static_cast<size_t>(n));
+        inputPos = 0;
+        consumed += static_cast<uint64_t>(n);
+        return n > 0;
+    }
+
+    bool Decompressor::read(std::string& out) {
+        out.resize(OUTPUT_CHUNK);
+
+        size_t produced = 0;
+        while (produced == 0) {
+            if (inputPos == input.size() && !fill()) {
+                if (!decoder->ended) {
+                    throw FileError(std::string("Truncated ") + codecName(codec) + " data: " + path);
+                }
+                out.clear();
+                return false;
+            }
+
+            // More input after the end of a stream is another gzip member or zstd frame
+            if (decoder->ended) {
+                decoder->reset();
+            }
+
+            produced = decoder->decode(input, inputPos, out.data(), out.size());
+        }
+
+        out.resize(produced);
+        return true;
+    }
+
+    Compressor::Compressor(const std::string& path, const Compression compression)
+        : path(path), codec(compression.codec) {
+        requireCodec(codec, path);
+
+        switch (codec) {
+#ifdef QEDIT_HAVE_ZLIB
+            case Codec::Gzip: encoder = std::make_unique<GzipEncoder>(path, compression.level); break;
+#endif
+#ifdef QEDIT_HAVE_ZSTD
+            case Codec::Zstd: encoder = std::make_unique<ZstdEncoder>(path, compression.level); break;
+#endif
+            default: throw FileSaveError(path);
+        }
+
+        fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        if (fd == -1) {
+            throw FileSaveError(path);
+        }
+    }
+
+    Compressor::~Compressor() {
+        if (fd != -1) {
+            close(fd);
+        }
+    }
+
+    void Compressor::write(const std::string_view data) {
+        pending.append(data);
+        if (pending.size() >= INPUT_CHUNK) {
+            flush(false);
+        }
+    }
+
+    void Compressor::finish() {
+        flush(true);
+
+        const int result = close(fd);
+        fd = -1;
+        if (result != 0) {
+            throw FileSaveError(path + ": Write failed");
+        }
+    }
+
+    void Compressor::flush(const bool end) {
+        encoder->encode(pending, end, [](void* context, const char* data, const size_t length) {
+            static_cast<Compressor*>(context)->writeOut(data, length);
+        }, this);
+        pending.clear();
+    }
+
+    void Compressor::writeOut(const char* data, size_t length) {
+        while (length > 0) {
+            const ssize_t n = ::write(fd, data, length);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                throw FileSaveError(path + ": Write failed");
+            }
+            data += n;
+            length -= static_cast<size_t>(n);
+        }
+    }
+}
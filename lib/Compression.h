@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace QEditor {
+    enum class Codec { None, Gzip, Zstd };
+
+    struct Compression {
+        Codec codec = Codec::None;
+        int level = 0;
+    };
+
+    // Identify a compressed file from its magic bytes. For gzip the level is
+    // recovered from the header's XFL flag; zstd frames don't record it, so
+    // the codec's default level is assumed.
+    [[nodiscard]] Compression detectCompression(const std::string& path);
+
+    // Codec implied by a file name extension (.gz, .zst), for new files
+    [[nodiscard]] Compression compressionForName(const std::string& path);
+
+    [[nodiscard]] const char* codecName(Codec codec);
+
+    // Whether support for the codec was compiled in
+    [[nodiscard]] bool codecAvailable(Codec codec);
+
+    // Codec state, defined per codec in Compression.cpp
+    class Decoder;
+    class Encoder;
+
+    // Streaming decompression of a whole file, one chunk at a time
+    class Decompressor {
+    public:
+        Decompressor(const std::string& path, Codec codec);
+        ~Decompressor();
+
+        Decompressor(const Decompressor&) = delete;
+        Decompressor& operator=(const Decompressor&) = delete;
+
+        // Replace out with the next chunk of decompressed bytes. Returns
+        // false at the end of the stream.
+        bool read(std::string& out);
+
+        [[nodiscard]] uint64_t compressedOffset() const { return consumed; }
+        [[nodiscard]] uint64_t compressedSize() const { return size; }
+
+    private:
+        bool fill();
+
+        std::string path;
+        Codec codec;
+        int fd = -1;
+        uint64_t size = 0;
+        std::atomic<uint64_t> consumed{0}; // read from other threads for progress
+        std::string input;
+        size_t inputPos = 0;
+        std::unique_ptr<Decoder> decoder;
+    };
+
+    // Streaming compression into a file, replacing its contents
+    class Compressor {
+    public:
+        Compressor(const std::string& path, Compression compression);
+        ~Compressor();
+
+        Compressor(const Compressor&) = delete;
+        Compressor& operator=(const Compressor&) = delete;
+
+        void write(std::string_view data);
+
+        // Flush the end of the stream and close the file
+        void finish();
+
+    private:
+        void flush(bool end);
+        void writeOut(const char* data, size_t length);
+
+        std::string path;
+        Codec codec;
+        int fd = -1;
+        std::string pending;
+        std::unique_ptr<Encoder> encoder;
+    };
+}
@@ -127,6 +127,19 @@ namespace QEditor {
         return std::nullopt;
     }
     
+    size_t Config::memoryUsage() const {
+        // Hash buckets plus one node per entry, and any heap text behind the strings
+        size_t total = values.bucket_count() * sizeof(void*);
+        for (const auto& [key, value] : values) {
+            total += sizeof(void*) + sizeof(size_t) + sizeof(key) + sizeof(value);
+            if (key.capacity() > 15) total += key.capacity() + 1;
+            if (const auto* str = std::get_if<std::string>(&value); str && str->capacity() > 15) {
+                total += str->capacity() + 1;
+            }
+        }
+        return total;
+    }
+
     std::string Config::trim(const std::string& str) {
         const auto first = str.find_first_not_of(" \t");
         if (first == std::string::npos) {
@@ -33,6 +33,9 @@ namespace QEditor {
         
         // Get the path to the config file
         static std::string getConfigFilePath();
+
+        // Approximate bytes held by the parsed settings
+        [[nodiscard]] size_t memoryUsage() const;
         
     private:
         std::unordered_map<std::string, ConfigValue> values;
@@ -35,6 +35,12 @@ public:
         : FileError("Permission denied: " + filename) {}
 };
 
+class FileConflictError : public FileError {
+public:
+    explicit FileConflictError(const std::string& filename)
+        : FileError("File changed on disk since it was read: " + filename + " (:w! to overwrite, :e! to reload)") {}
+};
+
 // Configuration errors
 class ConfigError : public EditorError {
 public:
@@ -0,0 +1,31 @@
+#include "FileIdentity.h"
+#include <sys/stat.h>
+
+namespace QEditor {
+    FileIdentity FileIdentity::of(const std::string& path) {
+        FileIdentity id;
+
+        struct stat st{};
+        if (stat(path.c_str(), &st) == -1) {
+            return id;
+        }
+
+        id.exists = true;
+        id.device = st.st_dev;
+        id.inode = st.st_ino;
+        id.size = static_cast<uint64_t>(st.st_size);
+#ifdef __APPLE__
+        id.mtimeSec = st.st_mtimespec.tv_sec;
+        id.mtimeNsec = st.st_mtimespec.tv_nsec;
+#else
+        id.mtimeSec = st.st_mtim.tv_sec;
+        id.mtimeNsec = st.st_mtim.tv_nsec;
+#endif
+        return id;
+    }
+
+    bool FileIdentity::operator==(const FileIdentity& other) const {
+        return exists == other.exists && device == other.device && inode == other.inode &&
+               size == other.size && mtimeSec == other.mtimeSec && mtimeNsec == other.mtimeNsec;
+    }
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <sys/types.h>
+
+namespace QEditor {
+    // What we know about a file on disk when it was last read or written.
+    // A mismatch means another process changed it in the meantime.
+    struct FileIdentity {
+        bool exists = false;
+        dev_t device = 0;
+        ino_t inode = 0;
+        uint64_t size = 0;
+        int64_t mtimeSec = 0;
+        int64_t mtimeNsec = 0;
+
+        static FileIdentity of(const std::string& path);
+
+        bool operator==(const FileIdentity& other) const;
+        bool operator!=(const FileIdentity& other) const { return !(*this == other); }
+    };
+}
@@ -0,0 +1,88 @@
+#include "FileTail.h"
+#include "EditorError.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace QEditor {
+    namespace {
+        constexpr size_t READ_CHUNK = 256 * 1024;
+    }
+
+    FileTail::FileTail(const std::string& path, const uint64_t offset) : path(path), offset(offset) {
+        if (!reopen()) {
+            throw FileOpenError(path);
+        }
+    }
+
+    FileTail::~FileTail() {
+        if (fd != -1) {
+            close(fd);
+        }
+    }
+
+    bool FileTail::reopen() {
+        const int newFd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (newFd == -1) return false;
+
+        struct stat st{};
+        if (fstat(newFd, &st) == -1) {
+            close(newFd);
+            return false;
+        }
+
+        if (fd != -1) close(fd);
+        fd = newFd;
+        device = st.st_dev;
+        inode = st.st_ino;
+        return true;
+    }
+
+    void FileTail::readFrom(uint64_t from, const uint64_t to, std::string& out) {
+        while (from < to) {
+            const size_t want = static_cast<size_t>(std::min<uint64_t>(to - from, READ_CHUNK));
+            const size_t old = out.size();
+            out.resize(old + want);
+
+            const ssize_t n = pread(fd, out.data() + old, want, static_cast<off_t>(from));
+            if (n <= 0) {
+                out.resize(old);
+                break;
+            }
+
+            out.resize(old + static_cast<size_t>(n));
+            from += static_cast<uint64_t>(n);
+        }
+        offset = from;
+    }
+
+    FileTail::Change FileTail::poll(std::string& out) {
+        Change change = Change::None;
+
+        // A different inode at the path means the file was rotated. While the
+        // path is missing keep draining the old descriptor.
+        if (struct stat st{}; stat(path.c_str(), &st) == 0 && (st.st_ino != inode || st.st_dev != device)) {
+            if (reopen()) {
+                offset = 0;
+                change = Change::Replaced;
+            }
+        }
+
+        struct stat st{};
+        if (fstat(fd, &st) == -1) return change;
+        const auto size = static_cast<uint64_t>(st.st_size);
+
+        if (size < offset) {
+            offset = 0;
+            change = Change::Truncated;
+        }
+
+        if (size > offset) {
+            readFrom(offset, size, out);
+            if (change == Change::None) change = Change::Appended;
+        }
+
+        return change;
+    }
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <sys/types.h>
+
+namespace QEditor {
+    // Incremental reader for a growing file. Each poll reads only the bytes
+    // appended since the previous one, and reopens the path if the file was
+    // truncated or replaced (log rotation).
+    class FileTail {
+    public:
+        enum class Change { None, Appended, Truncated, Replaced };
+
+        // Start tailing path from the given byte offset
+        FileTail(const std::string& path, uint64_t offset);
+        ~FileTail();
+
+        FileTail(const FileTail&) = delete;
+        FileTail& operator=(const FileTail&) = delete;
+
+        // Append new bytes to out. On Truncated/Replaced, out holds the
+        // complete contents of the new file rather than a continuation.
+        Change poll(std::string& out);
+
+        [[nodiscard]] uint64_t getOffset() const { return offset; }
+
+    private:
+        bool reopen();
+        void readFrom(uint64_t from, uint64_t to, std::string& out);
+
+        std::string path;
+        int fd = -1;
+        uint64_t offset;
+        dev_t device = 0;
+        ino_t inode = 0;
+    };
+}
@@ -0,0 +1,101 @@
+#include "FileWatcher.h"
+#include <cstring>
+#include <filesystem>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+// Without inotify the watcher has no descriptor and callers fall back to
+// polling the file on a timer
+namespace QEditor {
+#ifdef __linux__
+    namespace {
+        constexpr uint32_t FILE_MASK = IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_MOVE_SELF | IN_DELETE_SELF;
+        constexpr uint32_t DIR_MASK = IN_CREATE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE;
+    }
+#endif
+
+    FileWatcher::FileWatcher() {
+#ifdef __linux__
+        fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+    }
+
+    FileWatcher::~FileWatcher() {
+        if (fd != -1) {
+            close(fd);
+        }
+    }
+
+    void FileWatcher::watch(const std::string& path) {
+        unwatch();
+        this->path = path;
+#ifdef __linux__
+        if (fd == -1) return;
+
+        const std::filesystem::path p(path);
+        name = p.filename().string();
+        const std::string dir = p.has_parent_path() ? p.parent_path().string() : ".";
+
+        dirWd = inotify_add_watch(fd, dir.c_str(), DIR_MASK);
+        addFileWatch();
+#endif
+    }
+
+    void FileWatcher::unwatch() {
+#ifdef __linux__
+        if (fd == -1) return;
+
+        if (fileWd != -1) inotify_rm_watch(fd, fileWd);
+        if (dirWd != -1) inotify_rm_watch(fd, dirWd);
+        fileWd = dirWd = -1;
+#endif
+    }
+
+    void FileWatcher::addFileWatch() {
+#ifdef __linux__
+        fileWd = inotify_add_watch(fd, path.c_str(), FILE_MASK);
+#endif
+    }
+
+    unsigned FileWatcher::readEvents() {
+#ifndef __linux__
+        return None;
+#else
+        if (fd == -1) return None;
+
+        unsigned result = None;
+        alignas(inotify_event) char buf[4096];
+
+        while (true) {
+            const ssize_t len = read(fd, buf, sizeof(buf));
+            if (len <= 0) break;
+
+            for (ssize_t i = 0; i < len;) {
+                const auto* ev = reinterpret_cast<const inotify_event*>(buf + i);
+                i += static_cast<ssize_t>(sizeof(inotify_event) + ev->len);
+
+                if (ev->wd == fileWd) {
+                    if (ev->mask & (IN_MOVE_SELF | IN_DELETE_SELF | IN_IGNORED)) {
+                        result |= Replaced;
+                    } else {
+                        result |= Modified;
+                    }
+                } else if (ev->wd == dirWd && ev->len > 0 && name == ev->name) {
+                    result |= Replaced;
+                }
+            }
+        }
+
+        // The old inode is gone, follow whatever now lives at the path
+        if (result & Replaced) {
+            if (fileWd != -1) inotify_rm_watch(fd, fileWd);
+            addFileWatch();
+        }
+
+        return result;
+#endif
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+
+namespace QEditor {
+    // inotify watch on a single file. The parent directory is watched as
+    // well so a file that is replaced by rename (log rotation, editors that
+    // save via a temporary file) keeps being tracked.
+    class FileWatcher {
+    public:
+        enum Event : unsigned {
+            None = 0,
+            Modified = 1 << 0, // contents written or truncated
+            Replaced = 1 << 1, // file at the path was moved, deleted or recreated
+        };
+
+        FileWatcher();
+        ~FileWatcher();
+
+        FileWatcher(const FileWatcher&) = delete;
+        FileWatcher& operator=(const FileWatcher&) = delete;
+
+        void watch(const std::string& path);
+        void unwatch();
+
+        // Descriptor to select() on, or -1 when inotify is unavailable
+        [[nodiscard]] int getFd() const { return fd; }
+        [[nodiscard]] const std::string& getPath() const { return path; }
+
+        // Drain pending notifications and return the union of Event bits
+        unsigned readEvents();
+
+    private:
+        void addFileWatch();
+
+        int fd = -1;
+        int fileWd = -1;
+        int dirWd = -1;
+        std::string path;
+        std::string name;
+    };
+}
@@ -0,0 +1,359 @@
+#include "FoldTree.h"
+#include "LineStore.h"
+#include <algorithm>
+
+namespace QEditor {
+    namespace {
+        bool blank(const std::string& line) {
+            return line.find_first_not_of(" \t") == std::string::npos;
+        }
+
+        // Order folds outer first, keep one per start line, trim brace folds
+        // that end on the line another starts ("} else {") and number depths
+        void finish(std::vector<Fold>& found) {
+            std::sort(found.begin(), found.end(), [](const Fold& a, const Fold& b) {
+                return a.start != b.start ? a.start < b.start : a.end > b.end;
+            });
+            found.erase(std::unique(found.begin(), found.end(), [](const Fold& a, const Fold& b) {
+                return a.start == b.start;
+            }), found.end());
+
+            std::vector<size_t> open; // indexes of the folds around the current one
+            for (size_t i = 0; i < found.size(); ++i) {
+                Fold& fold = found[i];
+                while (!open.empty() && found[open.back()].end < fold.start) open.pop_back();
+                if (!open.empty() && found[open.back()].end < fold.end) {
+                    found[open.back()].end = fold.start - 1;
+                    open.pop_back();
+                }
+                fold.depth = open.size();
+                open.push_back(i);
+            }
+            found.erase(std::remove_if(found.begin(), found.end(), [](const Fold& fold) {
+                return fold.end <= fold.start;
+            }), found.end());
+        }
+
+        bool startsBefore(const Fold& fold, const size_t line) {
+            return fold.start < line;
+        }
+    }
+
+    size_t FoldTree::indentOf(const std::string& line) const {
+        size_t indent = 0;
+        for (const char c : line) {
+            if (c == ' ') ++indent;
+            else if (c == '\t') indent += tabWidth;
+            else break;
+        }
+        return indent;
+    }
+
+    size_t FoldTree::scan(const LineStore& lines, const size_t from, const size_t until, const size_t oldUntil,
+                          const std::vector<Fold>& old, std::vector<Fold>& found) const {
+        // Whether an old line sits inside a fold that started before it
+        auto next = std::lower_bound(old.begin(), old.end(), from, startsBefore);
+        size_t reach = 0;
+        bool reached = false;
+        auto insideOld = [&](const size_t oldLine) {
+            for (; next != old.end() && next->start < oldLine; ++next) {
+                reach = reached ? std::max(reach, next->end) : next->end;
+                reached = true;
+            }
+            return reached && reach >= oldLine;
+        };
+        auto settled = [&](const size_t line) {
+            return line >= until && !insideOld(line - until + oldUntil);
+        };
+
+        size_t line = from;
+        if (method == Method::Indent) {
+            struct Open {
+                size_t line, indent;
+            };
+            std::vector<Open> stack;
+            size_t prev = std::string::npos, prevIndent = 0;
+            for (; line < lines.size(); ++line) {
+                const std::string& text = lines[line];
+                if (blank(text)) continue;
+
+                // A fold runs until a line indented no deeper than its start
+                const size_t indent = indentOf(text);
+                while (!stack.empty() && stack.back().indent >= indent) {
+                    found.push_back({stack.back().line, prev});
+                    stack.pop_back();
+                }
+                if (prev != std::string::npos && indent > prevIndent) {
+                    stack.push_back({prev, prevIndent});
+                }
+                if (stack.empty() && settled(line)) break;
+
+                prev = line;
+                prevIndent = indent;
+            }
+            if (line == lines.size()) {
+                for (; !stack.empty(); stack.pop_back()) {
+                    found.push_back({stack.back().line, prev});
+                }
+            }
+        } else {
+            // Braces in strings and comments don't count; a block comment is
+            // only skipped on the line it starts so every line scans alike
+            std::vector<size_t> stack;
+            for (; line < lines.size(); ++line) {
+                if (stack.empty() && settled(line)) break;
+
+                const std::string& text = lines[line];
+                char quote = 0;
+                for (size_t i = 0; i < text.size(); ++i) {
+                    const char c = text[i];
+                    if (quote) {
+                        if (c == '\\') ++i;
+                        else if (c == quote) quote = 0;
+                    } else if (c == '"' || c == '\'') {
+                        quote = c;
+                    } else if (c == '/' && i + 1 < text.size() && text[i + 1] == '/') {
+                        break;
+                    } else if (c == '/' && i + 1 < text.size() && text[i + 1] == '*') {
+                        const size_t close = text.find("*/", i + 2);
+                        if (close == std::string::npos) break;
+                        i = close + 1;
+                    } else if (c == '{') {
+                        stack.push_back(line);
+                    } else if (c == '}' && !stack.empty()) {
+                        found.push_back({stack.back(), line});
+                        stack.pop_back();
+                    }
+                }
+            }
+            // Unclosed braces fold to the end so a half-typed block still nests
+            if (line == lines.size()) {
+                for (const size_t start : stack) {
+                    found.push_back({start, lines.size() - 1});
+                }
+            }
+        }
+
+        finish(found);
+        return line;
+    }
+
+    void FoldTree::build(const LineStore& lines, const Method method, const size_t tabWidth) {
+        this->method = method;
+        this->tabWidth = tabWidth;
+
+        std::vector<size_t> closed;
+        for (const Fold& fold : folds) {
+            if (fold.closed) closed.push_back(fold.start);
+        }
+        folds.clear();
+        scan(lines, 0, lines.size(), lines.size(), {}, folds);
+        for (Fold& fold : folds) {
+            fold.closed = std::binary_search(closed.begin(), closed.end(), fold.start);
+        }
+        rebuildHidden();
+    }
+
+    void FoldTree::update(const LineStore& lines, const size_t at, const size_t count, const size_t newCount) {
+        // Rescan from the outermost fold around the last line before the change
+        size_t from = 0;
+        size_t before = at;
+        while (before > 0 && blank(lines[before - 1])) --before;
+        if (before > 0) {
+            from = before - 1;
+            for (auto it = std::upper_bound(folds.begin(), folds.end(), from, [](const size_t line, const Fold& fold) {
+                     return line < fold.start;
+                 });
+                 it != folds.begin();) {
+                --it;
+                if (it->depth == 0) {
+                    if (it->end >= from) from = it->start;
+                    break;
+                }
+            }
+        }
+
+        const size_t until = at + newCount, oldUntil = at + count;
+        std::vector<Fold> found;
+        const size_t stop = scan(lines, from, until, oldUntil, folds, found);
+        const size_t oldStop = stop - until + oldUntil;
+
+        const auto first = std::lower_bound(folds.begin(), folds.end(), from, startsBefore);
+        const auto last = std::lower_bound(first, folds.end(), oldStop, startsBefore);
+
+        // Folds still starting on a surviving line stay closed
+        std::vector<size_t> closed;
+        for (auto it = first; it != last; ++it) {
+            if (!it->closed) continue;
+            if (it->start < at) closed.push_back(it->start);
+            else if (it->start >= oldUntil) closed.push_back(it->start - count + newCount);
+        }
+        for (Fold& fold : found) {
+            fold.closed = std::binary_search(closed.begin(), closed.end(), fold.start);
+        }
+
+        // Renumber the folds past the change in place, then swap in the new ones
+        const auto shift = [&](size_t& line) { line = line - count + newCount; };
+        if (count != newCount) {
+            for (auto it = last; it != folds.end(); ++it) {
+                shift(it->start);
+                shift(it->end);
+            }
+        }
+        const size_t firstIndex = static_cast<size_t>(first - folds.begin());
+        const size_t replaced = static_cast<size_t>(last - first);
+        std::copy_n(found.begin(), std::min(replaced, found.size()), first);
+        if (found.size() < replaced) {
+            folds.erase(folds.begin() + static_cast<ptrdiff_t>(firstIndex + found.size()), last);
+        } else {
+            folds.insert(last, found.begin() + static_cast<ptrdiff_t>(replaced), found.end());
+        }
+
+        // Only the hidden ranges shown within the rescan change; those after
+        // move with the folds and their counts by what the rescan changed
+        const auto shownFrom = [](const size_t line) {
+            return [line](const Hidden& range) { return range.first - 1 < line; };
+        };
+        const auto lo = std::partition_point(hidden.begin(), hidden.end(), shownFrom(from));
+        const auto hi = std::partition_point(lo, hidden.end(), shownFrom(oldStop));
+        const auto hiddenThrough = [](const Hidden& range) { return range.before + range.last - range.first + 1; };
+        const size_t base = lo == hidden.begin() ? 0 : hiddenThrough(*std::prev(lo));
+
+        std::vector<Hidden> ranges;
+        size_t total = base;
+        for (const Fold& fold : found) {
+            if (!fold.closed || (!ranges.empty() && fold.start <= ranges.back().last)) continue;
+            ranges.push_back({fold.start + 1, fold.end, total});
+            total += fold.end - fold.start;
+        }
+
+        const size_t oldRegion = hi == lo ? 0 : hiddenThrough(*std::prev(hi)) - base;
+        if (count != newCount || total - base != oldRegion) {
+            for (auto it = hi; it != hidden.end(); ++it) {
+                shift(it->first);
+                shift(it->last);
+                it->before = it->before - oldRegion + (total - base);
+            }
+        }
+
+        const size_t loIndex = static_cast<size_t>(lo - hidden.begin());
+        const size_t old = static_cast<size_t>(hi - lo);
+        std::copy_n(ranges.begin(), std::min(old, ranges.size()), lo);
+        if (ranges.size() < old) {
+            hidden.erase(hidden.begin() + static_cast<ptrdiff_t>(loIndex + ranges.size()), hi);
+        } else {
+            hidden.insert(hi, ranges.begin() + static_cast<ptrdiff_t>(old), ranges.end());
+        }
+    }
+
+    void FoldTree::clear() {
+        folds.clear();
+        hidden.clear();
+    }
+
+    bool FoldTree::close(const size_t line) {
+        // Walk back through the folds starting at or before line; the first
+        // top-level one ends the search since earlier ones end before it
+        auto it = std::upper_bound(folds.begin(), folds.end(), line, [](const size_t at, const Fold& fold) {
+            return at < fold.start;
+        });
+        while (it != folds.begin()) {
+            --it;
+            if (it->end >= line && !it->closed) {
+                it->closed = true;
+                rebuildHidden();
+                return true;
+            }
+            if (it->depth == 0) break;
+        }
+        return false;
+    }
+
+    bool FoldTree::open(const size_t line) {
+        const size_t shown = visibleLine(line);
+        const auto it = std::lower_bound(folds.begin(), folds.end(), shown, startsBefore);
+        for (auto fold = it; fold != folds.end() && fold->start == shown; ++fold) {
+            if (!fold->closed) continue;
+            fold->closed = false;
+            rebuildHidden();
+            return true;
+        }
+        return false;
+    }
+
+    void FoldTree::closeAll() {
+        for (Fold& fold : folds) fold.closed = true;
+        rebuildHidden();
+    }
+
+    void FoldTree::openAll() {
+        for (Fold& fold : folds) fold.closed = false;
+        rebuildHidden();
+    }
+
+    void FoldTree::rebuildHidden() {
+        hidden.clear();
+        size_t total = 0;
+        for (const Fold& fold : folds) {
+            if (!fold.closed || (!hidden.empty() && fold.start <= hidden.back().last)) continue;
+            hidden.push_back({fold.start + 1, fold.end, total});
+            total += fold.end - fold.start;
+        }
+    }
+
+    size_t FoldTree::hiddenAt(const size_t line) const {
+        const auto it = std::upper_bound(hidden.begin(), hidden.end(), line, [](const size_t at, const Hidden& range) {
+            return at < range.first;
+        });
+        if (it == hidden.begin() || std::prev(it)->last < line) return hidden.size();
+        return static_cast<size_t>(std::distance(hidden.begin(), it)) - 1;
+    }
+
+    bool FoldTree::isHidden(const size_t line) const {
+        return hiddenAt(line) != hidden.size();
+    }
+
+    size_t FoldTree::visibleLine(const size_t line) const {
+        const size_t range = hiddenAt(line);
+        return range == hidden.size() ? line : hidden[range].first - 1;
+    }
+
+    size_t FoldTree::closedEnd(const size_t line) const {
+        const size_t range = hiddenAt(line + 1);
+        if (range == hidden.size() || hidden[range].first != line + 1) return line;
+        return hidden[range].last;
+    }
+
+    size_t FoldTree::nextVisible(const size_t line) const {
+        return closedEnd(visibleLine(line)) + 1;
+    }
+
+    size_t FoldTree::prevVisible(const size_t line) const {
+        const size_t shown = visibleLine(line);
+        return shown == 0 ? 0 : visibleLine(shown - 1);
+    }
+
+    size_t FoldTree::visibleIndex(const size_t line) const {
+        const size_t shown = visibleLine(line);
+        const auto it = std::upper_bound(hidden.begin(), hidden.end(), shown, [](const size_t at, const Hidden& range) {
+            return at < range.first;
+        });
+        if (it == hidden.begin()) return shown;
+        const Hidden& range = *std::prev(it);
+        return shown - range.before - (range.last - range.first + 1);
+    }
+
+    size_t FoldTree::lineAtVisibleIndex(const size_t index) const {
+        // Lines after range r start at visible index r.first - r.before
+        const auto it = std::upper_bound(hidden.begin(), hidden.end(), index, [](const size_t at, const Hidden& range) {
+            return at < range.first - range.before;
+        });
+        if (it == hidden.begin()) return index;
+        const Hidden& range = *std::prev(it);
+        return index + range.before + (range.last - range.first + 1);
+    }
+
+    size_t FoldTree::memoryUsage() const {
+        return folds.capacity() * sizeof(Fold) + hidden.capacity() * sizeof(Hidden);
+    }
+}
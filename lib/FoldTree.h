@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace QEditor {
+    class LineStore;
+
+    struct Fold {
+        size_t start = 0; // the line left showing when the fold is closed
+        size_t end = 0;   // last line inside it
+        size_t depth = 0; // folds around it
+        bool closed = false;
+    };
+
+    // Foldable regions of a buffer and which of them are closed. Folds come
+    // from indentation (a line followed by more deeply indented ones) or
+    // from brace pairs spanning lines.
+    //
+    // An edit only rescans from the fold around it to the first line past
+    // the edit that is outside every fold both before and after it; folds
+    // beyond are renumbered. The lines hidden by closed folds are kept as
+    // sorted ranges with prefix counts, so stepping over them and mapping
+    // between lines and screen rows are binary searches.
+    class FoldTree {
+    public:
+        enum class Method { Indent, Braces };
+
+        // Rescan every line; folds starting where a closed one did stay closed
+        void build(const LineStore& lines, Method method, size_t tabWidth);
+        // Lines [at, at + count) were replaced by newCount lines
+        void update(const LineStore& lines, size_t at, size_t count, size_t newCount);
+        void clear();
+
+        [[nodiscard]] Method getMethod() const { return method; }
+        // Folds by start line, outer before inner
+        [[nodiscard]] const std::vector<Fold>& getFolds() const { return folds; }
+
+        // Close the innermost open fold around line
+        bool close(size_t line);
+        // Open the closed fold showing at line
+        bool open(size_t line);
+        void closeAll();
+        void openAll();
+
+        [[nodiscard]] bool isHidden(size_t line) const;
+        // The line shown in place of line: the start of the closed fold hiding it, or line itself
+        [[nodiscard]] size_t visibleLine(size_t line) const;
+        // Last line of the closed fold starting at line, or line when none is closed there
+        [[nodiscard]] size_t closedEnd(size_t line) const;
+        // Next and previous shown lines; next may be past the end of the buffer
+        [[nodiscard]] size_t nextVisible(size_t line) const;
+        [[nodiscard]] size_t prevVisible(size_t line) const;
+        // Shown lines before line, and the shown line with that many before it
+        [[nodiscard]] size_t visibleIndex(size_t line) const;
+        [[nodiscard]] size_t lineAtVisibleIndex(size_t index) const;
+
+        [[nodiscard]] size_t memoryUsage() const;
+
+    private:
+        struct Hidden {
+            size_t first = 0, last = 0; // lines hidden by one outermost closed fold
+            size_t before = 0;          // hidden by the ranges before this one
+        };
+
+        // Folds found scanning from line `from`, which is outside every fold,
+        // until a line at or past `until` that is outside every fold both
+        // now and in `old`, where it was line - until + oldUntil. Returns the
+        // line the scan stopped at.
+        size_t scan(const LineStore& lines, size_t from, size_t until, size_t oldUntil, const std::vector<Fold>& old,
+                    std::vector<Fold>& found) const;
+        [[nodiscard]] size_t indentOf(const std::string& line) const;
+        void rebuildHidden();
+        // Index of the range hiding line, or hidden.size()
+        [[nodiscard]] size_t hiddenAt(size_t line) const;
+
+        std::vector<Fold> folds;
+        std::vector<Hidden> hidden;
+        Method method = Method::Indent;
+        size_t tabWidth = 4;
+    };
+}
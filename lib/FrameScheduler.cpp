@@ -0,0 +1,27 @@
+#include "FrameScheduler.h"
+#include <algorithm>
+
+namespace QEditor {
+    FrameScheduler::FrameScheduler(const int framesPerSecond) {
+        setFrameRate(framesPerSecond);
+    }
+
+    void FrameScheduler::setFrameRate(const int framesPerSecond) {
+        interval = std::chrono::duration_cast<Clock::duration>(std::chrono::seconds(1)) / std::max(framesPerSecond, 1);
+    }
+
+    bool FrameScheduler::shouldRender(const bool inputPending, const Clock::time_point now) const {
+        if (!dirty) return false;
+        return !inputPending || now - lastFrame >= interval;
+    }
+
+    void FrameScheduler::rendered(const Clock::time_point now) {
+        lastFrame = now;
+        dirty = false;
+    }
+
+    FrameScheduler::Clock::duration FrameScheduler::timeUntilDue(const Clock::time_point now) const {
+        const Clock::duration elapsed = now - lastFrame;
+        return elapsed >= interval ? Clock::duration::zero() : interval - elapsed;
+    }
+}
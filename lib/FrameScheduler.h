@@ -0,0 +1,33 @@
+#pragma once
+
+#include <chrono>
+
+namespace QEditor {
+    // Decides when a dirty screen gets painted. While input keeps arriving,
+    // frames are limited to one per interval; as soon as input goes idle the
+    // latest state is painted without waiting.
+    class FrameScheduler {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        explicit FrameScheduler(int framesPerSecond = 60);
+
+        void setFrameRate(int framesPerSecond);
+
+        void markDirty() { dirty = true; }
+        [[nodiscard]] bool isDirty() const { return dirty; }
+
+        // Whether to paint now, given whether more input is already waiting
+        [[nodiscard]] bool shouldRender(bool inputPending, Clock::time_point now) const;
+
+        void rendered(Clock::time_point now);
+
+        // How long the run loop may sleep before a deferred frame is due
+        [[nodiscard]] Clock::duration timeUntilDue(Clock::time_point now) const;
+
+    private:
+        Clock::duration interval;
+        Clock::time_point lastFrame{};
+        bool dirty = false;
+    };
+}
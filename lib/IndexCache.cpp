@@ -0,0 +1,304 @@
+#include "IndexCache.h"
+#include "FileIdentity.h"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+namespace fs = std::filesystem;
+
+namespace QEditor {
+    namespace {
+        constexpr char MAGIC[8] = {'Q', 'E', 'D', 'I', 'D', 'X', '\0', '\0'};
+        constexpr uint32_t VERSION = 1;
+        constexpr size_t SAMPLE_BYTES = 4096;
+        constexpr const char* SUFFIX = ".idx";
+        // Everything evict() counts: line indexes and SymbolIndex tables
+        constexpr const char* ENTRY_SUFFIXES[] = {SUFFIX, ".tags"};
+
+        // A file being written as name.tmp<pid> by a process that has since exited
+        bool staleTemporary(const fs::path& path) {
+            const std::string extension = path.extension().string();
+            if (extension.rfind(".tmp", 0) != 0 || extension.size() == 4) return false;
+
+            char* end = nullptr;
+            const long pid = std::strtol(extension.c_str() + 4, &end, 10);
+            if (*end != '\0' || pid <= 0) return false;
+            return kill(static_cast<pid_t>(pid), 0) == -1 && errno == ESRCH;
+        }
+
+        struct Header {
+            char magic[8];
+            uint32_t version;
+            uint32_t endsWithNewline;
+            uint64_t device;
+            uint64_t inode;
+            uint64_t size;
+            int64_t mtimeSec;
+            int64_t mtimeNsec;
+            uint64_t sample;
+            uint64_t lines;
+            uint64_t count;
+            uint64_t pathLength; // the indexed path follows, padded to 8 bytes
+        };
+
+        uint64_t fnv1a(const char* data, const size_t size, uint64_t hash = 14695981039346656037ull) {
+            for (size_t i = 0; i < size; ++i) {
+                hash = (hash ^ static_cast<unsigned char>(data[i])) * 1099511628211ull;
+            }
+            return hash;
+        }
+
+        // Hash of the first and last few KB, catching a rewrite that kept
+        // the size and restored the mtime
+        std::optional<uint64_t> sampleHash(const std::string& path, const uint64_t size) {
+            const int fd = open(path.c_str(), O_RDONLY);
+            if (fd == -1) return std::nullopt;
+
+            char buf[SAMPLE_BYTES];
+            uint64_t hash = fnv1a(nullptr, 0);
+            bool ok = true;
+            for (const uint64_t at : {uint64_t{0}, size > SAMPLE_BYTES ? size - SAMPLE_BYTES : 0}) {
+                const size_t want = static_cast<size_t>(std::min<uint64_t>(size, SAMPLE_BYTES));
+                if (pread(fd, buf, want, static_cast<off_t>(at)) != static_cast<ssize_t>(want)) {
+                    ok = false;
+                    break;
+                }
+                hash = fnv1a(buf, want, hash);
+            }
+            close(fd);
+
+            if (!ok) return std::nullopt;
+            return hash;
+        }
+
+        std::string absolute(const std::string& path) {
+            char* resolved = realpath(path.c_str(), nullptr);
+            if (!resolved) return path;
+
+            std::string result(resolved);
+            std::free(resolved);
+            return result;
+        }
+
+        size_t padded(const size_t bytes) {
+            return (bytes + 7) & ~size_t{7};
+        }
+
+        bool writeAll(const int fd, const void* data, size_t size) {
+            const auto* p = static_cast<const char*>(data);
+            while (size > 0) {
+                const ssize_t n = write(fd, p, size);
+                if (n < 0) {
+                    if (errno == EINTR) continue;
+                    return false;
+                }
+                p += n;
+                size -= static_cast<size_t>(n);
+            }
+            return true;
+        }
+    }
+
+    MappedIndex::~MappedIndex() {
+        if (mapping) {
+            munmap(mapping, mappingSize);
+        }
+    }
+
+    MappedIndex::MappedIndex(MappedIndex&& other) noexcept
+        : mapping(std::exchange(other.mapping, nullptr)), mappingSize(other.mappingSize),
+          table(other.table), count(other.count), lineCount(other.lineCount),
+          newlineAtEnd(other.newlineAtEnd), bytes(other.bytes) {}
+
+    MappedIndex& MappedIndex::operator=(MappedIndex&& other) noexcept {
+        if (this != &other) {
+            if (mapping) {
+                munmap(mapping, mappingSize);
+            }
+            mapping = std::exchange(other.mapping, nullptr);
+            mappingSize = other.mappingSize;
+            table = other.table;
+            count = other.count;
+            lineCount = other.lineCount;
+            newlineAtEnd = other.newlineAtEnd;
+            bytes = other.bytes;
+        }
+        return *this;
+    }
+
+    IndexCache::IndexCache(std::string directory, const uint64_t maxBytes, const uint64_t minFileSize)
+        : directory(std::move(directory)), maxBytes(maxBytes), minFileSize(minFileSize) {}
+
+    std::string IndexCache::defaultDirectory() {
+        if (const char* xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg) {
+            return std::string(xdg) + "/qedit";
+        }
+        if (const char* home = std::getenv("HOME"); home && *home) {
+            return std::string(home) + "/.cache/qedit";
+        }
+        return {};
+    }
+
+    std::string IndexCache::entryFor(const std::string& path) const {
+        const std::string key = absolute(path);
+        const uint64_t hash = fnv1a(key.data(), key.size());
+
+        char name[17];
+        std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hash));
+        return directory + "/" + name + SUFFIX;
+    }
+
+    std::optional<MappedIndex> IndexCache::load(const std::string& path) const {
+        if (directory.empty()) return std::nullopt;
+
+        const FileIdentity id = FileIdentity::of(path);
+        if (!id.exists || id.size < minFileSize) return std::nullopt;
+
+        const std::string entry = entryFor(path);
+        const int fd = open(entry.c_str(), O_RDONLY);
+        if (fd == -1) return std::nullopt;
+
+        struct stat st{};
+        if (fstat(fd, &st) == -1 || static_cast<size_t>(st.st_size) < sizeof(Header)) {
+            close(fd);
+            return std::nullopt;
+        }
+
+        MappedIndex index;
+        index.mappingSize = static_cast<size_t>(st.st_size);
+        void* mapping = mmap(nullptr, index.mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) return std::nullopt;
+        index.mapping = mapping;
+
+        Header header{};
+        std::memcpy(&header, mapping, sizeof(header));
+
+        const std::string key = absolute(path);
+        const size_t tableStart = sizeof(Header) + padded(header.pathLength);
+        if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION ||
+            header.device != static_cast<uint64_t>(id.device) ||
+            header.inode != static_cast<uint64_t>(id.inode) || header.size != id.size ||
+            header.mtimeSec != id.mtimeSec || header.mtimeNsec != id.mtimeNsec ||
+            header.pathLength != key.size() || header.count == 0 ||
+            tableStart + header.count * sizeof(uint64_t) != index.mappingSize ||
+            std::memcmp(static_cast<const char*>(mapping) + sizeof(Header), key.data(), key.size()) != 0) {
+            return std::nullopt;
+        }
+
+        if (sampleHash(path, id.size) != header.sample) return std::nullopt;
+
+        index.table = reinterpret_cast<const uint64_t*>(static_cast<const char*>(mapping) + tableStart);
+        index.count = static_cast<size_t>(header.count);
+        index.lineCount = header.lines;
+        index.newlineAtEnd = header.endsWithNewline != 0;
+        index.bytes = header.size;
+
+        // The entry's mtime records when it was last used, for eviction
+        utimensat(AT_FDCWD, entry.c_str(), nullptr, 0);
+        return index;
+    }
+
+    void IndexCache::save(const std::string& path, const FileIdentity& scanned, const std::vector<uint64_t>& offsets,
+                          const uint64_t lines, const bool endsWithNewline) const {
+        if (directory.empty() || scanned.size < minFileSize) return;
+
+        // The index only describes the file as it was while being scanned
+        if (FileIdentity::of(path) != scanned) return;
+
+        const auto sample = sampleHash(path, scanned.size);
+        if (!sample) return;
+
+        std::error_code ec;
+        fs::create_directories(directory, ec);
+        if (ec) return;
+
+        const std::string key = absolute(path);
+        Header header{};
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.device = static_cast<uint64_t>(scanned.device);
+        header.inode = static_cast<uint64_t>(scanned.inode);
+        header.size = scanned.size;
+        header.mtimeSec = scanned.mtimeSec;
+        header.mtimeNsec = scanned.mtimeNsec;
+        header.sample = *sample;
+        header.lines = lines;
+        header.endsWithNewline = endsWithNewline;
+        header.count = offsets.size();
+        header.pathLength = key.size();
+
+        std::string pathBlock = key;
+        pathBlock.resize(padded(key.size()), '\0');
+
+        // Written aside and renamed over, so a reader never maps half an entry
+        const std::string entry = entryFor(path);
+        const std::string temp = entry + ".tmp" + std::to_string(getpid());
+        const int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        if (fd == -1) return;
+
+        const bool written = writeAll(fd, &header, sizeof(header)) &&
+                             writeAll(fd, pathBlock.data(), pathBlock.size()) &&
+                             writeAll(fd, offsets.data(), offsets.size() * sizeof(uint64_t));
+        close(fd);
+
+        if (!written || rename(temp.c_str(), entry.c_str()) == -1) {
+            unlink(temp.c_str());
+            return;
+        }
+
+        evict();
+    }
+
+    void IndexCache::evict() const {
+        struct Entry {
+            fs::path path;
+            uint64_t size;
+            fs::file_time_type used;
+        };
+
+        std::vector<Entry> entries;
+        uint64_t total = 0;
+        std::error_code ec;
+        for (fs::directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec)) {
+            if (staleTemporary(it->path())) {
+                std::error_code removeError;
+                fs::remove(it->path(), removeError);
+                continue;
+            }
+            const fs::path extension = it->path().extension();
+            if (std::none_of(std::begin(ENTRY_SUFFIXES), std::end(ENTRY_SUFFIXES),
+                             [&extension](const char* suffix) { return extension == suffix; })) {
+                continue;
+            }
+
+            std::error_code statError;
+            const uint64_t size = it->file_size(statError);
+            const auto used = it->last_write_time(statError);
+            if (statError) continue;
+
+            entries.push_back({it->path(), size, used});
+            total += size;
+        }
+        if (total <= maxBytes) return;
+
+        std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+            return a.used < b.used;
+        });
+        for (const Entry& entry : entries) {
+            if (total <= maxBytes) break;
+            if (fs::remove(entry.path, ec)) {
+                total -= entry.size;
+            }
+        }
+    }
+}
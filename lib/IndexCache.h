@@ -0,0 +1,80 @@
+#pragma once
+
+#include "FileIdentity.h"
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace QEditor {
+    // A line index loaded from the cache, mapped straight from disk
+    class MappedIndex {
+    public:
+        MappedIndex() = default;
+        ~MappedIndex();
+
+        MappedIndex(MappedIndex&& other) noexcept;
+        MappedIndex& operator=(MappedIndex&& other) noexcept;
+        MappedIndex(const MappedIndex&) = delete;
+        MappedIndex& operator=(const MappedIndex&) = delete;
+
+        [[nodiscard]] const uint64_t* offsets() const { return table; }
+        [[nodiscard]] size_t size() const { return count; }
+        [[nodiscard]] uint64_t lines() const { return lineCount; }
+        [[nodiscard]] bool endsWithNewline() const { return newlineAtEnd; }
+        [[nodiscard]] uint64_t fileSize() const { return bytes; }
+
+    private:
+        friend class IndexCache;
+
+        void* mapping = nullptr;
+        size_t mappingSize = 0;
+        const uint64_t* table = nullptr;
+        size_t count = 0;
+        uint64_t lineCount = 0;
+        bool newlineAtEnd = true;
+        uint64_t bytes = 0;
+    };
+
+    // Sidecar files holding the sparse line index of large files, so
+    // reopening one costs a stat and a mapping rather than a full scan.
+    // An entry is only used while the file's device, inode, size and mtime
+    // match and its first and last few KB hash the same. Entries, symbol
+    // indexes included, are evicted least recently used first once the
+    // directory outgrows maxBytes. Failures are never reported; the file
+    // is just scanned.
+    class IndexCache {
+    public:
+        static constexpr uint64_t DEFAULT_MAX_BYTES = 64 * 1024 * 1024;
+        static constexpr uint64_t DEFAULT_MIN_FILE_SIZE = 16 * 1024 * 1024;
+
+        explicit IndexCache(std::string directory, uint64_t maxBytes = DEFAULT_MAX_BYTES,
+                            uint64_t minFileSize = DEFAULT_MIN_FILE_SIZE);
+
+        // $XDG_CACHE_HOME/qedit, or ~/.cache/qedit
+        [[nodiscard]] static std::string defaultDirectory();
+
+        // The cached index of the file at path, if it is still current
+        [[nodiscard]] std::optional<MappedIndex> load(const std::string& path) const;
+
+        // Store the index of the file as it was when scanned. Skipped for
+        // small files and for files that changed since.
+        void save(const std::string& path, const FileIdentity& scanned, const std::vector<uint64_t>& offsets,
+                  uint64_t lines, bool endsWithNewline) const;
+
+        // Sidecar file used for the given path
+        [[nodiscard]] std::string entryFor(const std::string& path) const;
+
+        [[nodiscard]] const std::string& getDirectory() const { return directory; }
+
+        // Remove the least recently used entries of every kind until the
+        // directory fits in maxBytes, and temporary files whose writer is gone
+        void evict() const;
+
+    private:
+
+        std::string directory;
+        uint64_t maxBytes;
+        uint64_t minFileSize;
+    };
+}
@@ -0,0 +1,221 @@
+#include "LineDiff.h"
+#include <algorithm>
+
+namespace QEditor {
+    namespace {
+        // Past this many edit steps a subproblem is split at the furthest
+        // forward reach instead of the exact middle snake
+        constexpr long EXPENSIVE_COST = 256;
+
+        class Differ {
+        public:
+            Differ(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b)
+                : a(a), b(b), removed(a.size(), false), added(b.size(), false) {}
+
+            void compare(size_t aLo, size_t aHi, size_t bLo, size_t bHi) {
+                // Common prefix and suffix never take part in the diff
+                while (aLo < aHi && bLo < bHi && a[aLo] == b[bLo]) {
+                    ++aLo;
+                    ++bLo;
+                }
+                while (aLo < aHi && bLo < bHi && a[aHi - 1] == b[bHi - 1]) {
+                    --aHi;
+                    --bHi;
+                }
+
+                if (aLo == aHi) {
+                    std::fill(added.begin() + static_cast<long>(bLo), added.begin() + static_cast<long>(bHi), true);
+                    return;
+                }
+                if (bLo == bHi) {
+                    std::fill(removed.begin() + static_cast<long>(aLo), removed.begin() + static_cast<long>(aHi), true);
+                    return;
+                }
+
+                const auto [x, y] = split(aLo, aHi, bLo, bHi);
+                if ((x == 0 && y == 0) || (x == aHi - aLo && y == bHi - bLo)) {
+                    // No usable split, everything in the range changed
+                    std::fill(removed.begin() + static_cast<long>(aLo), removed.begin() + static_cast<long>(aHi), true);
+                    std::fill(added.begin() + static_cast<long>(bLo), added.begin() + static_cast<long>(bHi), true);
+                    return;
+                }
+
+                compare(aLo, aLo + x, bLo, bLo + y);
+                compare(aLo + x, aHi, bLo + y, bHi);
+            }
+
+            [[nodiscard]] const std::vector<bool>& removedLines() const { return removed; }
+            [[nodiscard]] const std::vector<bool>& addedLines() const { return added; }
+
+        private:
+            // Find the middle snake of a[aLo, aHi) vs b[bLo, bHi), returned
+            // relative to (aLo, bLo)
+            std::pair<size_t, size_t> split(const size_t aLo, const size_t aHi, const size_t bLo, const size_t bHi) {
+                const long n = static_cast<long>(aHi - aLo);
+                const long m = static_cast<long>(bHi - bLo);
+                const long maxD = (n + m + 1) / 2;
+                const long offset = maxD;
+                const long length = 2 * maxD + 2;
+
+                v1.assign(static_cast<size_t>(length), -1);
+                v2.assign(static_cast<size_t>(length), -1);
+                v1[static_cast<size_t>(offset + 1)] = 0;
+                v2[static_cast<size_t>(offset + 1)] = 0;
+
+                const long delta = n - m;
+                const bool front = delta % 2 != 0;
+                long k1start = 0, k1end = 0, k2start = 0, k2end = 0;
+
+                auto A = [&](long i) { return a[aLo + static_cast<size_t>(i)]; };
+                auto B = [&](long j) { return b[bLo + static_cast<size_t>(j)]; };
+
+                for (long d = 0; d < maxD; ++d) {
+                    if (d > EXPENSIVE_COST) {
+                        return furthestReach(d - 1, offset, n, m, k1start, k1end);
+                    }
+
+                    for (long k1 = -d + k1start; k1 <= d - k1end; k1 += 2) {
+                        const long k1off = offset + k1;
+                        long x1;
+                        if (k1 == -d || (k1 != d && v1[k1off - 1] < v1[k1off + 1])) {
+                            x1 = v1[k1off + 1];
+                        } else {
+                            x1 = v1[k1off - 1] + 1;
+                        }
+                        long y1 = x1 - k1;
+                        while (x1 < n && y1 < m && A(x1) == B(y1)) {
+                            ++x1;
+                            ++y1;
+                        }
+                        v1[k1off] = x1;
+
+                        if (x1 > n) {
+                            k1end += 2;
+                        } else if (y1 > m) {
+                            k1start += 2;
+                        } else if (front) {
+                            const long k2off = offset + delta - k1;
+                            if (k2off >= 0 && k2off < length && v2[k2off] != -1 && x1 >= n - v2[k2off]) {
+                                return {static_cast<size_t>(x1), static_cast<size_t>(y1)};
+                            }
+                        }
+                    }
+
+                    for (long k2 = -d + k2start; k2 <= d - k2end; k2 += 2) {
+                        const long k2off = offset + k2;
+                        long x2;
+                        if (k2 == -d || (k2 != d && v2[k2off - 1] < v2[k2off + 1])) {
+                            x2 = v2[k2off + 1];
+                        } else {
+                            x2 = v2[k2off - 1] + 1;
+                        }
+                        long y2 = x2 - k2;
+                        while (x2 < n && y2 < m && A(n - x2 - 1) == B(m - y2 - 1)) {
+                            ++x2;
+                            ++y2;
+                        }
+                        v2[k2off] = x2;
+
+                        if (x2 > n) {
+                            k2end += 2;
+                        } else if (y2 > m) {
+                            k2start += 2;
+                        } else if (!front) {
+                            const long k1off = offset + delta - k2;
+                            if (k1off >= 0 && k1off < length && v1[k1off] != -1) {
+                                const long x1 = v1[k1off];
+                                const long y1 = offset + x1 - k1off;
+                                if (x1 >= n - x2) {
+                                    return {static_cast<size_t>(x1), static_cast<size_t>(y1)};
+                                }
+                            }
+                        }
+                    }
+                }
+
+                return {0, 0};
+            }
+
+            // Heuristic split for expensive inputs: the forward path that got furthest
+            std::pair<size_t, size_t> furthestReach(const long d, const long offset, const long n, const long m,
+                                                    const long k1start, const long k1end) const {
+                long bestX = 0, bestY = 0;
+                for (long k = -d + k1start; k <= d - k1end; k += 2) {
+                    const long x = v1[offset + k];
+                    const long y = x - k;
+                    if (x >= 0 && x <= n && y >= 0 && y <= m && x + y > bestX + bestY) {
+                        bestX = x;
+                        bestY = y;
+                    }
+                }
+                return {static_cast<size_t>(bestX), static_cast<size_t>(bestY)};
+            }
+
+            const std::vector<uint32_t>& a;
+            const std::vector<uint32_t>& b;
+            std::vector<bool> removed;
+            std::vector<bool> added;
+            std::vector<long> v1, v2;
+        };
+
+        std::vector<DiffHunk> hunksFrom(const std::vector<bool>& removed, const std::vector<bool>& added) {
+            std::vector<DiffHunk> result;
+            size_t i = 0, j = 0;
+
+            while (i < removed.size() || j < added.size()) {
+                if (i < removed.size() && j < added.size() && !removed[i] && !added[j]) {
+                    ++i;
+                    ++j;
+                    continue;
+                }
+
+                DiffHunk hunk{i, 0, j, 0};
+                while ((i < removed.size() && removed[i]) || (j < added.size() && added[j])) {
+                    while (i < removed.size() && removed[i]) ++i;
+                    while (j < added.size() && added[j]) ++j;
+                }
+                hunk.oldCount = i - hunk.oldStart;
+                hunk.newCount = j - hunk.newStart;
+                result.push_back(hunk);
+            }
+
+            return result;
+        }
+    }
+
+    std::vector<DiffHunk> diffSequences(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b) {
+        // Lines found on only one side can't be part of any match, so they
+        // are marked as changed up front and Myers runs on the rest. The
+        // result is the same, but a file that was largely rewritten no longer
+        // costs a long search.
+        uint32_t maxId = 0;
+        for (const uint32_t id : a) maxId = std::max(maxId, id);
+        for (const uint32_t id : b) maxId = std::max(maxId, id);
+        std::vector<uint8_t> sides(static_cast<size_t>(maxId) + 1, 0);
+        for (const uint32_t id : a) sides[id] |= 1;
+        for (const uint32_t id : b) sides[id] |= 2;
+
+        std::vector<bool> removed(a.size(), true);
+        std::vector<bool> added(b.size(), true);
+
+        auto keepShared = [&sides](const std::vector<uint32_t>& lines, std::vector<uint32_t>& kept, std::vector<size_t>& at) {
+            for (size_t i = 0; i < lines.size(); ++i) {
+                if (sides[lines[i]] == 3) {
+                    kept.push_back(lines[i]);
+                    at.push_back(i);
+                }
+            }
+        };
+        std::vector<uint32_t> sharedA, sharedB;
+        std::vector<size_t> atA, atB;
+        keepShared(a, sharedA, atA);
+        keepShared(b, sharedB, atB);
+
+        Differ differ(sharedA, sharedB);
+        differ.compare(0, sharedA.size(), 0, sharedB.size());
+        for (size_t i = 0; i < sharedA.size(); ++i) removed[atA[i]] = differ.removedLines()[i];
+        for (size_t j = 0; j < sharedB.size(); ++j) added[atB[j]] = differ.addedLines()[j];
+
+        return hunksFrom(removed, added);
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace QEditor {
+    // Lines [oldStart, oldStart + oldCount) of the old text were replaced by
+    // lines [newStart, newStart + newCount) of the new text
+    struct DiffHunk {
+        size_t oldStart, oldCount;
+        size_t newStart, newCount;
+    };
+
+    // Myers' O(ND) difference algorithm in linear space, on sequences of
+    // line ids. Very expensive inputs fall back to a non-minimal diff.
+    std::vector<DiffHunk> diffSequences(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b);
+
+    // Diff two line containers. Lines are interned to integer ids first, so
+    // the algorithm itself only ever compares integers.
+    template <class A, class B>
+    std::vector<DiffHunk> diffLines(const A& a, const B& b) {
+        std::unordered_map<std::string_view, uint32_t> ids;
+        ids.reserve(a.size() + b.size());
+
+        auto intern = [&ids](const auto& lines) {
+            std::vector<uint32_t> result;
+            result.reserve(lines.size());
+            for (size_t i = 0; i < lines.size(); ++i) {
+                const std::string_view line = lines[i];
+                result.push_back(ids.try_emplace(line, static_cast<uint32_t>(ids.size())).first->second);
+            }
+            return result;
+        };
+
+        const std::vector<uint32_t> ia = intern(a);
+        const std::vector<uint32_t> ib = intern(b);
+        return diffSequences(ia, ib);
+    }
+}
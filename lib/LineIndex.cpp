@@ -0,0 +1,165 @@
+#include "LineIndex.h"
+#include "EditorError.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace QEditor {
+    namespace {
+        constexpr size_t SCAN_CHUNK = 1024 * 1024;
+    }
+
+    LineIndex::~LineIndex() {
+        cancel();
+    }
+
+    void LineIndex::build(const std::string& path, std::optional<IndexCache> cache) {
+        cancel();
+
+        this->cache = std::move(cache);
+        auto loaded = this->cache ? this->cache->load(path) : std::nullopt;
+        {
+            std::lock_guard lock(mutex);
+            offsets.assign(1, 0);
+            mapped = loaded ? std::move(*loaded) : MappedIndex();
+            lines = loaded ? mapped.lines() : 0;
+            endsWithNewline = loaded ? mapped.endsWithNewline() : true;
+        }
+
+        if (loaded) {
+            this->path = path;
+            scanned = mapped.fileSize();
+            complete = true;
+            return;
+        }
+
+        scanned = 0;
+        start(path);
+    }
+
+    void LineIndex::extend(const std::string& path) {
+        // A running scan reads until EOF and picks up the new bytes itself
+        if (!complete) return;
+
+        cancel();
+        {
+            // The scan appends, so a mapped index becomes an ordinary one
+            std::lock_guard lock(mutex);
+            if (mapped.size()) {
+                offsets.assign(mapped.offsets(), mapped.offsets() + mapped.size());
+                mapped = MappedIndex();
+            }
+        }
+        start(path);
+    }
+
+    void LineIndex::start(const std::string& path) {
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd == -1) {
+            throw FileOpenError(path);
+        }
+
+        this->path = path;
+        identity = FileIdentity::of(path);
+        complete = false;
+        stopRequested = false;
+
+        worker = std::thread([this, fd] {
+            scan(fd);
+            close(fd);
+        });
+    }
+
+    void LineIndex::cancel() {
+        stopRequested = true;
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    void LineIndex::scan(const int fd) {
+        std::vector<char> chunk(SCAN_CHUNK);
+        uint64_t offset = scanned;
+        uint64_t lineNo;
+        bool lastWasNewline;
+        {
+            std::lock_guard lock(mutex);
+            lineNo = lines;
+            lastWasNewline = endsWithNewline;
+        }
+
+        // Checkpoints found in the current chunk, published under the lock once per chunk
+        std::vector<uint64_t> found;
+
+        while (!stopRequested) {
+            const ssize_t n = pread(fd, chunk.data(), chunk.size(), static_cast<off_t>(offset));
+            if (n <= 0) break;
+
+            const char* begin = chunk.data();
+            const char* end = begin + n;
+            for (const char* p = begin; p < end;) {
+                const void* hit = std::memchr(p, '\n', static_cast<size_t>(end - p));
+                if (!hit) break;
+
+                p = static_cast<const char*>(hit) + 1;
+                ++lineNo;
+                if (lineNo % STRIDE == 0) {
+                    found.push_back(offset + static_cast<uint64_t>(p - begin));
+                }
+            }
+
+            lastWasNewline = chunk[static_cast<size_t>(n) - 1] == '\n';
+            offset += static_cast<uint64_t>(n);
+
+            {
+                std::lock_guard lock(mutex);
+                offsets.insert(offsets.end(), found.begin(), found.end());
+                lines = lineNo;
+                endsWithNewline = lastWasNewline;
+            }
+            found.clear();
+            scanned = offset;
+        }
+
+        if (stopRequested) return;
+
+        // Only this thread writes the offsets, so they can be read unlocked
+        if (cache && offset == identity.size) {
+            cache->save(path, identity, offsets, lineNo, lastWasNewline);
+        }
+        complete = true;
+    }
+
+    uint64_t LineIndex::lineCount() const {
+        std::lock_guard lock(mutex);
+        // A trailing partial line counts as a line, an empty file has one empty line
+        if (lines == 0) return 1;
+        return endsWithNewline ? lines : lines + 1;
+    }
+
+    LineIndex::Checkpoint LineIndex::checkpointForLine(const uint64_t line) const {
+        std::lock_guard lock(mutex);
+        const uint64_t slot = std::min<uint64_t>(line / STRIDE, slotCount() - 1);
+        return {slot * STRIDE, slotOffset(slot)};
+    }
+
+    LineIndex::Checkpoint LineIndex::checkpointForOffset(const uint64_t offset) const {
+        std::lock_guard lock(mutex);
+        const uint64_t* first = mapped.size() ? mapped.offsets() : offsets.data();
+        const uint64_t* last = first + slotCount();
+        const auto slot = static_cast<uint64_t>(std::upper_bound(first, last, offset) - first) - 1;
+        return {slot * STRIDE, first[slot]};
+    }
+
+    size_t LineIndex::memoryUsage() const {
+        std::lock_guard lock(mutex);
+        // Mapped pages belong to the page cache rather than the heap
+        return offsets.capacity() * sizeof(uint64_t);
+    }
+
+    bool LineIndex::isCached() const {
+        std::lock_guard lock(mutex);
+        return mapped.size() != 0;
+    }
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "FileIdentity.h"
+#include "IndexCache.h"
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace QEditor {
+    // Sparse index of line start offsets. Only every STRIDE-th line is
+    // recorded, so the index stays small even for multi-gigabyte files.
+    // The scan runs on a background thread; lookups are safe while it runs.
+    class LineIndex {
+    public:
+        static constexpr uint64_t STRIDE = 1024;
+
+        // A known (line number, byte offset) pair
+        using Checkpoint = std::pair<uint64_t, uint64_t>;
+
+        LineIndex() = default;
+        ~LineIndex();
+
+        LineIndex(const LineIndex&) = delete;
+        LineIndex& operator=(const LineIndex&) = delete;
+
+        // Start indexing the file at path in the background. With a cache,
+        // a current index of the file is mapped from it instead, and a
+        // finished scan is stored there for next time.
+        void build(const std::string& path, std::optional<IndexCache> cache = std::nullopt);
+
+        // Index bytes appended to the file since the last scan finished
+        void extend(const std::string& path);
+
+        // Stop the background scan and wait for it
+        void cancel();
+
+        [[nodiscard]] bool isComplete() const { return complete.load(); }
+        [[nodiscard]] uint64_t scannedBytes() const { return scanned.load(); }
+
+        // Number of lines in the file, only exact once the scan is complete
+        [[nodiscard]] uint64_t lineCount() const;
+
+        // Closest recorded checkpoint at or before the given line
+        [[nodiscard]] Checkpoint checkpointForLine(uint64_t line) const;
+
+        // Closest recorded checkpoint at or before the given byte offset
+        [[nodiscard]] Checkpoint checkpointForOffset(uint64_t offset) const;
+
+        [[nodiscard]] size_t memoryUsage() const;
+
+        // Whether the index was mapped from the cache rather than scanned
+        [[nodiscard]] bool isCached() const;
+
+    private:
+        void start(const std::string& path);
+        void scan(int fd);
+
+        // Number of checkpoints and the i-th one, from the mapping or the vector
+        [[nodiscard]] size_t slotCount() const { return mapped.size() ? mapped.size() : offsets.size(); }
+        [[nodiscard]] uint64_t slotOffset(size_t slot) const {
+            return mapped.size() ? mapped.offsets()[slot] : offsets[slot];
+        }
+
+        mutable std::mutex mutex;
+        std::vector<uint64_t> offsets{0}; // offsets[i] is the start of line i * STRIDE
+        MappedIndex mapped;               // replaces offsets when loaded from the cache
+        uint64_t lines = 0;
+        bool endsWithNewline = true;
+
+        std::atomic<uint64_t> scanned{0};
+        std::atomic<bool> complete{false};
+        std::atomic<bool> stopRequested{false};
+        std::thread worker;
+
+        std::optional<IndexCache> cache;
+        std::string path;
+        FileIdentity identity; // of the file when the current scan started
+    };
+}
@@ -0,0 +1,130 @@
+#include "LineLoader.h"
+#include "EditorError.h"
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace QEditor {
+    LineLoader::LineLoader(std::unique_ptr<Decompressor> source) : source(std::move(source)) {
+        int fds[2];
+        if (pipe(fds) == -1) {
+            throw EditorError(std::string("pipe: ") + std::strerror(errno));
+        }
+        wakeRead = fds[0];
+        wakeWrite = fds[1];
+        fcntl(wakeRead, F_SETFL, O_NONBLOCK);
+        fcntl(wakeRead, F_SETFD, FD_CLOEXEC);
+        fcntl(wakeWrite, F_SETFD, FD_CLOEXEC);
+
+        worker = std::thread([this] { load(); });
+    }
+
+    LineLoader::~LineLoader() {
+        stopRequested = true;
+        if (worker.joinable()) {
+            worker.join();
+        }
+        close(wakeRead);
+        close(wakeWrite);
+    }
+
+    void LineLoader::load() {
+        std::vector<std::string> lines;
+        std::string chunk;
+        std::string partial;
+
+        try {
+            while (!stopRequested && source->read(chunk)) {
+                const char* p = chunk.data();
+                const char* end = p + chunk.size();
+
+                while (p < end) {
+                    const auto* nl = static_cast<const char*>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+                    if (!nl) {
+                        partial.append(p, end);
+                        break;
+                    }
+
+                    if (partial.empty()) {
+                        lines.emplace_back(p, nl);
+                    } else {
+                        partial.append(p, nl);
+                        lines.push_back(std::move(partial));
+                        partial.clear();
+                    }
+                    p = nl + 1;
+                }
+
+                // One batch per decompressed chunk
+                publish(lines, false);
+            }
+
+            // Like getline, a final line without a newline still counts
+            if (!partial.empty()) {
+                lines.push_back(std::move(partial));
+            }
+        } catch (const EditorError& e) {
+            std::lock_guard lock(mutex);
+            failure = e.what();
+        }
+
+        publish(lines, true);
+    }
+
+    void LineLoader::publish(std::vector<std::string>& lines, const bool last) {
+        bool wake;
+        {
+            std::lock_guard lock(mutex);
+            if (pending.empty()) {
+                pending.swap(lines);
+            } else {
+                pending.insert(pending.end(), std::make_move_iterator(lines.begin()),
+                               std::make_move_iterator(lines.end()));
+            }
+            lines.clear();
+            finished = last;
+
+            wake = !signalled && (!pending.empty() || last);
+            if (wake) signalled = true;
+        }
+
+        if (wake) {
+            const char byte = 1;
+            [[maybe_unused]] const ssize_t n = write(wakeWrite, &byte, 1);
+        }
+    }
+
+    bool LineLoader::drain(std::vector<std::string>& out) {
+        std::lock_guard lock(mutex);
+
+        char bytes[16];
+        while (read(wakeRead, bytes, sizeof(bytes)) > 0) {}
+        signalled = false;
+
+        if (out.empty()) {
+            out.swap(pending);
+        } else {
+            out.insert(out.end(), std::make_move_iterator(pending.begin()), std::make_move_iterator(pending.end()));
+        }
+        pending.clear();
+
+        return finished;
+    }
+
+    void LineLoader::wait() {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    unsigned LineLoader::progress() const {
+        const uint64_t size = source->compressedSize();
+        if (size == 0) return 100;
+        return static_cast<unsigned>(source->compressedOffset() * 100 / size);
+    }
+
+    std::string LineLoader::error() const {
+        std::lock_guard lock(mutex);
+        return failure;
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Compression.h"
+
+namespace QEditor {
+    // Splits a decompressed file into lines on a background thread and hands
+    // them over in batches, so the first screen can be shown long before the
+    // whole file has been inflated.
+    class LineLoader {
+    public:
+        explicit LineLoader(std::unique_ptr<Decompressor> source);
+        ~LineLoader();
+
+        LineLoader(const LineLoader&) = delete;
+        LineLoader& operator=(const LineLoader&) = delete;
+
+        // Readable whenever lines are waiting to be drained
+        [[nodiscard]] int getFd() const { return wakeRead; }
+
+        // Append the lines decoded so far to out. Returns true once the whole
+        // file has been handed over.
+        bool drain(std::vector<std::string>& out);
+
+        // Block until the background thread has finished
+        void wait();
+
+        // Percentage of the compressed input consumed
+        [[nodiscard]] unsigned progress() const;
+
+        // Error message if decoding failed part way, empty otherwise
+        [[nodiscard]] std::string error() const;
+
+    private:
+        void load();
+        void publish(std::vector<std::string>& lines, bool last);
+
+        std::unique_ptr<Decompressor> source;
+
+        mutable std::mutex mutex;
+        std::vector<std::string> pending;
+        std::string failure;
+        bool finished = false;
+        bool signalled = false;
+
+        int wakeRead = -1;
+        int wakeWrite = -1;
+        std::atomic<bool> stopRequested{false};
+        std::thread worker;
+    };
+}
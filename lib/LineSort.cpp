@@ -0,0 +1,255 @@
+#include "LineSort.h"
+#include "EditorError.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+
+namespace QEditor {
+    namespace {
+        // Below this many lines per thread the sort stays on one thread
+        constexpr size_t MIN_RUN = 16384;
+
+        struct TextKey {
+            uint64_t prefix; // first bytes of the key, big-endian, settles most comparisons
+            const char* data;
+            uint32_t size;
+            uint32_t line;
+        };
+
+        struct NumberKey {
+            double number;
+            uint32_t line;
+            bool present;
+        };
+
+        bool isBlank(const char c) {
+            return c == ' ' || c == '\t';
+        }
+
+        std::string_view keyOf(const std::string_view line, const SortOptions& options) {
+            if (options.column == 0) return line;
+
+            size_t at = 0;
+            for (size_t field = 1;; ++field) {
+                if (options.separator == 0) {
+                    while (at < line.size() && isBlank(line[at])) ++at;
+                }
+                if (at >= line.size()) return {};
+
+                size_t end = at;
+                if (options.separator == 0) {
+                    while (end < line.size() && !isBlank(line[end])) ++end;
+                } else {
+                    end = std::min(line.find(options.separator, at), line.size());
+                }
+
+                if (field == options.column) return line.substr(at, end - at);
+                at = end + (options.separator != 0);
+            }
+        }
+
+        uint64_t prefixOf(const std::string_view key) {
+            uint64_t prefix = 0;
+            for (size_t i = 0; i < sizeof(prefix); ++i) {
+                prefix = (prefix << 8) | (i < key.size() ? static_cast<unsigned char>(key[i]) : 0);
+            }
+            return prefix;
+        }
+
+        NumberKey numberOf(const std::string_view key, const uint32_t line) {
+            const auto digit = std::find_if(key.begin(), key.end(), [](const char c) {
+                return std::isdigit(static_cast<unsigned char>(c));
+            });
+            if (digit == key.end()) return {0, line, false};
+
+            const char* from = &*digit;
+            if (from > key.data() && from[-1] == '-') --from;
+
+            double number = 0;
+            std::from_chars(from, key.data() + key.size(), number);
+            return {number, line, true};
+        }
+
+        // Elements of a and b that come before output position t of their merge,
+        // taking a's element first on ties
+        template <class T, class Less>
+        size_t coRank(const size_t t, const T* a, const size_t na, const T* b, const size_t nb, const Less& less) {
+            size_t lo = t > nb ? t - nb : 0;
+            size_t hi = std::min(t, na);
+            while (lo < hi) {
+                const size_t i = lo + (hi - lo) / 2;
+                const size_t j = t - i;
+                if (j > 0 && !less(b[j - 1], a[i])) {
+                    lo = i + 1;
+                } else {
+                    hi = i;
+                }
+            }
+            return lo;
+        }
+
+        template <class T, class Less>
+        void parallelSort(std::vector<T>& keys, const Less& less, ThreadPool& pool) {
+            const size_t n = keys.size();
+            const size_t threads = std::max<size_t>(1, std::min(pool.size(), n / MIN_RUN));
+
+            std::vector<size_t> bounds;
+            for (size_t i = 0; i <= threads; ++i) {
+                bounds.push_back(n * i / threads);
+            }
+
+            pool.run(threads, [&](const size_t run) {
+                std::stable_sort(keys.begin() + static_cast<std::ptrdiff_t>(bounds[run]),
+                                 keys.begin() + static_cast<std::ptrdiff_t>(bounds[run + 1]), less);
+            });
+            if (threads == 1) return;
+
+            std::vector<T> merged(n);
+            while (bounds.size() > 2) {
+                const size_t runs = bounds.size() - 1;
+                const size_t pairs = runs / 2;
+                const size_t parts = std::max<size_t>(1, threads / pairs);
+
+                pool.run(pairs * parts + runs % 2, [&](const size_t task) {
+                    if (task == pairs * parts) {
+                        // An odd run out carries over to the next round
+                        std::copy(keys.begin() + static_cast<std::ptrdiff_t>(bounds[runs - 1]), keys.end(),
+                                  merged.begin() + static_cast<std::ptrdiff_t>(bounds[runs - 1]));
+                        return;
+                    }
+
+                    const size_t pair = task / parts;
+                    const size_t part = task % parts;
+                    const T* a = keys.data() + bounds[2 * pair];
+                    const T* b = keys.data() + bounds[2 * pair + 1];
+                    const size_t na = bounds[2 * pair + 1] - bounds[2 * pair];
+                    const size_t nb = bounds[2 * pair + 2] - bounds[2 * pair + 1];
+
+                    const size_t from = (na + nb) * part / parts;
+                    const size_t to = (na + nb) * (part + 1) / parts;
+                    const size_t ia = coRank(from, a, na, b, nb, less);
+                    const size_t ja = coRank(to, a, na, b, nb, less);
+                    std::merge(a + ia, a + ja, b + (from - ia), b + (to - ja),
+                               merged.begin() + static_cast<std::ptrdiff_t>(bounds[2 * pair] + from), less);
+                });
+
+                std::vector<size_t> next;
+                for (size_t i = 0; i < runs; i += 2) {
+                    next.push_back(bounds[i]);
+                }
+                next.push_back(n);
+                bounds = std::move(next);
+                keys.swap(merged);
+            }
+        }
+
+        template <class T, class Less>
+        std::vector<std::string> sortBy(std::vector<std::string>& lines, std::vector<T>& keys, const Less& less,
+                                        const SortOptions& options, ThreadPool& pool) {
+            auto order = [&](const T& a, const T& b) { return options.reverse ? less(b, a) : less(a, b); };
+            parallelSort(keys, order, pool);
+
+            std::vector<std::string> sorted;
+            sorted.reserve(keys.size());
+            for (size_t i = 0; i < keys.size(); ++i) {
+                if (options.unique && i > 0 && !order(keys[i - 1], keys[i])) continue;
+                sorted.push_back(std::move(lines[keys[i].line]));
+            }
+            return sorted;
+        }
+    }
+
+    SortOptions parseSortOptions(const std::string_view text) {
+        SortOptions options;
+        for (size_t i = 0; i < text.size(); ++i) {
+            const char c = text[i];
+            if (isBlank(c)) continue;
+
+            if (c == 'n') {
+                options.numeric = true;
+            } else if (c == 'r') {
+                options.reverse = true;
+            } else if (c == 'u') {
+                options.unique = true;
+            } else if (c == 'k') {
+                const size_t start = i + 1;
+                size_t end = start;
+                while (end < text.size() && std::isdigit(static_cast<unsigned char>(text[end]))) ++end;
+                if (end == start || std::from_chars(text.data() + start, text.data() + end, options.column).ec != std::errc() ||
+                    options.column == 0) {
+                    throw CommandError("Expected a field number after k");
+                }
+
+                // Any punctuation right after the number separates the fields
+                i = end - 1;
+                if (end < text.size() && !isBlank(text[end]) && !std::isalnum(static_cast<unsigned char>(text[end]))) {
+                    options.separator = text[end];
+                    i = end;
+                }
+            } else {
+                throw CommandError(std::string("Unknown sort option: ") + c);
+            }
+        }
+        return options;
+    }
+
+    std::vector<std::string> sortLines(std::vector<std::string> lines, const SortOptions& options, ThreadPool& pool) {
+        if (lines.size() > UINT32_MAX) {
+            throw BufferError("Too many lines to sort");
+        }
+
+        if (options.numeric) {
+            std::vector<NumberKey> keys(lines.size());
+            pool.run(pool.size(), [&](const size_t part) {
+                const size_t to = lines.size() * (part + 1) / pool.size();
+                for (size_t i = lines.size() * part / pool.size(); i < to; ++i) {
+                    keys[i] = numberOf(keyOf(lines[i], options), static_cast<uint32_t>(i));
+                }
+            });
+
+            return sortBy(lines, keys, [](const NumberKey& a, const NumberKey& b) {
+                if (a.present != b.present) return !a.present;
+                return a.number < b.number;
+            }, options, pool);
+        }
+
+        std::vector<TextKey> keys(lines.size());
+        for (size_t i = 0; i < lines.size(); ++i) {
+            const std::string_view key = keyOf(lines[i], options);
+            keys[i] = {prefixOf(key), key.data(), static_cast<uint32_t>(std::min<size_t>(key.size(), UINT32_MAX)), static_cast<uint32_t>(i)};
+        }
+
+        return sortBy(lines, keys, [](const TextKey& a, const TextKey& b) {
+            if (a.prefix != b.prefix) return a.prefix < b.prefix;
+            return std::string_view(a.data, a.size) < std::string_view(b.data, b.size);
+        }, options, pool);
+    }
+
+    void uniqueLines(std::vector<std::string>& lines) {
+        lines.erase(std::unique(lines.begin(), lines.end()), lines.end());
+    }
+
+    void filterLines(std::vector<std::string>& lines, const std::function<bool(const std::string&)>& matches,
+                     const bool keep, ThreadPool& pool) {
+        // Match in parallel, then compact in order on this thread
+        std::vector<char> kept(lines.size());
+        const size_t parts = std::max<size_t>(1, std::min(pool.size(), lines.size() / MIN_RUN));
+        pool.run(parts, [&](const size_t part) {
+            const size_t to = lines.size() * (part + 1) / parts;
+            for (size_t i = lines.size() * part / parts; i < to; ++i) {
+                kept[i] = matches(lines[i]) == keep;
+            }
+        });
+
+        size_t out = 0;
+        for (size_t i = 0; i < lines.size(); ++i) {
+            if (kept[i]) {
+                if (out != i) lines[out] = std::move(lines[i]);
+                ++out;
+            }
+        }
+        lines.resize(out);
+    }
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace QEditor {
+    class ThreadPool;
+
+    struct SortOptions {
+        bool numeric = false; // by the first number in the key; lines without one go first
+        bool reverse = false;
+        bool unique = false;  // keep the first of each run of equal keys
+        size_t column = 0;    // 1-based key field, 0 for the whole line
+        char separator = 0;   // between fields, 0 for runs of blanks
+    };
+
+    // Options as written after :sort, e.g. "nu", "r k2," (field 2 of a CSV)
+    [[nodiscard]] SortOptions parseSortOptions(std::string_view text);
+
+    // Stable sort. Only small (key, line) records are compared and moved
+    // around; the strings themselves are moved once, into the result. The
+    // records are sorted in runs on the pool and merged pairwise, with each
+    // merge split across the threads as well.
+    [[nodiscard]] std::vector<std::string> sortLines(std::vector<std::string> lines, const SortOptions& options,
+                                                     ThreadPool& pool);
+
+    // Drop lines equal to the one before them
+    void uniqueLines(std::vector<std::string>& lines);
+
+    // Keep the lines for which matches() returns keep. matches() runs on the
+    // pool's threads, so it must be safe to call concurrently.
+    void filterLines(std::vector<std::string>& lines, const std::function<bool(const std::string&)>& matches,
+                     bool keep, ThreadPool& pool);
+}
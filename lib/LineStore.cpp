@@ -0,0 +1,533 @@
+#include "LineStore.h"
+#include "LzCodec.h"
+#include <algorithm>
+#include <cstring>
+#include <tuple>
+
+namespace QEditor {
+    namespace {
+        // Heap bytes behind a string, none while it fits the small-string buffer
+        size_t heapBytes(const std::string& s) {
+            return s.capacity() > 15 ? s.capacity() + 1 : 0;
+        }
+
+        // Append lines [from, to) of a packed block to out
+        void unpackLines(const std::string& packed, const size_t textBytes, const size_t from, const size_t to,
+                         std::vector<std::string>& out) {
+            std::string text;
+            text.reserve(textBytes + to);
+            lzDecompress(packed, text);
+
+            const char* p = text.data();
+            const char* end = p + text.size();
+            for (size_t line = 0; p < end && line < to; ++line) {
+                const auto* nl = static_cast<const char*>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+                if (line >= from) out.emplace_back(p, nl);
+                p = nl + 1;
+            }
+        }
+    }
+
+    LineSlice::LineSlice(std::vector<std::string> lines) {
+        if (lines.empty()) return;
+
+        total = lines.size();
+        pieces.emplace_back();
+        pieces.back().count = total;
+        pieces.back().lines = std::move(lines);
+    }
+
+    void LineSlice::pieceText(const size_t piece, std::string& text) const {
+        const Piece& p = pieces[piece];
+        text.clear();
+        if (p.packed) {
+            lzDecompress(*p.packed, text);
+            return;
+        }
+        for (const std::string& line : p.lines) {
+            text += line;
+            text += '\n';
+        }
+    }
+
+    std::vector<std::string> LineSlice::lines() && {
+        std::vector<std::string> out;
+        out.reserve(total);
+        for (Piece& piece : pieces) {
+            if (piece.packed) {
+                unpackLines(*piece.packed, piece.textBytes, 0, piece.count, out);
+            } else {
+                out.insert(out.end(), std::make_move_iterator(piece.lines.begin()),
+                           std::make_move_iterator(piece.lines.end()));
+            }
+        }
+        return out;
+    }
+
+    std::vector<std::string> LineSlice::lines() const& {
+        std::vector<std::string> out;
+        out.reserve(total);
+        for (const Piece& piece : pieces) {
+            if (piece.packed) {
+                unpackLines(*piece.packed, piece.textBytes, 0, piece.count, out);
+            } else {
+                out.insert(out.end(), piece.lines.begin(), piece.lines.end());
+            }
+        }
+        return out;
+    }
+
+    size_t LineSlice::memoryUsage() const {
+        size_t bytes = pieces.capacity() * sizeof(Piece);
+        for (const Piece& piece : pieces) {
+            if (piece.packed) bytes += piece.packed->capacity();
+            bytes += piece.lines.capacity() * sizeof(std::string);
+            for (const std::string& line : piece.lines) {
+                bytes += heapBytes(line);
+            }
+        }
+        return bytes;
+    }
+
+    LineStore::LineStore(LineStore&& other) noexcept
+        : blocks(std::move(other.blocks)), total(other.total), starts(std::move(other.starts)),
+          validStarts(other.validStarts), hotList(std::move(other.hotList)), revisionCount(other.revisionCount + 1) {
+        other.clear();
+    }
+
+    LineStore& LineStore::operator=(LineStore&& other) noexcept {
+        if (this != &other) {
+            blocks = std::move(other.blocks);
+            total = other.total;
+            starts = std::move(other.starts);
+            validStarts = other.validStarts;
+            hotList = std::move(other.hotList);
+            revisionCount = std::max(revisionCount, other.revisionCount) + 1;
+            other.clear();
+        }
+        return *this;
+    }
+
+    LineStore& LineStore::operator=(std::vector<std::string>&& lines) {
+        clear();
+        append(std::move(lines));
+        return *this;
+    }
+
+
+    std::string& LineStore::operator[](const size_t line) {
+        ++revisionCount;
+        const auto [block, offset] = locate(line);
+        Block& b = touch(block);
+        b.dirty = true;
+        return b.lines[offset];
+    }
+
+    const std::string& LineStore::operator[](const size_t line) const {
+        const auto [block, offset] = locate(line);
+        return touch(block).lines[offset];
+    }
+
+    std::pair<size_t, size_t> LineStore::locate(const size_t line) const {
+        if (validStarts < blocks.size()) {
+            starts.resize(blocks.size());
+            for (size_t i = validStarts; i < blocks.size(); ++i) {
+                starts[i] = i == 0 ? 0 : starts[i - 1] + blocks[i - 1]->count;
+            }
+            validStarts = blocks.size();
+        }
+
+        // Inserting at the very end lands in the last block
+        if (line >= total) {
+            return {blocks.size() - 1, line - (total - blocks.back()->count)};
+        }
+
+        const auto it = std::upper_bound(starts.begin(), starts.begin() + static_cast<long>(blocks.size()), line);
+        const size_t block = static_cast<size_t>(it - starts.begin()) - 1;
+        return {block, line - starts[block]};
+    }
+
+    LineStore::Block& LineStore::touch(const size_t block) const {
+        Block& b = *blocks[block];
+
+        if (!b.hot) {
+            unpack(b);
+            hotList.push_back(&b);
+            evict();
+        } else if (hotList.back() != &b) {
+            const auto it = std::find(hotList.begin(), hotList.end(), &b);
+            std::rotate(it, it + 1, hotList.end());
+        }
+
+        return b;
+    }
+
+    void LineStore::evict() const {
+        while (hotList.size() > HOT_BLOCKS) {
+            Block* victim = hotList.front();
+            hotList.erase(hotList.begin());
+            pack(*victim);
+        }
+    }
+
+    void LineStore::forget(const Block* block) const {
+        const auto it = std::find(hotList.begin(), hotList.end(), block);
+        if (it != hotList.end()) hotList.erase(it);
+    }
+
+    void LineStore::invalidateFrom(const size_t block) const {
+        validStarts = std::min(validStarts, block);
+    }
+
+    void LineStore::encode(Block& block) {
+        if (!block.dirty) return;
+
+        std::string text;
+        size_t unpacked = block.lines.size() * sizeof(std::string);
+        for (const std::string& line : block.lines) {
+            text += line;
+            text += '\n';
+            unpacked += heapBytes(line);
+        }
+
+        // A fresh string each time: slices may still share the old one
+        std::string packed = lzCompress(text);
+        packed.shrink_to_fit();
+        block.packed = std::make_shared<const std::string>(std::move(packed));
+        block.textBytes = text.size() - block.lines.size();
+        block.unpackedBytes = unpacked;
+        block.dirty = false;
+    }
+
+    void LineStore::pack(Block& block) {
+        encode(block);
+        std::vector<std::string>().swap(block.lines);
+        block.hot = false;
+    }
+
+    void LineStore::unpack(Block& block) {
+        block.lines.reserve(block.count);
+        unpackLines(*block.packed, block.textBytes, 0, block.count, block.lines);
+
+        block.hot = true;
+        block.dirty = false;
+    }
+
+    LineSlice LineStore::slice(size_t at, const size_t count) const {
+        const size_t end = std::min(at + count, total);
+        LineSlice out;
+
+        while (at < end) {
+            const auto [block, offset] = locate(at);
+            Block& b = *blocks[block];
+            const size_t n = std::min(end - at, b.count - offset);
+
+            LineSlice::Piece piece;
+            piece.count = n;
+            if (n == b.count) {
+                // Share the whole block; a modified hot block is packed first
+                encode(b);
+                piece.packed = b.packed;
+                piece.textBytes = b.textBytes;
+                piece.unpackedBytes = b.unpackedBytes;
+            } else if (b.hot) {
+                const auto first = b.lines.begin() + static_cast<long>(offset);
+                piece.lines.assign(first, first + static_cast<long>(n));
+            } else {
+                piece.lines.reserve(n);
+                unpackLines(*b.packed, b.textBytes, offset, offset + n, piece.lines);
+            }
+
+            out.pieces.push_back(std::move(piece));
+            out.total += n;
+            at += n;
+        }
+        return out;
+    }
+
+    LineSlice LineStore::cut(const size_t at, size_t count) {
+        ++revisionCount;
+        LineSlice out;
+
+        while (count > 0 && at < total) {
+            const auto [block, offset] = locate(at);
+            Block& b = *blocks[block];
+            const size_t n = std::min(count, b.count - offset);
+
+            LineSlice::Piece piece;
+            piece.count = n;
+            if (n == b.count) {
+                // Whole blocks move over as they are, packed or not
+                if (b.hot && b.dirty) {
+                    piece.lines = std::move(b.lines);
+                } else {
+                    piece.packed = b.packed;
+                    piece.textBytes = b.textBytes;
+                    piece.unpackedBytes = b.unpackedBytes;
+                }
+                removeBlock(block);
+            } else {
+                touch(block);
+                b.dirty = true;
+                const auto first = b.lines.begin() + static_cast<long>(offset);
+                const auto last = first + static_cast<long>(n);
+                piece.lines.assign(std::make_move_iterator(first), std::make_move_iterator(last));
+                b.lines.erase(first, last);
+                b.count -= n;
+                invalidateFrom(block + 1);
+            }
+
+            out.pieces.push_back(std::move(piece));
+            out.total += n;
+            total -= n;
+            count -= n;
+        }
+        return out;
+    }
+
+    void LineStore::splice(size_t at, const LineSlice& lines) {
+        ++revisionCount;
+        std::vector<std::unique_ptr<Block>> shared;
+
+        // Runs of shared blocks go in with one insert into the block table
+        auto flush = [&] {
+            if (shared.empty()) return;
+            const size_t block = splitAt(at);
+            size_t added = 0;
+            for (const auto& b : shared) added += b->count;
+
+            blocks.insert(blocks.begin() + static_cast<long>(block),
+                          std::make_move_iterator(shared.begin()), std::make_move_iterator(shared.end()));
+            invalidateFrom(block);
+            total += added;
+            at += added;
+            shared.clear();
+        };
+
+        for (const LineSlice::Piece& piece : lines.pieces) {
+            if (piece.packed) {
+                auto block = std::make_unique<Block>();
+                block->packed = piece.packed;
+                block->count = piece.count;
+                block->textBytes = piece.textBytes;
+                block->unpackedBytes = piece.unpackedBytes;
+                block->dirty = false;
+                shared.push_back(std::move(block));
+            } else {
+                flush();
+                insertLines(at, std::vector<std::string>(piece.lines));
+                at += piece.count;
+            }
+        }
+        flush();
+    }
+
+    size_t LineStore::splitAt(const size_t at) {
+        if (at >= total) return blocks.size();
+
+        const auto [block, offset] = locate(at);
+        if (offset == 0) return block;
+
+        Block& b = touch(block);
+        b.dirty = true;
+
+        auto tail = std::make_unique<Block>();
+        tail->lines.assign(std::make_move_iterator(b.lines.begin() + static_cast<long>(offset)),
+                           std::make_move_iterator(b.lines.end()));
+        tail->count = b.count - offset;
+        tail->hot = true;
+        b.lines.erase(b.lines.begin() + static_cast<long>(offset), b.lines.end());
+        b.count = offset;
+
+        hotList.push_back(tail.get());
+        blocks.insert(blocks.begin() + static_cast<long>(block + 1), std::move(tail));
+        invalidateFrom(block + 1);
+        evict();
+        return block + 1;
+    }
+
+    void LineStore::insertLine(const size_t at, std::string&& line) {
+        ++revisionCount;
+        if (blocks.empty() || (at == total && blocks.back()->count >= BLOCK_LINES)) {
+            std::vector<std::string> more;
+            more.push_back(std::move(line));
+            insertLines(at, std::move(more));
+            return;
+        }
+
+        // A single line goes straight into its block, without a temporary vector
+        const auto [block, offset] = locate(at);
+        Block& b = touch(block);
+        b.dirty = true;
+        b.lines.insert(b.lines.begin() + static_cast<long>(offset), std::move(line));
+        ++b.count;
+        ++total;
+        invalidateFrom(block + 1);
+
+        if (b.count > 2 * BLOCK_LINES) {
+            split(block);
+        }
+    }
+
+    void LineStore::insertLines(size_t at, std::vector<std::string>&& more) {
+        ++revisionCount;
+        if (more.empty()) return;
+
+        const size_t n = more.size();
+        size_t block;
+        size_t offset;
+
+        if (blocks.empty() || (at == total && blocks.back()->count >= BLOCK_LINES)) {
+            // Start a fresh block at the end, split below if it's too big
+            auto fresh = std::make_unique<Block>();
+            fresh->hot = true;
+            hotList.push_back(fresh.get());
+            blocks.push_back(std::move(fresh));
+            block = blocks.size() - 1;
+            offset = 0;
+            invalidateFrom(block);
+            evict();
+        } else {
+            std::tie(block, offset) = locate(at);
+            touch(block);
+        }
+
+        Block& b = *blocks[block];
+        b.dirty = true;
+        if (b.lines.empty()) {
+            b.lines = std::move(more);
+        } else {
+            b.lines.insert(b.lines.begin() + static_cast<long>(offset),
+                           std::make_move_iterator(more.begin()), std::make_move_iterator(more.end()));
+        }
+        b.count += n;
+        total += n;
+        invalidateFrom(block + 1);
+
+        if (b.count > 2 * BLOCK_LINES) {
+            split(block);
+        }
+    }
+
+    void LineStore::split(const size_t block) {
+        std::unique_ptr<Block> whole = std::move(blocks[block]);
+        forget(whole.get());
+
+        std::vector<std::unique_ptr<Block>> pieces;
+        for (size_t from = 0; from < whole->count; from += BLOCK_LINES) {
+            const size_t to = std::min(from + BLOCK_LINES, whole->count);
+            auto piece = std::make_unique<Block>();
+            piece->lines.assign(std::make_move_iterator(whole->lines.begin() + static_cast<long>(from)),
+                                std::make_move_iterator(whole->lines.begin() + static_cast<long>(to)));
+            piece->count = to - from;
+            piece->hot = true;
+            hotList.push_back(piece.get());
+            pieces.push_back(std::move(piece));
+        }
+
+        blocks.erase(blocks.begin() + static_cast<long>(block));
+        blocks.insert(blocks.begin() + static_cast<long>(block),
+                      std::make_move_iterator(pieces.begin()), std::make_move_iterator(pieces.end()));
+        invalidateFrom(block);
+        evict();
+    }
+
+    void LineStore::removeBlock(const size_t block) {
+        forget(blocks[block].get());
+        blocks.erase(blocks.begin() + static_cast<long>(block));
+        starts.resize(blocks.size());
+        invalidateFrom(block);
+    }
+
+    void LineStore::eraseLines(const size_t at, size_t count) {
+        ++revisionCount;
+        while (count > 0 && at < total) {
+            const auto [block, offset] = locate(at);
+            Block& b = *blocks[block];
+            const size_t n = std::min(count, b.count - offset);
+
+            if (n == b.count) {
+                // Whole blocks go without being unpacked
+                total -= n;
+                count -= n;
+                removeBlock(block);
+                continue;
+            }
+
+            touch(block);
+            b.dirty = true;
+            b.lines.erase(b.lines.begin() + static_cast<long>(offset),
+                          b.lines.begin() + static_cast<long>(offset + n));
+            b.count -= n;
+            total -= n;
+            count -= n;
+            invalidateFrom(block + 1);
+        }
+    }
+
+    void LineStore::resize(const size_t count) {
+        if (count < total) {
+            eraseLines(count, total - count);
+        } else if (count > total) {
+            append(std::vector<std::string>(count - total));
+        }
+    }
+
+    void LineStore::clear() {
+        ++revisionCount;
+        blocks.clear();
+        hotList.clear();
+        starts.clear();
+        validStarts = 0;
+        total = 0;
+    }
+
+    void LineStore::release() {
+        for (Block* block : hotList) pack(*block);
+        std::vector<Block*>().swap(hotList);
+    }
+
+    LineStore::Stats LineStore::stats() const {
+        Stats result;
+        result.lines = total;
+        result.blocks = blocks.size();
+        result.indexBytes = blocks.capacity() * sizeof(blocks[0]) + blocks.size() * sizeof(Block) +
+                            starts.capacity() * sizeof(size_t) + hotList.capacity() * sizeof(Block*);
+
+        for (const auto& block : blocks) {
+            if (block->packed) result.packedBytes += block->packed->capacity();
+
+            if (!block->hot) {
+                result.textBytes += block->textBytes;
+                result.unpackedBytes += block->unpackedBytes;
+                continue;
+            }
+
+            ++result.hotBlocks;
+            size_t strings = block->lines.size() * sizeof(std::string);
+            size_t slack = (block->lines.capacity() - block->lines.size()) * sizeof(std::string);
+            for (const std::string& line : block->lines) {
+                result.textBytes += line.size();
+                if (heapBytes(line) > 0) {
+                    strings += line.size() + 1;
+                    slack += line.capacity() - line.size();
+                }
+            }
+            result.stringBytes += strings;
+            result.slackBytes += slack;
+            result.unpackedBytes += strings + slack;
+        }
+
+        result.residentBytes = result.stringBytes + result.slackBytes + result.packedBytes + result.indexBytes;
+        return result;
+    }
+
+    bool operator==(const LineStore& store, const std::vector<std::string>& other) {
+        if (store.size() != other.size()) return false;
+
+        for (size_t i = 0; i < other.size(); ++i) {
+            if (store[i] != other[i]) return false;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,257 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace QEditor {
+    class LineStore;
+
+    // Lines taken out of a LineStore. Whole blocks are kept in their packed
+    // form and shared with the store they came from, so a slice of a million
+    // lines costs a few pointers; only a partial block at either end is
+    // copied. Packed text is immutable, so editing the store afterwards
+    // never changes the slice.
+    class LineSlice {
+    public:
+        LineSlice() = default;
+        LineSlice(std::vector<std::string> lines);
+
+        [[nodiscard]] size_t size() const { return total; }
+        [[nodiscard]] bool empty() const { return total == 0; }
+
+        // The lines as plain strings, decoding shared blocks
+        [[nodiscard]] std::vector<std::string> lines() const&;
+        // Same, moving the plain lines out rather than copying them
+        [[nodiscard]] std::vector<std::string> lines() &&;
+
+        // The slice a piece at a time. A shared block's key stays the same
+        // for as long as its text does, so whatever a reader derives from
+        // the lines can be cached against it; copied lines have no key.
+        [[nodiscard]] size_t pieceCount() const { return pieces.size(); }
+        [[nodiscard]] std::shared_ptr<const void> pieceKey(const size_t piece) const { return pieces[piece].packed; }
+        [[nodiscard]] size_t pieceSize(const size_t piece) const { return pieces[piece].count; }
+        // A piece's lines as one string, each followed by '\n'
+        void pieceText(size_t piece, std::string& text) const;
+
+        // Heap bytes held, counting shared blocks in full
+        [[nodiscard]] size_t memoryUsage() const;
+
+        friend bool operator==(const LineSlice& slice, const std::vector<std::string>& other) {
+            return slice.lines() == other;
+        }
+
+    private:
+        friend class LineStore;
+
+        struct Piece {
+            std::shared_ptr<const std::string> packed; // a whole block, when set
+            std::vector<std::string> lines;            // otherwise
+            size_t count = 0;
+            size_t textBytes = 0;
+            size_t unpackedBytes = 0;
+        };
+
+        std::vector<Piece> pieces;
+        size_t total = 0;
+    };
+
+    // Line storage for the edit buffer. Lines are grouped into blocks; the
+    // most recently used blocks are kept as plain strings and the rest are
+    // packed with lzCompress, so a huge file that is mostly never touched
+    // costs a fraction of its std::string footprint.
+    //
+    // The interface follows std::vector<std::string>. A reference to a line
+    // stays valid until the store is modified or HOT_BLOCKS other blocks
+    // have been accessed.
+    class LineStore {
+    public:
+        static constexpr size_t BLOCK_LINES = 512;
+        static constexpr size_t HOT_BLOCKS = 32;
+
+        template <class Store, class Ref>
+        class Iterator {
+        public:
+            using iterator_category = std::random_access_iterator_tag;
+            using value_type = std::string;
+            using difference_type = std::ptrdiff_t;
+            using pointer = std::remove_reference_t<Ref>*;
+            using reference = Ref;
+
+            Iterator() = default;
+            Iterator(Store* store, const size_t index) : store(store), index(index) {}
+
+            // iterator converts to const_iterator
+            template <class S, class R, class = std::enable_if_t<std::is_convertible_v<S*, Store*>>>
+            Iterator(const Iterator<S, R>& other) : store(other.getStore()), index(other.position()) {}
+
+            reference operator*() const { return (*store)[index]; }
+            pointer operator->() const { return &(*store)[index]; }
+            reference operator[](const difference_type n) const { return (*store)[index + n]; }
+
+            Iterator& operator++() { ++index; return *this; }
+            Iterator& operator--() { --index; return *this; }
+            Iterator operator++(int) { Iterator old = *this; ++index; return old; }
+            Iterator operator--(int) { Iterator old = *this; --index; return old; }
+            Iterator& operator+=(const difference_type n) { index += n; return *this; }
+            Iterator& operator-=(const difference_type n) { index -= n; return *this; }
+
+            friend Iterator operator+(Iterator it, const difference_type n) { return it += n; }
+            friend Iterator operator+(const difference_type n, Iterator it) { return it += n; }
+            friend Iterator operator-(Iterator it, const difference_type n) { return it -= n; }
+            friend difference_type operator-(const Iterator& a, const Iterator& b) {
+                return static_cast<difference_type>(a.index) - static_cast<difference_type>(b.index);
+            }
+
+            friend bool operator==(const Iterator& a, const Iterator& b) { return a.index == b.index; }
+            friend bool operator!=(const Iterator& a, const Iterator& b) { return a.index != b.index; }
+            friend bool operator<(const Iterator& a, const Iterator& b) { return a.index < b.index; }
+            friend bool operator>(const Iterator& a, const Iterator& b) { return a.index > b.index; }
+            friend bool operator<=(const Iterator& a, const Iterator& b) { return a.index <= b.index; }
+            friend bool operator>=(const Iterator& a, const Iterator& b) { return a.index >= b.index; }
+
+            [[nodiscard]] Store* getStore() const { return store; }
+            [[nodiscard]] size_t position() const { return index; }
+
+        private:
+            Store* store = nullptr;
+            size_t index = 0;
+        };
+
+        using value_type = std::string;
+        using size_type = size_t;
+        using difference_type = std::ptrdiff_t;
+        using iterator = Iterator<LineStore, std::string&>;
+        using const_iterator = Iterator<const LineStore, const std::string&>;
+
+        struct Stats {
+            size_t lines = 0;
+            size_t blocks = 0;
+            size_t hotBlocks = 0;
+            size_t textBytes = 0;     // line contents alone
+            size_t stringBytes = 0;   // hot lines: std::string headers plus heap text
+            size_t slackBytes = 0;    // hot lines: unused vector and string capacity
+            size_t packedBytes = 0;   // compressed blocks
+            size_t indexBytes = 0;    // block table and bookkeeping
+            size_t residentBytes = 0; // everything above that the store holds
+            size_t unpackedBytes = 0; // what the same lines cost as plain strings
+        };
+
+        LineStore() = default;
+        LineStore(LineStore&& other) noexcept;
+        LineStore& operator=(LineStore&& other) noexcept;
+        LineStore& operator=(std::vector<std::string>&& lines);
+
+        [[nodiscard]] size_t size() const { return total; }
+        [[nodiscard]] bool empty() const { return total == 0; }
+
+        std::string& operator[](size_t line);
+        const std::string& operator[](size_t line) const;
+        std::string& back() { return (*this)[total - 1]; }
+        [[nodiscard]] const std::string& back() const { return (*this)[total - 1]; }
+
+        iterator begin() { return {this, 0}; }
+        iterator end() { return {this, total}; }
+        [[nodiscard]] const_iterator begin() const { return {this, 0}; }
+        [[nodiscard]] const_iterator end() const { return {this, total}; }
+
+        void push_back(std::string line) { insertLine(total, std::move(line)); }
+        template <class... Args>
+        std::string& emplace_back(Args&&... args) {
+            insertLine(total, std::string(std::forward<Args>(args)...));
+            return back();
+        }
+
+        iterator insert(const const_iterator pos, std::string line) {
+            insertLine(pos.position(), std::move(line));
+            return {this, pos.position()};
+        }
+        template <class It>
+        iterator insert(const const_iterator pos, It first, It last) {
+            insertLines(pos.position(), std::vector<std::string>(first, last));
+            return {this, pos.position()};
+        }
+
+        iterator erase(const const_iterator first, const const_iterator last) {
+            eraseLines(first.position(), last.position() - first.position());
+            return {this, first.position()};
+        }
+        iterator erase(const const_iterator pos) { return erase(pos, pos + 1); }
+
+        // Move the given lines onto the end, in whole blocks where possible
+        void append(std::vector<std::string>&& more) { insertLines(total, std::move(more)); }
+
+        // Lines [at, at + count), sharing whole blocks rather than copying them
+        [[nodiscard]] LineSlice slice(size_t at, size_t count) const;
+
+        // Erase lines [at, at + count) and hand them back, blocks and all
+        LineSlice cut(size_t at, size_t count);
+
+        // Insert a slice before line `at`. Shared blocks go in as they are,
+        // so the cost is in blocks rather than bytes.
+        void splice(size_t at, const LineSlice& lines);
+
+        void resize(size_t count);
+        void clear();
+        // Pack every hot block, for a store that won't be read for a while
+        void release();
+
+        [[nodiscard]] Stats stats() const;
+
+        // Changes whenever the contents may have, including on every
+        // non-const operator[]
+        [[nodiscard]] uint64_t revision() const { return revisionCount; }
+
+        friend bool operator==(const LineStore& store, const std::vector<std::string>& other);
+        friend bool operator!=(const LineStore& store, const std::vector<std::string>& other) {
+            return !(store == other);
+        }
+
+    private:
+        struct Block {
+            std::vector<std::string> lines;             // contents while hot
+            std::shared_ptr<const std::string> packed;  // compressed contents, kept while hot until the block is modified
+            size_t count = 0;
+            size_t textBytes = 0;     // as of the last pack
+            size_t unpackedBytes = 0; // as of the last pack
+            bool hot = false;
+            bool dirty = true;        // lines no longer match packed
+        };
+
+        void insertLine(size_t at, std::string&& line);
+        void insertLines(size_t at, std::vector<std::string>&& more);
+        void eraseLines(size_t at, size_t count);
+
+        // Block holding the line and the line's offset inside it
+        std::pair<size_t, size_t> locate(size_t line) const;
+        Block& touch(size_t block) const;
+        void split(size_t block);
+        void removeBlock(size_t block);
+        void forget(const Block* block) const;
+        void invalidateFrom(size_t block) const;
+        void evict() const;
+
+        // First block starting at line `at`, splitting the block there if needed
+        size_t splitAt(size_t at);
+
+        static void encode(Block& block);
+        static void pack(Block& block);
+        static void unpack(Block& block);
+
+        std::vector<std::unique_ptr<Block>> blocks;
+        size_t total = 0;
+
+        // starts[i] is the first line of block i, valid below validStarts
+        mutable std::vector<size_t> starts;
+        mutable size_t validStarts = 0;
+
+        // Hot blocks, least recently used first
+        mutable std::vector<Block*> hotList;
+
+        uint64_t revisionCount = 0;
+    };
+}
@@ -0,0 +1,134 @@
+#include "LzCodec.h"
+#include "EditorError.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace QEditor {
+    namespace {
+        constexpr size_t MIN_MATCH = 4;
+        constexpr size_t MAX_OFFSET = 65535;
+        constexpr int HASH_BITS = 14;
+
+        uint32_t read32(const char* p) {
+            uint32_t v;
+            std::memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        uint32_t hash(const uint32_t v) {
+            return (v * 2654435761u) >> (32 - HASH_BITS);
+        }
+
+        // Lengths past the 4-bit token field continue in bytes of 255
+        void writeLength(std::string& out, size_t length) {
+            while (length >= 255) {
+                out += static_cast<char>(255);
+                length -= 255;
+            }
+            out += static_cast<char>(length);
+        }
+
+        void writeSequence(std::string& out, const char* literals, const size_t literalCount,
+                           const size_t offset, const size_t matchLength) {
+            const size_t matchCode = matchLength ? matchLength - MIN_MATCH : 0;
+            const auto token = static_cast<uint8_t>((std::min<size_t>(literalCount, 15) << 4) |
+                                                    std::min<size_t>(matchCode, 15));
+            out += static_cast<char>(token);
+            if (literalCount >= 15) writeLength(out, literalCount - 15);
+            out.append(literals, literalCount);
+
+            // The final sequence carries literals only
+            if (matchLength == 0) return;
+
+            out += static_cast<char>(offset & 0xff);
+            out += static_cast<char>(offset >> 8);
+            if (matchCode >= 15) writeLength(out, matchCode - 15);
+        }
+
+        size_t readLength(const uint8_t*& p, const uint8_t* end) {
+            size_t length = 0;
+            uint8_t byte;
+            do {
+                if (p == end) throw BufferError("corrupt compressed block");
+                byte = *p++;
+                length += byte;
+            } while (byte == 255);
+            return length;
+        }
+    }
+
+    std::string lzCompress(const std::string_view in) {
+        std::string out;
+        out.reserve(in.size() / 2 + 16);
+
+        const char* base = in.data();
+        const size_t n = in.size();
+        std::vector<uint32_t> table(size_t{1} << HASH_BITS, 0);
+
+        size_t anchor = 0;
+        size_t i = 0;
+        while (i + MIN_MATCH <= n) {
+            const uint32_t v = read32(base + i);
+            uint32_t& slot = table[hash(v)];
+            const size_t candidate = slot;
+            slot = static_cast<uint32_t>(i);
+
+            if (candidate < i && i - candidate <= MAX_OFFSET && read32(base + candidate) == v) {
+                size_t length = MIN_MATCH;
+                while (i + length < n && base[candidate + length] == base[i + length]) {
+                    ++length;
+                }
+
+                writeSequence(out, base + anchor, i - anchor, i - candidate, length);
+                i += length;
+                anchor = i;
+            } else {
+                ++i;
+            }
+        }
+
+        writeSequence(out, base + anchor, n - anchor, 0, 0);
+        return out;
+    }
+
+    void lzDecompress(const std::string_view in, std::string& out) {
+        const auto* p = reinterpret_cast<const uint8_t*>(in.data());
+        const uint8_t* end = p + in.size();
+
+        while (p < end) {
+            const uint8_t token = *p++;
+
+            size_t literals = token >> 4;
+            if (literals == 15) literals += readLength(p, end);
+            if (static_cast<size_t>(end - p) < literals) throw BufferError("corrupt compressed block");
+            out.append(reinterpret_cast<const char*>(p), literals);
+            p += literals;
+
+            if (p == end) break;
+
+            if (end - p < 2) throw BufferError("corrupt compressed block");
+            const size_t offset = p[0] | (static_cast<size_t>(p[1]) << 8);
+            p += 2;
+
+            size_t length = token & 15;
+            if (length == 15) length += readLength(p, end);
+            length += MIN_MATCH;
+
+            if (offset == 0 || offset > out.size()) throw BufferError("corrupt compressed block");
+
+            // Overlapping matches repeat their own output and are copied byte by byte
+            size_t from = out.size() - offset;
+            const size_t to = out.size() + length;
+            out.resize(to);
+            if (offset >= length) {
+                std::memcpy(&out[to - length], &out[from], length);
+            } else {
+                for (size_t at = to - length; at < to; ++at, ++from) {
+                    out[at] = out[from];
+                }
+            }
+        }
+    }
+}
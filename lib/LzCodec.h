@@ -0,0 +1,15 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+namespace QEditor {
+    // Small LZ77 codec in the spirit of LZ4: byte-aligned sequences of
+    // literals followed by a back-reference into the last 64KB. Fast enough
+    // to run on every block that falls out of the hot set, and compresses
+    // repetitive text such as logs several times over.
+    std::string lzCompress(std::string_view in);
+
+    // Decode data produced by lzCompress, appending to out
+    void lzDecompress(std::string_view in, std::string& out);
+}
@@ -0,0 +1,202 @@
+#include "PagedFile.h"
+#include "EditorError.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <string_view>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace QEditor {
+    PagedFile::PagedFile(const std::string& path, const size_t maxPages)
+        : path(path), maxPages(std::max<size_t>(maxPages, 2)) {
+        fd = open(path.c_str(), O_RDONLY);
+        if (fd == -1) {
+            if (errno == EACCES) {
+                throw FilePermissionError(path);
+            }
+            throw FileOpenError(path);
+        }
+
+        struct stat st{};
+        if (fstat(fd, &st) == -1) {
+            close(fd);
+            throw FileOpenError(path);
+        }
+        fileSize = static_cast<uint64_t>(st.st_size);
+        device = st.st_dev;
+        inode = st.st_ino;
+    }
+
+    PagedFile::~PagedFile() {
+        if (fd != -1) {
+            close(fd);
+        }
+    }
+
+    bool PagedFile::refresh() {
+        struct stat st{};
+        if (fstat(fd, &st) == -1) return true;
+
+        const auto newSize = static_cast<uint64_t>(st.st_size);
+        if (newSize < fileSize) {
+            return false;
+        }
+
+        // The page holding the old end of file was cached short, drop it
+        if (newSize != fileSize) {
+            if (const auto it = lookup.find(fileSize / PAGE_SIZE); it != lookup.end()) {
+                pages.erase(it->second);
+                lookup.erase(it);
+            }
+            fileSize = newSize;
+        }
+
+        return true;
+    }
+
+    bool PagedFile::isReplaced() const {
+        struct stat st{};
+        return stat(path.c_str(), &st) == 0 && (st.st_ino != inode || st.st_dev != device);
+    }
+
+    const PagedFile::Page& PagedFile::page(const uint64_t index) {
+        if (const auto it = lookup.find(index); it != lookup.end()) {
+            pages.splice(pages.begin(), pages, it->second);
+            return pages.front();
+        }
+
+        // Recycle the least recently used page once the cache is full
+        if (pages.size() >= maxPages) {
+            lookup.erase(pages.back().index);
+            pages.splice(pages.begin(), pages, std::prev(pages.end()));
+        } else {
+            pages.push_front(Page{0, std::vector<char>(PAGE_SIZE), 0});
+        }
+
+        Page& p = pages.front();
+        p.index = index;
+        const ssize_t n = pread(fd, p.data.data(), PAGE_SIZE, static_cast<off_t>(index * PAGE_SIZE));
+        p.length = n > 0 ? static_cast<size_t>(n) : 0;
+        lookup[index] = pages.begin();
+
+        return p;
+    }
+
+    uint64_t PagedFile::lineStart(const uint64_t offset) {
+        uint64_t pos = std::min(offset, fileSize);
+
+        while (pos > 0) {
+            const Page& p = page((pos - 1) / PAGE_SIZE);
+            const size_t end = static_cast<size_t>(pos - p.index * PAGE_SIZE);
+            const auto* hit = static_cast<const char*>(memrchr(p.data.data(), '\n', std::min(end, p.length)));
+            if (hit) {
+                return p.index * PAGE_SIZE + static_cast<uint64_t>(hit - p.data.data()) + 1;
+            }
+            pos = p.index * PAGE_SIZE;
+        }
+
+        return 0;
+    }
+
+    uint64_t PagedFile::nextLineStart(const uint64_t offset) {
+        uint64_t pos = offset;
+
+        while (pos < fileSize) {
+            const Page& p = page(pos / PAGE_SIZE);
+            const size_t start = static_cast<size_t>(pos - p.index * PAGE_SIZE);
+            if (start >= p.length) break;
+
+            const auto* hit = static_cast<const char*>(std::memchr(p.data.data() + start, '\n', p.length - start));
+            if (hit) {
+                return p.index * PAGE_SIZE + static_cast<uint64_t>(hit - p.data.data()) + 1;
+            }
+            pos = (p.index + 1) * PAGE_SIZE;
+        }
+
+        return fileSize;
+    }
+
+    uint64_t PagedFile::prevLineStart(const uint64_t lineStartOffset) {
+        if (lineStartOffset == 0) return 0;
+        return lineStart(lineStartOffset - 1);
+    }
+
+    void PagedFile::readLine(const uint64_t offset, std::string& out, const size_t maxBytes) {
+        out.clear();
+        uint64_t pos = offset;
+
+        while (pos < fileSize && out.size() < maxBytes) {
+            const Page& p = page(pos / PAGE_SIZE);
+            const size_t start = static_cast<size_t>(pos - p.index * PAGE_SIZE);
+            if (start >= p.length) break;
+
+            const size_t avail = std::min(p.length - start, maxBytes - out.size());
+            const char* begin = p.data.data() + start;
+            if (const auto* hit = static_cast<const char*>(std::memchr(begin, '\n', avail))) {
+                out.append(begin, hit);
+                break;
+            }
+            out.append(begin, avail);
+            pos += avail;
+        }
+
+        if (!out.empty() && out.back() == '\r') {
+            out.pop_back();
+        }
+    }
+
+    std::optional<uint64_t> PagedFile::find(const uint64_t from, const std::string& needle) {
+        if (needle.empty() || from >= fileSize) return std::nullopt;
+
+        // Carry the tail of the previous page so matches spanning pages are found
+        std::string window;
+        uint64_t windowStart = from;
+        uint64_t pos = from;
+
+        while (pos < fileSize) {
+            const Page& p = page(pos / PAGE_SIZE);
+            const size_t start = static_cast<size_t>(pos - p.index * PAGE_SIZE);
+            if (start >= p.length) break;
+
+            window.append(p.data.data() + start, p.length - start);
+            if (const size_t hit = window.find(needle); hit != std::string::npos) {
+                return windowStart + hit;
+            }
+
+            const size_t keep = std::min(window.size(), needle.size() - 1);
+            windowStart += window.size() - keep;
+            window.erase(0, window.size() - keep);
+            pos = (p.index + 1) * PAGE_SIZE;
+        }
+
+        return std::nullopt;
+    }
+
+    std::optional<uint64_t> PagedFile::rfind(const uint64_t before, const std::string& needle) {
+        if (needle.empty() || before == 0) return std::nullopt;
+
+        std::string window;
+        uint64_t end = std::min(before + needle.size() - 1, fileSize);
+
+        while (end > 0) {
+            const Page& p = page((end - 1) / PAGE_SIZE);
+            const uint64_t pageStart = p.index * PAGE_SIZE;
+            const size_t len = std::min(static_cast<size_t>(end - pageStart), p.length);
+
+            window.insert(0, p.data.data(), len);
+            // Only accept matches that start before `before`
+            for (size_t hit = window.rfind(needle); hit != std::string::npos;
+                 hit = hit == 0 ? std::string::npos : window.rfind(needle, hit - 1)) {
+                if (pageStart + hit < before) {
+                    return pageStart + hit;
+                }
+            }
+
+            window.resize(std::min(window.size(), needle.size() - 1));
+            end = pageStart;
+        }
+
+        return std::nullopt;
+    }
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <optional>
+#include <string>
+#include <sys/types.h>
+#include <unordered_map>
+#include <vector>
+
+namespace QEditor {
+    // Read-only access to a file through a bounded LRU cache of fixed-size
+    // pages. Memory use is capped at maxPages * PAGE_SIZE regardless of the
+    // file size.
+    class PagedFile {
+    public:
+        static constexpr size_t PAGE_SIZE = 64 * 1024;
+        static constexpr size_t DEFAULT_MAX_PAGES = 256; // 16 MB window
+
+        explicit PagedFile(const std::string& path, size_t maxPages = DEFAULT_MAX_PAGES);
+        ~PagedFile();
+
+        PagedFile(const PagedFile&) = delete;
+        PagedFile& operator=(const PagedFile&) = delete;
+
+        [[nodiscard]] uint64_t size() const { return fileSize; }
+        [[nodiscard]] const std::string& getPath() const { return path; }
+
+        // Pick up a size change of the underlying file. Returns false if
+        // the file shrank, in which case cached pages are no longer valid.
+        bool refresh();
+        // Whether a different file now lives at the path, as after log
+        // rotation. While the path is missing the open file is kept.
+        [[nodiscard]] bool isReplaced() const;
+
+        // Start of the line containing offset
+        uint64_t lineStart(uint64_t offset);
+
+        // Start of the line after the one containing offset, or size() at EOF
+        uint64_t nextLineStart(uint64_t offset);
+
+        // Start of the line before the one starting at lineStartOffset
+        uint64_t prevLineStart(uint64_t lineStartOffset);
+
+        // Copy at most maxBytes of the line starting at offset, without the newline
+        void readLine(uint64_t offset, std::string& out, size_t maxBytes);
+
+        // Offset of the first occurrence of needle at or after `from`
+        std::optional<uint64_t> find(uint64_t from, const std::string& needle);
+
+        // Offset of the last occurrence of needle starting before `before`
+        std::optional<uint64_t> rfind(uint64_t before, const std::string& needle);
+
+        [[nodiscard]] size_t cachedBytes() const { return pages.size() * PAGE_SIZE; }
+
+    private:
+        struct Page {
+            uint64_t index;
+            std::vector<char> data;
+            size_t length;
+        };
+
+        // Fetch a page through the cache, loading it if needed
+        const Page& page(uint64_t index);
+
+        std::string path;
+        int fd = -1;
+        uint64_t fileSize = 0;
+        dev_t device = 0;
+        ino_t inode = 0;
+        size_t maxPages;
+
+        std::list<Page> pages; // front is most recently used
+        std::unordered_map<uint64_t, std::list<Page>::iterator> lookup;
+    };
+}
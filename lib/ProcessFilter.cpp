@@ -0,0 +1,197 @@
+#include "ProcessFilter.h"
+#include "EditorError.h"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace QEditor {
+    namespace {
+        // Pipes are made close-on-exec so other children don't inherit them
+        void makePipe(int fds[2]) {
+            if (pipe(fds) != 0) {
+                throw EditorError(std::string("pipe: ") + std::strerror(errno));
+            }
+            fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+            fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+        }
+
+        void closeFd(int& fd) {
+            if (fd >= 0) close(fd);
+            fd = -1;
+        }
+
+        // Writing to a child that has exited must fail with EPIPE rather
+        // than kill the editor
+        class IgnoreSigpipe {
+        public:
+            IgnoreSigpipe() {
+                struct sigaction ignore {};
+                ignore.sa_handler = SIG_IGN;
+                sigaction(SIGPIPE, &ignore, &saved);
+            }
+            ~IgnoreSigpipe() { sigaction(SIGPIPE, &saved, nullptr); }
+
+        private:
+            struct sigaction saved {};
+        };
+
+        int waitFor(const pid_t pid) {
+            int status = 0;
+            while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+            if (WIFEXITED(status)) return WEXITSTATUS(status);
+            if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+            return -1;
+        }
+
+        // Ask the whole process group to stop, then insist
+        void stop(const pid_t pid) {
+            kill(-pid, SIGTERM);
+            for (int i = 0; i < 20; ++i) {
+                if (waitpid(pid, nullptr, WNOHANG) != 0) return;
+                usleep(10000);
+            }
+            kill(-pid, SIGKILL);
+            while (waitpid(pid, nullptr, 0) < 0 && errno == EINTR) {}
+        }
+    }
+
+    ProcessFilter::Result ProcessFilter::run(const std::string& command, const Source& input, const Sink& output,
+                                             const Progress& progress, const int interruptFd) {
+        int in[2], out[2], err[2];
+        makePipe(in);
+        makePipe(out);
+        makePipe(err);
+
+        const IgnoreSigpipe ignoreSigpipe;
+        const pid_t pid = fork();
+        if (pid < 0) {
+            for (int* fd : {&in[0], &in[1], &out[0], &out[1], &err[0], &err[1]}) closeFd(*fd);
+            throw EditorError(std::string("fork: ") + std::strerror(errno));
+        }
+
+        if (pid == 0) {
+            // Own process group, so cancelling reaches every stage of a pipeline
+            setpgid(0, 0);
+            std::signal(SIGPIPE, SIG_DFL);
+            dup2(in[0], STDIN_FILENO);
+            dup2(out[1], STDOUT_FILENO);
+            dup2(err[1], STDERR_FILENO);
+            execl("/bin/sh", "sh", "-c", command.c_str(), static_cast<char*>(nullptr));
+            _exit(127);
+        }
+        setpgid(pid, pid);
+
+        closeFd(in[0]);
+        closeFd(out[1]);
+        closeFd(err[1]);
+        int toChild = in[1];
+        int fromChild = out[0];
+        int errorsFromChild = err[0];
+        fcntl(toChild, F_SETFL, O_NONBLOCK);
+
+        try {
+            return pump(pid, toChild, fromChild, errorsFromChild, input, output, progress, interruptFd);
+        } catch (...) {
+            // A callback failed; don't leave the child behind
+            for (int* fd : {&toChild, &fromChild, &errorsFromChild}) closeFd(*fd);
+            stop(pid);
+            throw;
+        }
+    }
+
+    ProcessFilter::Result ProcessFilter::pump(const pid_t pid, int& toChild, int& fromChild, int& errorsFromChild,
+                                              const Source& input, const Sink& output, const Progress& progress,
+                                              const int interruptFd) {
+        Result result;
+        std::string pending; // input not yet taken by the child
+        size_t written = 0;
+        bool more = true;
+        std::string line;
+        char buffer[CHUNK_BYTES];
+
+        while (fromChild >= 0 || errorsFromChild >= 0) {
+            // Top up the input only when the last chunk has gone
+            if (toChild >= 0 && written == pending.size()) {
+                pending.clear();
+                written = 0;
+                while (more && pending.size() < CHUNK_BYTES) {
+                    more = input(pending);
+                }
+                if (pending.empty()) closeFd(toChild);
+            }
+
+            pollfd fds[4];
+            nfds_t count = 0;
+            for (const int fd : {fromChild, errorsFromChild}) {
+                if (fd >= 0) fds[count++] = {fd, POLLIN, 0};
+            }
+            if (toChild >= 0) fds[count++] = {toChild, POLLOUT, 0};
+            if (interruptFd >= 0) fds[count++] = {interruptFd, POLLIN, 0};
+
+            if (poll(fds, count, 100) < 0 && errno != EINTR) break;
+
+            if (!progress()) {
+                for (int* fd : {&toChild, &fromChild, &errorsFromChild}) closeFd(*fd);
+                stop(pid);
+                result.cancelled = true;
+                return result;
+            }
+
+            for (nfds_t i = 0; i < count; ++i) {
+                if (!fds[i].revents || fds[i].fd == interruptFd) continue;
+
+                if (fds[i].fd == toChild) {
+                    const ssize_t n = write(toChild, pending.data() + written, pending.size() - written);
+                    if (n > 0) {
+                        written += static_cast<size_t>(n);
+                    } else if (n < 0 && errno != EAGAIN && errno != EINTR) {
+                        // The child stopped reading; what it wrote so far still counts
+                        closeFd(toChild);
+                    }
+                    continue;
+                }
+
+                const ssize_t n = read(fds[i].fd, buffer, sizeof(buffer));
+                if (n < 0 && (errno == EAGAIN || errno == EINTR)) continue;
+
+                if (fds[i].fd == errorsFromChild) {
+                    if (n <= 0) {
+                        closeFd(errorsFromChild);
+                    } else if (result.errors.size() < MAX_ERROR_BYTES) {
+                        result.errors.append(buffer, std::min<size_t>(static_cast<size_t>(n), MAX_ERROR_BYTES - result.errors.size()));
+                    }
+                    continue;
+                }
+
+                if (n <= 0) {
+                    closeFd(fromChild);
+                    continue;
+                }
+
+                // Hand on each complete line, keep the partial one for later
+                const char* p = buffer;
+                const char* end = buffer + n;
+                while (const void* newline = std::memchr(p, '\n', static_cast<size_t>(end - p))) {
+                    const auto* stop = static_cast<const char*>(newline);
+                    line.append(p, static_cast<size_t>(stop - p));
+                    output(std::move(line));
+                    line.clear();
+                    p = stop + 1;
+                }
+                line.append(p, static_cast<size_t>(end - p));
+            }
+        }
+
+        if (!line.empty()) output(std::move(line));
+        closeFd(toChild);
+        closeFd(fromChild);
+        closeFd(errorsFromChild);
+        result.status = waitFor(pid);
+        return result;
+    }
+}
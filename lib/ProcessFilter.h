@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <sys/types.h>
+
+namespace QEditor {
+    // Runs a shell command with its stdin, stdout and stderr on pipes and
+    // drives all three from one poll loop, so a child that writes before it
+    // has read everything can't deadlock against us. Input is pulled in
+    // chunks as the pipe drains and output is handed on line by line, which
+    // keeps the text in flight to a few pipe buffers.
+    class ProcessFilter {
+    public:
+        static constexpr size_t CHUNK_BYTES = 64 * 1024;
+        static constexpr size_t MAX_ERROR_BYTES = 4096;
+
+        // Append the next piece of input to chunk; false once there is no more
+        using Source = std::function<bool(std::string& chunk)>;
+        using Sink = std::function<void(std::string&& line)>;
+        // Called whenever the loop wakes, including when interruptFd becomes
+        // readable; returning false kills the child
+        using Progress = std::function<bool()>;
+
+        struct Result {
+            int status = 0;       // exit status, or 128 + signal
+            std::string errors;   // the start of what the child wrote to stderr
+            bool cancelled = false;
+        };
+
+        // sh -c command. interruptFd (-1 for none) only wakes the loop, it is
+        // never read here.
+        static Result run(const std::string& command, const Source& input, const Sink& output,
+                          const Progress& progress, int interruptFd = -1);
+
+    private:
+        static Result pump(pid_t pid, int& toChild, int& fromChild, int& errorsFromChild, const Source& input,
+                           const Sink& output, const Progress& progress, int interruptFd);
+    };
+}
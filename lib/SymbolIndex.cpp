@@ -0,0 +1,1039 @@
+#include "SymbolIndex.h"
+#include "FileIdentity.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+
+namespace fs = std::filesystem;
+
+namespace QEditor {
+    namespace {
+        constexpr char MAGIC[8] = {'Q', 'E', 'D', 'T', 'A', 'G', '\0', '\0'};
+        constexpr uint32_t VERSION = 1;
+        constexpr const char* SUFFIX = ".tags";
+
+        struct Header {
+            char magic[8];
+            uint32_t version;
+            uint32_t fromTags; // read from a tags file rather than scanned
+            uint64_t files;
+            uint64_t symbols;
+            uint64_t stringBytes;
+            uint64_t tagsSize;
+            int64_t tagsMtimeSec;
+            int64_t tagsMtimeNsec;
+            uint64_t rootLength; // the indexed root follows, padded to 8 bytes
+        };
+
+        struct FileEntry {
+            uint64_t path; // offset into the strings
+            uint32_t pathLength;
+            uint32_t unused;
+            uint64_t size;
+            int64_t mtimeSec;
+            int64_t mtimeNsec;
+        };
+
+        struct SymbolEntry {
+            uint64_t name;
+            uint32_t nameLength;
+            uint32_t file;
+            uint32_t line;
+            uint32_t unused;
+        };
+
+        uint64_t fnv1a(const char* data, const size_t size) {
+            uint64_t hash = 14695981039346656037ull;
+            for (size_t i = 0; i < size; ++i) {
+                hash = (hash ^ static_cast<unsigned char>(data[i])) * 1099511628211ull;
+            }
+            return hash;
+        }
+
+        std::string absolute(const std::string& path) {
+            char* resolved = realpath(path.c_str(), nullptr);
+            if (!resolved) return path;
+
+            std::string result(resolved);
+            std::free(resolved);
+            return result;
+        }
+
+        size_t padded(const size_t bytes) {
+            return (bytes + 7) & ~size_t{7};
+        }
+
+        bool writeAll(const int fd, const void* data, size_t size) {
+            const auto* p = static_cast<const char*>(data);
+            while (size > 0) {
+                const ssize_t n = write(fd, p, size);
+                if (n < 0) {
+                    if (errno == EINTR) continue;
+                    return false;
+                }
+                p += n;
+                size -= static_cast<size_t>(n);
+            }
+            return true;
+        }
+
+        bool readFile(const std::string& path, std::string& text) {
+            const int fd = open(path.c_str(), O_RDONLY);
+            if (fd == -1) return false;
+
+            struct stat st{};
+            bool ok = fstat(fd, &st) == 0;
+            text.resize(ok ? static_cast<size_t>(st.st_size) : 0);
+            size_t got = 0;
+            while (ok && got < text.size()) {
+                const ssize_t n = read(fd, text.data() + got, text.size() - got);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) break;
+                got += static_cast<size_t>(n);
+            }
+            close(fd);
+            text.resize(got);
+            return ok;
+        }
+
+        // Tokens of C and C++ source, with comments, whitespace and
+        // preprocessor lines dropped. Names of #defines go straight to out.
+        class Lexer {
+        public:
+            enum Kind { End, Name, Punct, Literal };
+
+            struct Token {
+                Kind kind = End;
+                std::string_view text;
+                uint32_t line = 0;
+            };
+
+            Lexer(const std::string_view text, std::vector<Definition>& out) : text(text), out(out) {}
+
+            Token next() {
+                while (i < text.size()) {
+                    const char c = text[i];
+                    if (c == '\n') {
+                        ++line;
+                        ++i;
+                        lineStart = true;
+                    } else if (c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v') {
+                        ++i;
+                    } else if (c == '\\' && i + 1 < text.size() && text[i + 1] == '\n') {
+                        i += 2;
+                        ++line;
+                    } else if (c == '/' && peek(1) == '/') {
+                        skipLineComment();
+                    } else if (c == '/' && peek(1) == '*') {
+                        skipBlockComment();
+                    } else if (c == '#' && lineStart) {
+                        directive();
+                    } else {
+                        lineStart = false;
+                        return token();
+                    }
+                }
+                return {End, {}, line};
+            }
+
+        private:
+            static bool isNameStart(const char c) {
+                const auto u = static_cast<unsigned char>(c);
+                return (u >= 'a' && u <= 'z') || (u >= 'A' && u <= 'Z') || u == '_' || u >= 0x80;
+            }
+
+            static bool isNameChar(const char c) {
+                return isNameStart(c) || (c >= '0' && c <= '9');
+            }
+
+            [[nodiscard]] char peek(const size_t ahead) const {
+                return i + ahead < text.size() ? text[i + ahead] : '\0';
+            }
+
+            void skipLineComment() {
+                while (i < text.size() && text[i] != '\n') ++i;
+            }
+
+            void skipBlockComment() {
+                i += 2;
+                while (i < text.size() && !(text[i] == '*' && peek(1) == '/')) {
+                    if (text[i] == '\n') ++line;
+                    ++i;
+                }
+                i = std::min(i + 2, text.size());
+            }
+
+            // A quoted literal, ending at its closing quote or the end of the line
+            void skipQuoted(const char quote) {
+                ++i;
+                while (i < text.size() && text[i] != quote && text[i] != '\n') {
+                    if (text[i] == '\\' && i + 1 < text.size()) {
+                        if (text[i + 1] == '\n') ++line;
+                        ++i;
+                    }
+                    ++i;
+                }
+                if (i < text.size() && text[i] == quote) ++i;
+            }
+
+            // R"delim( ... )delim", i at the opening quote
+            void skipRaw() {
+                const size_t open = text.find('(', i);
+                if (open == std::string_view::npos || open - i > 17) {
+                    skipQuoted('"');
+                    return;
+                }
+                const std::string close = ")" + std::string(text.substr(i + 1, open - i - 1)) + "\"";
+                const size_t end = text.find(close, open);
+                const size_t stop = end == std::string_view::npos ? text.size() : end + close.size();
+                line += static_cast<uint32_t>(std::count(text.begin() + static_cast<long>(i),
+                                                         text.begin() + static_cast<long>(stop), '\n'));
+                i = stop;
+            }
+
+            void directive() {
+                ++i;
+                while (i < text.size() && (text[i] == ' ' || text[i] == '\t')) ++i;
+                const size_t start = i;
+                while (i < text.size() && isNameChar(text[i])) ++i;
+
+                if (text.substr(start, i - start) == "define") {
+                    while (i < text.size() && (text[i] == ' ' || text[i] == '\t')) ++i;
+                    const size_t name = i;
+                    while (i < text.size() && isNameChar(text[i])) ++i;
+                    if (i > name) out.push_back({std::string(text.substr(name, i - name)), line});
+                }
+
+                // The rest of the line, continuations included
+                while (i < text.size() && text[i] != '\n') {
+                    if (text[i] == '\\' && peek(1) == '\n') {
+                        i += 2;
+                        ++line;
+                    } else if (text[i] == '/' && peek(1) == '*') {
+                        skipBlockComment();
+                    } else if (text[i] == '/' && peek(1) == '/') {
+                        skipLineComment();
+                    } else {
+                        ++i;
+                    }
+                }
+            }
+
+            Token token() {
+                const size_t start = i;
+                const uint32_t at = line;
+                const char c = text[i];
+
+                if (isNameStart(c)) {
+                    while (i < text.size() && isNameChar(text[i])) ++i;
+                    const std::string_view name = text.substr(start, i - start);
+                    const char after = peek(0);
+                    if (after == '"' && (name == "R" || name == "LR" || name == "uR" || name == "UR" || name == "u8R")) {
+                        skipRaw();
+                        return {Literal, text.substr(start, i - start), at};
+                    }
+                    if ((after == '"' || after == '\'') && (name == "L" || name == "u" || name == "U" || name == "u8")) {
+                        skipQuoted(after);
+                        return {Literal, text.substr(start, i - start), at};
+                    }
+                    return {Name, name, at};
+                }
+
+                if ((c >= '0' && c <= '9') || (c == '.' && peek(1) >= '0' && peek(1) <= '9')) {
+                    // Digit separators and exponent signs belong to the number
+                    while (i < text.size()) {
+                        const char d = text[i];
+                        if (isNameChar(d) || d == '.' || d == '\'') {
+                            ++i;
+                        } else if ((d == '+' || d == '-') && (text[i - 1] == 'e' || text[i - 1] == 'E' ||
+                                                              text[i - 1] == 'p' || text[i - 1] == 'P')) {
+                            ++i;
+                        } else {
+                            break;
+                        }
+                    }
+                    return {Literal, text.substr(start, i - start), at};
+                }
+
+                if (c == '"' || c == '\'') {
+                    skipQuoted(c);
+                    return {Literal, text.substr(start, i - start), at};
+                }
+
+                if ((c == ':' && peek(1) == ':') || (c == '-' && peek(1) == '>')) {
+                    i += 2;
+                } else {
+                    ++i;
+                }
+                return {Punct, text.substr(start, i - start), at};
+            }
+
+            std::string_view text;
+            std::vector<Definition>& out;
+            size_t i = 0;
+            uint32_t line = 1;
+            bool lineStart = true;
+        };
+
+        // Names followed by a parenthesis that never start a function
+        bool isCallKeyword(const std::string_view name) {
+            static const char* const keywords[] = {
+                "noexcept", "throw", "decltype", "alignas", "alignof", "__attribute__", "__declspec",
+                "sizeof", "requires", "static_assert", "if", "while", "for", "switch", "return", "catch", "typeid",
+            };
+            return std::any_of(std::begin(keywords), std::end(keywords),
+                               [name](const char* keyword) { return name == keyword; });
+        }
+
+        // Reads the tokens of a file, tracking which braces open a scope
+        // that holds definitions (the file, namespaces, classes) and which
+        // open bodies that are skipped
+        class DefinitionScanner {
+        public:
+            DefinitionScanner(const std::string_view text, std::vector<Definition>& out) : lexer(text, out), out(out) {}
+
+            void run() {
+                for (Lexer::Token token = lexer.next(); token.kind != Lexer::End; token = lexer.next()) {
+                    if (!frames.empty() && !frames.back().scope) {
+                        // Inside a body only the braces matter
+                        if (token.text == "{") {
+                            frames.push_back({false, false, {}});
+                        } else if (token.text == "}") {
+                            close();
+                        }
+                    } else {
+                        statementToken(token);
+                    }
+                    beforePrevious = previous;
+                    previous = token;
+                }
+            }
+
+        private:
+            enum TypeKind { NONE, CLASS, ENUM, NAMESPACE };
+
+            // What the tokens since the last ; { or } at this scope have shown
+            struct Statement {
+                TypeKind type = NONE;
+                Lexer::Token typeName;
+                bool typeNameDone = false; // a base list or template arguments follow the name
+
+                Lexer::Token function;
+                bool destructor = false;
+                bool parameters = false; // the function's parameter list has closed
+                bool initializers = false;
+
+                Lexer::Token last;
+                Lexer::Token typedefName;
+                bool isTypedef = false;
+                bool isUsing = false;
+                bool assigned = false;
+                int parens = 0;
+                int templateAngles = 0;
+                bool templateNext = false;
+            };
+
+            struct Frame {
+                bool scope;   // definitions can appear inside
+                bool restore; // the statement goes on after the closing brace
+                Statement saved;
+            };
+
+            void emit(const Lexer::Token& name, const bool destructor = false) {
+                if (name.text.empty() || name.text == "operator") return;
+                out.push_back({destructor ? "~" + std::string(name.text) : std::string(name.text), name.line});
+            }
+
+            void open(const bool scope, const bool restore) {
+                frames.push_back({scope, restore, restore ? statement : Statement{}});
+                statement = {};
+            }
+
+            void close() {
+                if (frames.empty()) return;
+                Frame frame = std::move(frames.back());
+                frames.pop_back();
+                if (frames.empty() || frames.back().scope) {
+                    statement = frame.restore ? frame.saved : Statement{};
+                }
+            }
+
+            void statementToken(const Lexer::Token& token) {
+                Statement& s = statement;
+
+                if (s.templateAngles > 0) {
+                    if (token.text == "<") ++s.templateAngles;
+                    if (token.text == ">") --s.templateAngles;
+                    return;
+                }
+                if (s.templateNext) {
+                    s.templateNext = false;
+                    if (token.text == "<") {
+                        s.templateAngles = 1;
+                        return;
+                    }
+                }
+
+                if (token.kind == Lexer::Name) {
+                    if (s.parens > 0) {
+                        // typedef void (*name)(...)
+                        if (s.isTypedef && s.typedefName.text.empty() && previous.text == "*") s.typedefName = token;
+                        return;
+                    }
+                    name(token);
+                    return;
+                }
+                if (token.kind != Lexer::Punct) return;
+
+                const std::string_view p = token.text;
+                if (p == "(") {
+                    if (s.parens == 0 && previous.kind == Lexer::Name && !isCallKeyword(previous.text) &&
+                        !s.assigned && !s.initializers && !(s.function.text == "operator" && !s.parameters)) {
+                        s.function = previous;
+                        s.destructor = beforePrevious.text == "~";
+                        s.parameters = false;
+                        if (s.type != NAMESPACE) s.type = NONE;
+                    }
+                    ++s.parens;
+                } else if (p == ")") {
+                    if (s.parens > 0 && --s.parens == 0 && !s.function.text.empty()) s.parameters = true;
+                } else if (s.parens > 0) {
+                    return;
+                } else if (p == ":") {
+                    if (s.parameters) {
+                        s.initializers = true;
+                    } else if (s.type != NONE) {
+                        s.typeNameDone = true;
+                    }
+                } else if (p == "<") {
+                    if (s.type != NONE) s.typeNameDone = true;
+                } else if (p == "=") {
+                    if (s.isUsing && s.type == NONE && !s.assigned) emit(s.last);
+                    s.assigned = true;
+                } else if (p == ",") {
+                    if (s.isTypedef) emit(s.last);
+                    if (!s.initializers) {
+                        s.function = {};
+                        s.parameters = false;
+                    }
+                } else if (p == ";") {
+                    if (s.isTypedef && !s.assigned) emit(s.typedefName.text.empty() ? s.last : s.typedefName);
+                    statement = {};
+                } else if (p == "{") {
+                    openBrace();
+                } else if (p == "}") {
+                    close();
+                }
+            }
+
+            void name(const Lexer::Token& token) {
+                Statement& s = statement;
+                const std::string_view n = token.text;
+
+                if (n == "template") {
+                    s.templateNext = true;
+                } else if (n == "class" || n == "struct" || n == "union") {
+                    // enum class, or class as a keyword of an elaborated type
+                    if (s.type != ENUM && s.function.text.empty() && !s.assigned) {
+                        s.type = CLASS;
+                        s.typeName = {};
+                        s.typeNameDone = false;
+                    }
+                } else if (n == "enum") {
+                    s.type = ENUM;
+                    s.typeName = {};
+                    s.typeNameDone = false;
+                } else if (n == "namespace") {
+                    s.type = NAMESPACE;
+                    s.typeName = {};
+                    s.typeNameDone = false;
+                } else if (n == "typedef") {
+                    s.isTypedef = true;
+                } else if (n == "using") {
+                    s.isUsing = true;
+                } else if (n == "operator") {
+                    if (s.parens == 0 && !s.assigned && !s.initializers) {
+                        s.function = token;
+                        s.parameters = false;
+                    }
+                } else {
+                    if (s.type != NONE && !s.typeNameDone && s.function.text.empty() && n != "final" &&
+                        n != "alignas" && n != "__attribute__" && n != "__declspec") {
+                        s.typeName = token;
+                    }
+                    s.last = token;
+                }
+            }
+
+            void openBrace() {
+                const Statement s = statement;
+                switch (s.type) {
+                    case CLASS:
+                        emit(s.typeName);
+                        open(true, true);
+                        return;
+                    case ENUM:
+                        emit(s.typeName);
+                        open(false, true);
+                        return;
+                    case NAMESPACE:
+                        emit(s.typeName);
+                        open(true, false);
+                        return;
+                    case NONE:
+                        break;
+                }
+
+                if (s.parameters && !s.assigned) {
+                    // A braced member initializer, or the body after the last one
+                    if (s.initializers && previous.text != ")" && previous.text != "}") {
+                        open(false, true);
+                        return;
+                    }
+                    emit(s.function, s.destructor);
+                    open(false, false);
+                } else if (s.assigned) {
+                    open(false, true);
+                } else {
+                    // extern "C" { and the like
+                    open(true, false);
+                }
+            }
+
+            Lexer lexer;
+            std::vector<Definition>& out;
+            std::vector<Frame> frames;
+            Statement statement;
+            Lexer::Token previous;
+            Lexer::Token beforePrevious;
+        };
+
+        // A symbol while the index is being put together. The name points
+        // into the previous table, a scanned file's definitions or the
+        // lines read from a tags file.
+        struct Record {
+            std::string_view name;
+            uint32_t file;
+            uint32_t line;
+
+            bool operator<(const Record& other) const {
+                if (name != other.name) return name < other.name;
+                if (file != other.file) return file < other.file;
+                return line < other.line;
+            }
+        };
+
+        struct SourceFile {
+            std::string path;
+            FileIdentity identity;
+        };
+    }
+
+    void scanDefinitions(const std::string_view text, std::vector<Definition>& out) {
+        DefinitionScanner(text, out).run();
+    }
+
+    // The index as laid out on disk: a header, the root it covers, the
+    // files, the symbols sorted by name and the strings they point into
+    class SymbolIndex::Table {
+    public:
+        ~Table() {
+            if (mapping) munmap(mapping, size);
+        }
+
+        // The index in the file at path, if it is whole and covers root
+        static std::shared_ptr<const Table> map(const std::string& path, const std::string& root) {
+            const int fd = open(path.c_str(), O_RDONLY);
+            if (fd == -1) return nullptr;
+
+            struct stat st{};
+            if (fstat(fd, &st) == -1 || static_cast<size_t>(st.st_size) < sizeof(Header)) {
+                close(fd);
+                return nullptr;
+            }
+
+            auto table = std::make_shared<Table>();
+            table->size = static_cast<size_t>(st.st_size);
+            void* mapping = mmap(nullptr, table->size, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (mapping == MAP_FAILED) return nullptr;
+            table->mapping = mapping;
+            table->data = static_cast<const char*>(mapping);
+
+            if (!table->valid(root)) return nullptr;
+            return table;
+        }
+
+        // The index in image, kept in memory
+        static std::shared_ptr<const Table> hold(std::string image) {
+            auto table = std::make_shared<Table>();
+            table->image = std::move(image);
+            table->data = table->image.data();
+            table->size = table->image.size();
+            table->valid({});
+            return table;
+        }
+
+        [[nodiscard]] const Header& header() const { return *reinterpret_cast<const Header*>(data); }
+        [[nodiscard]] const FileEntry* files() const { return reinterpret_cast<const FileEntry*>(data + filesAt); }
+        [[nodiscard]] const SymbolEntry* symbols() const {
+            return reinterpret_cast<const SymbolEntry*>(data + symbolsAt);
+        }
+        [[nodiscard]] std::string_view string(const uint64_t at, const uint32_t length) const {
+            return {data + stringsAt + at, length};
+        }
+        [[nodiscard]] std::string_view name(const SymbolEntry& symbol) const {
+            return string(symbol.name, symbol.nameLength);
+        }
+        [[nodiscard]] std::string_view path(const uint32_t file) const {
+            return string(files()[file].path, files()[file].pathLength);
+        }
+
+    private:
+        bool valid(const std::string& root) {
+            const Header& h = header();
+            if (std::memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0 || h.version != VERSION) return false;
+
+            filesAt = sizeof(Header) + padded(h.rootLength);
+            symbolsAt = filesAt + h.files * sizeof(FileEntry);
+            stringsAt = symbolsAt + h.symbols * sizeof(SymbolEntry);
+            if (h.rootLength > size || h.files > size || h.symbols > size || stringsAt + h.stringBytes != size) {
+                return false;
+            }
+            if (!root.empty() && std::string_view(data + sizeof(Header), h.rootLength) != root) return false;
+
+            // A damaged entry is caught here rather than at lookup
+            for (uint64_t i = 0; i < h.files; ++i) {
+                if (files()[i].path + files()[i].pathLength > h.stringBytes) return false;
+            }
+            for (uint64_t i = 0; i < h.symbols; ++i) {
+                const SymbolEntry& symbol = symbols()[i];
+                if (symbol.name + symbol.nameLength > h.stringBytes || symbol.file >= h.files) return false;
+            }
+            return true;
+        }
+
+        void* mapping = nullptr;
+        std::string image;
+        const char* data = nullptr;
+        size_t size = 0;
+        size_t filesAt = 0;
+        size_t symbolsAt = 0;
+        size_t stringsAt = 0;
+    };
+
+    namespace {
+        // Lay out sorted records over files as a table image
+        std::string serialize(const std::string& root, const std::vector<SourceFile>& files,
+                              const std::vector<Record>& records, const FileIdentity* tags) {
+            std::string strings;
+            std::vector<FileEntry> fileEntries;
+            fileEntries.reserve(files.size());
+            for (const SourceFile& file : files) {
+                FileEntry entry{};
+                entry.path = strings.size();
+                entry.pathLength = static_cast<uint32_t>(file.path.size());
+                entry.size = file.identity.size;
+                entry.mtimeSec = file.identity.mtimeSec;
+                entry.mtimeNsec = file.identity.mtimeNsec;
+                fileEntries.push_back(entry);
+                strings += file.path;
+            }
+
+            // Sorted, so each name is stored once however often it is defined
+            std::vector<SymbolEntry> symbolEntries;
+            symbolEntries.reserve(records.size());
+            for (size_t i = 0; i < records.size(); ++i) {
+                SymbolEntry entry{};
+                if (i > 0 && records[i].name == records[i - 1].name) {
+                    entry.name = symbolEntries.back().name;
+                } else {
+                    entry.name = strings.size();
+                    strings += records[i].name;
+                }
+                entry.nameLength = static_cast<uint32_t>(records[i].name.size());
+                entry.file = records[i].file;
+                entry.line = records[i].line;
+                symbolEntries.push_back(entry);
+            }
+
+            Header header{};
+            std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+            header.version = VERSION;
+            header.fromTags = tags != nullptr;
+            header.files = fileEntries.size();
+            header.symbols = symbolEntries.size();
+            header.stringBytes = strings.size();
+            if (tags) {
+                header.tagsSize = tags->size;
+                header.tagsMtimeSec = tags->mtimeSec;
+                header.tagsMtimeNsec = tags->mtimeNsec;
+            }
+            header.rootLength = root.size();
+
+            std::string image;
+            image.reserve(sizeof(header) + padded(root.size()) + fileEntries.size() * sizeof(FileEntry) +
+                          symbolEntries.size() * sizeof(SymbolEntry) + strings.size());
+            image.append(reinterpret_cast<const char*>(&header), sizeof(header));
+            image += root;
+            image.resize(sizeof(header) + padded(root.size()), '\0');
+            image.append(reinterpret_cast<const char*>(fileEntries.data()), fileEntries.size() * sizeof(FileEntry));
+            image.append(reinterpret_cast<const char*>(symbolEntries.data()),
+                         symbolEntries.size() * sizeof(SymbolEntry));
+            image += strings;
+            return image;
+        }
+
+        // Where a tags entry points: a line number, or an ex search pattern
+        // that is looked up in the file afterwards
+        struct TagAddress {
+            uint32_t line = 0;
+            std::string pattern;
+            bool anchoredStart = false;
+            bool anchoredEnd = false;
+        };
+
+        TagAddress parseAddress(const std::string_view address) {
+            TagAddress result;
+            if (address.empty()) return result;
+
+            const char delimiter = address[0];
+            if (delimiter != '/' && delimiter != '?') {
+                for (const char c : address) {
+                    if (c < '0' || c > '9') break;
+                    result.line = result.line * 10 + static_cast<uint32_t>(c - '0');
+                }
+                return result;
+            }
+
+            size_t i = 1;
+            if (i < address.size() && address[i] == '^') {
+                result.anchoredStart = true;
+                ++i;
+            }
+            for (; i < address.size() && address[i] != delimiter; ++i) {
+                if (address[i] == '\\' && i + 1 < address.size()) ++i;
+                result.pattern += address[i];
+            }
+            // An escaped $ was unescaped above; only a bare one anchors
+            if (!result.pattern.empty() && result.pattern.back() == '$' &&
+                !(i >= 2 && address[i - 2] == '\\')) {
+                result.pattern.pop_back();
+                result.anchoredEnd = true;
+            }
+
+            // Universal ctags can write the line number too
+            const size_t field = address.find("\tline:");
+            if (field != std::string_view::npos) {
+                result.line = static_cast<uint32_t>(std::strtoul(std::string(address.substr(field + 6)).c_str(),
+                                                                 nullptr, 10));
+            }
+            return result;
+        }
+
+        bool matches(const std::string_view line, const TagAddress& address) {
+            if (address.anchoredStart && address.anchoredEnd) return line == address.pattern;
+            if (address.anchoredStart) return line.substr(0, address.pattern.size()) == address.pattern;
+            return line.find(address.pattern) != std::string_view::npos;
+        }
+    }
+
+    SymbolIndex::SymbolIndex(std::string root, std::optional<IndexCache> cache)
+        : root(std::move(root)), cache(std::move(cache)) {
+        if (this->cache) entry = entryFor(this->root, this->cache->getDirectory());
+        if (this->root != ".") prefix = this->root + "/";
+    }
+
+    SymbolIndex::~SymbolIndex() {
+        cancelled = true;
+        if (worker.joinable()) worker.join();
+    }
+
+    std::string SymbolIndex::entryFor(const std::string& root, const std::string& cacheDirectory) {
+        const std::string key = absolute(root);
+        const uint64_t hash = fnv1a(key.data(), key.size());
+
+        char name[17];
+        std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hash));
+        return cacheDirectory + "/" + name + SUFFIX;
+    }
+
+    bool SymbolIndex::isSourceFile(const std::string_view path) {
+        static const char* const extensions[] = {
+            ".c", ".cc", ".cpp", ".cxx", ".c++", ".h", ".hh", ".hpp", ".hxx", ".h++", ".inl", ".ipp", ".tcc",
+        };
+        const size_t dot = path.rfind('.');
+        if (dot == std::string_view::npos || path.find('/', dot) != std::string_view::npos) return false;
+        const std::string_view extension = path.substr(dot);
+        return std::any_of(std::begin(extensions), std::end(extensions),
+                           [extension](const char* known) { return extension == known; });
+    }
+
+    void SymbolIndex::refresh() {
+        if (!loaded) {
+            loaded = true;
+            if (!entry.empty()) table = Table::map(entry, absolute(root));
+            // The entry's mtime records when it was last used, for eviction
+            if (table) utimensat(AT_FDCWD, entry.c_str(), nullptr, 0);
+        }
+
+        take();
+        if (refreshing) return;
+
+        refreshing = true;
+        done = false;
+        cancelled = false;
+        worker = std::thread([this, previous = table] {
+            std::shared_ptr<const Table> result = build(previous);
+
+            std::lock_guard lock(mutex);
+            built = std::move(result);
+            done = true;
+            finished.notify_all();
+        });
+    }
+
+    void SymbolIndex::take() {
+        if (!refreshing) return;
+        {
+            std::lock_guard lock(mutex);
+            if (!done) return;
+            if (built) table = std::move(built);
+        }
+        worker.join();
+        refreshing = false;
+    }
+
+    bool SymbolIndex::isReady() {
+        take();
+        return table != nullptr;
+    }
+
+    bool SymbolIndex::waitReady(const std::chrono::milliseconds timeout) {
+        take();
+        if (table || !refreshing) return table != nullptr;
+
+        {
+            std::unique_lock lock(mutex);
+            if (!finished.wait_for(lock, timeout, [this] { return done; })) return false;
+        }
+        take();
+        return table != nullptr;
+    }
+
+    bool SymbolIndex::waitRefreshed(const std::chrono::milliseconds timeout) {
+        if (!refreshing) return true;
+        {
+            std::unique_lock lock(mutex);
+            if (!finished.wait_for(lock, timeout, [this] { return done; })) return false;
+        }
+        take();
+        return true;
+    }
+
+    std::vector<SymbolIndex::Location> SymbolIndex::find(const std::string_view name) const {
+        std::vector<Location> found;
+        if (!table) return found;
+
+        const SymbolEntry* first = table->symbols();
+        const SymbolEntry* last = first + table->header().symbols;
+        const Table& t = *table;
+        auto it = std::lower_bound(first, last, name, [&t](const SymbolEntry& symbol, const std::string_view key) {
+            return t.name(symbol) < key;
+        });
+        for (; it != last && t.name(*it) == name; ++it) {
+            const std::string_view path = t.path(it->file);
+            found.push_back({!path.empty() && path.front() == '/' ? std::string(path) : prefix + std::string(path), it->line});
+        }
+        return found;
+    }
+
+    size_t SymbolIndex::symbolCount() const {
+        return table ? static_cast<size_t>(table->header().symbols) : 0;
+    }
+
+    size_t SymbolIndex::fileCount() const {
+        return table ? static_cast<size_t>(table->header().files) : 0;
+    }
+
+    std::shared_ptr<const SymbolIndex::Table> SymbolIndex::build(const std::shared_ptr<const Table>& previous) {
+        std::vector<SourceFile> files;
+        std::vector<Record> records;
+        size_t sorted = 0; // records carried over from previous, still in order
+        std::deque<std::string> tagNames;
+        std::vector<std::vector<Definition>> scanned;
+
+        const FileIdentity tags = FileIdentity::of(prefix + "tags");
+        if (tags.exists) {
+            if (previous && previous->header().fromTags && previous->header().tagsSize == tags.size &&
+                previous->header().tagsMtimeSec == tags.mtimeSec &&
+                previous->header().tagsMtimeNsec == tags.mtimeNsec) {
+                return nullptr;
+            }
+
+            std::ifstream in(prefix + "tags", std::ios::binary);
+            std::unordered_map<std::string, uint32_t> fileIds;
+            std::vector<TagAddress> addresses;
+            std::string line;
+            while (std::getline(in, line) && !cancelled) {
+                if (line.compare(0, 6, "!_TAG_") == 0) continue;
+                const size_t nameEnd = line.find('\t');
+                const size_t fileEnd = nameEnd == std::string::npos ? nameEnd : line.find('\t', nameEnd + 1);
+                if (fileEnd == std::string::npos || nameEnd == 0) continue;
+
+                std::string path = line.substr(nameEnd + 1, fileEnd - nameEnd - 1);
+                auto [it, added] = fileIds.emplace(path, static_cast<uint32_t>(files.size()));
+                if (added) files.push_back({std::move(path), {}});
+
+                tagNames.push_back(line.substr(0, nameEnd));
+                records.push_back({tagNames.back(), it->second, 0});
+                addresses.push_back(parseAddress(std::string_view(line).substr(fileEnd + 1)));
+            }
+
+            // Patterns are looked up one file per task, each file read once
+            std::vector<std::vector<size_t>> byFile(files.size());
+            for (size_t i = 0; i < records.size(); ++i) {
+                if (addresses[i].line > 0) {
+                    records[i].line = addresses[i].line;
+                } else if (!addresses[i].pattern.empty()) {
+                    byFile[records[i].file].push_back(i);
+                }
+            }
+            pool.run(files.size(), [&](const size_t file) {
+                std::vector<size_t>& pending = byFile[file];
+                std::string text;
+                if (pending.empty() || cancelled) return;
+                const std::string& path = files[file].path;
+                if (!readFile(!path.empty() && path.front() == '/' ? path : prefix + path, text)) return;
+
+                uint32_t number = 1;
+                for (size_t at = 0; at <= text.size() && !pending.empty(); ++number) {
+                    size_t end = text.find('\n', at);
+                    if (end == std::string::npos) end = text.size();
+                    std::string_view current(text.data() + at, end - at);
+                    if (!current.empty() && current.back() == '\r') current.remove_suffix(1);
+
+                    pending.erase(std::remove_if(pending.begin(), pending.end(), [&](const size_t i) {
+                        if (!matches(current, addresses[i])) return false;
+                        records[i].line = number;
+                        return true;
+                    }), pending.end());
+                    at = end + 1;
+                }
+            });
+            for (Record& record : records) {
+                if (record.line == 0) record.line = 1;
+            }
+        } else {
+            // Every source file under the root, skipping hidden directories
+            // and build trees
+            std::error_code ec;
+            for (fs::recursive_directory_iterator it(root, fs::directory_options::skip_permission_denied, ec), end; !ec && it != end && !cancelled;
+                 it.increment(ec)) {
+                const std::string name = it->path().filename().string();
+                std::error_code typeError;
+                if (it->is_directory(typeError)) {
+                    if (name.front() == '.' || fs::exists(it->path() / "CMakeCache.txt", typeError)) {
+                        it.disable_recursion_pending();
+                    }
+                    continue;
+                }
+                if (!isSourceFile(name) || !it->is_regular_file(typeError)) continue;
+
+                std::string path = it->path().lexically_relative(root).string();
+                FileIdentity identity = FileIdentity::of(it->path().string());
+                if (identity.exists) files.push_back({std::move(path), identity});
+            }
+            if (cancelled) return nullptr;
+            std::sort(files.begin(), files.end(), [](const SourceFile& a, const SourceFile& b) {
+                return a.path < b.path;
+            });
+
+            // Files unchanged since the previous index keep their symbols
+            const bool incremental = previous && !previous->header().fromTags;
+            std::vector<bool> reused(files.size(), false);
+            std::vector<uint32_t> moved; // previous file number to new, or NOT_REUSED
+            constexpr uint32_t NOT_REUSED = UINT32_MAX;
+            if (incremental) {
+                const Header& h = previous->header();
+                std::unordered_map<std::string_view, uint32_t> known;
+                for (uint32_t i = 0; i < h.files; ++i) known.emplace(previous->path(i), i);
+                moved.assign(h.files, NOT_REUSED);
+
+                for (size_t i = 0; i < files.size(); ++i) {
+                    const auto it = known.find(files[i].path);
+                    if (it == known.end()) continue;
+                    const FileEntry& old = previous->files()[it->second];
+                    if (old.size == files[i].identity.size && old.mtimeSec == files[i].identity.mtimeSec &&
+                        old.mtimeNsec == files[i].identity.mtimeNsec) {
+                        reused[i] = true;
+                        moved[it->second] = static_cast<uint32_t>(i);
+                    }
+                }
+
+                if (files.size() == h.files && std::all_of(reused.begin(), reused.end(), [](bool r) { return r; })) {
+                    return nullptr;
+                }
+                for (uint64_t i = 0; i < h.symbols; ++i) {
+                    const SymbolEntry& entry = previous->symbols()[i];
+                    if (moved[entry.file] != NOT_REUSED) {
+                        // Both file lists are sorted by path, so the order holds
+                        records.push_back({previous->name(entry), moved[entry.file], entry.line});
+                    }
+                }
+                sorted = records.size();
+            }
+
+            scanned.resize(files.size());
+            pool.run(files.size(), [&](const size_t i) {
+                if (reused[i] || cancelled) return;
+                std::string text;
+                if (readFile(prefix + files[i].path, text)) scanDefinitions(text, scanned[i]);
+            });
+            if (cancelled) return nullptr;
+
+            for (size_t i = 0; i < files.size(); ++i) {
+                for (Definition& definition : scanned[i]) {
+                    records.push_back({definition.name, static_cast<uint32_t>(i), definition.line});
+                }
+            }
+        }
+        if (cancelled) return nullptr;
+
+        const auto middle = records.begin() + static_cast<long>(sorted);
+        std::sort(middle, records.end());
+        std::inplace_merge(records.begin(), middle, records.end());
+
+        const std::string key = absolute(root);
+        std::string image = serialize(key, files, records, tags.exists ? &tags : nullptr);
+
+        // Written aside and renamed over, so a reader never maps half an index
+        if (!entry.empty()) {
+            std::error_code ec;
+            fs::create_directories(fs::path(entry).parent_path(), ec);
+            const std::string temp = entry + ".tmp" + std::to_string(getpid());
+            const int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+            if (fd != -1) {
+                const bool written = writeAll(fd, image.data(), image.size());
+                close(fd);
+                if (written && rename(temp.c_str(), entry.c_str()) == 0) {
+                    cache->evict();
+                    if (auto mapped = Table::map(entry, key)) return mapped;
+                } else {
+                    unlink(temp.c_str());
+                }
+            }
+        }
+        return Table::hold(std::move(image));
+    }
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "IndexCache.h"
+#include "ThreadPool.h"
+
+namespace QEditor {
+    // A name defined in a source file, and the line it is defined on
+    struct Definition {
+        std::string name;
+        uint32_t line; // from 1
+    };
+
+    // Definitions in C or C++ source: functions with a body, classes,
+    // structs, unions, enums, namespaces, typedefs, using aliases and
+    // #defines. Comments, strings and function bodies are skipped. This is
+    // a tokenizer with a few rules rather than a parser, so macro-heavy code
+    // can fool it; it is only meant to find where to jump.
+    void scanDefinitions(std::string_view text, std::vector<Definition>& out);
+
+    // Symbols of a source tree, each with the file and line defining it.
+    // They come from a ctags `tags` file at the root when there is one and
+    // from scanning the tree's C and C++ files with scanDefinitions
+    // otherwise.
+    //
+    // The index is a sorted table in one file in the index cache, counted
+    // against its size limit along with line indexes and mapped straight
+    // from disk, so a lookup is a binary search and opening
+    // a tree indexed before costs one mapping. Refreshing runs in the
+    // background and only rescans files whose mtime or size changed, or
+    // the tags file as a whole when it changed.
+    class SymbolIndex {
+    public:
+        struct Location {
+            std::string file; // relative to the working directory, or absolute
+            uint32_t line;
+        };
+
+        // Without a cache the index is kept in memory
+        SymbolIndex(std::string root, std::optional<IndexCache> cache);
+        ~SymbolIndex();
+
+        SymbolIndex(const SymbolIndex&) = delete;
+        SymbolIndex& operator=(const SymbolIndex&) = delete;
+
+        // Bring the index up to date on a worker thread. The first call maps
+        // the index saved by an earlier session, which serves lookups while
+        // the refresh runs. Does nothing while a refresh is running.
+        void refresh();
+        // Whether the index can be queried; a finished refresh is taken in here
+        [[nodiscard]] bool isReady();
+        // Same, waiting up to timeout when there is nothing to query yet
+        bool waitReady(std::chrono::milliseconds timeout);
+        // Wait up to timeout for the running refresh, if any, to finish and
+        // take it in; false when it is still running
+        bool waitRefreshed(std::chrono::milliseconds timeout);
+
+        // Where name is defined, in index order
+        [[nodiscard]] std::vector<Location> find(std::string_view name) const;
+
+        [[nodiscard]] size_t symbolCount() const;
+        [[nodiscard]] size_t fileCount() const;
+
+        // The file the index of root is kept in
+        [[nodiscard]] static std::string entryFor(const std::string& root, const std::string& cacheDirectory);
+
+        // Source files the tree scan reads
+        [[nodiscard]] static bool isSourceFile(std::string_view path);
+
+    private:
+        class Table;
+
+        void take();
+        std::shared_ptr<const Table> build(const std::shared_ptr<const Table>& previous);
+
+        std::string root;
+        std::optional<IndexCache> cache;
+        std::string entry;
+        std::string prefix; // added to relative paths so they resolve from the working directory
+        std::shared_ptr<const Table> table;
+        bool loaded = false;
+
+        // Refresh in progress, guarded by mutex. The scan has a pool of its
+        // own so it never holds up the editor's commands on the shared one.
+        std::thread worker;
+        ThreadPool pool;
+        std::mutex mutex;
+        std::condition_variable finished;
+        std::shared_ptr<const Table> built;
+        bool refreshing = false;
+        bool done = false;
+        std::atomic<bool> cancelled{false};
+    };
+}
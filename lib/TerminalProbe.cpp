@@ -0,0 +1,57 @@
+#include "TerminalProbe.h"
+#include <cctype>
+#include <poll.h>
+#include <string>
+#include <unistd.h>
+
+namespace QEditor {
+    namespace {
+        // DECRQM for mode 2026, then primary device attributes
+        constexpr std::string_view QUERY = "\x1b[?2026$p\x1b[c";
+    }
+
+    TerminalCaps parseProbeReplies(const std::string_view replies) {
+        TerminalCaps caps;
+
+        // DECRPM: CSI ? 2026 ; Ps $ y, where 1 is set and 2 reset but available
+        constexpr std::string_view report = "\x1b[?2026;";
+        if (const size_t at = replies.find(report); at != std::string_view::npos) {
+            const std::string_view rest = replies.substr(at + report.size());
+            caps.synchronizedOutput = rest.size() >= 3 && (rest[0] == '1' || rest[0] == '2') && rest.substr(1, 2) == "$y";
+        }
+        return caps;
+    }
+
+    bool probeFinished(const std::string_view replies) {
+        // DA1: CSI ? Ps ; ... c
+        for (size_t at = replies.find("\x1b[?"); at != std::string_view::npos; at = replies.find("\x1b[?", at + 1)) {
+            size_t end = at + 3;
+            while (end < replies.size() && (std::isdigit(static_cast<unsigned char>(replies[end])) || replies[end] == ';')) {
+                ++end;
+            }
+            if (end < replies.size() && replies[end] == 'c') return true;
+        }
+        return false;
+    }
+
+    TerminalCaps probeTerminal(const int in, const int out, const std::chrono::milliseconds timeout) {
+        if (!isatty(in) || !isatty(out)) return {};
+        if (write(out, QUERY.data(), QUERY.size()) != static_cast<ssize_t>(QUERY.size())) return {};
+
+        const auto deadline = std::chrono::steady_clock::now() + timeout;
+        std::string replies;
+        while (!probeFinished(replies)) {
+            const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+            if (left.count() <= 0) break;
+
+            pollfd fd{in, POLLIN, 0};
+            if (poll(&fd, 1, static_cast<int>(left.count())) <= 0) continue;
+
+            char buf[256];
+            const ssize_t n = read(in, buf, sizeof(buf));
+            if (n <= 0) break;
+            replies.append(buf, static_cast<size_t>(n));
+        }
+        return parseProbeReplies(replies);
+    }
+}
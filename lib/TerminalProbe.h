@@ -0,0 +1,23 @@
+#pragma once
+
+#include <chrono>
+#include <string_view>
+
+namespace QEditor {
+    // Optional features the terminal reported at startup
+    struct TerminalCaps {
+        bool synchronizedOutput = false; // DEC private mode 2026, frames shown whole
+    };
+
+    // Ask the terminal on `out` about its features and read the replies from
+    // `in`, which must be in raw mode. A primary device attributes query goes
+    // last; every terminal answers that one, so the wait normally ends with
+    // its reply rather than at the timeout. Keys typed meanwhile are lost.
+    [[nodiscard]] TerminalCaps probeTerminal(int in, int out, std::chrono::milliseconds timeout);
+
+    // Features named in the replies read so far
+    [[nodiscard]] TerminalCaps parseProbeReplies(std::string_view replies);
+
+    // Whether the replies end with the device attributes answer
+    [[nodiscard]] bool probeFinished(std::string_view replies);
+}
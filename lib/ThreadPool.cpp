@@ -0,0 +1,98 @@
+#include "ThreadPool.h"
+#include <algorithm>
+#include <utility>
+
+namespace QEditor {
+    ThreadPool::ThreadPool(size_t threads) {
+        if (threads == 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        workers.reserve(threads - 1);
+        for (size_t i = 1; i < threads; ++i) {
+            workers.emplace_back([this] { work(); });
+        }
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+    }
+
+    void ThreadPool::run(const size_t count, const std::function<void(size_t)>& task) {
+        if (count == 0) return;
+
+        std::lock_guard<std::mutex> job(jobMutex);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            this->task = &task;
+            this->count = count;
+            next = 0;
+            error = nullptr;
+            ++generation;
+        }
+        if (count > 1) wake.notify_all();
+
+        drain();
+
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [this] { return next == this->count && running == 0; });
+        this->task = nullptr;
+
+        if (error) {
+            std::rethrow_exception(std::exchange(error, nullptr));
+        }
+    }
+
+    ThreadPool& ThreadPool::shared() {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    void ThreadPool::work() {
+        size_t seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || (generation != seen && task); });
+                if (stopping) return;
+                seen = generation;
+            }
+            drain();
+        }
+    }
+
+    // Take pieces of the current job until none are left
+    void ThreadPool::drain() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (task && next < count) {
+            const size_t piece = next++;
+            const auto* current = task;
+            ++running;
+            lock.unlock();
+
+            std::exception_ptr failure;
+            try {
+                (*current)(piece);
+            } catch (...) {
+                failure = std::current_exception();
+            }
+
+            lock.lock();
+            --running;
+            if (failure && !error) {
+                error = failure;
+                next = count; // skip what hasn't started
+            }
+        }
+        if (next == count && running == 0) {
+            finished.notify_all();
+        }
+    }
+}
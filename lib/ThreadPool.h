@@ -0,0 +1,56 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace QEditor {
+    // A fixed set of worker threads for splitting one large job into
+    // independent pieces. The caller works on the job too and returns once
+    // every piece has run, so a pool of one thread is plain sequential code.
+    class ThreadPool {
+    public:
+        // 0 means one thread per core
+        explicit ThreadPool(size_t threads = 0);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        // Threads working on a job, the caller included
+        [[nodiscard]] size_t size() const { return workers.size() + 1; }
+
+        // Run task(0) ... task(count - 1) and wait for all of them. The first
+        // exception a task throws is rethrown here once the others finish.
+        // Jobs from several threads run one after another; a task must not
+        // start a job of its own.
+        void run(size_t count, const std::function<void(size_t)>& task);
+
+        // Pool shared by the editor's bulk commands
+        static ThreadPool& shared();
+
+    private:
+        void work();
+        void drain();
+
+        std::vector<std::thread> workers;
+
+        std::mutex jobMutex; // one job at a time
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable finished;
+
+        // Current job, guarded by mutex
+        const std::function<void(size_t)>* task = nullptr;
+        size_t count = 0;
+        size_t next = 0;
+        size_t running = 0;
+        size_t generation = 0;
+        std::exception_ptr error;
+        bool stopping = false;
+    };
+}
@@ -0,0 +1,493 @@
+#include "TreeSearch.h"
+#include "EditorError.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+namespace QEditor {
+    namespace {
+        // A NUL in the first few KB marks a file as binary
+        constexpr size_t BINARY_PROBE = 8192;
+        // Larger .gitignore files aren't read
+        constexpr off_t MAX_IGNORE_FILE = 1024 * 1024;
+
+        // Bytes of source and prose from most to least common; anything not
+        // listed is rarer still
+        constexpr std::string_view COMMON_BYTES = " etaoinsrlhdcu_mpf(),;=g.\nybwv/\t*-\"k0x1>:2ET{}SAIRNLOC<#";
+
+        size_t byteRank(const char c) {
+            const size_t at = COMMON_BYTES.find(c);
+            return at == std::string_view::npos ? COMMON_BYTES.size() : at;
+        }
+
+        std::string join(const std::string& directory, const std::string_view name) {
+            if (directory == ".") return std::string(name);
+            std::string path = directory;
+            if (path.empty() || path.back() != '/') path += '/';
+            path += name;
+            return path;
+        }
+
+        bool readSmallFile(const std::string& path, std::string& text) {
+            const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd == -1) return false;
+
+            struct stat st{};
+            if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size > MAX_IGNORE_FILE) {
+                close(fd);
+                return false;
+            }
+            text.resize(static_cast<size_t>(st.st_size));
+            const ssize_t got = read(fd, text.data(), text.size());
+            close(fd);
+            text.resize(got > 0 ? static_cast<size_t>(got) : 0);
+            return true;
+        }
+
+        // One line of a .gitignore
+        struct IgnoreRule {
+            std::string pattern;
+            bool negated = false;
+            bool directoryOnly = false;
+            bool anchored = false;  // matched against the path from the .gitignore's directory
+            bool crossesSlash = false; // has **, which matches across directories
+        };
+
+        std::vector<IgnoreRule> parseIgnoreFile(const std::string_view text) {
+            std::vector<IgnoreRule> rules;
+            size_t at = 0;
+            while (at < text.size()) {
+                size_t end = text.find('\n', at);
+                if (end == std::string_view::npos) end = text.size();
+                std::string_view line = text.substr(at, end - at);
+                at = end + 1;
+
+                if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+                while (!line.empty() && line.back() == ' ' && !(line.size() >= 2 && line[line.size() - 2] == '\\')) {
+                    line.remove_suffix(1);
+                }
+                if (line.empty() || line[0] == '#') continue;
+
+                IgnoreRule rule;
+                if (line[0] == '!') {
+                    rule.negated = true;
+                    line.remove_prefix(1);
+                } else if (line[0] == '\\') {
+                    line.remove_prefix(1);
+                }
+                if (!line.empty() && line.back() == '/') {
+                    rule.directoryOnly = true;
+                    line.remove_suffix(1);
+                }
+                if (line.substr(0, 3) == "**/") {
+                    line.remove_prefix(3);
+                } else if (!line.empty() && line[0] == '/') {
+                    rule.anchored = true;
+                    line.remove_prefix(1);
+                }
+                if (line.empty()) continue;
+                if (line.find('/') != std::string_view::npos) rule.anchored = true;
+
+                // fnmatch has no **; a * that may cross slashes stands in for it
+                rule.crossesSlash = line.find("**") != std::string_view::npos;
+                std::string pattern;
+                for (size_t i = 0; i < line.size(); ++i) {
+                    pattern += line[i];
+                    if (line[i] == '*' && i + 1 < line.size() && line[i + 1] == '*') ++i;
+                }
+                rule.pattern = std::move(pattern);
+                rules.push_back(std::move(rule));
+            }
+            return rules;
+        }
+
+        bool matches(const IgnoreRule& rule, const std::string& relative, const char* name) {
+            if (!rule.anchored) return fnmatch(rule.pattern.c_str(), name, 0) == 0;
+            return fnmatch(rule.pattern.c_str(), relative.c_str(), rule.crossesSlash ? 0 : FNM_PATHNAME) == 0;
+        }
+    }
+
+    // The rules of one .gitignore, and those of the directories above it
+    struct TreeSearch::IgnoreList {
+        std::string base; // the .gitignore's directory, as paths below it start
+        std::vector<IgnoreRule> rules;
+        std::shared_ptr<const IgnoreList> parent;
+
+        // Closer files override further ones, and later lines earlier ones
+        [[nodiscard]] bool ignores(const std::string& path, const char* name, const bool directory) const {
+            for (const IgnoreList* list = this; list; list = list->parent.get()) {
+                const std::string relative = path.substr(std::min(list->base.size(), path.size()));
+                for (auto rule = list->rules.rbegin(); rule != list->rules.rend(); ++rule) {
+                    if (rule->directoryOnly && !directory) continue;
+                    if (matches(*rule, relative, name)) return !rule->negated;
+                }
+            }
+            return false;
+        }
+    };
+
+    TreeSearch::TreeSearch() {
+        int fds[2];
+        if (pipe(fds) == -1) {
+            throw EditorError(std::string("pipe: ") + std::strerror(errno));
+        }
+        wakeRead = fds[0];
+        wakeWrite = fds[1];
+        fcntl(wakeRead, F_SETFL, O_NONBLOCK);
+        fcntl(wakeRead, F_SETFD, FD_CLOEXEC);
+        fcntl(wakeWrite, F_SETFD, FD_CLOEXEC);
+    }
+
+    TreeSearch::~TreeSearch() {
+        cancel();
+        close(wakeRead);
+        close(wakeWrite);
+    }
+
+    bool TreeSearch::isPlainText(const std::string_view pattern) {
+        return pattern.find_first_of(".^$|()[]{}*+?\\") == std::string_view::npos;
+    }
+
+    std::string TreeSearch::requiredLiteral(const std::string_view pattern) {
+        if (isPlainText(pattern)) return std::string(pattern);
+
+        // With an alternation at the top nothing is certain
+        int depth = 0;
+        for (size_t i = 0; i < pattern.size(); ++i) {
+            const char c = pattern[i];
+            if (c == '\\') {
+                ++i;
+            } else if (c == '[') {
+                for (++i; i < pattern.size() && pattern[i] != ']'; ++i) {
+                    if (pattern[i] == '\\') ++i;
+                }
+            } else if (c == '(') {
+                ++depth;
+            } else if (c == ')') {
+                --depth;
+            } else if (c == '|' && depth == 0) {
+                return {};
+            }
+        }
+
+        // Runs of plain characters outside groups and classes, without any
+        // character a quantifier makes optional
+        std::string best, run;
+        auto endRun = [&best, &run] {
+            if (run.size() > best.size()) best = run;
+            run.clear();
+        };
+
+        depth = 0;
+        for (size_t i = 0; i < pattern.size(); ++i) {
+            const char c = pattern[i];
+            if (c == '(') {
+                ++depth;
+                endRun();
+            } else if (c == ')') {
+                --depth;
+                endRun();
+            } else if (c == '[') {
+                endRun();
+                for (++i; i < pattern.size() && pattern[i] != ']'; ++i) {
+                    if (pattern[i] == '\\') ++i;
+                }
+            } else if (c == '*' || c == '?' || c == '{') {
+                if (!run.empty()) run.pop_back();
+                endRun();
+                if (c == '{') {
+                    while (i < pattern.size() && pattern[i] != '}') ++i;
+                }
+            } else if (c == '+') {
+                endRun();
+            } else if (c == '.' || c == '^' || c == '$') {
+                endRun();
+            } else if (depth > 0) {
+                if (c == '\\') ++i;
+            } else if (c == '\\') {
+                // Escaped punctuation is itself; \d, \w, \b and the like are classes
+                if (i + 1 < pattern.size() && std::strchr(".^$|()[]{}*+?\\/-", pattern[i + 1])) {
+                    run += pattern[++i];
+                } else {
+                    endRun();
+                    ++i;
+                }
+            } else {
+                run += c;
+            }
+        }
+        // A quantifier right after the last run has been handled above
+        endRun();
+        return best;
+    }
+
+    void TreeSearch::start(const std::string& pattern, const std::string& root) {
+        // A bad pattern throws before the search running now is touched
+        std::unique_ptr<const std::regex> compiled;
+        const bool isPlain = isPlainText(pattern);
+        if (!isPlain) compiled = std::make_unique<const std::regex>(pattern);
+
+        cancel();
+
+        plain = isPlain;
+        regex = std::move(compiled);
+        literal = requiredLiteral(pattern);
+        rare = 0;
+        for (size_t i = 1; i < literal.size(); ++i) {
+            if (byteRank(literal[i]) > byteRank(literal[rare])) rare = i;
+        }
+        this->root = root;
+
+        cancelled = false;
+        limited = false;
+        searched = 0;
+        {
+            std::lock_guard lock(resultMutex);
+            total = 0;
+            running = true;
+        }
+        {
+            std::lock_guard lock(mutex);
+            queue.push_back({root, nullptr, true});
+            active = 0;
+        }
+
+        worker = std::thread([this] {
+            pool.run(pool.size(), [this](size_t) { drain(); });
+
+            std::lock_guard lock(resultMutex);
+            running = false;
+            signal();
+        });
+    }
+
+    void TreeSearch::cancel() {
+        {
+            std::lock_guard lock(mutex);
+            cancelled = true;
+        }
+        wake.notify_all();
+        if (worker.joinable()) worker.join();
+
+        {
+            std::lock_guard lock(mutex);
+            queue.clear();
+            active = 0;
+        }
+        std::lock_guard lock(resultMutex);
+        found.clear();
+        running = false;
+        char bytes[16];
+        while (read(wakeRead, bytes, sizeof(bytes)) > 0) {}
+        signalled = false;
+    }
+
+    bool TreeSearch::take(std::vector<SearchMatch>& out) {
+        std::lock_guard lock(resultMutex);
+
+        char bytes[16];
+        while (read(wakeRead, bytes, sizeof(bytes)) > 0) {}
+        signalled = false;
+
+        out.reserve(out.size() + found.size());
+        std::move(found.begin(), found.end(), std::back_inserter(out));
+        found.clear();
+        return running;
+    }
+
+    void TreeSearch::wait() {
+        if (worker.joinable()) worker.join();
+    }
+
+    bool TreeSearch::isRunning() const {
+        std::lock_guard lock(resultMutex);
+        return running;
+    }
+
+    void TreeSearch::signal() {
+        if (signalled) return;
+        signalled = true;
+        [[maybe_unused]] const ssize_t n = write(wakeWrite, "x", 1);
+    }
+
+    void TreeSearch::push(Work item) {
+        {
+            std::lock_guard lock(mutex);
+            queue.push_back(std::move(item));
+        }
+        wake.notify_one();
+    }
+
+    void TreeSearch::drain() {
+        while (true) {
+            Work item;
+            {
+                std::unique_lock lock(mutex);
+                wake.wait(lock, [this] { return !queue.empty() || active == 0 || cancelled; });
+                if (queue.empty() || cancelled) {
+                    // Nothing queued and nobody left to queue more: done
+                    wake.notify_all();
+                    return;
+                }
+                // Newest first keeps the walk depth first and the queue short
+                item = std::move(queue.back());
+                queue.pop_back();
+                ++active;
+            }
+
+            if (item.directory) {
+                searchDirectory(item);
+            } else {
+                searchFile(item.path);
+            }
+
+            std::lock_guard lock(mutex);
+            if (--active == 0 && queue.empty()) wake.notify_all();
+        }
+    }
+
+    void TreeSearch::searchDirectory(const Work& item) {
+        DIR* dir = opendir(item.path.c_str());
+        if (!dir) {
+            // The root may be a single file
+            if (errno == ENOTDIR) searchFile(item.path);
+            return;
+        }
+
+        std::shared_ptr<const IgnoreList> ignores = item.ignores;
+        std::string text;
+        if (readSmallFile(join(item.path, ".gitignore"), text)) {
+            auto list = std::make_shared<IgnoreList>();
+            list->base = join(item.path, "");
+            list->rules = parseIgnoreFile(text);
+            list->parent = ignores;
+            if (!list->rules.empty()) ignores = std::move(list);
+        }
+
+        while (const dirent* entry = readdir(dir)) {
+            if (cancelled) break;
+            // Hidden files and directories, .git among them, are left out
+            if (entry->d_name[0] == '.') continue;
+
+            std::string path = join(item.path, entry->d_name);
+            bool directory = false;
+            if (entry->d_type == DT_DIR) {
+                directory = true;
+            } else if (entry->d_type != DT_REG) {
+                // Symlinked files are searched, symlinked directories aren't
+                // followed so the walk can't loop
+                struct stat st{};
+                if (lstat(path.c_str(), &st) == -1) continue;
+                if (S_ISDIR(st.st_mode)) {
+                    directory = true;
+                } else if (S_ISLNK(st.st_mode)) {
+                    if (stat(path.c_str(), &st) == -1 || !S_ISREG(st.st_mode)) continue;
+                } else if (!S_ISREG(st.st_mode)) {
+                    continue;
+                }
+            }
+
+            if (ignores && ignores->ignores(path, entry->d_name, directory)) continue;
+            push({std::move(path), directory ? ignores : nullptr, directory});
+        }
+        closedir(dir);
+    }
+
+    const char* TreeSearch::findLiteral(const char* from, const char* const end) const {
+        const size_t n = literal.size();
+        while (static_cast<size_t>(end - from) >= n) {
+            // memchr is vectorized; the full compare only runs where the rare byte is
+            const auto* hit = static_cast<const char*>(
+                std::memchr(from + rare, literal[rare], static_cast<size_t>(end - from) - n + 1));
+            if (!hit) return nullptr;
+            const char* candidate = hit - rare;
+            if (std::memcmp(candidate, literal.data(), n) == 0) return candidate;
+            from = candidate + 1;
+        }
+        return nullptr;
+    }
+
+    void TreeSearch::searchFile(const std::string& path) {
+        const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) return;
+
+        struct stat st{};
+        if (fstat(fd, &st) == -1 || st.st_size == 0) {
+            close(fd);
+            return;
+        }
+        const auto size = static_cast<size_t>(st.st_size);
+        void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) return;
+        madvise(mapping, size, MADV_SEQUENTIAL);
+
+        const auto* data = static_cast<const char*>(mapping);
+        const char* end = data + size;
+        ++searched;
+        if (std::memchr(data, '\0', std::min(size, BINARY_PROBE))) {
+            munmap(mapping, size);
+            return;
+        }
+
+        // Line numbers are only counted up to lines that matched
+        std::vector<SearchMatch> matches;
+        uint64_t line = 1;
+        const char* counted = data;
+        auto test = [&](const char* start, const char* stop, const char* hit) {
+            const char* shown = stop > start && stop[-1] == '\r' ? stop - 1 : stop;
+            size_t column;
+            if (plain) {
+                column = static_cast<size_t>(hit - start);
+            } else {
+                std::cmatch match;
+                if (!std::regex_search(start, shown, match, *regex)) return;
+                column = static_cast<size_t>(match.position(0));
+            }
+
+            line += static_cast<uint64_t>(std::count(counted, start, '\n'));
+            counted = start;
+            const size_t length = std::min(static_cast<size_t>(shown - start), MAX_TEXT);
+            matches.push_back({path, line, column, std::string(start, length)});
+        };
+
+        const char* at = data;
+        while (at < end && matches.size() < MAX_MATCHES && !cancelled) {
+            const char* hit = at;
+            if (!literal.empty()) {
+                hit = findLiteral(at, end);
+                if (!hit) break;
+            }
+
+            const char* start = hit;
+            while (start > at && start[-1] != '\n') --start;
+            const auto* newline = static_cast<const char*>(std::memchr(hit, '\n', static_cast<size_t>(end - hit)));
+            const char* stop = newline ? newline : end;
+
+            test(start, stop, hit);
+            at = stop + 1;
+        }
+        munmap(mapping, size);
+
+        if (matches.empty()) return;
+        std::lock_guard lock(resultMutex);
+        if (!running) return;
+        const size_t room = MAX_MATCHES - total;
+        if (matches.size() >= room) {
+            matches.resize(room);
+            limited = true;
+            cancelled = true;
+            wake.notify_all();
+        }
+        total += matches.size();
+        std::move(matches.begin(), matches.end(), std::back_inserter(found));
+        signal();
+    }
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "ThreadPool.h"
+
+namespace QEditor {
+    // A line of a file that matched
+    struct SearchMatch {
+        std::string file;
+        uint64_t line;  // from 1
+        size_t column;  // byte offset of the match in the line
+        std::string text; // the line, cut short if it is long
+    };
+
+    // Searches the text files under a directory for a pattern on a pool of
+    // its own threads, which walk the tree and search files in parallel.
+    // Hidden files and anything a .gitignore on the way excludes are
+    // skipped, and so are files with a NUL byte near the start. Each file
+    // is mapped and scanned for a literal the pattern can't match without,
+    // looking for its rarest byte with memchr; only lines holding it are
+    // run through the regex. Matches are handed over as each file is done.
+    class TreeSearch {
+    public:
+        static constexpr size_t MAX_MATCHES = 100000; // the search stops once it has this many
+        static constexpr size_t MAX_TEXT = 256;       // bytes of a matching line kept
+
+        TreeSearch();
+        ~TreeSearch();
+
+        TreeSearch(const TreeSearch&) = delete;
+        TreeSearch& operator=(const TreeSearch&) = delete;
+
+        // Readable while matches or the end of the search are waiting to be taken
+        [[nodiscard]] int getFd() const { return wakeRead; }
+
+        // Search the tree under root, cancelling any search still running.
+        // pattern is a regex unless it has no special characters; an invalid
+        // one throws std::regex_error.
+        void start(const std::string& pattern, const std::string& root);
+        void cancel();
+
+        // Append the matches found since the last take to out; false once
+        // the search is over and nothing more will come
+        bool take(std::vector<SearchMatch>& out);
+        // Block until the search is over
+        void wait();
+
+        [[nodiscard]] bool isRunning() const;
+        [[nodiscard]] size_t filesSearched() const { return searched; }
+        [[nodiscard]] bool reachedLimit() const { return limited; }
+
+        // Longest run of text every match of the regex contains, empty when
+        // nothing can be told from the pattern
+        [[nodiscard]] static std::string requiredLiteral(std::string_view pattern);
+        [[nodiscard]] static bool isPlainText(std::string_view pattern);
+
+    private:
+        struct IgnoreList;
+        struct Work {
+            std::string path; // as shown in matches
+            std::shared_ptr<const IgnoreList> ignores;
+            bool directory;
+        };
+
+        void drain();
+        void searchDirectory(const Work& item);
+        void searchFile(const std::string& path);
+        [[nodiscard]] const char* findLiteral(const char* from, const char* end) const;
+        void push(Work item);
+        void signal();
+
+        ThreadPool pool;
+        std::thread worker;
+
+        // The search in progress, fixed while it runs
+        std::string literal;
+        size_t rare = 0; // the literal's least common byte, looked for first
+        bool plain = false;
+        std::unique_ptr<const std::regex> regex;
+        std::string root;
+
+        // Work not yet started, guarded by mutex
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::vector<Work> queue;
+        size_t active = 0;
+
+        // Results, guarded by resultMutex
+        mutable std::mutex resultMutex;
+        std::vector<SearchMatch> found;
+        size_t total = 0;
+        bool running = false;
+        bool signalled = false;
+
+        std::atomic<bool> cancelled{false};
+        std::atomic<bool> limited{false};
+        std::atomic<size_t> searched{0};
+
+        int wakeRead = -1;
+        int wakeWrite = -1;
+    };
+}
@@ -0,0 +1,136 @@
+#include "WindowLayout.h"
+#include <algorithm>
+#include <iterator>
+
+namespace QEditor {
+    WindowLayout::Node* WindowLayout::find(Node& node, const size_t window, Node** parent) {
+        if (node.children.empty()) return node.window == window ? &node : nullptr;
+
+        for (Node& child : node.children) {
+            if (Node* found = find(child, window, parent)) {
+                if (!*parent && found == &child) *parent = &node;
+                return found;
+            }
+        }
+        return nullptr;
+    }
+
+    size_t WindowLayout::split(const size_t window, const bool vertical) {
+        Node* parent = nullptr;
+        Node* leaf = find(root, window, &parent);
+        if (!leaf) return window;
+
+        const size_t id = nextId++;
+        Node added;
+        added.window = id;
+
+        if (parent && parent->vertical == vertical) {
+            // Another window along the same direction
+            const auto at = parent->children.begin() + std::distance(parent->children.data(), leaf);
+            parent->children.insert(at, std::move(added));
+        } else {
+            // The window becomes a split of itself and the new one
+            Node old = std::move(*leaf);
+            leaf->children.clear();
+            leaf->vertical = vertical;
+            leaf->children.push_back(std::move(added));
+            leaf->children.push_back(std::move(old));
+        }
+        return id;
+    }
+
+    bool WindowLayout::close(const size_t window) {
+        Node* parent = nullptr;
+        Node* leaf = find(root, window, &parent);
+        if (!leaf || !parent) return false;
+
+        parent->children.erase(parent->children.begin() + std::distance(parent->children.data(), leaf));
+        if (parent->children.size() == 1) {
+            // A split of one is just that child
+            Node only = std::move(parent->children.front());
+            *parent = std::move(only);
+        }
+
+        flatten(root);
+        return true;
+    }
+
+    void WindowLayout::flatten(Node& node) {
+        // A child split the same way as its parent adds its children to the parent's
+        std::vector<Node> children;
+        for (Node& child : node.children) {
+            flatten(child);
+            if (!child.children.empty() && child.vertical == node.vertical) {
+                std::move(child.children.begin(), child.children.end(), std::back_inserter(children));
+            } else {
+                children.push_back(std::move(child));
+            }
+        }
+        node.children = std::move(children);
+    }
+
+    void WindowLayout::only(const size_t window) {
+        root = Node();
+        root.window = window;
+    }
+
+    void WindowLayout::collect(const Node& node, std::vector<size_t>& out) {
+        if (node.children.empty()) {
+            out.push_back(node.window);
+            return;
+        }
+        for (const Node& child : node.children) collect(child, out);
+    }
+
+    size_t WindowLayout::count() const {
+        return windows().size();
+    }
+
+    std::vector<size_t> WindowLayout::windows() const {
+        std::vector<size_t> out;
+        collect(root, out);
+        return out;
+    }
+
+    bool WindowLayout::place(const Node& node, const size_t top, const size_t left, const size_t height,
+                             const size_t width, const size_t bottom, std::vector<WindowRect>& rects,
+                             std::vector<Divider>& dividers) {
+        if (node.children.empty()) {
+            WindowRect rect{node.window, top, left, height, width, top + height < bottom};
+            rects.push_back(rect);
+            return rect.textRows() > 0 && width > 0;
+        }
+
+        // Side by side windows give up a column between each pair for a divider
+        const size_t n = node.children.size();
+        const size_t gaps = node.vertical ? n - 1 : 0;
+        const size_t total = node.vertical ? width : height;
+        const size_t space = total > gaps ? total - gaps : 0;
+        bool fits = true;
+
+        size_t offset = 0;
+        for (size_t i = 0; i < n; ++i) {
+            // The first children take what doesn't divide evenly
+            const size_t size = space / n + (i < space % n ? 1 : 0);
+            if (node.vertical) {
+                fits = place(node.children[i], top, left + offset, height, size, bottom, rects, dividers) && fits;
+                offset += size;
+                if (i + 1 < n) {
+                    dividers.push_back({top, left + offset, height});
+                    ++offset;
+                }
+            } else {
+                fits = place(node.children[i], top + offset, left, size, width, bottom, rects, dividers) && fits;
+                offset += size;
+            }
+        }
+        return fits;
+    }
+
+    bool WindowLayout::arrange(const size_t rows, const size_t cols, std::vector<WindowRect>& rects,
+                               std::vector<Divider>& dividers) const {
+        rects.clear();
+        dividers.clear();
+        return place(root, 0, 0, rows, cols, rows, rects, dividers);
+    }
+}
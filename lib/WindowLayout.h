@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace QEditor {
+    // Screen area of one window. Windows that don't reach the bottom of the
+    // text area end in a status row, counted in height.
+    struct WindowRect {
+        size_t window = 0;
+        size_t top = 0, left = 0, height = 0, width = 0;
+        bool status = false;
+
+        [[nodiscard]] size_t textRows() const { return status && height > 0 ? height - 1 : height; }
+    };
+
+    // Column of | between windows side by side
+    struct Divider {
+        size_t top = 0, left = 0, height = 0;
+    };
+
+    // How windows tile the screen: a tree of splits, each dividing its area
+    // evenly between its children, stacked or side by side. Windows are
+    // named by ids that stay the same while other windows come and go.
+    class WindowLayout {
+    public:
+        // The id of the first window
+        static constexpr size_t FIRST = 0;
+
+        // Split a window in two, the new one above it or, when vertical, to
+        // its left. Returns the new window's id.
+        size_t split(size_t window, bool vertical);
+        // Give a window's space to its neighbours. The last window can't be closed.
+        bool close(size_t window);
+        // Close every window but this one
+        void only(size_t window);
+
+        [[nodiscard]] size_t count() const;
+        // Window ids in screen order, top to bottom and left to right
+        [[nodiscard]] std::vector<size_t> windows() const;
+
+        // Tile a text area of rows x cols. Returns false when a window gets
+        // no text row or no column.
+        bool arrange(size_t rows, size_t cols, std::vector<WindowRect>& rects, std::vector<Divider>& dividers) const;
+
+    private:
+        struct Node {
+            size_t window = FIRST;
+            bool vertical = false;
+            std::vector<Node> children; // empty for a window
+        };
+
+        static Node* find(Node& node, size_t window, Node** parent);
+        static void flatten(Node& node);
+        static void collect(const Node& node, std::vector<size_t>& out);
+        static bool place(const Node& node, size_t top, size_t left, size_t height, size_t width, size_t bottom,
+                          std::vector<WindowRect>& rects, std::vector<Divider>& dividers);
+
+        Node root;
+        size_t nextId = FIRST + 1;
+    };
+}
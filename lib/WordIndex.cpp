@@ -0,0 +1,226 @@
+#include "WordIndex.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+namespace QEditor {
+    namespace {
+        // Overlays smaller than this are never worth folding in
+        constexpr size_t MIN_COMPACT = 4096;
+
+        // Call found for each indexed word of line
+        template <class Found>
+        void forEachWord(const std::string_view line, Found&& found) {
+            if (line.size() > WordIndex::MAX_LINE) return;
+
+            size_t i = 0;
+            while (i < line.size()) {
+                if (!WordIndex::isWordChar(line[i])) {
+                    ++i;
+                    continue;
+                }
+
+                const size_t start = i;
+                while (i < line.size() && WordIndex::isWordChar(line[i])) ++i;
+
+                // Numbers aren't words to complete
+                const bool digit = line[start] >= '0' && line[start] <= '9';
+                if (i - start >= WordIndex::MIN_WORD && !digit) {
+                    found(line.substr(start, i - start));
+                }
+            }
+        }
+    }
+
+    WordIndex::~WordIndex() {
+        cancelled = true;
+        if (worker.joinable()) worker.join();
+    }
+
+    bool WordIndex::isWordChar(const char c) {
+        const auto u = static_cast<unsigned char>(c);
+        return (u >= 'a' && u <= 'z') || (u >= 'A' && u <= 'Z') || (u >= '0' && u <= '9') || u == '_' || u >= 0x80;
+    }
+
+    void WordIndex::build(LineSlice lines) {
+        cancelled = true;
+        if (worker.joinable()) worker.join();
+
+        // Edits from here on count against the new snapshot
+        table.clear();
+        overlay.clear();
+        built.clear();
+        building = true;
+        done = false;
+        cancelled = false;
+
+        worker = std::thread([this, lines = std::move(lines)] {
+            std::vector<Entry> words = countWords(lines, cancelled);
+
+            std::lock_guard lock(mutex);
+            built = std::move(words);
+            done = true;
+            finished.notify_all();
+        });
+    }
+
+    bool WordIndex::isReady() {
+        return waitReady(std::chrono::milliseconds(0));
+    }
+
+    bool WordIndex::waitReady(const std::chrono::milliseconds timeout) {
+        if (!building) return true;
+
+        {
+            std::unique_lock lock(mutex);
+            if (!finished.wait_for(lock, timeout, [this] { return done; })) return false;
+            table = std::move(built);
+        }
+        worker.join();
+        building = false;
+        compact();
+        return true;
+    }
+
+    void WordIndex::adjust(const std::string_view line, const long delta) {
+        forEachWord(line, [this, delta](const std::string_view word) {
+            const auto it = overlay.find(word);
+            if (it == overlay.end()) {
+                overlay.emplace(std::string(word), delta);
+            } else if ((it->second += delta) == 0) {
+                overlay.erase(it);
+            }
+        });
+
+        if (!building && overlay.size() > std::max(MIN_COMPACT, table.size() / 8)) compact();
+    }
+
+    void WordIndex::compact() {
+        if (overlay.empty()) return;
+
+        // Merge the two sorted sequences, dropping words no longer in the buffer
+        std::vector<Entry> merged;
+        merged.reserve(table.size() + overlay.size());
+        auto t = table.begin();
+        auto o = overlay.begin();
+        while (t != table.end() || o != overlay.end()) {
+            Entry entry;
+            if (o == overlay.end() || (t != table.end() && t->first < o->first)) {
+                entry = std::move(*t++);
+            } else if (t == table.end() || o->first < t->first) {
+                entry = {o->first, o->second};
+                ++o;
+            } else {
+                entry = {std::move(t->first), t->second + o->second};
+                ++t;
+                ++o;
+            }
+            if (entry.second > 0) merged.push_back(std::move(entry));
+        }
+
+        table = std::move(merged);
+        overlay.clear();
+    }
+
+    void WordIndex::complete(const std::string_view prefix, const size_t limit, std::vector<std::string>& out) const {
+        auto t = std::lower_bound(table.begin(), table.end(), prefix, [](const Entry& entry, const std::string_view key) {
+            return entry.first < key;
+        });
+        auto o = overlay.lower_bound(prefix);
+
+        auto matches = [prefix](const std::string& word) { return word.compare(0, prefix.size(), prefix) == 0; };
+        if (t != table.end() && !matches(t->first)) t = table.end();
+        if (o != overlay.end() && !matches(o->first)) o = overlay.end();
+
+        // Walk both in order while they match, adding up counts for words in both
+        size_t found = 0;
+        while (found < limit && (t != table.end() || o != overlay.end())) {
+            const std::string* word;
+            long count = 0;
+            if (o == overlay.end() || (t != table.end() && t->first < o->first)) {
+                word = &t->first;
+                count = t->second;
+                ++t;
+            } else if (t == table.end() || o->first < t->first) {
+                word = &o->first;
+                count = o->second;
+                ++o;
+            } else {
+                word = &t->first;
+                count = t->second + o->second;
+                ++t;
+                ++o;
+            }
+
+            if (count > 0 && word->size() > prefix.size()) {
+                out.push_back(*word);
+                ++found;
+            }
+            if (t != table.end() && !matches(t->first)) t = table.end();
+            if (o != overlay.end() && !matches(o->first)) o = overlay.end();
+        }
+    }
+
+    size_t WordIndex::memoryUsage() const {
+        auto heap = [](const std::string& word) { return word.capacity() > 15 ? word.capacity() + 1 : 0; };
+
+        size_t total = table.capacity() * sizeof(Entry);
+        for (const Entry& entry : table) total += heap(entry.first);
+        for (const auto& [word, count] : overlay) {
+            // Tree nodes carry three pointers and a colour besides the entry
+            total += sizeof(Entry) + 4 * sizeof(void*) + heap(word);
+        }
+        return total;
+    }
+
+    std::vector<WordIndex::Entry> WordIndex::countWords(const LineSlice& lines, const std::atomic<bool>& cancelled) {
+        // Pieces are decoded and counted across the pool, each part into its
+        // own table, straight out of the decoded text
+        // A pool of its own, shared by every buffer's index, so a big build
+        // never holds up the editor's commands on the shared one
+        static ThreadPool pool;
+        const size_t pieces = lines.pieceCount();
+        const size_t parts = std::max<size_t>(std::min(pool.size(), pieces), 1);
+        std::vector<std::unordered_map<std::string, long>> counts(parts);
+
+        pool.run(parts, [&](const size_t part) {
+            std::string text, key;
+            std::unordered_map<std::string, long>& words = counts[part];
+            auto count = [&words, &key](const std::string_view word) {
+                // The key is only copied into the table the first time
+                key.assign(word);
+                ++words[key];
+            };
+
+            const size_t to = pieces * (part + 1) / parts;
+            for (size_t i = pieces * part / parts; i < to && !cancelled; ++i) {
+                lines.pieceText(i, text);
+
+                const char* p = text.data();
+                const char* end = p + text.size();
+                while (p < end) {
+                    const auto* nl = static_cast<const char*>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+                    forEachWord(std::string_view(p, static_cast<size_t>(nl - p)), count);
+                    p = nl + 1;
+                }
+            }
+        });
+
+        std::unordered_map<std::string, long>& all = counts[0];
+        for (size_t part = 1; part < parts && !cancelled; ++part) {
+            for (auto& [word, count] : counts[part]) all[word] += count;
+        }
+
+        std::vector<Entry> words;
+        if (cancelled) return words;
+
+        words.reserve(all.size());
+        while (!all.empty()) {
+            auto node = all.extract(all.begin());
+            words.emplace_back(std::move(node.key()), node.mapped());
+        }
+        std::sort(words.begin(), words.end());
+        return words;
+    }
+}
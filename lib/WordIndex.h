@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "LineStore.h"
+
+namespace QEditor {
+    // Words of a buffer for completion, with how often each occurs. Counts
+    // live in a sorted table plus a small sorted overlay of what edits have
+    // changed since, which is folded into the table once it grows, so an
+    // edit costs a few map updates and a lookup is a binary search.
+    //
+    // The table is built on a worker thread from a snapshot of the lines.
+    // Edits made meanwhile collect in the overlay and count on top of it.
+    class WordIndex {
+    public:
+        static constexpr size_t MIN_WORD = 3;         // shorter words aren't worth completing
+        static constexpr size_t MAX_LINE = 64 * 1024; // longer lines aren't indexed
+        // Edits over more lines than this drop the index rather than update
+        // it; it is built again in the background when next needed
+        static constexpr size_t MAX_EDIT_LINES = 4096;
+
+        WordIndex() = default;
+        ~WordIndex();
+
+        WordIndex(const WordIndex&) = delete;
+        WordIndex& operator=(const WordIndex&) = delete;
+
+        // Count the words of lines on a worker thread, replacing the index
+        void build(LineSlice lines);
+        // Whether the index can be queried; a finished build is taken in here
+        [[nodiscard]] bool isReady();
+        // Same, waiting up to timeout for a build to finish
+        bool waitReady(std::chrono::milliseconds timeout);
+
+        // Count a line's words in or out as it is added to or removed from the buffer
+        void add(std::string_view line) { adjust(line, 1); }
+        void remove(std::string_view line) { adjust(line, -1); }
+
+        // Words longer than prefix that start with it, in order, at most limit of them
+        void complete(std::string_view prefix, size_t limit, std::vector<std::string>& out) const;
+
+        [[nodiscard]] size_t memoryUsage() const;
+
+        // Letters, digits, _ and the bytes of UTF-8 sequences
+        [[nodiscard]] static bool isWordChar(char c);
+
+    private:
+        using Entry = std::pair<std::string, long>;
+
+        void adjust(std::string_view line, long delta);
+        void compact();
+        static std::vector<Entry> countWords(const LineSlice& lines, const std::atomic<bool>& cancelled);
+
+        std::vector<Entry> table;
+        std::map<std::string, long, std::less<>> overlay; // count changes not in the table yet
+
+        // Build in progress, guarded by mutex
+        std::thread worker;
+        std::mutex mutex;
+        std::condition_variable finished;
+        std::vector<Entry> built;
+        bool building = false;
+        bool done = false;
+        std::atomic<bool> cancelled{false};
+    };
+}
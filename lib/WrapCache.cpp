@@ -0,0 +1,122 @@
+#include "WrapCache.h"
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+namespace QEditor {
+    namespace {
+        bool continuation(const char c) {
+            return (static_cast<unsigned char>(c) & 0xc0) == 0x80;
+        }
+
+        size_t cellWidth(const char c, const size_t tabWidth) {
+            if (c == '\t') return tabWidth;
+            return continuation(c) ? 0 : 1;
+        }
+    }
+
+    void WrapCache::setLayout(const size_t width, const size_t tabWidth) {
+        // Stale entries are recomputed when next drawn rather than all at once
+        this->width = std::max<size_t>(width, 1);
+        this->tabWidth = tabWidth;
+    }
+
+    const std::vector<WrapRow>& WrapCache::rows(const size_t line, const std::string_view text) {
+        // Short lines without tabs fit without looking at them
+        if (text.size() <= width && !std::memchr(text.data(), '\t', text.size())) {
+            return single;
+        }
+
+        if (const auto it = entries.find(line); it != entries.end()) {
+            const Entry& entry = it->second;
+            if (entry.width == width && entry.tabWidth == tabWidth && entry.size == text.size()) {
+                return entry.rows;
+            }
+            entries.erase(it);
+        }
+
+        wrap(text, scratch);
+        if (scratch.size() == 1) return single;
+
+        if (entries.size() >= MAX_LINES) {
+            entries.clear();
+        }
+        Entry& entry = entries[line];
+        entry.width = width;
+        entry.tabWidth = tabWidth;
+        entry.size = text.size();
+        entry.rows.assign(scratch.begin(), scratch.end());
+        return entry.rows;
+    }
+
+    void WrapCache::wrap(const std::string_view text, std::vector<WrapRow>& out) const {
+        out.assign(1, WrapRow{});
+
+        size_t used = 0;   // cells on the current row
+        size_t column = 0; // cells since the start of the line
+        for (size_t i = 0; i < text.size(); ++i) {
+            const size_t w = cellWidth(text[i], tabWidth);
+            if (w > 0 && used > 0 && used + w > width) {
+                out.push_back({i, column});
+                used = 0;
+            }
+            used += w;
+            column += w;
+        }
+    }
+
+    size_t WrapCache::rowOf(const std::vector<WrapRow>& rows, const size_t x) {
+        const auto it = std::upper_bound(rows.begin(), rows.end(), x, [](const size_t byte, const WrapRow& row) {
+            return byte < row.byte;
+        });
+        return static_cast<size_t>(std::distance(rows.begin(), it)) - 1;
+    }
+
+    size_t WrapCache::cells(const std::string_view text, const size_t from, size_t to, const size_t tabWidth) {
+        to = std::min(to, text.size());
+        size_t total = 0;
+        for (size_t i = from; i < to; ++i) {
+            total += cellWidth(text[i], tabWidth);
+        }
+        return total;
+    }
+
+    size_t WrapCache::byteAt(const std::string_view text, const size_t from, size_t to, const size_t column,
+                             const size_t tabWidth) {
+        to = std::min(to, text.size());
+        size_t used = 0;
+        size_t i = from;
+        while (i < to) {
+            const size_t w = cellWidth(text[i], tabWidth);
+            if (w > 0 && used + w > column) break;
+            used += w;
+            ++i;
+        }
+
+        // Land on the start of a character
+        while (i > from && i < text.size() && continuation(text[i])) --i;
+        return i;
+    }
+
+    void WrapCache::replace(const size_t at, const size_t count, const size_t newCount) {
+        entries.erase(entries.lower_bound(at), entries.lower_bound(at + count));
+        if (count == newCount) return;
+
+        // Renumber the lines after the change, keeping their break points
+        std::map<size_t, Entry> moved;
+        for (auto it = entries.lower_bound(at + count); it != entries.end();) {
+            auto node = entries.extract(it++);
+            node.key() = node.key() - count + newCount;
+            moved.insert(std::move(node));
+        }
+        entries.merge(moved);
+    }
+
+    size_t WrapCache::memoryUsage() const {
+        size_t total = (single.capacity() + scratch.capacity()) * sizeof(WrapRow);
+        for (const auto& [line, entry] : entries) {
+            total += sizeof(entry) + 3 * sizeof(void*) + entry.rows.capacity() * sizeof(WrapRow);
+        }
+        return total;
+    }
+}
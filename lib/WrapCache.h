@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <string_view>
+#include <vector>
+
+namespace QEditor {
+    // Start of one display row of a soft-wrapped line
+    struct WrapRow {
+        size_t byte = 0;   // first byte on the row
+        size_t column = 0; // cells before it, counted from the start of the line
+    };
+
+    // Where lines break when soft-wrapped at a given width. Lines that fit
+    // on one row cost nothing; the break points of longer lines are cached
+    // by line number and recomputed when the width, tab width or line
+    // length no longer match, so a resize reflows lines as they are drawn.
+    //
+    // A tab takes tabWidth cells and a UTF-8 continuation byte none, the
+    // same as the editor draws them; a row never breaks inside a character.
+    class WrapCache {
+    public:
+        static constexpr size_t MAX_LINES = 4096;
+
+        void setLayout(size_t width, size_t tabWidth);
+        [[nodiscard]] size_t getWidth() const { return width; }
+
+        // Display rows of the line, valid until the cache is next used or changed
+        const std::vector<WrapRow>& rows(size_t line, std::string_view text);
+
+        // Row of the line holding byte x
+        [[nodiscard]] static size_t rowOf(const std::vector<WrapRow>& rows, size_t x);
+
+        // Cells taken by text[from, to)
+        [[nodiscard]] static size_t cells(std::string_view text, size_t from, size_t to, size_t tabWidth);
+
+        // First byte at or after `column` cells into the row starting at
+        // `from`, stopping at `to`
+        [[nodiscard]] static size_t byteAt(std::string_view text, size_t from, size_t to, size_t column, size_t tabWidth);
+
+        // Lines [at, at + count) were replaced by newCount lines
+        void replace(size_t at, size_t count, size_t newCount);
+        void clear() { entries.clear(); }
+
+        [[nodiscard]] size_t cachedLines() const { return entries.size(); }
+        [[nodiscard]] size_t memoryUsage() const;
+
+    private:
+        struct Entry {
+            size_t width = 0;
+            size_t tabWidth = 0;
+            size_t size = 0;
+            std::vector<WrapRow> rows;
+        };
+
+        void wrap(std::string_view text, std::vector<WrapRow>& out) const;
+
+        std::map<size_t, Entry> entries;
+        std::vector<WrapRow> single{WrapRow{}};
+        std::vector<WrapRow> scratch;
+        size_t width = 80;
+        size_t tabWidth = 4;
+    };
+}
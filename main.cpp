@@ -15,7 +15,35 @@ void cleanupTerminal();
 
 int main(const int argc, char *argv[]) {
     try {
-        const std::string filename = (argc >= 2) ? argv[1] : "";
+        std::string filename;
+        bool viewOnly = false;
+        bool follow = false;
+        bool diff = false;
+        std::string otherFilename;
+
+        for (int i = 1; i < argc; ++i) {
+            if (const std::string arg = argv[i]; arg == "--view" || arg == "-R") {
+                viewOnly = true;
+            } else if (arg == "--follow" || arg == "-f") {
+                follow = true;
+            } else if (arg == "--diff" || arg == "-d") {
+                diff = true;
+            } else if (diff && !filename.empty()) {
+                otherFilename = arg;
+            } else {
+                filename = arg;
+            }
+        }
+
+        if (diff && (filename.empty() || otherFilename.empty() || viewOnly)) {
+            std::cerr << "Error: --diff requires two filenames." << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        if ((viewOnly || follow) && filename.empty()) {
+            std::cerr << "Error: " << (viewOnly ? "--view" : "--follow") << " requires a filename." << std::endl;
+            return EXIT_FAILURE;
+        }
 
         // Set up signal handlers
         std::signal(SIGTSTP, handleSigTSTP);
@@ -24,11 +52,19 @@ int main(const int argc, char *argv[]) {
         setupSigCONT();
         setupSigTSTP();
 
-        // Initialize editor
-        Editor editor;
+        // Initialize editor, the signal handlers act on this same instance
+        Editor& editor = Editor::getInstance();
 
         // Load file if specified
-        if (!filename.empty()) {
+        if (viewOnly) {
+            try {
+                editor.openView(filename);
+            } catch (const QEditor::FileError& e) {
+                cleanupTerminal();
+                std::cerr << "Error: " << e.what() << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (!filename.empty()) {
             try {
                 editor.loadFile(filename);
             } catch (const QEditor::FileOpenError& e) {
@@ -44,6 +80,20 @@ int main(const int argc, char *argv[]) {
             editor.setStatusMessage("No file selected");
         }
 
+        if (follow) {
+            editor.startFollow();
+        }
+
+        if (diff) {
+            try {
+                editor.startDiff(otherFilename);
+            } catch (const QEditor::FileError& e) {
+                cleanupTerminal();
+                std::cerr << "Error: " << e.what() << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+
         // Start editor
         editor.drawScreen();
         editor.run();
@@ -8,6 +8,38 @@ namespace EditorCommands {
     static const std::string WRITE = ":w";
     static const std::string QUIT = ":q";
     static const std::string WRITE_QUIT = ":wq";
+    static const std::string FORCE_WRITE = ":w!";
+    static const std::string RELOAD = ":e!";
+    static const std::string EDIT = ":e";
+    static const std::string BUFFER_NEXT = ":bn";
+    static const std::string BUFFER_NEXT_LONG = ":bnext";
+    static const std::string BUFFER_PREV = ":bp";
+    static const std::string BUFFER_PREV_LONG = ":bprevious";
+    static const std::string TAG = ":tag";
+    static const std::string GREP = ":grep";
+    static const std::string QUICKFIX_NEXT = ":cn";
+    static const std::string QUICKFIX_NEXT_LONG = ":cnext";
+    static const std::string QUICKFIX_PREV = ":cp";
+    static const std::string QUICKFIX_PREV_LONG = ":cprevious";
+    static const std::string FOLLOW = ":follow";
+    static const std::string MEMORY = ":mem";
+    static const std::string CURSORS = ":cursors";
+    static const std::string DIFF_THIS = ":diffthis";
+    static const std::string DIFF_OFF = ":diffoff";
+    static const std::string WRAP = ":set wrap";
+    static const std::string NO_WRAP = ":set nowrap";
+    static const std::string SPLIT = ":split";
+    static const std::string SPLIT_SHORT = ":sp";
+    static const std::string VSPLIT = ":vsplit";
+    static const std::string VSPLIT_SHORT = ":vs";
+    static const std::string CLOSE = ":close";
+    static const std::string ONLY = ":only";
+
+    // Line commands, written after an optional range (":%sort n", ":'<,'>g/re/d")
+    static const std::string SORT = "sort";
+    static const std::string UNIQ = "uniq";
+    static const std::string GLOBAL = "g";
+    static const std::string VGLOBAL = "v";
 
     // Responses
     static const std::string WROTE_TO = "wrote: ";
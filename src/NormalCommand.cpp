@@ -0,0 +1,90 @@
+#include "NormalCommand.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    // Large enough for any buffer, small enough that multiplying two can't overflow
+    constexpr size_t MAX_COUNT = 1000000000;
+
+    constexpr char CTRL_W = 23;
+}
+
+bool NormalParser::isMotion(const char c) {
+    return c != 0 && std::strchr("hjklw0$G", c) != nullptr;
+}
+
+bool NormalParser::isRegister(const char c) {
+    return (c >= 'a' && c <= 'z') || c == '0' || c == '+' || c == '"';
+}
+
+NormalParser::Status NormalParser::feed(const char c) {
+    size_t& count = cmd.op ? motionCount : opCount;
+
+    if (prefixRegister) {
+        prefixRegister = false;
+        if (!isRegister(c)) return Status::Invalid;
+        cmd.reg = c;
+        return Status::Pending;
+    }
+
+    if (c == '"' && !cmd.op && !prefixG && !prefixZ && !prefixWindow) {
+        prefixRegister = true;
+        return Status::Pending;
+    }
+
+    if (prefixG) {
+        return c == 'g' ? finish('g') : Status::Invalid;
+    }
+
+    if (prefixZ) {
+        if (c != 'c' && c != 'o' && c != 'M' && c != 'R') return Status::Invalid;
+        cmd.prefix = 'z';
+        return finish(c);
+    }
+
+    if (prefixWindow) {
+        // Ctrl-W Ctrl-W is the same as Ctrl-W w
+        if (c != CTRL_W && (c == 0 || std::strchr("wWhjklcosvq", c) == nullptr)) return Status::Invalid;
+        cmd.prefix = CTRL_W;
+        return finish(c == CTRL_W ? 'w' : c);
+    }
+
+    // 0 is a motion unless it continues a count
+    if ((c >= '1' && c <= '9') || (c == '0' && count > 0)) {
+        count = std::min(count * 10 + static_cast<size_t>(c - '0'), MAX_COUNT);
+        return Status::Pending;
+    }
+
+    if (c == 'g') {
+        prefixG = true;
+        return Status::Pending;
+    }
+
+    if (!cmd.op) {
+        if (c == 'z') {
+            prefixZ = true;
+            return Status::Pending;
+        }
+        if (c == CTRL_W) {
+            prefixWindow = true;
+            return Status::Pending;
+        }
+        if (c == 'd' || c == 'y' || c == 'c') {
+            cmd.op = c;
+            return Status::Pending;
+        }
+        return finish(c);
+    }
+
+    if (c == cmd.op || isMotion(c)) {
+        return finish(c);
+    }
+    return Status::Invalid;
+}
+
+NormalParser::Status NormalParser::finish(const char key) {
+    cmd.key = key;
+    cmd.counted = opCount != 0 || motionCount != 0;
+    cmd.count = std::min(std::max<size_t>(opCount, 1) * std::max<size_t>(motionCount, 1), MAX_COUNT);
+    return Status::Complete;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+
+// One normal mode command: [count] key, or [count] operator [count] motion.
+// The parser is fed a key at a time so a command can span several reads.
+struct NormalCommand {
+    size_t count = 1;     // operator and motion counts multiplied together
+    bool counted = false; // whether a count was typed at all (G and gg take it as a line number)
+    char op = 0;          // 'd', 'y' or 'c', or 0 for a plain key
+    char key = 0;         // the motion or plain key; 'g' stands for gg, op itself for dd/yy/cc
+    char reg = 0;         // register named with "x, or 0 for the unnamed one
+    char prefix = 0;      // 'z' for the fold commands zc, zo, zM and zR, Ctrl-W for window commands
+};
+
+class NormalParser {
+public:
+    enum class Status { Pending, Complete, Invalid };
+
+    Status feed(char c);
+    void reset() { *this = NormalParser(); }
+
+    [[nodiscard]] const NormalCommand& command() const { return cmd; }
+    [[nodiscard]] bool isPending() const { return opCount != 0 || cmd.op != 0 || cmd.reg != 0 || prefixG || prefixZ || prefixWindow || prefixRegister; }
+
+    [[nodiscard]] bool wantsRegister() const { return prefixRegister; }
+
+    // Motions an operator accepts
+    [[nodiscard]] static bool isMotion(char c);
+    // Names that can follow "
+    [[nodiscard]] static bool isRegister(char c);
+
+private:
+    Status finish(char key);
+
+    NormalCommand cmd;
+    size_t opCount = 0;     // count typed before the operator
+    size_t motionCount = 0; // count typed after it
+    bool prefixG = false;   // first half of gg
+    bool prefixZ = false;   // z typed, a fold command comes next
+    bool prefixWindow = false; // Ctrl-W typed, a window command comes next
+    bool prefixRegister = false; // " typed, the register name comes next
+};
@@ -0,0 +1,137 @@
+#include "Pager.h"
+
+Pager::Pager(const std::string& filename, std::optional<QEditor::IndexCache> cache) : file(filename) {
+    index.build(filename, std::move(cache));
+}
+
+void Pager::scrollDown(const size_t lines) {
+    for (size_t i = 0; i < lines; ++i) {
+        const uint64_t next = file.nextLineStart(top);
+        if (next >= file.size()) break;
+
+        top = next;
+        if (topLine) ++*topLine;
+    }
+}
+
+void Pager::scrollUp(const size_t lines) {
+    for (size_t i = 0; i < lines && top > 0; ++i) {
+        top = file.prevLineStart(top);
+        if (topLine && *topLine > 0) --*topLine;
+    }
+}
+
+void Pager::gotoLine(const uint64_t line) {
+    // Start from the closest indexed line and walk the remainder. If the
+    // index hasn't reached the target yet this scans forward from its frontier.
+    auto [current, offset] = index.checkpointForLine(line);
+
+    while (current < line) {
+        const uint64_t next = file.nextLineStart(offset);
+        if (next >= file.size()) break;
+
+        offset = next;
+        ++current;
+    }
+
+    top = offset;
+    topLine = current;
+}
+
+void Pager::gotoStart() {
+    top = 0;
+    topLine = 0;
+}
+
+void Pager::gotoEnd(const size_t rows) {
+    // A trailing newline terminates the last line rather than starting a new one
+    top = file.size() == 0 ? 0 : file.lineStart(file.size() - 1);
+    topLine.reset();
+
+    scrollUp(rows > 0 ? rows - 1 : 0);
+}
+
+bool Pager::refresh() {
+    const uint64_t oldSize = file.size();
+    if (!file.refresh()) return false;
+
+    if (file.size() != oldSize) {
+        index.extend(file.getPath());
+    }
+    return true;
+}
+
+bool Pager::isAtEnd(const size_t rows) {
+    uint64_t offset = top;
+    for (size_t i = 0; i < rows; ++i) {
+        offset = file.nextLineStart(offset);
+        if (offset >= file.size()) return true;
+    }
+    return false;
+}
+
+bool Pager::search(const std::string& needle, const bool forward) {
+    std::optional<uint64_t> hit;
+    if (forward) {
+        hit = file.find(file.nextLineStart(top), needle);
+    } else {
+        hit = file.rfind(top, needle);
+    }
+
+    if (!hit) return false;
+
+    top = file.lineStart(*hit);
+    topLine.reset();
+    return true;
+}
+
+void Pager::visibleLines(const size_t rows, std::vector<std::string>& out, const size_t maxBytes) {
+    out.resize(rows);
+
+    uint64_t offset = top;
+    size_t filled = 0;
+    while (filled < rows && offset < file.size()) {
+        file.readLine(offset, out[filled], maxBytes);
+        offset = file.nextLineStart(offset);
+        ++filled;
+    }
+
+    out.resize(filled);
+}
+
+std::optional<uint64_t> Pager::topLineNumber() {
+    if (topLine) return topLine;
+
+    // Resolve from the nearest checkpoint once the index has scanned past us
+    if (index.scannedBytes() <= top && !index.isComplete()) {
+        return std::nullopt;
+    }
+
+    auto [line, offset] = index.checkpointForOffset(top);
+    while (offset < top) {
+        offset = file.nextLineStart(offset);
+        ++line;
+    }
+
+    topLine = line;
+    return topLine;
+}
+
+std::string Pager::status() {
+    std::string result = "\"" + file.getPath() + "\" [view] ";
+
+    if (const auto line = topLineNumber()) {
+        result += "line " + std::to_string(*line + 1);
+    } else {
+        result += "line ?";
+    }
+
+    if (index.isComplete()) {
+        result += " of " + std::to_string(index.lineCount());
+    } else {
+        const uint64_t size = file.size() ? file.size() : 1;
+        result += " (indexing " + std::to_string(index.scannedBytes() * 100 / size) + "%)";
+    }
+
+    return result;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "../lib/IndexCache.h"
+#include "../lib/LineIndex.h"
+#include "../lib/PagedFile.h"
+
+// Read-only viewer for files too large to load into the buffer. The view
+// is anchored by the byte offset of its top line, so every motion works
+// before the background line index has finished.
+class Pager {
+public:
+    // With a cache, the line index of a file seen before is reused
+    explicit Pager(const std::string& filename, std::optional<QEditor::IndexCache> cache = std::nullopt);
+
+    void scrollDown(size_t lines);
+    void scrollUp(size_t lines);
+    void gotoLine(uint64_t line); // 0-based
+    void gotoStart();
+    void gotoEnd(size_t rows);
+
+    // Pick up bytes appended to the file. Returns false if the file shrank
+    // and the pager has to be reopened.
+    bool refresh();
+    // Whether the file was rotated and the pager has to be reopened
+    [[nodiscard]] bool isReplaced() const { return file.isReplaced(); }
+
+    // Whether the last line of the file is within the first `rows` rows
+    [[nodiscard]] bool isAtEnd(size_t rows);
+
+    // Move the view to the next/previous line containing needle
+    bool search(const std::string& needle, bool forward);
+
+    // Fill rows with up to `rows` visible lines, each capped at maxBytes
+    void visibleLines(size_t rows, std::vector<std::string>& out, size_t maxBytes);
+
+    // Line number of the top row, if it can be determined from the index
+    [[nodiscard]] std::optional<uint64_t> topLineNumber();
+    [[nodiscard]] std::string status();
+
+    [[nodiscard]] const std::string& getFilename() const { return file.getPath(); }
+    [[nodiscard]] uint64_t getTopOffset() const { return top; }
+    [[nodiscard]] bool isIndexing() const { return !index.isComplete(); }
+    [[nodiscard]] size_t memoryUsage() const { return file.cachedBytes() + index.memoryUsage(); }
+
+private:
+    QEditor::PagedFile file;
+    QEditor::LineIndex index;
+
+    uint64_t top = 0;
+    std::optional<uint64_t> topLine = 0;
+};
@@ -6,12 +6,151 @@
 #include <thread>
 #include <sys/ioctl.h>
 #include <filesystem>
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <poll.h>
+#include <tuple>
+#include <utility>
 
 #include "EditorCommands.h"
 #include "../lib/EditorError.h"
+#include "../lib/LineDiff.h"
+#include "../lib/BackgroundDiff.h"
+#include "../lib/LineSort.h"
+#include "../lib/ProcessFilter.h"
+#include "../lib/ThreadPool.h"
+#include <regex>
 
 namespace {
     termios orig_termios;
+
+    std::string formatBytes(const size_t bytes) {
+        if (bytes >= 10 * 1024 * 1024) return std::to_string(bytes / (1024 * 1024)) + " MB";
+        if (bytes >= 10 * 1024) return std::to_string(bytes / 1024) + " KB";
+        return std::to_string(bytes) + " bytes";
+    }
+
+    size_t digitCount(size_t n) {
+        size_t digits = 1;
+        while (n >= 10) {
+            n /= 10;
+            ++digits;
+        }
+        return digits;
+    }
+
+    // Right-align n in width columns, formatted on the stack
+    void appendNumber(std::string& out, const size_t n, const size_t width) {
+        char digits[20];
+        const char* end = std::to_chars(digits, digits + sizeof(digits), n).ptr;
+        const auto length = static_cast<size_t>(end - digits);
+        if (width > length) out.append(width - length, ' ');
+        out.append(digits, length);
+    }
+
+    bool isBlank(const char c) {
+        return c == ' ' || c == '\t';
+    }
+
+    // Words are runs of one class: letters, digits and _, or other non-blank characters
+    int charClass(const char c) {
+        if (isBlank(c)) return 0;
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '_' ? 1 : 2;
+    }
+
+    size_t firstNonBlank(const std::string& line) {
+        const size_t x = line.find_first_not_of(" \t");
+        return x == std::string::npos ? 0 : x;
+    }
+
+    // OSC 52 payloads past this are refused by most terminals anyway
+    constexpr size_t MAX_CLIPBOARD_BYTES = 1 << 20;
+    constexpr size_t MAX_CLIPBOARD_LINES = 100000;
+
+    std::string base64Encode(const std::string& in) {
+        static const char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+        std::string out;
+        out.reserve((in.size() + 2) / 3 * 4);
+        for (size_t i = 0; i < in.size(); i += 3) {
+            const size_t n = std::min<size_t>(3, in.size() - i);
+            uint32_t v = static_cast<uint32_t>(static_cast<unsigned char>(in[i])) << 16;
+            if (n > 1) v |= static_cast<uint32_t>(static_cast<unsigned char>(in[i + 1])) << 8;
+            if (n > 2) v |= static_cast<unsigned char>(in[i + 2]);
+
+            out += digits[(v >> 18) & 63];
+            out += digits[(v >> 12) & 63];
+            out += n > 1 ? digits[(v >> 6) & 63] : '=';
+            out += n > 2 ? digits[v & 63] : '=';
+        }
+        return out;
+    }
+
+    bool cursorBefore(const UndoHistory::Cursor& a, const UndoHistory::Cursor& b) {
+        return a.y != b.y ? a.y < b.y : a.x < b.x;
+    }
+
+    // Keys handled before a frame is considered, however fast they arrive
+    constexpr size_t MAX_INPUT_BATCH = 4096;
+
+    // :!cmd keeps this much of its output for display
+    constexpr size_t MAX_SHELL_OUTPUT_LINES = 1000;
+
+    // How often a running shell command updates the status line
+    constexpr std::chrono::milliseconds SHELL_PROGRESS_INTERVAL{250};
+
+    // Longest wait for the terminal to answer the startup queries
+    constexpr std::chrono::milliseconds TERMINAL_PROBE_TIMEOUT{200};
+
+    // Most matches one Ctrl-N cycles through
+    constexpr size_t MAX_COMPLETIONS = 64;
+
+    // How long the first Ctrl-N waits for a buffer's words to be counted;
+    // small files are done by then, large ones keep counting in the background
+    constexpr std::chrono::milliseconds WORD_INDEX_WAIT{100};
+
+    // How long the first Ctrl-] waits for the working directory to be
+    // indexed; a tree indexed before is ready at once
+    constexpr std::chrono::milliseconds SYMBOL_INDEX_WAIT{2000};
+
+    bool inputPending() {
+        pollfd in{STDIN_FILENO, POLLIN, 0};
+        return poll(&in, 1, 0) > 0;
+    }
+
+    // Cells a composed row covers: escape sequences take none, and neither
+    // do UTF-8 continuation bytes
+    size_t displayCells(const std::string_view row) {
+        size_t cells = 0;
+        for (size_t i = 0; i < row.size(); ++i) {
+            if (row[i] == '\x1b') {
+                // Skip to the final byte of the sequence
+                for (i += 2; i < row.size() && (row[i] < '@' || row[i] > '~'); ++i) {}
+            } else if ((static_cast<unsigned char>(row[i]) & 0xc0) != 0x80) {
+                ++cells;
+            }
+        }
+        return cells;
+    }
+
+    // Brace pairs fold code in these, indentation everything else
+    QEditor::FoldTree::Method foldMethodFor(const std::string& filename) {
+        static const char* const braced[] = {".c", ".h", ".cc", ".cpp", ".cxx", ".hh", ".hpp", ".java", ".js",
+                                             ".ts", ".go", ".rs", ".cs", ".swift", ".kt", ".php"};
+        const std::string extension = std::filesystem::path(filename).extension().string();
+        for (const char* candidate : braced) {
+            if (extension == candidate) return QEditor::FoldTree::Method::Braces;
+        }
+        return QEditor::FoldTree::Method::Indent;
+    }
+
+    // Suffix for the load message once cold blocks have been packed
+    std::string compressionSavings(const QEditor::LineStore& lines) {
+        const QEditor::LineStore::Stats stats = lines.stats();
+        if (stats.unpackedBytes <= stats.residentBytes) return "";
+        return ", " + formatBytes(stats.unpackedBytes - stats.residentBytes) + " saved by compression";
+    }
 }
 
 Editor::Editor() {
@@ -27,6 +166,7 @@ Editor::Editor() {
         screenCols = 80;
     }
 #endif
+    layoutWindows();
 
     // Load configuration
     config.parse();
@@ -40,6 +180,25 @@ Editor::Editor() {
         showLineNumbers = *lineNums;
     }
 
+    if (const auto frameRate = config.getInt("frame_rate")) {
+        frames.setFrameRate(*frameRate);
+    }
+
+    if (const auto softWrap = config.getBool("wrap")) {
+        wrap = *softWrap;
+    }
+
+    if (config.getBool("index_cache").value_or(true)) {
+        const auto cacheSize = config.getInt("index_cache_size");
+        indexCache.emplace(QEditor::IndexCache::defaultDirectory(),
+                           cacheSize ? static_cast<uint64_t>(std::max(*cacheSize, 0)) * 1024 * 1024
+                                     : QEditor::IndexCache::DEFAULT_MAX_BYTES);
+    }
+
+    if (const auto cacheSize = config.getInt("background_cache_size")) {
+        backgroundCacheBytes = static_cast<size_t>(std::max(*cacheSize, 0)) * 1024 * 1024;
+    }
+
     filename = "";
     commandBuffer = "";
 
@@ -54,6 +213,8 @@ Editor::Editor() {
         std::cout << "\x1b[H" << std::flush;
         // Disable line wrapping
         std::cout << "\x1b[?7l" << std::flush;
+
+        terminal = QEditor::probeTerminal(STDIN_FILENO, STDOUT_FILENO, TERMINAL_PROBE_TIMEOUT);
 #ifdef TESTING
     }
 #endif
@@ -92,27 +253,116 @@ void Editor::run() {
     running = true;
 
     while (running) {
-        // Wait up to 500ms for input
+        // Wait up to 1s for input or a change to a followed file, or until a
+        // frame held back during an input burst is due
         fd_set readfds;
         FD_ZERO(&readfds);
         FD_SET(STDIN_FILENO, &readfds);
 
+        int maxFd = STDIN_FILENO;
+        const int watchFd = watcher ? watcher->getFd() : -1;
+        if (watchFd != -1) {
+            FD_SET(watchFd, &readfds);
+            maxFd = std::max(maxFd, watchFd);
+        }
+        const int loadFd = loader ? loader->getFd() : -1;
+        if (loadFd != -1) {
+            FD_SET(loadFd, &readfds);
+            maxFd = std::max(maxFd, loadFd);
+        }
+        const int diffFd = differ ? differ->getFd() : -1;
+        if (diffFd != -1) {
+            FD_SET(diffFd, &readfds);
+            maxFd = std::max(maxFd, diffFd);
+        }
+        const int searchFd = search ? search->getFd() : -1;
+        if (searchFd != -1) {
+            FD_SET(searchFd, &readfds);
+            maxFd = std::max(maxFd, searchFd);
+        }
+
+        const bool framePending = frames.isDirty();
         timeval timeout{};
-        timeout.tv_sec = 1;
+        if (framePending) {
+            const auto wait = std::chrono::duration_cast<std::chrono::microseconds>(
+                frames.timeUntilDue(QEditor::FrameScheduler::Clock::now()));
+            timeout.tv_sec = static_cast<time_t>(wait.count() / 1000000);
+            timeout.tv_usec = static_cast<suseconds_t>(wait.count() % 1000000);
+        } else {
+            timeout.tv_sec = 1;
+        }
 
-        const int ready = select(STDIN_FILENO + 1, &readfds, nullptr, nullptr, &timeout);
+        const int ready = select(maxFd + 1, &readfds, nullptr, nullptr, &timeout);
 
         if (ready == -1 && errno != EINTR) {
             perror("select");
             break;
         }
 
-        if (ready > 0) {
-            processKeypress();
+        if (needsRedrawn) {
+            // Resumed or resized, the terminal contents can't be trusted
+            needsRedrawn = false;
+            invalidateScreen();
+            requestRedraw();
+        }
+
+        if (ready > 0 && loadFd != -1 && FD_ISSET(loadFd, &readfds) && drainLoader()) {
+            requestRedraw();
+        }
+
+        if (ready > 0 && diffFd != -1 && FD_ISSET(diffFd, &readfds)) {
+            takeDiff();
+        }
+
+        if (ready > 0 && searchFd != -1 && FD_ISSET(searchFd, &readfds)) {
+            takeSearchResults();
+            requestRedraw();
+        }
+
+        if (ready > 0 && watchFd != -1 && FD_ISSET(watchFd, &readfds)) {
+            const unsigned events = watcher->readEvents();
+            if (following ? followUpdate(events) : checkExternalChange()) {
+                requestRedraw();
+            }
+        }
+
+        if (ready > 0 && FD_ISSET(STDIN_FILENO, &readfds)) {
+            // Everything already typed is one batch, painted at most once
+            size_t keys = 0;
+            do {
+                processKeypress();
+            } while (running && ++keys < MAX_INPUT_BATCH && inputPending());
+        } else if (ready == 0 && !framePending) {
+            // Without inotify, fall back to checking the file on each tick
+            if (following && followUpdate()) {
+                requestRedraw();
+            } else if (!following && watchFd == -1 && checkExternalChange()) {
+                requestRedraw();
+            } else if (pager && pager->isIndexing() && mode != COMMAND) {
+                // Keep the indexing progress in the status bar current
+                setStatusMessage(pager->status());
+                requestRedraw();
+            }
+        }
+
+        // Edits since the last diff go to the worker once it is free
+        if (differ) {
+            refreshDiff();
+        }
+
+        const auto now = QEditor::FrameScheduler::Clock::now();
+        if (running && frames.shouldRender(inputPending(), now)) {
+            drawScreen();
+            frames.rendered(now);
         }
     }
 }
 
+void Editor::requestRedraw() {
+    scroll();
+    frames.markDirty();
+}
+
 void Editor::stop() {
     running = false;
 }
@@ -127,72 +377,43 @@ void Editor::processKeypress() {
         }
     }
 
-    if (nread == 1) {
-        if (mode == VIEW) {
-            if (c == 'i') {
-                editMode();
-            } else if (c == ':') {
-                commandBuffer.clear();
-
-                mode = COMMAND;
-                if (cur_y >= buffer.size()) {
-                    // Ensure at least one line exists
-                    buffer.emplace_back("");
+    if (nread == 1 && !infoLines.empty()) {
+        // Any key dismisses the info lines
+        infoLines.clear();
+    } else if (nread == 1) {
+        if (pager && mode != COMMAND) {
+            processPagerKey(c);
+        } else if (mode == VIEW) {
+            if (c == '\x1b') {
+                // Esc drops a half-typed command, a lone one the extra cursors too
+                normalKeys.reset();
+                if (!inputPending()) {
+                    extraCursors.clear();
                 }
 
-                if (buffer[cur_y].size() < 2) {
-                    // Pad with spaces to at least 2 chars for cur x positioning
-                    buffer[cur_y].resize(2, ' ');
-                }
-
-                cur_x = 1;
-
-                commandBuffer += c;
-            } else if (c == 'x') {
-                deleteChar();
-            } else if (c == 'o') {
-                cur_x = buffer[cur_y].length();
-
-                insertNewline();
-
-                editMode();
-            } else if (c == 'a') {
-                ++cur_x;
-                editMode();
-            } else if (c == 'd') {
-                commandBuffer += c;
-
-                if (commandBuffer == "dd") {
-                    commandBuffer.clear();
-                    deleteLine();
-                }
-            } else if (c == 'A') {
-                editMode();
-
-                jumpToEnd();
-            } else if (c == 'D') {
-                deleteToEol();
-            } else if (c == 'w') {
-                jumpWord();
-            } else if (c == '0') {
-                cur_x = 0;
-            } else {
-                // Handle multibyte input by ignoring them
-                if (c == '\x1b') {
-                    // Possible escape sequence (i.e., arrow key)
-                    char seq[2];
-                    if (read(STDIN_FILENO, &seq[0], 1) == 1 &&
-                        read(STDIN_FILENO, &seq[1], 1) == 1) {
-                        // Check for arrow key sequence: [A, B, C, D]
-                        if (seq[0] == '[' && (seq[1] >= 'A' && seq[1] <= 'D')) {
-                            return;
-                        }
+                // Possible escape sequence (i.e., arrow key), ignored for now
+                char seq[2];
+                if (inputPending() && read(STDIN_FILENO, &seq[0], 1) == 1 &&
+                    read(STDIN_FILENO, &seq[1], 1) == 1) {
+                    // Check for arrow key sequence: [A, B, C, D]
+                    if (seq[0] == '[' && (seq[1] >= 'A' && seq[1] <= 'D')) {
+                        return;
                     }
                 }
-
-                moveCursor(c);
+            } else if (const auto status = normalKeys.feed(c); status != NormalParser::Status::Pending) {
+                if (status == NormalParser::Status::Complete) {
+                    runNormal(normalKeys.command());
+                }
+                normalKeys.reset();
             }
+        } else if (mode == VISUAL) {
+            processVisualKey(c);
         } else if (mode == EDIT) {
+            // Any key but another Ctrl-N or Ctrl-P keeps the completion shown
+            if (c != 14 && c != 16) {
+                completion.active = false;
+            }
+
             if (c == 27) { // esc
                 mode = VIEW;
 
@@ -200,15 +421,36 @@ void Editor::processKeypress() {
                 if (cur_x > 0) {
                     --cur_x;
                 }
+                for (Cursor& cursor : extraCursors) {
+                    if (cursor.x > 0) --cursor.x;
+                }
 
                 setCursorShapeNormal();
+            } else if (c == 14 || c == 16) { // Ctrl-N / Ctrl-P
+                completeWord(c == 14);
+            } else if (!extraCursors.empty()) {
+                // Every cursor gets the same edit, applied in one pass
+                if (c == 127) {
+                    deleteAtCursors();
+                } else if (c == '\n') {
+                    splitAtCursors();
+                } else if (c == '\t') {
+                    insertAtCursors(std::string(TAB_WIDTH, ' '));
+                } else {
+                    insertAtCursors(std::string_view(&c, 1));
+                }
             } else if (c == 127) { // backspace
                 deleteChar();
             } else if (c == '\n') {
                 insertNewline();
             } else if (c == '\t') {
-                buffer[cur_y].insert(cur_x, 1, '\t');
-                buffer[cur_y] = expandTabs(buffer[cur_y]);
+                ensureLine(cur_y);
+
+                // Tabs are inserted as spaces, in place
+                beginChange(cur_y, 1);
+                std::string& line = buffer[cur_y];
+                line.insert(std::min(cur_x, line.size()), TAB_WIDTH, ' ');
+                endChange(1);
 
                 cur_x += TAB_WIDTH;
             } else { // insert
@@ -226,12 +468,12 @@ void Editor::processKeypress() {
                 if (!commandBuffer.empty())
                     processCommand();
 
-                mode = VIEW;
+                leaveCommandMode();
             } else if (c == 127) { // backspace
                 if (!commandBuffer.empty()) commandBuffer.pop_back();
-                if (commandBuffer.empty()) mode = VIEW;
+                if (commandBuffer.empty()) leaveCommandMode();
             } else if (c == 27) { // esc
-                mode = VIEW;
+                leaveCommandMode();
                 commandBuffer.clear();
             } else {
                 commandBuffer.push_back(c);
@@ -239,236 +481,3074 @@ void Editor::processKeypress() {
         }
     }
 
-    drawScreen();
+    // Everything since the last keypress outside insert mode is one undo step
+    if (mode != EDIT) {
+        undoHistory.commit(buffer, {cur_x, cur_y});
+    }
+
+    requestRedraw();
 }
 
-void Editor::moveCursor(const char direction) {
-    if (direction == 'h' || direction == 127) { // Move left for "h" key or delete/backspace
-        if (cur_x > 0) {
-            --cur_x;
-        }
-    } else if (direction == 'l') { // Move right
-        if (cur_y < buffer.size()) {
-            if (const std::string& line = buffer[cur_y]; cur_x < line.size() - 1) {
-                ++cur_x;
-            }
-        }
-    } else if (direction == 'j') { // Move down
-        if (cur_y + 1 < buffer.size()) {
-            ++cur_y;
+void Editor::enterCommandMode(const std::string& text) {
+    mode = COMMAND;
+    commandBuffer = text;
 
-            if (const std::string& line = buffer[cur_y]; cur_x >= line.length()) {
-                // clamp cur_x to end of line (or 0 if empty)
-                cur_x = line.empty() ? 0 : line.size() - 1;
-            }
-        }
-    } else if (direction == 'k') { // Move up
-        if (cur_y > 0) {
-            --cur_y;
+    // cur_x tracks the command bar until the command finishes
+    commandReturnX = cur_x;
+    cur_x = commandBuffer.size();
+}
 
-            if (cur_x >= buffer[cur_y].size()) {
-                cur_x = buffer[cur_y].size() - 1;
-            }
-        }
+void Editor::leaveCommandMode() {
+    mode = VIEW;
+    if (pager) return;
+
+    cur_x = commandReturnX;
+    if (cur_y >= buffer.size()) {
+        cur_y = buffer.empty() ? 0 : buffer.size() - 1;
+    }
+    if (cur_y < buffer.size() && cur_x >= std::as_const(buffer)[cur_y].size()) {
+        cur_x = std::as_const(buffer)[cur_y].empty() ? 0 : std::as_const(buffer)[cur_y].size() - 1;
     }
 }
 
-void Editor::insertText(const char c) {
-    if (cur_y >= buffer.size()) buffer.resize(cur_y + 1);
+void Editor::runNormal(const NormalCommand& cmd) {
+    const char c = cmd.key;
 
-    std::string& line = buffer[cur_y];
-    if (cur_x <= line.size()) {
-        line.insert(cur_x, 1, c);
+    // Typing and motions go to every cursor, other edits to the primary alone
+    if (cmd.op || std::string_view("xDpPou").find(c) != std::string_view::npos || c == 18) {
+        extraCursors.clear();
+    }
+
+    if (cmd.prefix == 'z') {
+        runFold(cmd);
+    } else if (cmd.prefix == 23) { // Ctrl-W
+        runWindowCommand(c);
+    } else if (cmd.op) {
+        applyOperator(cmd);
+    } else if (c == 'i') {
+        editMode();
+    } else if (c == ':') {
+        enterCommandMode(":");
+    } else if (c == 'u') {
+        for (size_t i = 0; i < cmd.count && undoHistory.undoDepth() > 0; ++i) {
+            undo();
+        }
+    } else if (c == 18) { // Ctrl-R
+        for (size_t i = 0; i < cmd.count && undoHistory.redoDepth() > 0; ++i) {
+            redo();
+        }
+    } else if (c == 'x') {
+        if (cur_y < buffer.size() && std::as_const(buffer)[cur_y].empty()) {
+            deleteChar();
+        } else {
+            applyOperator({cmd.count, cmd.counted, 'd', 'l', cmd.reg});
+        }
+    } else if (c == 'D') {
+        applyOperator({cmd.count, cmd.counted, 'd', '$', cmd.reg});
+    } else if (c == 'p' || c == 'P') {
+        putRegister(c == 'p', cmd.count, cmd.reg);
+    } else if (c == 'o') {
+        cur_x = std::as_const(buffer)[cur_y].length();
+
+        insertNewline();
+
+        editMode();
+    } else if (c == 'a') {
+        ++cur_x;
+        for (Cursor& cursor : extraCursors) {
+            cursor.x = std::min(cursor.x + 1, std::as_const(buffer)[cursor.y].size());
+        }
+        editMode();
+    } else if (c == 14) { // Ctrl-N
+        addCursorAtNextMatch();
+    } else if (c == 29 && cur_y < buffer.size()) { // Ctrl-]
+        const std::string& line = std::as_const(buffer)[cur_y];
+        size_t start = std::min(cur_x, line.size());
+        size_t end = start;
+        while (start > 0 && charClass(line[start - 1]) == 1) --start;
+        while (end < line.size() && charClass(line[end]) == 1) ++end;
+        if (start == end) {
+            setStatusMessage("No word under the cursor");
+            return;
+        }
+        try {
+            jumpToTag(line.substr(start, end - start));
+        } catch (const QEditor::EditorError& e) {
+            setStatusMessage(e.what());
+        }
+    } else if (c == 20) { // Ctrl-T
+        popTag();
+    } else if (c == 'A') {
+        editMode();
+
+        jumpToEnd();
+        for (Cursor& cursor : extraCursors) {
+            cursor.x = std::as_const(buffer)[cursor.y].size();
+        }
+    } else if (c == 'v' || c == 'V' || c == 22) { // Ctrl-V
+        startVisual(c);
+    } else if ((NormalParser::isMotion(c) || c == 'g') && !extraCursors.empty()) {
+        // Motions move every cursor
+        size_t primary;
+        std::vector<Cursor> all = allCursors(primary);
+        for (Cursor& cursor : all) {
+            cur_x = cursor.x;
+            cur_y = cursor.y;
+            moveTo(cmd);
+            cursor = {cur_x, cur_y};
+        }
+        setCursors(std::move(all), primary);
+    } else if (NormalParser::isMotion(c) || c == 'g') {
+        moveTo(cmd);
     } else {
-        line += c;
+        moveCursor(c);
     }
+}
 
-    ++cur_x;
+void Editor::moveTo(const NormalCommand& cmd) {
+    if (buffer.empty()) return;
+
+    clampCursor();
+    const Motion target = resolveMotion(cmd);
+    cur_x = target.x;
+    cur_y = target.y;
+
+    // The normal mode cursor sits on a character
+    const size_t length = std::as_const(buffer)[cur_y].size();
+    cur_x = std::min(cur_x, length ? length - 1 : 0);
 }
 
-void Editor::deleteChar() {
-    if (cur_y >= buffer.size()) {
-        // nothing to delete
-        return;
-    }
+void Editor::startVisual(const char kind) {
+    ensureLine(cur_y);
+    clampCursor();
 
-    // if empty line, delete it
-    if (buffer[cur_y].empty()) {
-        const auto it = buffer.begin() + static_cast<std::vector<std::string>::difference_type>(cur_y);
-        buffer.erase(it);
+    mode = VISUAL;
+    visualKind = kind;
+    visualX = cur_x;
+    visualY = cur_y;
+}
 
-        if (cur_y > 0) {
-            cur_y = buffer.empty() ? 0 : cur_y - 1;
-            cur_x = buffer[cur_y].length() - 1;
+void Editor::processVisualKey(const char c) {
+    if (c == '\x1b') {
+        normalKeys.reset();
+
+        // Arrow keys are ignored, a lone Esc ends the selection
+        if (inputPending()) {
+            char seq[2];
+            if (read(STDIN_FILENO, &seq[0], 1) == 1 && read(STDIN_FILENO, &seq[1], 1) == 1) return;
         }
-    } else {
-        const bool deleted = cur_x >= buffer[cur_y].size();
+        mode = VIEW;
+    } else if (normalKeys.wantsRegister()) {
+        // "x names the register for the operator that follows
+        if (normalKeys.feed(c) == NormalParser::Status::Invalid) normalKeys.reset();
+    } else if (c == 'd' || c == 'x' || c == 'y' || c == 'c' || c == '>' || c == '<' ||
+               c == '~' || c == 'u' || c == 'U') {
+        const char name = normalKeys.command().reg;
+        normalKeys.reset();
+        applyVisual(c == 'x' ? 'd' : c, name);
+    } else if (c == 'v' || c == 'V' || c == 22) {
+        normalKeys.reset();
+
+        // The same key again ends the selection, another one switches its kind
+        if (c == visualKind) {
+            mode = VIEW;
+        } else {
+            visualKind = c;
+        }
+    } else if (c == 14) { // Ctrl-N
+        normalKeys.reset();
+        mode = VIEW;
+        addCursorsOnLines(std::min(visualY, cur_y), std::max(visualY, cur_y));
+    } else if (c == ':') {
+        // The command runs on the selected lines
+        normalKeys.reset();
+        visualFirst = std::min(visualY, cur_y);
+        visualLast = std::max(visualY, cur_y);
+        enterCommandMode(":'<,'>");
+    } else if (c == 'o') {
+        normalKeys.reset();
+        std::swap(cur_x, visualX);
+        std::swap(cur_y, visualY);
+    } else if (normalKeys.feed(c) != NormalParser::Status::Pending) {
+        // Only motions reach here, operators were handled above
+        const NormalCommand cmd = normalKeys.command();
+        normalKeys.reset();
+        if (NormalParser::isMotion(cmd.key) || cmd.key == 'g') {
+            moveTo(cmd);
+        }
+    }
+}
 
-        buffer[cur_y].erase(cur_x, 1);
+std::pair<size_t, size_t> Editor::selectionOn(const size_t y, const std::string& line) const {
+    if (visualKind == 22) {
+        const size_t left = std::min(visualX, cur_x);
+        const size_t right = std::max(visualX, cur_x) + 1;
+        return {std::min(left, line.size()), std::min(right, line.size())};
+    }
 
-        if (deleted) --cur_x;
+    if (visualKind == 'V' || visualY == cur_y) {
+        if (visualKind == 'V') return {0, line.size()};
+        return {std::min(std::min(visualX, cur_x), line.size()), std::min(std::max(visualX, cur_x) + 1, line.size())};
     }
+
+    // Charwise across lines: the first row from the start, the last row up to the end, whole rows between
+    const bool anchorFirst = visualY < cur_y;
+    const size_t startX = anchorFirst ? visualX : cur_x;
+    const size_t endX = anchorFirst ? cur_x : visualX;
+    const size_t first = std::min(visualY, cur_y);
+    const size_t last = std::max(visualY, cur_y);
+
+    const size_t start = y == first ? std::min(startX, line.size()) : 0;
+    const size_t end = y == last ? std::min(endX + 1, line.size()) : line.size();
+    return {start, end};
 }
 
-void Editor::loadFile(const std::string& filename) {
-    if (filename.empty()) {
-        throw QEditor::FileError("Empty filename");
+void Editor::applyVisual(const char op, const char name) {
+    const size_t first = std::min(visualY, cur_y);
+    const size_t last = std::max(visualY, cur_y);
+    const size_t count = last - first + 1;
+    const QEditor::LineStore& lines = buffer;
+    mode = VIEW;
+
+    if (op == '>' || op == '<') {
+        shiftLines(first, last, op == '>');
+        cur_y = first;
+        cur_x = firstNonBlank(lines[first]);
+        return;
     }
 
-    // Check if file exists and is readable
-    if (std::filesystem::exists(filename)) {
-        if (access(filename.c_str(), R_OK) != 0) {
-            throw QEditor::FilePermissionError(filename);
+    if (op == '~' || op == 'u' || op == 'U') {
+        // One pass over the rows, recorded as a single change
+        beginChange(first, count);
+        for (size_t y = first; y <= last; ++y) {
+            std::string& line = buffer[y];
+            const auto [start, end] = selectionOn(y, line);
+            for (size_t x = start; x < end; ++x) {
+                const auto ch = static_cast<unsigned char>(line[x]);
+                const bool upper = op == 'U' || (op == '~' && std::islower(ch));
+                line[x] = static_cast<char>(upper ? std::toupper(ch) : std::tolower(ch));
+            }
         }
+        endChange(count);
+
+        cur_y = first;
+        cur_x = std::min(cur_x, visualX);
+        return;
     }
 
-    std::ifstream file(filename, std::ios::in);
-    if (!file) {
-        // File doesn't exist, create empty buffer
-        this->filename = filename;
-        buffer.clear();
-        buffer.emplace_back("");
-        setStatusMessage("New file: " + filename);
+    if (visualKind == 'V') {
+        // The same range operation as a counted dd, yy or cc from the first line
+        cur_y = first;
+        applyOperator({count, true, op, op, name});
         return;
     }
 
-    try {
-        this->filename = filename;
-        buffer.clear();
-        std::string line;
-        while (std::getline(file, line)) {
-            buffer.push_back(line);
+    if (visualKind == 22) {
+        // Block edits work row by row inside one change
+        std::vector<std::string> text;
+        text.reserve(count);
+        for (size_t y = first; y <= last; ++y) {
+            const std::string& line = lines[y];
+            const auto [start, end] = selectionOn(y, line);
+            text.push_back(line.substr(start, end - start));
+        }
+        storeRegister(name, op == 'y', {std::move(text), Register::Kind::Blockwise});
+
+        const size_t left = std::min(visualX, cur_x);
+        if (op != 'y') {
+            beginChange(first, count);
+            for (size_t y = first; y <= last; ++y) {
+                std::string& line = buffer[y];
+                const auto [start, end] = selectionOn(y, line);
+                line.erase(start, end - start);
+            }
+            endChange(count);
         }
 
-        if (buffer.empty()) {
-            buffer.emplace_back("");
+        cur_y = first;
+        cur_x = left;
+    } else {
+        const bool anchorFirst = std::tie(visualY, visualX) < std::tie(cur_y, cur_x);
+        const Motion from = anchorFirst ? Motion{visualX, visualY} : Motion{cur_x, cur_y};
+        Motion to = anchorFirst ? Motion{cur_x, cur_y} : Motion{visualX, visualY};
+        to.x = std::min(to.x + 1, lines[to.y].size());
+
+        storeRegister(name, op == 'y', {copyText(from, to), Register::Kind::Charwise});
+        if (op != 'y') {
+            eraseText(from, to);
         }
 
-        setStatusMessage("\"" + filename + "\" " + std::to_string(buffer.size()) + " lines");
-    } catch (const std::exception& e) {
-        throw QEditor::FileOpenError(filename + ": " + e.what());
+        cur_x = from.x;
+        cur_y = from.y;
     }
-}
 
-void Editor::saveFile(const std::string& filename) const {
-    const std::string trimmedFilename = trimWhitespace(filename);
-    if (trimmedFilename.empty()) {
-        throw QEditor::FileError("Empty filename");
+    if (op == 'c') {
+        editMode();
+    } else {
+        const size_t length = lines[cur_y].size();
+        cur_x = std::min(cur_x, length ? length - 1 : 0);
     }
+}
 
-    // Check if we can write to the directory
-    const std::filesystem::path filePath(trimmedFilename);
-    const std::filesystem::path dirPath = filePath.parent_path();
-    
-    if (!dirPath.empty() && std::filesystem::exists(dirPath)) {
-        if (access(dirPath.c_str(), W_OK) != 0) {
-            throw QEditor::FilePermissionError(dirPath.string());
+void Editor::shiftLines(const size_t first, const size_t last, const bool right) {
+    const size_t count = last - first + 1;
+
+    beginChange(first, count);
+    for (size_t y = first; y <= last; ++y) {
+        std::string& line = buffer[y];
+        if (right) {
+            // Empty lines are left alone, as in vim
+            if (!line.empty()) line.insert(0, TAB_WIDTH, ' ');
+        } else if (!line.empty() && line[0] == '\t') {
+            line.erase(0, 1);
+        } else {
+            line.erase(0, std::min(line.find_first_not_of(' '), std::min(TAB_WIDTH, line.size())));
         }
     }
+    endChange(count);
+}
 
-    // Check if file exists and is writable
-    if (std::filesystem::exists(trimmedFilename)) {
-        if (access(trimmedFilename.c_str(), W_OK) != 0) {
-            throw QEditor::FilePermissionError(trimmedFilename);
+Editor::Motion Editor::resolveMotion(const NormalCommand& cmd) const {
+    const QEditor::LineStore& lines = buffer;
+    const size_t last = lines.size() - 1;
+    const size_t count = cmd.count;
+    Motion target{std::min(cur_x, lines[cur_y].size()), cur_y, false};
+
+    if (cmd.op && cmd.key == cmd.op) { // dd, yy, cc
+        target.y = lineBelow(cur_y, count - 1);
+        target.linewise = true;
+    } else if (cmd.key == 'h') {
+        target.x -= std::min(count, target.x);
+    } else if (cmd.key == 'l') {
+        target.x = std::min(target.x + count, lines[cur_y].size());
+    } else if (cmd.key == '0') {
+        target.x = 0;
+    } else if (cmd.key == '$') {
+        target.y = std::min(cur_y + count - 1, last);
+        target.x = lines[target.y].size();
+    } else if ((cmd.key == 'j' || cmd.key == 'k') && wrap && !cmd.op && !differ) {
+        target = moveByRows(count, cmd.key == 'j');
+    } else if (cmd.key == 'j' || cmd.key == 'k') {
+        target.y = cmd.key == 'j' ? lineBelow(cur_y, count) : lineAbove(cur_y, count);
+        target.linewise = true;
+    } else if (cmd.key == 'G' || cmd.key == 'g') {
+        // A count is a line number, otherwise G goes to the end and gg to the start
+        const size_t line = cmd.counted ? std::min(count, lines.size()) - 1 : (cmd.key == 'G' ? last : 0);
+        target = {firstNonBlank(lines[line]), line, true};
+    } else if (cmd.key == 'w') {
+        for (size_t i = 0; i < count && nextWordStart(target.x, target.y); ++i) {}
+
+        if (cmd.op && target.y > cur_y) {
+            // An operator stops at the end of the line rather than at the next line's first word
+            --target.y;
+            target.x = lines[target.y].size();
         }
-    }
-
-    std::ofstream file(trimmedFilename);
-    if (!file) {
-        throw QEditor::FileSaveError(trimmedFilename);
-    }
 
-    try {
-        for (const std::string& line : buffer) {
-            if (!(file << line << std::endl)) {
-                throw QEditor::FileSaveError(trimmedFilename + ": Write failed");
+        if (cmd.op == 'c') {
+            // cw changes the word but not the blanks after it
+            const std::string& line = lines[target.y];
+            const size_t start = target.y == cur_y ? std::min(cur_x, line.size()) : 0;
+            if (start < line.size() && !isBlank(line[start])) {
+                while (target.x > start && isBlank(line[target.x - 1])) --target.x;
             }
         }
-        setStatusMessage(EditorCommands::WROTE_TO + trimmedFilename);
-    } catch (const std::exception& e) {
-        throw QEditor::FileSaveError(trimmedFilename + ": " + e.what());
     }
+
+    return target;
 }
 
-void Editor::drawScreen() const {
-    // First, hide cursor while drawing
-    std::cout << "\x1b[?25l";
+bool Editor::nextWordStart(size_t& x, size_t& y) const {
+    const QEditor::LineStore& lines = buffer;
+    const std::string* line = &lines[y];
 
-    // Position at home
-    std::cout << "\x1b[H";
-    
-    // Calculate line number width
-    size_t lineNumWidth = 0;
-    if (showLineNumbers) {
-        lineNumWidth = std::to_string(buffer.size()).length() + 1; // +1 for the space after
+    // Skip the rest of the current word or run of punctuation
+    if (x < line->size()) {
+        const int kind = charClass((*line)[x]);
+        while (x < line->size() && charClass((*line)[x]) == kind) ++x;
     }
 
-    // Draw content line by line with explicit positioning
-    for (size_t i = 0; i < screenRows - 1; ++i) {
-        // Position cursor at start of each line
-        std::cout << "\x1b[" << (i + 1) << ";1H";
+    while (true) {
+        while (x < line->size() && isBlank((*line)[x])) ++x;
+        if (x < line->size()) return true;
 
-        // Clear the entire line first
-        std::cout << "\x1b[2K";
+        if (y + 1 >= lines.size()) return false;
+        ++y;
+        x = 0;
+        line = &lines[y];
 
-        // Draw line numbers if config'd
-        if (showLineNumbers) {
-            if (i < buffer.size() || i == 0) {
-                // Right-align the line number
-                std::string lineNum = std::to_string(i + 1);
-                std::string padding(lineNumWidth - lineNum.length() - 1, ' ');
-                std::cout << padding << lineNum << " ";
-            } else {
-                // Print spaces for line number column on empty lines
-                std::cout << std::string(lineNumWidth, ' ');
-            }
-        }
+        // An empty line counts as a word
+        if (line->empty()) return true;
+    }
+}
 
-        // Draw content if available
-        if (i < buffer.size()) {
-            std::cout << expandTabs(buffer[i]);
-        } else if (i != 0) {
-            std::cout << "~";
-        }
+void Editor::applyOperator(const NormalCommand& cmd) {
+    if (buffer.empty()) {
+        if (cmd.op == 'c') editMode();
+        return;
     }
 
-    // Draw status/command line
-    std::cout << "\x1b[" << screenRows << ";1H\x1b[2K";
+    clampCursor();
+    const Motion target = resolveMotion(cmd);
+    const QEditor::LineStore& lines = buffer;
+
+    if (target.linewise) {
+        // A closed fold is taken whole
+        const size_t first = std::min(cur_y, target.y);
+        size_t lastLine = std::max(cur_y, target.y);
+        if (const QEditor::FoldTree* shown = shownFolds()) lastLine = shown->closedEnd(lastLine);
+        const size_t count = lastLine - first + 1;
+        storeRegister(cmd.reg, cmd.op == 'y', {lines.slice(first, count), Register::Kind::Linewise});
+
+        if (cmd.op == 'd') {
+            // The whole range goes in a single erase and a single undo record
+            removeLines(first, count);
+            cur_y = std::min(first, buffer.empty() ? 0 : buffer.size() - 1);
+            cur_x = buffer.empty() ? 0 : firstNonBlank(lines[cur_y]);
+        } else if (cmd.op == 'c') {
+            if (count > 1) {
+                removeLines(first + 1, count - 1);
+            }
+            beginChange(first, 1);
+            buffer[first].clear();
+            endChange(1);
 
-    if (mode == COMMAND && !commandBuffer.empty()) {
-        std::cout << ":" << commandBuffer.substr(1);
+            cur_y = first;
+            cur_x = 0;
+            editMode();
+        } else {
+            cur_y = first;
+            clampCursor();
+        }
+        return;
     }
 
-    // Show status message if any
-    if (!statusMessage.empty()) {
-        size_t col = screenCols - statusMessage.length() + 1;
+    Motion from{cur_x, cur_y, false};
+    Motion to = target;
+    if (std::tie(to.y, to.x) < std::tie(from.y, from.x)) std::swap(from, to);
 
-        if (col < 1) col = 1;
+    storeRegister(cmd.reg, cmd.op == 'y', {copyText(from, to), Register::Kind::Charwise});
 
-        std::cout << "\x1b[" << screenRows << ";" << col << "H" << statusMessage;
+    if (cmd.op != 'y') {
+        eraseText(from, to);
     }
 
-    // Position cursor at edit location
-    if (mode != COMMAND) {
-        const int renderX = getRenderX(buffer[cur_y], cur_x);
-        if (showLineNumbers) {
-            lineNumWidth = std::to_string(buffer.size()).length() + 1; // +1 for the space after
-        }
-        std::cout << "\x1b[" << (cur_y + 1) << ";" << (renderX + lineNumWidth + 1) << "H";
+    cur_x = from.x;
+    cur_y = from.y;
+
+    if (cmd.op == 'c') {
+        editMode();
     } else {
-        // Move cursor to command bar
-        std::cout << "\033[" << screenRows << ";" << cur_x + 1 << "H" << std::flush;
+        const size_t length = lines[cur_y].size();
+        cur_x = std::min(cur_x, length ? length - 1 : 0);
+    }
+}
+
+std::vector<std::string> Editor::copyText(const Motion& from, const Motion& to) const {
+    const QEditor::LineStore& lines = buffer;
+
+    if (from.y == to.y) {
+        return {lines[from.y].substr(from.x, to.x - from.x)};
+    }
+
+    std::vector<std::string> text;
+    text.reserve(to.y - from.y + 1);
+    text.push_back(lines[from.y].substr(from.x));
+    for (size_t y = from.y + 1; y < to.y; ++y) {
+        text.push_back(lines[y]);
+    }
+    text.push_back(lines[to.y].substr(0, to.x));
+    return text;
+}
+
+void Editor::eraseText(const Motion& from, const Motion& to) {
+    if (from.y == to.y) {
+        beginChange(from.y, 1);
+        buffer[from.y].erase(from.x, to.x - from.x);
+        endChange(1);
+        return;
+    }
+
+    // Drop the lines in between, then join what is left of the two ends
+    if (to.y - from.y > 1) {
+        removeLines(from.y + 1, to.y - from.y - 1);
+    }
+
+    beginChange(from.y, 2);
+    std::string tail = std::as_const(buffer)[from.y + 1].substr(to.x);
+    std::string& head = buffer[from.y];
+    head.erase(from.x);
+    head += tail;
+    buffer.erase(buffer.begin() + static_cast<QEditor::LineStore::difference_type>(from.y + 1));
+    endChange(1);
+}
+
+void Editor::storeRegister(const char name, const bool yank, Register reg) {
+    if (name >= 'a' && name <= 'z') {
+        named[name - 'a'] = reg;
+    } else if (name == '+') {
+        copyToClipboard(reg);
+        clipboard = reg;
+    }
+
+    if (yank && (name == 0 || name == '"')) {
+        yanked = reg;
+    }
+    unnamed = std::move(reg);
+}
+
+const Editor::Register& Editor::readRegister(const char name) const {
+    if (name >= 'a' && name <= 'z') return named[name - 'a'];
+    if (name == '0') return yanked;
+    if (name == '+') return clipboard;
+    return unnamed;
+}
+
+void Editor::copyToClipboard(const Register& reg) const {
+    if (reg.text.size() > MAX_CLIPBOARD_LINES) {
+        setStatusMessage("Too many lines for the clipboard");
+        return;
+    }
+
+    std::string text;
+    const std::vector<std::string> lines = reg.text.lines();
+    for (size_t i = 0; i < lines.size(); ++i) {
+        if (i > 0) text += '\n';
+        text += lines[i];
+    }
+    if (reg.kind == Register::Kind::Linewise) text += '\n';
+
+    if (text.size() > MAX_CLIPBOARD_BYTES) {
+        setStatusMessage("Too much text for the clipboard");
+        return;
+    }
+
+    // OSC 52 asks the terminal to set its clipboard, which works over ssh too
+    std::cout << "\x1b]52;c;" << base64Encode(text) << "\x07";
+    std::cout.flush();
+}
+
+void Editor::putRegister(const bool after, const size_t count, const char name) {
+    const Register& reg = readRegister(name);
+    if (reg.text.empty()) return;
+
+    if (reg.kind == Register::Kind::Linewise) {
+        const size_t at = std::min(after ? cur_y + 1 : cur_y, buffer.size());
+
+        // Shared blocks go straight into the block table, however large the register
+        beginChange(at, 0);
+        for (size_t i = 0; i < count; ++i) {
+            buffer.splice(at, reg.text);
+        }
+        endChange(reg.text.size() * count);
+
+        cur_y = at;
+        cur_x = firstNonBlank(std::as_const(buffer)[at]);
+        return;
+    }
+
+    const std::vector<std::string> lines = reg.text.lines();
+    if (reg.kind == Register::Kind::Blockwise) {
+        putBlock(lines, after, count);
+        return;
+    }
+
+    // Repeating charwise text joins the end of each copy to the start of the next
+    std::vector<std::string> text(1);
+    for (size_t i = 0; i < count; ++i) {
+        text.back() += lines.front();
+        text.insert(text.end(), lines.begin() + 1, lines.end());
+    }
+
+    ensureLine(cur_y);
+    const size_t length = std::as_const(buffer)[cur_y].size();
+    const size_t x = std::min(after && length > 0 ? cur_x + 1 : cur_x, length);
+
+    beginChange(cur_y, 1);
+    std::string& line = buffer[cur_y];
+    std::string tail = line.substr(x);
+    line.erase(x);
+    line += text.front();
+
+    if (text.size() == 1) {
+        line += tail;
+        endChange(1);
+        cur_x = x + text.front().size() - 1;
+        return;
+    }
+
+    text.back() += tail;
+    const size_t added = text.size() - 1;
+    buffer.insert(buffer.begin() + static_cast<QEditor::LineStore::difference_type>(cur_y + 1),
+                  std::make_move_iterator(text.begin() + 1), std::make_move_iterator(text.end()));
+    endChange(1 + added);
+    cur_x = x;
+}
+
+void Editor::putBlock(const std::vector<std::string>& text, const bool after, const size_t count) {
+    const size_t rows = text.size();
+    ensureLine(cur_y + rows - 1);
+
+    const QEditor::LineStore& lines = buffer;
+    const size_t x = std::min(after && !lines[cur_y].empty() ? cur_x + 1 : cur_x, lines[cur_y].size());
+
+    // Each row of the block goes in at the same column, short lines are padded out to it
+    size_t width = 0;
+    for (const std::string& piece : text) width = std::max(width, piece.size());
+
+    beginChange(cur_y, rows);
+    for (size_t i = 0; i < rows; ++i) {
+        std::string& line = buffer[cur_y + i];
+        if (line.size() < x) line.resize(x, ' ');
+
+        std::string piece;
+        for (size_t n = 0; n < count; ++n) {
+            piece += text[i];
+            if (x < line.size() || n + 1 < count) piece.resize((n + 1) * width, ' ');
+        }
+        line.insert(x, piece);
+    }
+    endChange(rows);
+
+    cur_x = x;
+}
+
+std::vector<Editor::Cursor> Editor::allCursors(size_t& primary) const {
+    std::vector<Cursor> all;
+    all.reserve(extraCursors.size() + 1);
+
+    // extraCursors is kept sorted, so the primary just has to be slotted in
+    const Cursor self{cur_x, cur_y};
+    const auto at = std::lower_bound(extraCursors.begin(), extraCursors.end(), self, cursorBefore);
+    all.insert(all.end(), extraCursors.begin(), at);
+    primary = all.size();
+    all.push_back(self);
+    all.insert(all.end(), at, extraCursors.end());
+    return all;
+}
+
+void Editor::setCursors(std::vector<Cursor> all, const size_t primary) {
+    const Cursor self = all[primary];
+    std::sort(all.begin(), all.end(), cursorBefore);
+    all.erase(std::unique(all.begin(), all.end(), [](const Cursor& a, const Cursor& b) {
+        return a.x == b.x && a.y == b.y;
+    }), all.end());
+
+    cur_x = self.x;
+    cur_y = self.y;
+    all.erase(std::lower_bound(all.begin(), all.end(), self, cursorBefore));
+    extraCursors = std::move(all);
+}
+
+void Editor::addCursorAtNextMatch() {
+    const QEditor::LineStore& lines = buffer;
+    if (cur_y >= lines.size()) return;
+
+    if (extraCursors.empty() || cursorWord.empty()) {
+        // Start from the word under the cursor
+        const std::string& line = lines[cur_y];
+        size_t start = std::min(cur_x, line.size());
+        size_t end = start;
+        while (start > 0 && charClass(line[start - 1]) == 1) --start;
+        while (end < line.size() && charClass(line[end]) == 1) ++end;
+        if (start == end) {
+            setStatusMessage("No word under the cursor");
+            return;
+        }
+
+        cursorWord = line.substr(start, end - start);
+        cur_x = start;
+        lastCursor = {cur_x, cur_y};
+    }
+
+    // Search on from the newest cursor, wrapping around the end
+    for (size_t i = 0; i <= lines.size(); ++i) {
+        const size_t y = (lastCursor.y + i) % lines.size();
+        const size_t from = i == 0 ? lastCursor.x + 1 : 0;
+        const std::string& line = lines[y];
+        if (from > line.size()) continue;
+
+        const size_t x = line.find(cursorWord, from);
+        if (x == std::string::npos) continue;
+
+        size_t primary;
+        std::vector<Cursor> all = allCursors(primary);
+        all.push_back({x, y});
+        setCursors(std::move(all), primary);
+        lastCursor = {x, y};
+        setStatusMessage(std::to_string(extraCursors.size() + 1) + " cursors");
+        return;
+    }
+}
+
+void Editor::addCursorsOnMatches(std::string text) {
+    const QEditor::LineStore& lines = buffer;
+    if (text.empty() && cur_y < lines.size()) {
+        const std::string& line = lines[cur_y];
+        size_t start = std::min(commandReturnX, line.size());
+        size_t end = start;
+        while (start > 0 && charClass(line[start - 1]) == 1) --start;
+        while (end < line.size() && charClass(line[end]) == 1) ++end;
+        text = line.substr(start, end - start);
+    }
+    if (text.empty()) {
+        throw QEditor::CommandError("No word under the cursor");
+    }
+
+    std::vector<Cursor> all;
+    for (size_t y = 0; y < lines.size(); ++y) {
+        const std::string& line = lines[y];
+        for (size_t x = line.find(text); x != std::string::npos; x = line.find(text, x + text.size())) {
+            all.push_back({x, y});
+        }
+    }
+    if (all.empty()) {
+        throw QEditor::CommandError("Pattern not found: " + text);
+    }
+
+    // The first match after the cursor becomes the primary one
+    const Cursor self{commandReturnX, cur_y};
+    const auto next = std::lower_bound(all.begin(), all.end(), self, cursorBefore);
+    const size_t primary = next == all.end() ? 0 : static_cast<size_t>(next - all.begin());
+    commandReturnX = all[primary].x;
+    cursorWord = text;
+    lastCursor = all.back();
+    setCursors(std::move(all), primary);
+    setStatusMessage(std::to_string(extraCursors.size() + 1) + " cursors");
+}
+
+void Editor::addCursorsOnLines(const size_t first, const size_t last) {
+    std::vector<Cursor> all;
+    all.reserve(last - first + 1);
+    for (size_t y = first; y <= last; ++y) {
+        all.push_back({std::min(cur_x, std::as_const(buffer)[y].size()), y});
+    }
+    setCursors(std::move(all), cur_y - first);
+    setStatusMessage(std::to_string(extraCursors.size() + 1) + " cursors");
+}
+
+void Editor::insertAtCursors(const std::string_view text) {
+    size_t primary;
+    std::vector<Cursor> all = allCursors(primary);
+    ensureLine(all.back().y);
+
+    // One record covers every line with a cursor, each line is visited once
+    const size_t first = all.front().y;
+    const size_t count = all.back().y - first + 1;
+    beginChange(first, count);
+
+    for (size_t i = 0; i < all.size();) {
+        const size_t y = all[i].y;
+        size_t end = i;
+        while (end < all.size() && all[end].y == y) ++end;
+
+        std::string& line = buffer[y];
+        for (size_t k = i; k < end; ++k) {
+            all[k].x = std::min(all[k].x, line.size());
+        }
+
+        // Right to left, so the positions still to come stay valid
+        for (size_t k = end; k-- > i;) {
+            line.insert(all[k].x, text);
+        }
+
+        // Each cursor moves past its own text and the text inserted before it
+        for (size_t k = i; k < end; ++k) {
+            all[k].x += (k - i + 1) * text.size();
+        }
+        i = end;
+    }
+
+    endChange(count);
+    setCursors(std::move(all), primary);
+}
+
+void Editor::deleteAtCursors() {
+    size_t primary;
+    std::vector<Cursor> all = allCursors(primary);
+    const size_t first = all.front().y;
+    const size_t last = std::min(all.back().y, buffer.empty() ? 0 : buffer.size() - 1);
+    if (first >= buffer.size()) return;
+
+    const size_t count = last - first + 1;
+    beginChange(first, count);
+
+    for (size_t i = 0; i < all.size() && all[i].y <= last;) {
+        const size_t y = all[i].y;
+        size_t end = i;
+        while (end < all.size() && all[end].y == y) ++end;
+
+        std::string& line = buffer[y];
+        size_t removed = 0;
+        for (size_t k = i; k < end; ++k) {
+            // Positions are shifted left by the characters removed before them
+            const size_t x = all[k].x - removed;
+            if (x < line.size()) {
+                line.erase(x, 1);
+                ++removed;
+                all[k].x = x;
+            } else {
+                // Past the end there is nothing to take, like deleteChar
+                all[k].x = line.empty() ? 0 : line.size() - 1;
+            }
+        }
+        i = end;
+    }
+
+    endChange(count);
+    setCursors(std::move(all), primary);
+}
+
+void Editor::splitAtCursors() {
+    size_t primary;
+    std::vector<Cursor> all = allCursors(primary);
+    ensureLine(all.back().y);
+
+    const size_t first = all.front().y;
+    const size_t count = all.back().y - first + 1;
+    beginChange(first, count);
+
+    // Split the whole span in one pass and put it back with a single insert
+    std::vector<std::string> lines = buffer.cut(first, count).lines();
+    std::vector<std::string> split;
+    split.reserve(count + all.size());
+    size_t k = 0;
+    for (size_t i = 0; i < lines.size(); ++i) {
+        const std::string& line = lines[i];
+        size_t from = 0;
+        for (; k < all.size() && all[k].y == first + i; ++k) {
+            const size_t x = std::clamp(all[k].x, from, line.size());
+            split.emplace_back(line, from, x - from);
+            from = x;
+        }
+        split.emplace_back(line, from);
+    }
+    buffer.insert(buffer.begin() + static_cast<QEditor::LineStore::difference_type>(first),
+                  std::make_move_iterator(split.begin()), std::make_move_iterator(split.end()));
+
+    // Every split above a cursor pushes it down a line
+    for (size_t k = 0; k < all.size(); ++k) {
+        all[k] = {0, all[k].y + k + 1};
+    }
+
+    endChange(count + all.size());
+    setCursors(std::move(all), primary);
+}
+
+void Editor::beginChange(const size_t at, const size_t count) {
+    indexWords(at, count, false);
+    undoHistory.change(buffer, at, count, {cur_x, cur_y});
+    changeAt = at;
+    changeCount = count;
+}
+
+void Editor::endChange(const size_t newCount) {
+    undoHistory.changed(newCount);
+    indexWords(changeAt, newCount, true);
+    layoutChanged(changeAt, changeCount, newCount);
+}
+
+void Editor::removeLines(const size_t at, const size_t count) {
+    indexWords(at, count, false);
+    undoHistory.removeLines(buffer, at, count, {cur_x, cur_y});
+    layoutChanged(at, count, 0);
+}
+
+void Editor::layoutChanged(const size_t at, const size_t count, const size_t newCount) {
+    wraps.replace(at, count, newCount);
+    columns.replace(at, count, newCount);
+    if (folding && !foldsStale) folds.update(buffer, at, count, newCount);
+    shiftViews(at, count, newCount);
+}
+
+void Editor::clearLayout() {
+    wraps.clear();
+    columns.clear();
+    foldsStale = true;
+}
+
+void Editor::undo() {
+    UndoHistory::Cursor cursor{cur_x, cur_y};
+    clearLayout();
+    if (!undoHistory.undo(buffer, cursor, [this](const size_t at, const size_t count, const bool replaced) {
+            indexWords(at, count, replaced);
+        })) {
+        setStatusMessage("Already at oldest change");
+        return;
+    }
+
+    cur_x = cursor.x;
+    cur_y = cursor.y;
+    clampCursor();
+}
+
+void Editor::redo() {
+    UndoHistory::Cursor cursor{cur_x, cur_y};
+    clearLayout();
+    if (!undoHistory.redo(buffer, cursor, [this](const size_t at, const size_t count, const bool replaced) {
+            indexWords(at, count, replaced);
+        })) {
+        setStatusMessage("Already at newest change");
+        return;
+    }
+
+    cur_x = cursor.x;
+    cur_y = cursor.y;
+    clampCursor();
+}
+
+void Editor::completeWord(const bool forward) {
+    if (!extraCursors.empty()) {
+        setStatusMessage("Completion needs a single cursor");
+        return;
+    }
+
+    ensureLine(cur_y);
+    const size_t x = std::min(cur_x, std::as_const(buffer)[cur_y].size());
+
+    // A fresh Ctrl-N looks up the word before the cursor, later ones cycle
+    if (!completion.active || completion.y != cur_y || completion.end != x) {
+        const std::string& line = std::as_const(buffer)[cur_y];
+        size_t start = x;
+        while (start > 0 && QEditor::WordIndex::isWordChar(line[start - 1])) --start;
+        if (start == x) {
+            setStatusMessage("No word before the cursor");
+            return;
+        }
+
+        completion.prefix = line.substr(start, x - start);
+        completion.matches.clear();
+        bool indexing = false;
+        gatherCompletions(completion.prefix, completion.matches, indexing);
+        if (completion.matches.empty()) {
+            setStatusMessage(indexing ? "Still indexing words" : "No completions for " + completion.prefix);
+            return;
+        }
+
+        completion.active = true;
+        completion.x = start;
+        completion.y = cur_y;
+        completion.shown = completion.matches.size();
+    }
+
+    // One past the last match is the prefix as typed
+    const size_t choices = completion.matches.size() + 1;
+    completion.shown = (completion.shown + (forward ? 1 : choices - 1)) % choices;
+    const bool original = completion.shown == completion.matches.size();
+    const std::string& word = original ? completion.prefix : completion.matches[completion.shown];
+
+    beginChange(cur_y, 1);
+    buffer[cur_y].replace(completion.x, x - completion.x, word);
+    endChange(1);
+    cur_x = completion.end = completion.x + word.size();
+
+    setStatusMessage(original ? "Back at original"
+                              : "match " + std::to_string(completion.shown + 1) + " of " +
+                                    std::to_string(completion.matches.size()));
+}
+
+void Editor::gatherCompletions(const std::string& prefix, std::vector<std::string>& out, bool& indexing) {
+    auto query = [&](std::unique_ptr<QEditor::WordIndex>& index, const QEditor::LineStore& lines,
+                     const QEditor::LineLoader* loading) {
+        // A file still being read is counted once it is all there
+        if (loading) {
+            indexing = true;
+            return;
+        }
+        if (!index) {
+            index = std::make_unique<QEditor::WordIndex>();
+            index->build(lines.slice(0, lines.size()));
+            index->waitReady(WORD_INDEX_WAIT);
+        }
+        if (!index->isReady()) {
+            indexing = true;
+            return;
+        }
+        index->complete(prefix, MAX_COMPLETIONS, out);
+    };
+
+    query(words, buffer, loader.get());
+    for (size_t i = 0; i < buffers.size(); ++i) {
+        if (i != activeBuffer) query(buffers[i].words, buffers[i].lines, buffers[i].loader.get());
+    }
+
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+    if (out.size() > MAX_COMPLETIONS) out.resize(MAX_COMPLETIONS);
+}
+
+void Editor::indexWords(const size_t at, const size_t count, const bool add) {
+    if (!words) return;
+
+    // Rebuilding in the background beats counting a huge edit here
+    if (count > QEditor::WordIndex::MAX_EDIT_LINES) {
+        words.reset();
+        return;
+    }
+
+    const size_t end = std::min(at + count, buffer.size());
+    for (size_t y = at; y < end; ++y) {
+        const std::string& line = std::as_const(buffer)[y];
+        add ? words->add(line) : words->remove(line);
+    }
+}
+
+void Editor::clampCursor() {
+    if (buffer.empty()) {
+        cur_x = cur_y = 0;
+        return;
+    }
+
+    if (cur_y >= buffer.size()) cur_y = buffer.size() - 1;
+    if (cur_x > std::as_const(buffer)[cur_y].size()) cur_x = std::as_const(buffer)[cur_y].size();
+}
+
+void Editor::moveCursor(const char direction) {
+    if (direction == 'h' || direction == 127) { // Move left for "h" key or delete/backspace
+        if (cur_x > 0) {
+            --cur_x;
+        }
+    } else if (direction == 'l') { // Move right
+        if (cur_y < buffer.size()) {
+            if (const std::string& line = std::as_const(buffer)[cur_y]; cur_x < line.size() - 1) {
+                ++cur_x;
+            }
+        }
+    } else if (direction == 'j') { // Move down
+        if (const size_t below = lineBelow(cur_y); below < buffer.size()) {
+            cur_y = below;
+
+            if (const std::string& line = std::as_const(buffer)[cur_y]; cur_x >= line.length()) {
+                // clamp cur_x to end of line (or 0 if empty)
+                cur_x = line.empty() ? 0 : line.size() - 1;
+            }
+        }
+    } else if (direction == 'k') { // Move up
+        if (cur_y > 0) {
+            cur_y = lineAbove(cur_y);
+
+            if (cur_x >= std::as_const(buffer)[cur_y].size()) {
+                cur_x = std::as_const(buffer)[cur_y].size() - 1;
+            }
+        }
+    }
+}
+
+void Editor::ensureLine(const size_t y) {
+    if (y < buffer.size()) return;
+
+    const size_t oldSize = buffer.size();
+    beginChange(oldSize, 0);
+    buffer.resize(y + 1);
+    endChange(buffer.size() - oldSize);
+}
+
+void Editor::insertText(const char c) {
+    ensureLine(cur_y);
+
+    beginChange(cur_y, 1);
+    std::string& line = buffer[cur_y];
+    if (cur_x <= line.size()) {
+        line.insert(cur_x, 1, c);
+    } else {
+        line += c;
+    }
+    endChange(1);
+
+    ++cur_x;
+}
+
+void Editor::deleteChar() {
+    if (cur_y >= buffer.size()) {
+        // nothing to delete
+        return;
+    }
+
+    // if empty line, delete it
+    if (std::as_const(buffer)[cur_y].empty()) {
+        removeLines(cur_y, 1);
+
+        if (cur_y > 0) {
+            cur_y = buffer.empty() ? 0 : cur_y - 1;
+            cur_x = std::as_const(buffer)[cur_y].length() - 1;
+        }
+    } else {
+        const bool deleted = cur_x >= std::as_const(buffer)[cur_y].size();
+
+        beginChange(cur_y, 1);
+        buffer[cur_y].erase(cur_x, 1);
+        endChange(1);
+
+        if (deleted) --cur_x;
+    }
+}
+
+void Editor::loadFile(const std::string& filename) {
+    if (filename.empty()) {
+        throw QEditor::FileError("Empty filename");
+    }
+
+    // Check if file exists and is readable
+    if (std::filesystem::exists(filename)) {
+        if (access(filename.c_str(), R_OK) != 0) {
+            throw QEditor::FilePermissionError(filename);
+        }
+    }
+
+    loader.reset();
+    compression = QEditor::detectCompression(filename);
+    if (compression.codec != QEditor::Codec::None) {
+        loadCompressed(filename);
+        return;
+    }
+
+    undoHistory = UndoHistory();
+    clearLayout();
+    folding = false;
+    folds.clear();
+    words.reset();
+    diskIdentity = QEditor::FileIdentity::of(filename);
+    identityKnown = true;
+    changeWarned = false;
+    watchFile(filename);
+
+    std::ifstream file(filename, std::ios::in);
+    if (!file) {
+        // File doesn't exist, create empty buffer
+        this->filename = filename;
+        buffer.clear();
+        buffer.emplace_back("");
+        compression = QEditor::compressionForName(filename);
+        setStatusMessage("New file: " + filename);
+        return;
+    }
+
+    try {
+        this->filename = filename;
+
+        // Hand lines over a block at a time, so cold blocks are packed as
+        // the file is read rather than after all of it sits in memory
+        buffer.clear();
+        std::vector<std::string> batch;
+        std::string line;
+        while (std::getline(file, line)) {
+            batch.push_back(std::move(line));
+            if (batch.size() == QEditor::LineStore::BLOCK_LINES) {
+                buffer.append(std::move(batch));
+                batch.clear();
+            }
+        }
+        buffer.append(std::move(batch));
+        if (buffer.empty()) {
+            buffer.emplace_back("");
+        }
+
+        setStatusMessage("\"" + filename + "\" " + std::to_string(buffer.size()) + " lines" +
+                         compressionSavings(buffer));
+    } catch (const std::exception& e) {
+        throw QEditor::FileOpenError(filename + ": " + e.what());
+    }
+}
+
+void Editor::loadCompressed(const std::string& filename) {
+    auto source = std::make_unique<QEditor::Decompressor>(filename, compression.codec);
+
+    undoHistory = UndoHistory();
+    clearLayout();
+    folding = false;
+    folds.clear();
+    words.reset();
+    diskIdentity = QEditor::FileIdentity::of(filename);
+    identityKnown = true;
+    changeWarned = false;
+    watchFile(filename);
+
+    this->filename = filename;
+    buffer.clear();
+    cur_x = cur_y = 0;
+    loader = std::make_unique<QEditor::LineLoader>(std::move(source));
+
+    // Wait for the first batch only, the rest streams in from the run loop
+    pollfd first{loader->getFd(), POLLIN, 0};
+    while (poll(&first, 1, -1) == -1 && errno == EINTR) {}
+    drainLoader();
+}
+
+bool Editor::drainLoader() {
+    if (!loader) return false;
+
+    const std::string name = "\"" + filename + "\" [" + QEditor::codecName(compression.codec) + "] ";
+    std::vector<std::string> batch;
+    const bool done = loader->drain(batch);
+    buffer.append(std::move(batch));
+
+    if (!done) {
+        setStatusMessage(name + "loading " + std::to_string(loader->progress()) + "%");
+        return true;
+    }
+
+    const std::string error = loader->error();
+    loader.reset();
+    if (buffer.empty()) {
+        buffer.emplace_back("");
+    }
+
+    if (!error.empty()) {
+        setStatusMessage(error);
+    } else {
+        setStatusMessage(name + std::to_string(buffer.size()) + " lines" + compressionSavings(buffer));
+    }
+    return true;
+}
+
+void Editor::finishLoading() {
+    if (!loader) return;
+
+    loader->wait();
+    drainLoader();
+}
+
+std::vector<std::string> Editor::readFileLines(const std::string& filename) {
+    const QEditor::Compression detected = QEditor::detectCompression(filename);
+    if (detected.codec != QEditor::Codec::None) {
+        QEditor::LineLoader reader(std::make_unique<QEditor::Decompressor>(filename, detected.codec));
+        reader.wait();
+
+        std::vector<std::string> lines;
+        reader.drain(lines);
+        if (!reader.error().empty()) {
+            throw QEditor::FileOpenError(filename);
+        }
+        if (lines.empty()) {
+            lines.emplace_back("");
+        }
+        return lines;
+    }
+
+    std::ifstream file(filename, std::ios::in);
+    if (!file) {
+        throw QEditor::FileOpenError(filename);
+    }
+    return readLines(file);
+}
+
+std::vector<std::string> Editor::readLines(std::istream& in) {
+    std::vector<std::string> lines;
+    std::string line;
+    while (std::getline(in, line)) {
+        lines.push_back(line);
+    }
+
+    if (lines.empty()) {
+        lines.emplace_back("");
+    }
+
+    return lines;
+}
+
+void Editor::watchFile(const std::string& filename) {
+    if (!watcher) {
+        watcher = std::make_unique<QEditor::FileWatcher>();
+    }
+    watcher->watch(filename);
+}
+
+bool Editor::checkExternalChange() {
+    if (!identityKnown || filename.empty() || changeWarned) return false;
+
+    if (QEditor::FileIdentity::of(filename) == diskIdentity) return false;
+
+    changeWarned = true;
+    setStatusMessage("WARNING: " + filename + " changed on disk (:e! to reload, :w! to overwrite)");
+    return true;
+}
+
+void Editor::reloadFile() {
+    if (filename.empty()) {
+        throw QEditor::CommandError("No file name");
+    }
+
+    if (pager) {
+        openView(filename);
+        return;
+    }
+
+    finishLoading();
+    std::vector<std::string> disk = readFileLines(filename);
+    const QEditor::FileIdentity identity = QEditor::FileIdentity::of(filename);
+
+    // Only replace the hunks that differ, as a single undoable step
+    const std::vector<QEditor::DiffHunk> hunks = QEditor::diffLines(buffer, disk);
+    undoHistory.commit(buffer, {cur_x, cur_y});
+
+    // Map the cursor line through the hunks before any are applied
+    size_t newY = cur_y;
+    long shift = 0;
+    for (const QEditor::DiffHunk& hunk : hunks) {
+        if (cur_y >= hunk.oldStart + hunk.oldCount) {
+            shift += static_cast<long>(hunk.newCount) - static_cast<long>(hunk.oldCount);
+        } else if (cur_y >= hunk.oldStart) {
+            newY = hunk.newStart + std::min(cur_y - hunk.oldStart, hunk.newCount ? hunk.newCount - 1 : 0);
+            shift = 0;
+            break;
+        }
+    }
+    newY = static_cast<size_t>(static_cast<long>(newY) + shift);
+
+    // Apply back to front so earlier hunk positions stay valid
+    for (auto it = hunks.rbegin(); it != hunks.rend(); ++it) {
+        const auto at = static_cast<std::vector<std::string>::difference_type>(it->oldStart);
+        const auto from = disk.begin() + static_cast<std::vector<std::string>::difference_type>(it->newStart);
+
+        beginChange(it->oldStart, it->oldCount);
+        buffer.erase(buffer.begin() + at, buffer.begin() + at + static_cast<long>(it->oldCount));
+        buffer.insert(buffer.begin() + at, std::make_move_iterator(from),
+                      std::make_move_iterator(from + static_cast<long>(it->newCount)));
+        endChange(it->newCount);
+    }
+
+    cur_y = newY;
+    clampCursor();
+    undoHistory.commit(buffer, {cur_x, cur_y});
+
+    diskIdentity = identity;
+    identityKnown = true;
+    changeWarned = false;
+
+    setStatusMessage("Reloaded \"" + filename + "\", " + std::to_string(hunks.size()) + " changed hunk(s)");
+}
+
+void Editor::openView(const std::string& filename) {
+    if (filename.empty()) {
+        throw QEditor::FileError("Empty filename");
+    }
+    if (QEditor::detectCompression(filename).codec != QEditor::Codec::None) {
+        throw QEditor::FileError("Compressed files can't be paged, open them without --view: " + filename);
+    }
+
+    pager = std::make_unique<Pager>(filename, indexCache);
+    this->filename = filename;
+    buffer.clear();
+    words.reset();
+    cur_x = cur_y = 0;
+    mode = VIEW;
+
+    setStatusMessage(pager->status());
+}
+
+void Editor::startFollow() {
+    if (filename.empty()) {
+        throw QEditor::CommandError("No file to follow");
+    }
+    if (compression.codec != QEditor::Codec::None) {
+        throw QEditor::CommandError("Can't follow a compressed file");
+    }
+
+    const size_t rows = screenRows > 1 ? screenRows - 1 : 1;
+
+    if (pager) {
+        pager->gotoEnd(rows);
+    } else {
+        // Continue from the current end of the file, and remember whether the
+        // last line is complete so appended bytes extend or follow it
+        uint64_t size = 0;
+        tailTerminated = false;
+        if (std::ifstream file(filename, std::ios::binary); file) {
+            file.seekg(0, std::ios::end);
+            size = static_cast<uint64_t>(file.tellg());
+            char last = 0;
+            if (size > 0 && file.seekg(-1, std::ios::end) && file.get(last)) {
+                tailTerminated = last == '\n';
+            }
+        }
+
+        tail = std::make_unique<QEditor::FileTail>(filename, size);
+
+        if (buffer.empty()) buffer.emplace_back("");
+        cur_y = buffer.size() - 1;
+        cur_x = 0;
+    }
+
+    watchFile(filename);
+    following = true;
+    scroll();
+
+    setStatusMessage("Following " + filename);
+}
+
+void Editor::stopFollow() {
+    following = false;
+    tail.reset();
+
+    // The buffer mirrors the file as far as it was read
+    diskIdentity = QEditor::FileIdentity::of(filename);
+    changeWarned = false;
+
+    setStatusMessage("Stopped following " + filename);
+}
+
+bool Editor::followUpdate(const unsigned events) {
+    const size_t rows = screenRows > 1 ? screenRows - 1 : 1;
+
+    if (pager) {
+        const uint64_t oldTop = pager->getTopOffset();
+        const bool pinned = pager->isAtEnd(rows);
+
+        // Rotated or truncated, start over on the new contents
+        const bool replaced = (events & QEditor::FileWatcher::Replaced) && pager->isReplaced();
+        if (replaced || !pager->refresh()) {
+            pager = std::make_unique<Pager>(filename, indexCache);
+            pager->gotoEnd(rows);
+            setStatusMessage((replaced ? "File replaced: " : "File truncated: ") + filename);
+            invalidateScreen();
+            return true;
+        }
+
+        if (pinned) pager->gotoEnd(rows);
+        return pinned || pager->getTopOffset() != oldTop;
+    }
+
+    if (!tail) return false;
+
+    followChunk.clear();
+    const QEditor::FileTail::Change change = tail->poll(followChunk);
+    if (change == QEditor::FileTail::Change::None) return false;
+
+    const bool pinned = cur_y + 1 >= buffer.size();
+
+    if (change != QEditor::FileTail::Change::Appended) {
+        // Line positions in the undo history no longer mean anything
+        undoHistory = UndoHistory();
+        clearLayout();
+        buffer.clear();
+        words.reset();
+        tailTerminated = true;
+        setStatusMessage(change == QEditor::FileTail::Change::Truncated
+            ? "File truncated: " + filename
+            : "File replaced: " + filename);
+    }
+
+    appendText(followChunk);
+
+    if (pinned) {
+        cur_y = buffer.size() - 1;
+        cur_x = 0;
+    } else if (cur_y >= buffer.size()) {
+        cur_y = buffer.size() - 1;
+        cur_x = 0;
+    }
+
+    return true;
+}
+
+void Editor::appendText(const std::string& text) {
+    // Appends aren't undo steps, and a step restoring the old last line
+    // would drop what was appended to it since
+    if (undoHistory.undoDepth() > 0 || undoHistory.redoDepth() > 0) {
+        undoHistory = UndoHistory();
+    }
+
+    const size_t oldSize = buffer.size();
+    size_t pos = 0;
+
+    // The last line may grow as well as lines be added
+    const size_t at = oldSize > 0 ? oldSize - 1 : 0;
+    indexWords(at, oldSize - at, false);
+
+    while (pos < text.size()) {
+        const size_t newline = text.find('\n', pos);
+        const size_t end = newline == std::string::npos ? text.size() : newline;
+
+        if (tailTerminated || buffer.empty()) {
+            buffer.emplace_back(text, pos, end - pos);
+        } else {
+            buffer.back().append(text, pos, end - pos);
+        }
+
+        tailTerminated = newline != std::string::npos;
+        pos = end + 1;
+    }
+
+    if (buffer.empty()) {
+        buffer.emplace_back("");
+        tailTerminated = false;
+    }
+
+    indexWords(at, buffer.size() - at, true);
+    layoutChanged(at, oldSize - at, buffer.size() - at);
+}
+
+void Editor::processPagerKey(const char c) {
+    const size_t rows = screenRows > 1 ? screenRows - 1 : 1;
+
+    // Second key of a pending "gg"
+    if (commandBuffer == "g") {
+        commandBuffer.clear();
+        if (c == 'g') {
+            pager->gotoStart();
+            setStatusMessage(pager->status());
+            return;
+        }
+    }
+
+    switch (c) {
+        case 'j':
+        case '\n':
+            pager->scrollDown(1);
+            break;
+        case 'k':
+            pager->scrollUp(1);
+            break;
+        case ' ':
+        case 'f':
+        case 6: // Ctrl-F
+            pager->scrollDown(rows);
+            break;
+        case 'b':
+        case 2: // Ctrl-B
+            pager->scrollUp(rows);
+            break;
+        case 4: // Ctrl-D
+            pager->scrollDown(rows / 2);
+            break;
+        case 21: // Ctrl-U
+            pager->scrollUp(rows / 2);
+            break;
+        case 'g':
+            commandBuffer = "g";
+            return;
+        case 'G':
+            pager->gotoEnd(rows);
+            break;
+        case 'q':
+            running = false;
+            return;
+        case ':':
+        case '/':
+        case '?':
+            mode = COMMAND;
+            commandBuffer.assign(1, c);
+            cur_x = 1;
+            return;
+        case 'n':
+        case 'N':
+            if (lastSearch.empty()) break;
+            if (!pager->search(lastSearch, (c == 'n') == lastSearchForward)) {
+                setStatusMessage("Pattern not found: " + lastSearch);
+                return;
+            }
+            break;
+        case '\x1b': {
+            // Arrow keys scroll like j/k; a lone Esc doesn't wait for more keys
+            char seq[2];
+            if (inputPending() && read(STDIN_FILENO, &seq[0], 1) == 1 && read(STDIN_FILENO, &seq[1], 1) == 1 &&
+                seq[0] == '[') {
+                if (seq[1] == 'A') pager->scrollUp(1);
+                if (seq[1] == 'B') pager->scrollDown(1);
+            }
+            break;
+        }
+        default:
+            return;
+    }
+
+    setStatusMessage(pager->status());
+}
+
+void Editor::saveFile(const std::string& filename, const bool force) {
+    const std::string trimmedFilename(trimWhitespace(filename));
+    if (trimmedFilename.empty()) {
+        throw QEditor::FileError("Empty filename");
+    }
+
+    // Everything has to be inflated before any of it can be written back
+    finishLoading();
+
+    // Refuse to clobber changes another process made since we read the file
+    const bool ownFile = identityKnown && trimmedFilename == this->filename;
+    if (ownFile && !force && QEditor::FileIdentity::of(trimmedFilename) != diskIdentity) {
+        throw QEditor::FileConflictError(trimmedFilename);
+    }
+
+    // Check if we can write to the directory
+    const std::filesystem::path filePath(trimmedFilename);
+    const std::filesystem::path dirPath = filePath.parent_path();
+    
+    if (!dirPath.empty() && std::filesystem::exists(dirPath)) {
+        if (access(dirPath.c_str(), W_OK) != 0) {
+            throw QEditor::FilePermissionError(dirPath.string());
+        }
+    }
+
+    // Check if file exists and is writable
+    if (std::filesystem::exists(trimmedFilename)) {
+        if (access(trimmedFilename.c_str(), W_OK) != 0) {
+            throw QEditor::FilePermissionError(trimmedFilename);
+        }
+    }
+
+    // The buffer's own file keeps the codec it was read with
+    const QEditor::Compression target = trimmedFilename == this->filename
+        ? compression : QEditor::compressionForName(trimmedFilename);
+    if (target.codec != QEditor::Codec::None) {
+        saveCompressed(trimmedFilename, target);
+        return;
+    }
+
+    std::ofstream file(trimmedFilename);
+    if (!file) {
+        throw QEditor::FileSaveError(trimmedFilename);
+    }
+
+    try {
+        for (const std::string& line : std::as_const(buffer)) {
+            if (!(file << line << '\n')) {
+                throw QEditor::FileSaveError(trimmedFilename + ": Write failed");
+            }
+        }
+        file.close();
+        if (file.fail()) {
+            throw QEditor::FileSaveError(trimmedFilename + ": Write failed");
+        }
+
+        if (trimmedFilename == this->filename) {
+            diskIdentity = QEditor::FileIdentity::of(trimmedFilename);
+            identityKnown = true;
+            changeWarned = false;
+        }
+        // Keep jumps into the file right once the index has been used
+        if (symbols) symbols->refresh();
+        setStatusMessage(EditorCommands::WROTE_TO + trimmedFilename);
+    } catch (const std::exception& e) {
+        throw QEditor::FileSaveError(trimmedFilename + ": " + e.what());
+    }
+}
+
+void Editor::saveCompressed(const std::string& filename, const QEditor::Compression target) {
+    QEditor::Compressor out(filename, target);
+    for (const std::string& line : std::as_const(buffer)) {
+        out.write(line);
+        out.write("\n");
+    }
+    out.finish();
+
+    if (filename == this->filename) {
+        diskIdentity = QEditor::FileIdentity::of(filename);
+        identityKnown = true;
+        changeWarned = false;
+    }
+    setStatusMessage(EditorCommands::WROTE_TO + filename + " [" + QEditor::codecName(target.codec) + "]");
+}
+
+Editor::MemoryUsage Editor::memoryUsage() const {
+    auto rowBytes = [](const std::vector<std::string>& rows) {
+        size_t total = rows.capacity() * sizeof(std::string);
+        for (const std::string& row : rows) {
+            total += row.capacity() > 15 ? row.capacity() + 1 : 0;
+        }
+        return total;
+    };
+
+    MemoryUsage usage;
+    usage.lines = buffer.stats();
+    usage.undo = undoHistory.memoryUsage();
+    for (const Register* reg : {&unnamed, &yanked, &clipboard}) {
+        usage.registers += reg->text.memoryUsage();
+    }
+    for (const Register& reg : named) {
+        usage.registers += reg.text.memoryUsage();
+    }
+    usage.render = rowBytes(frameRows) + rowBytes(shadowRows) + rowBytes(pagerLines) + shadowKnown.capacity() +
+                   wraps.memoryUsage() + columns.memoryUsage() + folds.memoryUsage();
+    usage.pager = pager ? pager->memoryUsage() : 0;
+    usage.words = words ? words->memoryUsage() : 0;
+    for (const BufferState& state : buffers) {
+        usage.words += state.words ? state.words->memoryUsage() : 0;
+    }
+    for (size_t i = 0; i < buffers.size(); ++i) {
+        if (i == activeBuffer) continue;
+        const BufferState& state = buffers[i];
+        usage.buffers += state.lines.stats().residentBytes + state.undo.memoryUsage() + state.wraps.memoryUsage() +
+                         state.columns.memoryUsage() + state.folds.memoryUsage();
+    }
+    usage.config = config.memoryUsage();
+    usage.heap = QEditor::allocationStats();
+    return usage;
+}
+
+std::vector<std::string> Editor::memoryReport() const {
+    const MemoryUsage usage = memoryUsage();
+    const QEditor::LineStore::Stats& lines = usage.lines;
+
+    std::vector<std::string> report;
+    report.push_back("Memory:");
+    report.push_back("  text          " + formatBytes(lines.textBytes) + " in " + std::to_string(lines.lines) + " lines");
+    report.push_back("  strings       " + formatBytes(lines.stringBytes) + " in " + std::to_string(lines.hotBlocks) +
+                     " of " + std::to_string(lines.blocks) + " blocks");
+    report.push_back("  slack         " + formatBytes(lines.slackBytes));
+    report.push_back("  packed        " + formatBytes(lines.packedBytes) + " (" +
+                     formatBytes(lines.unpackedBytes > lines.residentBytes ? lines.unpackedBytes - lines.residentBytes : 0) +
+                     " saved)");
+    report.push_back("  block index   " + formatBytes(lines.indexBytes));
+    report.push_back("  undo          " + formatBytes(usage.undo));
+    report.push_back("  registers     " + formatBytes(usage.registers) + " (blocks shared with the buffer count in full)");
+    report.push_back("  render cache  " + formatBytes(usage.render));
+    if (pager) {
+        report.push_back("  view pager    " + formatBytes(usage.pager));
+    }
+    if (usage.words > 0) {
+        report.push_back("  word index    " + formatBytes(usage.words));
+    }
+    if (buffers.size() > 1) {
+        report.push_back("  other buffers " + formatBytes(usage.buffers) + " in " +
+                         std::to_string(buffers.size() - 1) + " files");
+    }
+    report.push_back("  config        " + formatBytes(usage.config));
+    report.push_back("  heap          " + formatBytes(usage.heap.liveBytes) + " live, " +
+                     formatBytes(usage.heap.peakBytes) + " peak, " + std::to_string(usage.heap.allocations) +
+                     " allocations");
+    report.push_back("Press any key to continue");
+    return report;
+}
+
+void Editor::drawScreen() {
+    // The terminal holds the frame back until it is complete
+    if (terminal.synchronizedOutput) std::cout << "\x1b[?2026h";
+
+    if (pager) {
+        drawPagerScreen();
+        if (terminal.synchronizedOutput) std::cout << "\x1b[?2026l" << std::flush;
+        return;
+    }
+
+    // First, hide cursor while drawing
+    std::cout << "\x1b[?25l";
+
+    layoutWindows();
+    const size_t rows = screenRows - 1;
+    const size_t lineNumWidth = lineNumberWidth();
+
+    // Compose each row, flushRows only sends the ones that changed
+    if (windowRects.size() > 1) {
+        composeWindows();
+    } else {
+        frameRows.resize(rows);
+        composeView(frameRows, true);
+    }
+
+    flushRows();
+
+    // Draw status/command line
+    std::cout << "\x1b[" << screenRows << ";1H\x1b[2K";
+
+    if (mode == COMMAND && !commandBuffer.empty()) {
+        std::cout << commandBuffer;
+    } else if (mode == VISUAL) {
+        std::cout << (visualKind == 'V' ? "-- VISUAL LINE --" : visualKind == 'v' ? "-- VISUAL --" : "-- VISUAL BLOCK --");
+    }
+
+    // Show status message if any
+    if (!statusMessage.empty()) {
+        size_t col = screenCols - statusMessage.length() + 1;
+
+        if (col < 1) col = 1;
+
+        std::cout << "\x1b[" << screenRows << ";" << col << "H" << statusMessage;
+    }
+
+    // Position cursor at edit location, inside the active window
+    if (mode != COMMAND) {
+        const size_t renderX = renderColumn(cur_y, cur_x);
+        const QEditor::WindowRect& window = activeRect();
+        const size_t top = window.top + 1, left = window.left;
+        if (differ) {
+            // The left pane holds the buffer, keep the cursor inside it
+            const size_t pane = (viewCols - 1) / 2;
+            std::cout << "\x1b[" << (diffRowOf(cur_y) - diffRowOf(rowOffset) + top) << ";"
+                      << left + std::min(renderX + lineNumWidth + 1, std::max<size_t>(pane, 1)) << "H";
+        } else if (wrap && cur_y < buffer.size()) {
+            // Display rows above the cursor's, scroll() keeps them on screen
+            size_t row = 0;
+            for (size_t y = rowOffset; y < cur_y; ++y) {
+                row += wrapRows(y).size();
+            }
+            const std::vector<QEditor::WrapRow>& cursorRows = wrapRows(cur_y);
+            const size_t sub = QEditor::WrapCache::rowOf(cursorRows, cur_x);
+            const size_t column = QEditor::WrapCache::cells(std::as_const(buffer)[cur_y], cursorRows[sub].byte, cur_x, TAB_WIDTH);
+            std::cout << "\x1b[" << (row + sub - topRow + top) << ";"
+                      << left + std::min(column + lineNumWidth + 1, viewCols) << "H";
+        } else {
+            const QEditor::FoldTree* shown = shownFolds();
+            const size_t row = shown ? shown->visibleIndex(cur_y) - shown->visibleIndex(rowOffset) : cur_y - rowOffset;
+            std::cout << "\x1b[" << (row + top) << ";" << left + (renderX - colOffset + lineNumWidth + 1) << "H";
+        }
+    } else {
+        // Move cursor to command bar
+        std::cout << "\033[" << screenRows << ";" << cur_x + 1 << "H" << std::flush;
     }
 
     // Show cursor again
     std::cout << "\x1b[?25h";
+    if (terminal.synchronizedOutput) std::cout << "\x1b[?2026l";
+
+    std::cout.flush();
+}
+
+void Editor::composeView(std::vector<std::string>& out, const bool active) const {
+    const size_t lineNumWidth = lineNumberWidth();
+    columns.setTabWidth(TAB_WIDTH);
+
+    if (differ) {
+        composeDiffRows(out, lineNumWidth);
+    } else if (wrap) {
+        composeWrappedRows(out, lineNumWidth, active);
+    } else {
+        composeRows(out, lineNumWidth, active);
+    }
+}
+
+void Editor::composeRows(std::vector<std::string>& out, const size_t lineNumWidth, const bool active) const {
+    const size_t textWidth = viewCols > lineNumWidth ? viewCols - lineNumWidth : 1;
+    const QEditor::FoldTree* shown = shownFolds();
+
+    size_t fileRow = rowOffset;
+    for (size_t i = 0; i < out.size(); ++i, fileRow = shown ? shown->nextVisible(fileRow) : fileRow + 1) {
+        std::string& row = out[i];
+        row.clear();
+
+        // Draw line numbers if config'd
+        if (showLineNumbers) {
+            if (fileRow < buffer.size() || fileRow == 0) {
+                // Right-align the line number
+                appendNumber(row, fileRow + 1, lineNumWidth - 1);
+                row += ' ';
+            } else {
+                // Print spaces for line number column on empty lines
+                row.append(lineNumWidth, ' ');
+            }
+        }
+
+        // A closed fold shows the size of it and its first line
+        if (const size_t foldEnd = shown ? shown->closedEnd(fileRow) : fileRow; foldEnd != fileRow) {
+            const std::string& line = buffer[fileRow];
+            const size_t start = row.size();
+            row += "+-- ";
+            appendNumber(row, foldEnd - fileRow + 1, 0);
+            row += " lines: ";
+
+            const size_t used = row.size() - start;
+            const size_t begin = firstNonBlank(line);
+            const size_t end = QEditor::WrapCache::byteAt(line, begin, line.size(),
+                                                          textWidth > used ? textWidth - used : 0, TAB_WIDTH);
+            appendExpanded(row, std::string_view(line).substr(begin, end - begin));
+            continue;
+        }
+
+        // Draw content if available, only the part of the line on screen
+        if (fileRow < buffer.size()) {
+            const std::string& line = buffer[fileRow];
+            size_t width = textWidth;
+            size_t begin = 0;
+            if (colOffset > 0) {
+                begin = columns.byteAt(fileRow, line, colOffset);
+
+                // A tab cut by the left edge shows the cells it has left
+                const size_t cut = colOffset - std::min(colOffset, columns.column(fileRow, line, begin));
+                if (cut > 0 && begin < line.size() && line[begin] == '\t') {
+                    row.append(TAB_WIDTH - cut, ' ');
+                    width -= std::min(width, TAB_WIDTH - cut);
+                    ++begin;
+                }
+            }
+            const size_t end = QEditor::WrapCache::byteAt(line, begin, line.size(), width, TAB_WIDTH);
+
+            const size_t textStart = row.size();
+            appendExpanded(row, std::string_view(line).substr(begin, end - begin));
+
+            // Only the active window shows the selection and extra cursors
+            if (active && mode == VISUAL && fileRow >= std::min(visualY, cur_y) && fileRow <= std::max(visualY, cur_y)) {
+                highlightSelection(row, textStart, fileRow, line, begin, end);
+            } else if (active && !extraCursors.empty()) {
+                highlightCursors(row, textStart, fileRow, line, begin, end);
+            }
+        } else if (fileRow != 0) {
+            row += '~';
+        }
+    }
+}
+
+void Editor::startDiff(const std::string& otherFilename) {
+    diffOther = readFileLines(otherFilename);
+    diffOtherText = diffOther.slice(0, diffOther.size());
+    diffOtherName = otherFilename;
+    diffHunks.clear();
+    diffExtraBefore.clear();
+
+    differ = std::make_unique<QEditor::BackgroundDiff>();
+    diffRevision = buffer.revision() - 1; // anything but the current one
+    refreshDiff();
+    setStatusMessage("Diffing against " + otherFilename);
+}
+
+void Editor::stopDiff() {
+    differ.reset();
+    diffOther.clear();
+    diffOtherText = {};
+    diffOtherName.clear();
+    diffHunks.clear();
+    diffExtraBefore.clear();
+    invalidateScreen();
+}
+
+void Editor::finishDiff() {
+    if (!differ) return;
+    refreshDiff();
+    differ->wait();
+    takeDiff();
+}
+
+void Editor::refreshDiff() {
+    // One request at a time; edits made meanwhile are picked up afterwards
+    if (buffer.revision() == diffRevision || differ->isBusy()) return;
+    diffRevision = buffer.revision();
+    differ->request(buffer.slice(0, buffer.size()), diffOtherText);
+}
+
+void Editor::takeDiff() {
+    std::optional<std::vector<QEditor::DiffHunk>> hunks = differ->take();
+    if (!hunks) return;
+
+    diffHunks = std::move(*hunks);
+    diffExtraBefore.assign(1, 0);
+    for (const QEditor::DiffHunk& hunk : diffHunks) {
+        const size_t extra = hunk.newCount > hunk.oldCount ? hunk.newCount - hunk.oldCount : 0;
+        diffExtraBefore.push_back(diffExtraBefore.back() + extra);
+    }
+
+    if (mode != COMMAND) {
+        setStatusMessage(diffHunks.empty() ? "No differences" : std::to_string(diffHunks.size()) + " changes");
+    }
+    requestRedraw();
+}
+
+size_t Editor::diffRowOf(const size_t line) const {
+    // Hunks that end at or before the line put their filler rows above it
+    const auto it = std::partition_point(diffHunks.begin(), diffHunks.end(), [line](const QEditor::DiffHunk& hunk) {
+        return hunk.oldStart + hunk.oldCount <= line;
+    });
+    return line + (diffExtraBefore.empty() ? 0 : diffExtraBefore[static_cast<size_t>(it - diffHunks.begin())]);
+}
+
+Editor::DiffRow Editor::diffRowAt(const size_t row) const {
+    // Last hunk starting at or above the row
+    const auto it = std::partition_point(diffHunks.begin(), diffHunks.end(), [&](const QEditor::DiffHunk& hunk) {
+        return hunk.oldStart + diffExtraBefore[static_cast<size_t>(&hunk - diffHunks.data())] <= row;
+    });
+    if (it == diffHunks.begin()) {
+        return {row, row, false};
+    }
+
+    const QEditor::DiffHunk& hunk = *(it - 1);
+    const size_t start = hunk.oldStart + diffExtraBefore[static_cast<size_t>(it - 1 - diffHunks.begin())];
+    const size_t offset = row - start;
+    const size_t height = std::max(hunk.oldCount, hunk.newCount);
+    if (offset < height) {
+        DiffRow result;
+        if (offset < hunk.oldCount) result.left = hunk.oldStart + offset;
+        if (offset < hunk.newCount) result.right = hunk.newStart + offset;
+        result.changed = true;
+        return result;
+    }
+
+    // Unchanged lines after the hunk
+    return {hunk.oldStart + hunk.oldCount + offset - height, hunk.newStart + hunk.newCount + offset - height, false};
+}
+
+void Editor::composeDiffRows(std::vector<std::string>& out, const size_t lineNumWidth) const {
+    const size_t leftWidth = (viewCols - 1) / 2;
+    const size_t rightWidth = viewCols - 1 - leftWidth;
+    const size_t top = diffRowOf(rowOffset);
+    const QEditor::LineStore& lines = buffer;
+
+    for (size_t i = 0; i < out.size(); ++i) {
+        std::string& row = out[i];
+        row.clear();
+
+        DiffRow at = diffRowAt(top + i);
+        // The last result may predate an edit, so don't trust it past either end
+        if (at.left && *at.left >= lines.size()) at.left.reset();
+        if (at.right && *at.right >= diffOther.size()) at.right.reset();
+        if (!at.left && !at.right) {
+            row += '~';
+            continue;
+        }
+
+        // Changed lines on blue, removed ones on red, added ones on green
+        const char* color = !at.changed ? "" : at.left && at.right ? "\x1b[44m" : at.left ? "\x1b[41m" : "\x1b[42m";
+        appendDiffPane(row, lines, at.left, color, leftWidth, lineNumWidth);
+        row += '|';
+        appendDiffPane(row, diffOther, at.right, color, rightWidth,
+                       showLineNumbers ? digitCount(diffOther.size()) + 1 : 0);
+    }
+}
+
+void Editor::appendDiffPane(std::string& row, const QEditor::LineStore& lines, const std::optional<size_t> line,
+                            const char* color, const size_t width, const size_t lineNumWidth) const {
+    if (!line) {
+        // Filler across from lines the other side doesn't have
+        row += "\x1b[2m";
+        row.append(width, '-');
+        row += "\x1b[22m";
+        return;
+    }
+
+    diffScratch.clear();
+    if (lineNumWidth > 0) {
+        appendNumber(diffScratch, *line + 1, lineNumWidth - 1);
+        diffScratch += ' ';
+    }
+    appendExpanded(diffScratch, lines[*line]);
+    if (diffScratch.size() > width) {
+        diffScratch.resize(width);
+    }
+
+    row += color;
+    row += diffScratch;
+    row.append(width - diffScratch.size(), ' ');
+    if (*color) row += "\x1b[49m";
+}
+
+void Editor::highlightSelection(std::string& row, const size_t textStart, const size_t y, const std::string& line,
+                                const size_t begin, size_t end) const {
+    const auto [from, to] = selectionOn(y, line);
+    end = std::min(end, line.size());
+
+    // Columns as appendExpanded lays them out
+    auto column = [&](const size_t x) {
+        return textStart + x - begin +
+               static_cast<size_t>(std::count(line.begin() + static_cast<long>(begin), line.begin() + static_cast<long>(x), '\t')) *
+               (TAB_WIDTH - 1);
+    };
+
+    if (from < to) {
+        // Only the part of the selection on this row
+        const size_t first = std::max(from, begin), last = std::min(to, end);
+        if (first < last) {
+            row.insert(column(last), "\x1b[27m");
+            row.insert(column(first), "\x1b[7m");
+        }
+    } else if (visualKind != 22 && begin == 0) {
+        // An empty row in the selection shows as one highlighted cell
+        row += "\x1b[7m \x1b[27m";
+    }
+}
+
+void Editor::highlightCursors(std::string& row, const size_t textStart, const size_t y, const std::string& line,
+                              const size_t begin, const size_t end) const {
+    const auto first = std::lower_bound(extraCursors.begin(), extraCursors.end(), Cursor{0, y}, cursorBefore);
+    auto last = first;
+    while (last != extraCursors.end() && last->y == y) ++last;
+
+    auto column = [&](const size_t x) {
+        return textStart + x - begin +
+               static_cast<size_t>(std::count(line.begin() + static_cast<long>(begin), line.begin() + static_cast<long>(x), '\t')) *
+               (TAB_WIDTH - 1);
+    };
+
+    // Right to left, so the escapes added don't move the cells still to mark
+    for (auto it = last; it != first;) {
+        const size_t x = (--it)->x;
+        // Past the end of the line shows on the line's last row
+        if (x < begin || (x >= end && (x < line.size() || end < line.size()))) continue;
+        if (x >= line.size()) {
+            row += "\x1b[7m \x1b[27m";
+            continue;
+        }
+        row.insert(column(x) + (line[x] == '\t' ? TAB_WIDTH : 1), "\x1b[27m");
+        row.insert(column(x), "\x1b[7m");
+    }
+}
+
+void Editor::invalidateScreen() const {
+    const size_t rows = screenRows > 0 ? screenRows - 1 : 0;
+    shadowRows.resize(rows);
+    shadowKnown.assign(rows, false);
+    shadowValid = false;
+}
+
+Editor::ScrollShift Editor::findScrollShift() const {
+    const size_t rows = frameRows.size();
+    auto same = [this](const size_t frame, const size_t shadow) {
+        return shadowKnown[shadow] && frameRows[frame] == shadowRows[shadow];
+    };
+
+    // Rows above the first change stay where they are; a line deleted or
+    // opened below them moves only the rows from there down
+    size_t top = 0;
+    while (top < rows && same(top, top)) ++top;
+    if (rows - top < 2) return {};
+
+    size_t unchanged = 0;
+    for (size_t i = top; i < rows; ++i) {
+        if (same(i, i)) ++unchanged;
+    }
+
+    // Smallest shift either way that lines up the old rows with the new
+    // ones, and only if it saves more rows than redrawing in place
+    const size_t region = rows - top;
+    for (size_t shift = 1; region - shift > unchanged; ++shift) {
+        bool up = true, down = true;
+        for (size_t i = top; i + shift < rows && (up || down); ++i) {
+            up = up && same(i, i + shift);
+            down = down && same(i + shift, i);
+        }
+        if (up) return {top, static_cast<long>(shift)};
+        if (down) return {top, -static_cast<long>(shift)};
+    }
+
+    return {};
+}
+
+void Editor::flushRows() const {
+    const size_t rows = frameRows.size();
+    if (shadowRows.size() != rows) {
+        invalidateScreen();
+    }
+
+    // Info lines cover the bottom of the text area
+    const size_t infoRows = std::min(infoLines.size(), rows);
+    for (size_t i = 0; i < infoRows; ++i) {
+        frameRows[rows - infoRows + i] = infoLines[infoLines.size() - infoRows + i];
+    }
+
+    // Content that moved (scrolling, appended, deleted or opened lines) is
+    // shifted by the terminal inside a scroll region from the first changed
+    // row down, so only the rows it uncovers are painted
+    if (shadowValid) {
+        if (const ScrollShift moved = findScrollShift(); moved.shift != 0) {
+            const long shift = std::labs(moved.shift);
+            std::cout << "\x1b[" << (moved.top + 1) << ";" << rows << "r\x1b[" << shift
+                      << (moved.shift > 0 ? 'S' : 'T') << "\x1b[r";
+
+            const auto first = shadowRows.begin() + static_cast<long>(moved.top);
+            const auto known = shadowKnown.begin() + static_cast<long>(moved.top);
+            if (moved.shift > 0) {
+                std::rotate(first, first + shift, shadowRows.end());
+                std::rotate(known, known + shift, shadowKnown.end());
+                std::fill(shadowKnown.end() - shift, shadowKnown.end(), false);
+            } else {
+                std::rotate(first, shadowRows.end() - shift, shadowRows.end());
+                std::rotate(known, shadowKnown.end() - shift, shadowKnown.end());
+                std::fill(known, known + shift, false);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < rows; ++i) {
+        if (shadowKnown[i] && frameRows[i] == shadowRows[i]) {
+            continue;
+        }
+
+        // Position at the start of the row, clear it, then draw it
+        std::cout << "\x1b[" << (i + 1) << ";1H\x1b[2K" << frameRows[i];
+        shadowRows[i] = frameRows[i];
+        shadowKnown[i] = true;
+    }
+
+    shadowValid = true;
+}
+
+void Editor::scroll() {
+    layoutWindows();
+    const size_t rows = viewRows;
+
+    if (wrap && !differ) {
+        colOffset = 0;
+        scrollWrapped(rows);
+        return;
+    }
+    topRow = 0;
+
+    // Lines inside a closed fold aren't shown, the cursor goes to its first line
+    const QEditor::FoldTree* shown = shownFolds();
+    if (shown && cur_y < buffer.size() && shown->isHidden(cur_y)) {
+        cur_y = shown->visibleLine(cur_y);
+        clampCursor();
+    }
+
+    // Sideways, keep the cursor's column within the text area
+    if (differ) {
+        colOffset = 0;
+    } else {
+        const size_t textWidth = viewCols > lineNumberWidth() ? viewCols - lineNumberWidth() : 1;
+        const size_t column = renderColumn(cur_y, cur_x);
+        if (column < colOffset) {
+            colOffset = column;
+        } else if (column >= colOffset + textWidth) {
+            colOffset = column - textWidth + 1;
+        }
+    }
+
+    if (cur_y < rowOffset) {
+        rowOffset = cur_y;
+    } else if (differ) {
+        // Filler rows take screen space too: find the first top line that
+        // still leaves the cursor's row on screen
+        const size_t target = diffRowOf(cur_y);
+        size_t lo = rowOffset, hi = cur_y;
+        while (lo < hi) {
+            const size_t mid = lo + (hi - lo) / 2;
+            if (target - diffRowOf(mid) < rows) {
+                hi = mid;
+            } else {
+                lo = mid + 1;
+            }
+        }
+        rowOffset = lo;
+    } else if (shown) {
+        // Closed folds take one row each
+        rowOffset = shown->visibleLine(rowOffset);
+        const size_t index = shown->visibleIndex(cur_y);
+        if (index >= shown->visibleIndex(rowOffset) + rows) {
+            rowOffset = shown->lineAtVisibleIndex(index - rows + 1);
+        }
+    } else if (cur_y >= rowOffset + rows) {
+        rowOffset = cur_y - rows + 1;
+    }
+}
+
+size_t Editor::lineNumberWidth() const {
+    return showLineNumbers ? digitCount(buffer.size()) + 1 : 0; // +1 for the space after
+}
+
+const std::vector<QEditor::WrapRow>& Editor::wrapRows(const size_t y) const {
+    // A resize or a new line number width only changes the layout here;
+    // lines are reflowed as they are next asked for
+    const size_t width = viewCols > lineNumberWidth() ? viewCols - lineNumberWidth() : 1;
+    wraps.setLayout(width, TAB_WIDTH);
+    return wraps.rows(y, buffer[y]);
+}
+
+void Editor::scrollWrapped(const size_t rows) {
+    if (cur_y >= buffer.size()) {
+        rowOffset = std::min(rowOffset, cur_y);
+        topRow = 0;
+        return;
+    }
+
+    const size_t sub = QEditor::WrapCache::rowOf(wrapRows(cur_y), cur_x);
+    if (rowOffset < buffer.size()) {
+        topRow = std::min(topRow, wrapRows(rowOffset).size() - 1);
+    }
+
+    if (cur_y < rowOffset || (cur_y == rowOffset && sub < topRow)) {
+        // Show the whole line from its start when that reaches the cursor
+        rowOffset = cur_y;
+        topRow = sub < rows ? 0 : sub;
+        return;
+    }
+
+    // Display rows from the top of the screen to the cursor, given up on
+    // once they can't fit, so a far jump costs a screen's worth of lines
+    size_t distance = sub;
+    for (size_t y = rowOffset; y < cur_y && distance < rows + topRow; ++y) {
+        distance += wrapRows(y).size();
+    }
+    if (distance - topRow < rows) return;
+
+    // Otherwise put the cursor on the bottom row, counting back from it
+    size_t line = cur_y, first = sub, need = rows - 1;
+    while (need > 0) {
+        if (first > 0) {
+            const size_t step = std::min(first, need);
+            first -= step;
+            need -= step;
+        } else if (line == 0) {
+            break;
+        } else {
+            --line;
+            first = wrapRows(line).size() - 1;
+            --need;
+        }
+    }
+    rowOffset = line;
+    topRow = first;
+}
+
+void Editor::composeWrappedRows(std::vector<std::string>& out, const size_t lineNumWidth, const bool active) const {
+    size_t y = rowOffset;
+    size_t sub = topRow;
+
+    for (size_t i = 0; i < out.size(); ++i) {
+        std::string& row = out[i];
+        row.clear();
+
+        if (y >= buffer.size()) {
+            if (showLineNumbers) {
+                if (y == 0) {
+                    appendNumber(row, 1, lineNumWidth - 1);
+                    row += ' ';
+                } else {
+                    row.append(lineNumWidth, ' ');
+                }
+            }
+            if (y != 0) row += '~';
+            ++y;
+            continue;
+        }
+
+        // Only the first display row of a line carries its number
+        if (showLineNumbers) {
+            if (sub == 0) {
+                appendNumber(row, y + 1, lineNumWidth - 1);
+                row += ' ';
+            } else {
+                row.append(lineNumWidth, ' ');
+            }
+        }
+
+        const std::string& line = buffer[y];
+        const std::vector<QEditor::WrapRow>& lineRows = wrapRows(y);
+        const size_t count = lineRows.size();
+        const size_t begin = lineRows[sub].byte;
+        const size_t end = sub + 1 < count ? lineRows[sub + 1].byte : line.size();
+
+        const size_t textStart = row.size();
+        appendExpanded(row, std::string_view(line).substr(begin, end - begin));
+
+        // Only the active window shows the selection and extra cursors
+        if (active && mode == VISUAL && y >= std::min(visualY, cur_y) && y <= std::max(visualY, cur_y)) {
+            highlightSelection(row, textStart, y, line, begin, end);
+        } else if (active && !extraCursors.empty()) {
+            highlightCursors(row, textStart, y, line, begin, end);
+        }
+
+        if (++sub == count) {
+            ++y;
+            sub = 0;
+        }
+    }
+}
+
+Editor::Motion Editor::moveByRows(const size_t count, const bool down) const {
+    const QEditor::LineStore& lines = buffer;
+    size_t y = cur_y;
+    const std::vector<QEditor::WrapRow>* rows = &wrapRows(y);
+    size_t sub = QEditor::WrapCache::rowOf(*rows, cur_x);
+    const size_t column = QEditor::WrapCache::cells(lines[y], (*rows)[sub].byte, cur_x, TAB_WIDTH);
+
+    // Stepping within a line is a binary search away, whatever its length
+    for (size_t i = 0; i < count; ++i) {
+        if (down) {
+            if (sub + 1 < rows->size()) {
+                ++sub;
+            } else if (y + 1 < lines.size()) {
+                rows = &wrapRows(++y);
+                sub = 0;
+            } else {
+                break;
+            }
+        } else {
+            if (sub > 0) {
+                --sub;
+            } else if (y > 0) {
+                rows = &wrapRows(--y);
+                sub = rows->size() - 1;
+            } else {
+                break;
+            }
+        }
+    }
+
+    const size_t end = sub + 1 < rows->size() ? (*rows)[sub + 1].byte - 1 : lines[y].size();
+    return {QEditor::WrapCache::byteAt(lines[y], (*rows)[sub].byte, end, column, TAB_WIDTH), y, false};
+}
+
+void Editor::loadView(const View& view) {
+    cur_x = view.x;
+    cur_y = view.y;
+    rowOffset = view.rowOffset;
+    topRow = view.topRow;
+    colOffset = view.colOffset;
+}
+
+void Editor::enterView(const View& view) {
+    if (view.buffer != activeBuffer) {
+        const size_t left = activeBuffer;
+        const View last = currentView();
+        enterBuffer(view.buffer);
+        buffers[left].view = last;
+        buffers[left].lastUsed = ++bufferClock;
+        watchFile(filename);
+        releaseBuffers();
+    }
+    loadView(view);
+}
+
+void Editor::splitWindow(const bool vertical) {
+    const size_t window = windowLayout.split(activeWindow, vertical);
+    if (!arrangeWindows()) {
+        windowLayout.close(window);
+        arrangeWindows();
+        throw QEditor::CommandError("Not enough room");
+    }
+
+    // The new window starts where this one is and takes the focus
+    views[window] = currentView();
+    focusWindow(window);
+}
+
+void Editor::closeWindow() {
+    if (windowLayout.count() == 1) {
+        throw QEditor::CommandError("Can't close the last window");
+    }
+
+    // The focus goes to the window before it, or after it for the first one
+    const std::vector<size_t> order = windowLayout.windows();
+    const size_t index = static_cast<size_t>(std::find(order.begin(), order.end(), activeWindow) - order.begin());
+    const size_t next = order[index > 0 ? index - 1 : 1];
+
+    windowLayout.close(activeWindow);
+    activeWindow = next;
+    enterView(views[next]);
+    views.erase(next);
+    extraCursors.clear();
+    arrangeWindows();
+    clampCursor();
+}
+
+void Editor::onlyWindow() {
+    windowLayout.only(activeWindow);
+    views.clear();
+    arrangeWindows();
+}
+
+void Editor::focusWindow(const size_t window) {
+    if (window == activeWindow) return;
+
+    views[activeWindow] = currentView();
+    activeWindow = window;
+    enterView(views[window]);
+    views.erase(window);
+    extraCursors.clear();
+
+    const QEditor::WindowRect& rect = activeRect();
+    viewRows = std::max<size_t>(rect.textRows(), 1);
+    viewCols = std::max<size_t>(rect.width, 1);
+    clampCursor();
+}
+
+void Editor::runWindowCommand(const char c) {
+    try {
+        const std::vector<size_t> order = windowLayout.windows();
+        const size_t index = static_cast<size_t>(std::find(order.begin(), order.end(), activeWindow) - order.begin());
+
+        if (c == 'w') {
+            focusWindow(order[(index + 1) % order.size()]);
+        } else if (c == 'W') {
+            focusWindow(order[(index + order.size() - 1) % order.size()]);
+        } else if (c == 'c') {
+            closeWindow();
+        } else if (c == 'q') {
+            if (order.size() > 1) {
+                closeWindow();
+            } else {
+                running = false;
+            }
+        } else if (c == 'o') {
+            onlyWindow();
+        } else if (c == 's' || c == 'v') {
+            splitWindow(c == 'v');
+        } else {
+            // h, j, k, l: the window past the edge of this one, level with the cursor
+            layoutWindows();
+            const QEditor::WindowRect& from = activeRect();
+            size_t targetRow = from.top + std::min(cur_y >= rowOffset ? cur_y - rowOffset : 0, viewRows - 1);
+            size_t targetColumn = from.left;
+            if (c == 'j') targetRow = from.top + from.height;
+            if (c == 'k') targetRow = from.top - 1;
+            if (c == 'l') targetColumn = from.left + from.width + 1;
+            if (c == 'h') targetColumn = from.left - 2;
+
+            for (const QEditor::WindowRect& rect : windowRects) {
+                if (targetRow >= rect.top && targetRow < rect.top + rect.height &&
+                    targetColumn >= rect.left && targetColumn < rect.left + rect.width) {
+                    focusWindow(rect.window);
+                    break;
+                }
+            }
+        }
+    } catch (const QEditor::EditorError& e) {
+        setStatusMessage(e.what());
+    }
+}
+
+void Editor::layoutWindows() {
+    if (screenRows == arrangedRows && screenCols == arrangedCols) return;
+    arrangeWindows();
+}
+
+bool Editor::arrangeWindows() {
+    arrangedRows = screenRows;
+    arrangedCols = screenCols;
+    const bool fits = windowLayout.arrange(screenRows > 1 ? screenRows - 1 : 1, screenCols, windowRects, dividers);
+
+    const QEditor::WindowRect& rect = activeRect();
+    viewRows = std::max<size_t>(rect.textRows(), 1);
+    viewCols = std::max<size_t>(rect.width, 1);
+    return fits;
+}
+
+const QEditor::WindowRect& Editor::activeRect() const {
+    return *std::find_if(windowRects.begin(), windowRects.end(), [this](const QEditor::WindowRect& rect) {
+        return rect.window == activeWindow;
+    });
+}
+
+void Editor::shiftViews(const size_t at, const size_t count, const size_t newCount) {
+    // Lines after the change move with it; lines it removed go to the line after it
+    auto follow = [&](size_t& line) {
+        if (line >= at + count) {
+            line = line - count + newCount;
+        } else if (line >= at + newCount) {
+            line = at + newCount;
+            return true;
+        }
+        return false;
+    };
+
+    for (auto& [window, view] : views) {
+        if (view.buffer != activeBuffer) continue;
+        follow(view.y);
+        if (follow(view.rowOffset)) view.topRow = 0;
+    }
+}
+
+void Editor::editFile(const std::string& name) {
+    // A file that is already open is just switched to
+    const QEditor::FileIdentity identity = QEditor::FileIdentity::of(name);
+    for (size_t i = 0; i < buffers.size(); ++i) {
+        const std::string& open = bufferName(i);
+        if (open.empty()) continue;
+
+        const QEditor::FileIdentity other = QEditor::FileIdentity::of(open);
+        if (open == name || (identity.exists && other.exists && identity.device == other.device &&
+                             identity.inode == other.inode)) {
+            switchBuffer(i);
+            return;
+        }
+    }
+
+    // The empty buffer Qedit starts with is used rather than kept around
+    if (filename.empty() && buffer.size() <= 1 && (buffer.empty() || std::as_const(buffer)[0].empty()) &&
+        undoHistory.undoDepth() == 0 && !pager) {
+        loadFile(name);
+        cur_x = cur_y = 0;
+        return;
+    }
+
+    const size_t previous = activeBuffer;
+    buffers.emplace_back();
+    switchBuffer(buffers.size() - 1);
+    try {
+        loadFile(name);
+    } catch (const QEditor::EditorError&) {
+        switchBuffer(previous);
+        buffers.pop_back();
+        throw;
+    }
+}
+
+void Editor::jumpToTag(const std::string& name) {
+    if (!symbols) {
+        symbols = std::make_unique<QEditor::SymbolIndex>(".", indexCache);
+    }
+    // Files saved since the last jump are rescanned while this one is looked up
+    symbols->refresh();
+    if (!symbols->waitReady(SYMBOL_INDEX_WAIT)) {
+        throw QEditor::CommandError("Still indexing symbols");
+    }
+
+    std::vector<QEditor::SymbolIndex::Location> found = symbols->find(name);
+    // It may be in a file saved a moment ago that is still being scanned
+    if (found.empty() && symbols->waitRefreshed(SYMBOL_INDEX_WAIT)) found = symbols->find(name);
+    if (found.empty()) {
+        throw QEditor::CommandError("Tag not found: " + name);
+    }
+
+    // A definition in the file being edited comes first
+    std::stable_partition(found.begin(), found.end(), [this](const QEditor::SymbolIndex::Location& tag) {
+        return isEditing(tag.file);
+    });
+
+    const QEditor::SymbolIndex::Location& tag = found.front();
+    const TagOrigin origin{activeBuffer, cur_x, cur_y};
+    openLocation(tag.file, tag.line);
+    tagStack.push_back(origin);
+
+    if (cur_y < buffer.size()) {
+        const std::string& line = std::as_const(buffer)[cur_y];
+        const size_t at = line.find(name);
+        cur_x = at != std::string::npos ? at : firstNonBlank(line);
+    }
+
+    std::string status = "\"" + tag.file + "\" line " + std::to_string(tag.line);
+    if (found.size() > 1) status += " (tag 1 of " + std::to_string(found.size()) + ")";
+    setStatusMessage(status);
+}
+
+void Editor::openLocation(const std::string& file, const size_t line) {
+    if (!isEditing(file)) editFile(file);
+
+    extraCursors.clear();
+    cur_x = commandReturnX = 0;
+    cur_y = std::min<size_t>(line > 0 ? line - 1 : 0, buffer.empty() ? 0 : buffer.size() - 1);
+    while (folds.isHidden(cur_y) && folds.open(cur_y)) {}
+}
+
+bool Editor::isEditing(const std::string& file) const {
+    if (file == filename) return true;
+
+    const QEditor::FileIdentity current = QEditor::FileIdentity::of(filename);
+    const QEditor::FileIdentity identity = QEditor::FileIdentity::of(file);
+    return current.exists && identity.exists && identity.device == current.device &&
+           identity.inode == current.inode;
+}
+
+void Editor::popTag() {
+    if (tagStack.empty()) {
+        setStatusMessage("At bottom of tag stack");
+        return;
+    }
+
+    const TagOrigin origin = tagStack.back();
+    tagStack.pop_back();
+    switchBuffer(origin.buffer);
+    extraCursors.clear();
+    cur_x = origin.x;
+    cur_y = origin.y;
+    clampCursor();
+}
+
+void Editor::startSearch(const std::string& args) {
+    // The pattern is one word, or quoted to hold spaces
+    std::string pattern;
+    size_t i = 0;
+    if (!args.empty() && (args[0] == '"' || args[0] == '\'')) {
+        const char quote = args[0];
+        for (i = 1; i < args.size() && args[i] != quote; ++i) {
+            if (args[i] == '\\' && i + 1 < args.size() && args[i + 1] == quote) ++i;
+            pattern += args[i];
+        }
+        ++i;
+    } else {
+        while (i < args.size() && args[i] != ' ' && args[i] != '\t') pattern += args[i++];
+    }
+    if (pattern.empty()) {
+        throw QEditor::CommandError("Expected a pattern");
+    }
+
+    std::string directory(trimWhitespace(std::string_view(args).substr(std::min(i, args.size()))));
+    if (directory.empty()) directory = ".";
+    if (!std::filesystem::exists(directory)) {
+        throw QEditor::CommandError("No such directory: " + directory);
+    }
+
+    if (!search) search = std::make_unique<QEditor::TreeSearch>();
+    try {
+        search->start(pattern, directory);
+    } catch (const std::regex_error&) {
+        throw QEditor::CommandError("Invalid pattern: " + pattern);
+    }
+
+    searchPattern = pattern;
+    quickfix.clear();
+    quickfixAt.reset();
+    setStatusMessage("Searching for " + pattern + "...");
+}
+
+void Editor::takeSearchResults() {
+    if (!search) return;
+
+    if (search->take(quickfix)) return;
+
+    // The search is over
+    std::string status = quickfix.empty() ? "No matches for " + searchPattern
+                                          : std::to_string(quickfix.size()) + " matches for " + searchPattern;
+    status += " in " + std::to_string(search->filesSearched()) + " files";
+    if (search->reachedLimit()) status += ", stopped at the limit";
+    setStatusMessage(status);
+}
+
+void Editor::stepQuickfix(const bool forward) {
+    takeSearchResults();
+    const bool searching = search && search->isRunning();
+    if (quickfix.empty()) {
+        throw QEditor::CommandError(searching ? "No matches yet, still searching" : "No matches");
+    }
+
+    size_t next;
+    if (forward) {
+        next = quickfixAt ? *quickfixAt + 1 : 0;
+        if (next >= quickfix.size()) {
+            throw QEditor::CommandError(searching ? "No more matches yet, still searching" : "No more items");
+        }
+    } else {
+        if (!quickfixAt || *quickfixAt == 0) {
+            throw QEditor::CommandError("No more items");
+        }
+        next = *quickfixAt - 1;
+    }
+
+    const QEditor::SearchMatch& match = quickfix[next];
+    openLocation(match.file, match.line);
+    quickfixAt = next;
+    if (cur_y < buffer.size()) cur_x = match.column;
+    clampCursor();
+    commandReturnX = cur_x;
+
+    setStatusMessage("(" + std::to_string(next + 1) + " of " + std::to_string(quickfix.size()) +
+                     (searching ? "+" : "") + ") " + match.file + ":" + std::to_string(match.line) + ": " +
+                     std::string(trimWhitespace(match.text)));
+}
+
+void Editor::cycleBuffer(const bool forward) {
+    const size_t count = buffers.size();
+    switchBuffer(forward ? (activeBuffer + 1) % count : (activeBuffer + count - 1) % count);
+}
+
+void Editor::switchBuffer(const size_t index) {
+    if (index == activeBuffer) return;
+
+    View view = buffers[index].view;
+    view.buffer = index;
+    extraCursors.clear();
+    enterView(view);
+    clampCursor();
+
+    setStatusMessage("\"" + (filename.empty() ? std::string("[No Name]") : filename) + "\" " +
+                     std::to_string(buffer.size()) + " lines [" + std::to_string(activeBuffer + 1) + "/" +
+                     std::to_string(buffers.size()) + "]");
+}
+
+void Editor::enterBuffer(const size_t index) {
+    exchangeBuffer(buffers[activeBuffer]);
+    activeBuffer = index;
+    exchangeBuffer(buffers[activeBuffer]);
+}
+
+void Editor::exchangeBuffer(BufferState& other) {
+    using std::swap;
+    swap(filename, other.filename);
+    swap(buffer, other.lines);
+    swap(undoHistory, other.undo);
+    swap(compression, other.compression);
+    swap(loader, other.loader);
+    swap(diskIdentity, other.diskIdentity);
+    swap(identityKnown, other.identityKnown);
+    swap(changeWarned, other.changeWarned);
+    swap(visualFirst, other.visualFirst);
+    swap(visualLast, other.visualLast);
+
+    swap(following, other.following);
+    swap(tailTerminated, other.tailTerminated);
+    swap(tail, other.tail);
+    swap(followChunk, other.followChunk);
+
+    swap(differ, other.differ);
+    swap(diffOther, other.diffOther);
+    swap(diffOtherText, other.diffOtherText);
+    swap(diffOtherName, other.diffOtherName);
+    swap(diffHunks, other.diffHunks);
+    swap(diffExtraBefore, other.diffExtraBefore);
+    swap(diffRevision, other.diffRevision);
+
+    swap(folding, other.folding);
+    swap(foldsStale, other.foldsStale);
+    swap(folds, other.folds);
+    swap(wraps, other.wraps);
+    swap(columns, other.columns);
+    swap(words, other.words);
+}
+
+void Editor::releaseBuffers() {
+    // Buffers other windows show are drawn every frame, so they keep theirs
+    std::vector<size_t> hidden;
+    for (size_t i = 0; i < buffers.size(); ++i) {
+        const bool shown = std::any_of(views.begin(), views.end(), [i](const auto& entry) {
+            return entry.second.buffer == i;
+        });
+        if (i != activeBuffer && !shown) hidden.push_back(i);
+    }
+    std::sort(hidden.begin(), hidden.end(), [this](const size_t a, const size_t b) {
+        return buffers[a].lastUsed > buffers[b].lastUsed;
+    });
+
+    size_t kept = 0;
+    for (const size_t i : hidden) {
+        BufferState& state = buffers[i];
+        const QEditor::LineStore::Stats lines = state.lines.stats();
+        const size_t bytes = state.wraps.memoryUsage() + state.columns.memoryUsage() + lines.stringBytes +
+                             lines.slackBytes;
+        if (kept + bytes <= backgroundCacheBytes) {
+            kept += bytes;
+            continue;
+        }
+
+        state.wraps.clear();
+        state.columns.clear();
+        state.lines.release();
+    }
+}
+
+const std::string& Editor::bufferName(const size_t index) const {
+    return index == activeBuffer ? filename : buffers[index].filename;
+}
+
+void Editor::composeWindows() {
+    const size_t rows = screenRows > 0 ? screenRows - 1 : 0;
+    frameRows.resize(rows);
+
+    // Each window composes its own rows, the others by swapping their view in
+    const View live = currentView();
+    const size_t liveRows = viewRows, liveCols = viewCols;
+    paneRows.resize(windowRects.size());
+    for (size_t i = 0; i < windowRects.size(); ++i) {
+        const QEditor::WindowRect& rect = windowRects[i];
+        paneRows[i].resize(rect.textRows());
+
+        if (rect.window == activeWindow) {
+            composeView(paneRows[i], true);
+            continue;
+        }
+
+        // A window on another buffer draws it swapped in, caches and all
+        View& view = views[rect.window];
+        if (view.buffer != activeBuffer) enterBuffer(view.buffer);
+        loadView(view);
+        viewRows = std::max<size_t>(rect.textRows(), 1);
+        viewCols = std::max<size_t>(rect.width, 1);
+        clampCursor();
+        scroll();
+        composeView(paneRows[i], false);
+        view = currentView();
+    }
+    if (live.buffer != activeBuffer) enterBuffer(live.buffer);
+    loadView(live);
+    viewRows = liveRows;
+    viewCols = liveCols;
+
+    // Then each screen row is laid out left to right from the windows and
+    // dividers crossing it
+    std::vector<std::pair<size_t, size_t>> pieces; // left column, window index or dividers marker
+    const size_t divider = windowRects.size();
+    for (size_t r = 0; r < rows; ++r) {
+        pieces.clear();
+        for (size_t i = 0; i < windowRects.size(); ++i) {
+            const QEditor::WindowRect& rect = windowRects[i];
+            if (r >= rect.top && r < rect.top + rect.height) pieces.emplace_back(rect.left, i);
+        }
+        for (const QEditor::Divider& bar : dividers) {
+            if (r >= bar.top && r < bar.top + bar.height) pieces.emplace_back(bar.left, divider);
+        }
+        std::sort(pieces.begin(), pieces.end());
+
+        std::string& row = frameRows[r];
+        row.clear();
+        size_t used = 0;
+        for (size_t p = 0; p < pieces.size(); ++p) {
+            const auto [left, index] = pieces[p];
+            if (left > used) row.append(left - used, ' ');
+            used = left;
+
+            if (index == divider) {
+                row += '|';
+                ++used;
+                continue;
+            }
+
+            const QEditor::WindowRect& rect = windowRects[index];
+            const size_t start = row.size();
+            if (r - rect.top < rect.textRows()) {
+                row += paneRows[index][r - rect.top];
+            } else {
+                // Status row: the file and the window's cursor line, the active one in bold
+                const View& shown = rect.window == activeWindow ? live : views[rect.window];
+                const std::string& name = bufferName(shown.buffer);
+                std::string label = " " + (name.empty() ? std::string("[No Name]") : name) + "  " +
+                                    std::to_string(shown.y + 1) + " ";
+                label.resize(QEditor::WrapCache::byteAt(label, 0, label.size(), rect.width, TAB_WIDTH));
+                label.append(rect.width - displayCells(label), ' ');
+                row += rect.window == activeWindow ? "\x1b[1;7m" : "\x1b[7m";
+                row += label;
+                row += "\x1b[22;27m";
+            }
+
+            // Pad to the window's width unless nothing follows on the row
+            used += rect.width;
+            if (p + 1 < pieces.size()) {
+                const size_t cells = displayCells(std::string_view(row).substr(start));
+                if (cells < rect.width) row.append(rect.width - cells, ' ');
+            }
+        }
+    }
+}
 
+void Editor::runFold(const NormalCommand& cmd) {
+    if (pager || buffer.empty()) return;
+
+    if (!folding) {
+        folding = true;
+        foldsStale = true;
+    }
+    if (foldsStale) {
+        folds.build(buffer, foldMethodFor(filename), TAB_WIDTH);
+        foldsStale = false;
+    }
+
+    clampCursor();
+    if (cmd.key == 'c') {
+        if (!folds.close(cur_y)) setStatusMessage("No fold found");
+    } else if (cmd.key == 'o') {
+        if (!folds.open(cur_y)) setStatusMessage("No fold found");
+    } else if (cmd.key == 'M') {
+        folds.closeAll();
+    } else if (cmd.key == 'R') {
+        folds.openAll();
+    }
+
+    // The cursor moves to the line left showing for a fold it is in
+    cur_y = folds.visibleLine(cur_y);
+    clampCursor();
+}
+
+const QEditor::FoldTree* Editor::shownFolds() const {
+    if (!folding || wrap || differ || pager) return nullptr;
+
+    if (foldsStale) {
+        folds.build(buffer, foldMethodFor(filename), TAB_WIDTH);
+        foldsStale = false;
+    }
+    return &folds;
+}
+
+size_t Editor::lineBelow(const size_t y, const size_t count) const {
+    const size_t last = buffer.empty() ? 0 : buffer.size() - 1;
+    if (const QEditor::FoldTree* shown = shownFolds()) {
+        return shown->lineAtVisibleIndex(std::min(shown->visibleIndex(y) + count, shown->visibleIndex(last)));
+    }
+    return std::min(y + count, last);
+}
+
+size_t Editor::lineAbove(const size_t y, const size_t count) const {
+    if (const QEditor::FoldTree* shown = shownFolds()) {
+        const size_t index = shown->visibleIndex(y);
+        return shown->lineAtVisibleIndex(index - std::min(count, index));
+    }
+    return y - std::min(count, y);
+}
+
+void Editor::setWrap(const bool on) {
+    wrap = on;
+    topRow = 0;
+    invalidateScreen();
+    requestRedraw();
+}
+
+void Editor::drawPagerScreen() const {
+    std::cout << "\x1b[?25l";
+
+    const size_t rows = screenRows - 1;
+    pager->visibleLines(rows, pagerLines, screenCols * TAB_WIDTH);
+
+    const std::optional<uint64_t> topLine = showLineNumbers ? pager->topLineNumber() : std::nullopt;
+    const size_t lineNumWidth = topLine ? digitCount(*topLine + rows) + 1 : 0;
+
+    frameRows.resize(rows);
+    for (size_t i = 0; i < rows; ++i) {
+        std::string& row = frameRows[i];
+        row.clear();
+
+        if (i >= pagerLines.size()) {
+            row += '~';
+            continue;
+        }
+
+        if (topLine) {
+            appendNumber(row, *topLine + i + 1, lineNumWidth - 1);
+            row += ' ';
+        }
+
+        appendExpanded(row, pagerLines[i]);
+        if (row.size() > screenCols) {
+            row.resize(screenCols);
+        }
+    }
+
+    flushRows();
+
+    std::cout << "\x1b[" << screenRows << ";1H\x1b[2K";
+    if (mode == COMMAND) {
+        std::cout << commandBuffer;
+    } else if (!statusMessage.empty()) {
+        const size_t col = statusMessage.length() < screenCols ? screenCols - statusMessage.length() + 1 : 1;
+        std::cout << "\x1b[" << screenRows << ";" << col << "H" << statusMessage;
+    }
+
+    if (mode == COMMAND) {
+        std::cout << "\x1b[" << screenRows << ";" << cur_x + 1 << "H";
+    } else {
+        std::cout << "\x1b[1;1H";
+    }
+
+    std::cout << "\x1b[?25h";
     std::cout.flush();
 }
 
 void Editor::processCommand() {
     try {
+        if (pager) {
+            const char kind = commandBuffer[0];
+            const std::string arg = commandBuffer.substr(1);
+
+            if (kind == '/' || kind == '?') {
+                if (!arg.empty()) {
+                    lastSearch = arg;
+                    lastSearchForward = kind == '/';
+                }
+                if (!lastSearch.empty() && !pager->search(lastSearch, lastSearchForward)) {
+                    throw QEditor::CommandError("Pattern not found: " + lastSearch);
+                }
+                setStatusMessage(pager->status());
+            } else if (!arg.empty() && std::all_of(arg.begin(), arg.end(), ::isdigit)) {
+                uint64_t line = 0;
+                if (std::from_chars(arg.data(), arg.data() + arg.size(), line).ec != std::errc()) {
+                    throw QEditor::CommandError("Invalid line number: " + arg);
+                }
+                pager->gotoLine(line > 0 ? line - 1 : 0);
+                setStatusMessage(pager->status());
+            } else if (commandBuffer == EditorCommands::QUIT) {
+                running = false;
+            } else if (commandBuffer == EditorCommands::FOLLOW) {
+                following ? stopFollow() : startFollow();
+            } else if (commandBuffer == EditorCommands::RELOAD) {
+                reloadFile();
+            } else if (commandBuffer == EditorCommands::MEMORY) {
+                infoLines = memoryReport();
+            } else {
+                throw QEditor::CommandError("Read-only view: " + commandBuffer);
+            }
+
+            commandBuffer.clear();
+            return;
+        }
+
+        if (runLineCommand(commandBuffer)) {
+            commandBuffer.clear();
+            return;
+        }
+
         if (commandBuffer == EditorCommands::WRITE ||
+            commandBuffer == EditorCommands::FORCE_WRITE ||
             commandBuffer == EditorCommands::WRITE_QUIT) {
             std::string file = this->filename;
 
@@ -481,21 +3561,108 @@ void Editor::processCommand() {
                 }
             }
 
-            saveFile(file);
+            saveFile(file, commandBuffer == EditorCommands::FORCE_WRITE);
+        }
+
+        if (commandBuffer == EditorCommands::RELOAD) {
+            reloadFile();
+        }
+
+        if (commandBuffer == EditorCommands::EDIT || commandBuffer.rfind(EditorCommands::EDIT + " ", 0) == 0) {
+            const std::string name(trimWhitespace(std::string_view(commandBuffer).substr(EditorCommands::EDIT.size())));
+            if (name.empty()) {
+                throw QEditor::CommandError("Expected a file to edit");
+            }
+            editFile(name);
+        }
+
+        if (commandBuffer == EditorCommands::BUFFER_NEXT || commandBuffer == EditorCommands::BUFFER_NEXT_LONG ||
+            commandBuffer == EditorCommands::BUFFER_PREV || commandBuffer == EditorCommands::BUFFER_PREV_LONG) {
+            cycleBuffer(commandBuffer == EditorCommands::BUFFER_NEXT || commandBuffer == EditorCommands::BUFFER_NEXT_LONG);
+        }
+
+        if (commandBuffer == EditorCommands::GREP || commandBuffer.rfind(EditorCommands::GREP + " ", 0) == 0) {
+            startSearch(std::string(trimWhitespace(std::string_view(commandBuffer).substr(EditorCommands::GREP.size()))));
+        }
+
+        if (commandBuffer == EditorCommands::QUICKFIX_NEXT || commandBuffer == EditorCommands::QUICKFIX_NEXT_LONG ||
+            commandBuffer == EditorCommands::QUICKFIX_PREV || commandBuffer == EditorCommands::QUICKFIX_PREV_LONG) {
+            stepQuickfix(commandBuffer == EditorCommands::QUICKFIX_NEXT ||
+                         commandBuffer == EditorCommands::QUICKFIX_NEXT_LONG);
+        }
+
+        if (commandBuffer == EditorCommands::TAG || commandBuffer.rfind(EditorCommands::TAG + " ", 0) == 0) {
+            const std::string name(trimWhitespace(std::string_view(commandBuffer).substr(EditorCommands::TAG.size())));
+            if (name.empty()) {
+                throw QEditor::CommandError("Expected a tag name");
+            }
+            jumpToTag(name);
         }
 
         if (commandBuffer == EditorCommands::QUIT ||
             commandBuffer == EditorCommands::WRITE_QUIT) {
-            running = false;
+            // With several windows only this one goes
+            if (windowLayout.count() > 1) {
+                closeWindow();
+            } else {
+                running = false;
+            }
+        }
+
+        if (commandBuffer == EditorCommands::SPLIT || commandBuffer == EditorCommands::SPLIT_SHORT ||
+            commandBuffer == EditorCommands::VSPLIT || commandBuffer == EditorCommands::VSPLIT_SHORT) {
+            splitWindow(commandBuffer == EditorCommands::VSPLIT || commandBuffer == EditorCommands::VSPLIT_SHORT);
+        }
+
+        if (commandBuffer == EditorCommands::CLOSE) {
+            closeWindow();
+        }
+
+        if (commandBuffer == EditorCommands::ONLY) {
+            onlyWindow();
+        }
+
+        if (commandBuffer == EditorCommands::FOLLOW) {
+            following ? stopFollow() : startFollow();
+        }
+
+        if (commandBuffer == EditorCommands::MEMORY) {
+            infoLines = memoryReport();
+        }
+
+        if (commandBuffer.rfind(EditorCommands::DIFF_THIS, 0) == 0) {
+            const std::string other(trimWhitespace(std::string_view(commandBuffer).substr(EditorCommands::DIFF_THIS.size())));
+            if (other.empty()) {
+                throw QEditor::CommandError("Expected a file to diff against");
+            }
+            startDiff(other);
+        }
+
+        if (commandBuffer == EditorCommands::DIFF_OFF) {
+            stopDiff();
+        }
+
+        if (commandBuffer == EditorCommands::WRAP || commandBuffer == EditorCommands::NO_WRAP) {
+            setWrap(commandBuffer == EditorCommands::WRAP);
+        }
+
+        if (commandBuffer == EditorCommands::CURSORS || commandBuffer.rfind(EditorCommands::CURSORS + " ", 0) == 0) {
+            addCursorsOnMatches(std::string(trimWhitespace(std::string_view(commandBuffer).substr(EditorCommands::CURSORS.size()))));
         }
 
         if (commandBuffer.substr(0, 3) == EditorCommands::WRITE + " ") {
-            const std::string saveFilename = trimWhitespace(commandBuffer.substr(3));
+            const std::string saveFilename(trimWhitespace(std::string_view(commandBuffer).substr(3)));
             if (saveFilename.empty()) {
                 throw QEditor::CommandError("Empty filename");
             }
 
-            filename = saveFilename;
+            if (saveFilename != filename) {
+                finishLoading();
+                filename = saveFilename;
+                compression = QEditor::compressionForName(filename);
+                identityKnown = false;
+                watchFile(filename);
+            }
             saveFile(saveFilename);
         }
 
@@ -506,6 +3673,269 @@ void Editor::processCommand() {
     }
 }
 
+bool Editor::runLineCommand(std::string_view command) {
+    command.remove_prefix(1); // ':'
+    const size_t unparsed = command.size();
+    const auto [first, last] = parseRange(command);
+    const bool ranged = command.size() != unparsed;
+
+    size_t nameLength = 0;
+    while (nameLength < command.size() && std::isalpha(static_cast<unsigned char>(command[nameLength]))) {
+        ++nameLength;
+    }
+    const std::string_view name = command.substr(0, nameLength);
+    const std::string_view args = command.substr(nameLength);
+
+    const bool shell = name.empty() && !args.empty() && args[0] == '!';
+    if (shell && !ranged) {
+        runShellCommand(std::string(trimWhitespace(args.substr(1))));
+        return true;
+    }
+    if (!shell && name != EditorCommands::SORT && name != EditorCommands::UNIQ &&
+        name != EditorCommands::GLOBAL && name != EditorCommands::VGLOBAL) {
+        return false;
+    }
+    if (first > last || last >= buffer.size()) {
+        throw QEditor::CommandError("Invalid range");
+    }
+
+    const size_t before = buffer.size();
+    if (shell) {
+        filterThroughCommand(first, last, std::string(trimWhitespace(args.substr(1))));
+    } else if (name == EditorCommands::SORT) {
+        const QEditor::SortOptions options = QEditor::parseSortOptions(args);
+        rewriteLines(first, last - first + 1, [&](std::vector<std::string>& lines) {
+            lines = QEditor::sortLines(std::move(lines), options, QEditor::ThreadPool::shared());
+        });
+    } else if (name == EditorCommands::UNIQ) {
+        if (!trimWhitespace(args).empty()) {
+            throw QEditor::CommandError("Trailing characters: " + std::string(args));
+        }
+        rewriteLines(first, last - first + 1, [](std::vector<std::string>& lines) {
+            QEditor::uniqueLines(lines);
+        });
+    } else if (!args.empty() && args[0] == '!') {
+        runFilterCommand(first, last, args.substr(1), name != EditorCommands::GLOBAL);
+    } else {
+        runFilterCommand(first, last, args, name == EditorCommands::GLOBAL);
+    }
+
+    // Like vim, the cursor ends up at the start of the range
+    cur_y = std::min(first, buffer.empty() ? 0 : buffer.size() - 1);
+    commandReturnX = 0;
+    if (buffer.size() < before) {
+        setStatusMessage(std::to_string(before - buffer.size()) + " fewer lines");
+    }
+    return true;
+}
+
+std::pair<size_t, size_t> Editor::parseRange(std::string_view& command) const {
+    if (!command.empty() && command[0] == '%') {
+        command.remove_prefix(1);
+        return {0, buffer.empty() ? 0 : buffer.size() - 1};
+    }
+
+    // No address at all means the whole buffer, as for :sort and :g in vim
+    if (command.empty() || !(std::isdigit(static_cast<unsigned char>(command[0])) ||
+                             std::string_view(".$'+-,").find(command[0]) != std::string_view::npos)) {
+        return {0, buffer.empty() ? 0 : buffer.size() - 1};
+    }
+
+    const size_t first = parseAddress(command);
+    if (command.empty() || command[0] != ',') {
+        return {first, first};
+    }
+    command.remove_prefix(1);
+    return {first, parseAddress(command)};
+}
+
+size_t Editor::parseAddress(std::string_view& command) const {
+    auto number = [&command] {
+        size_t n = 0;
+        const auto [end, error] = std::from_chars(command.data(), command.data() + command.size(), n);
+        if (error != std::errc()) throw QEditor::CommandError("Invalid range");
+        command.remove_prefix(static_cast<size_t>(end - command.data()));
+        return n;
+    };
+
+    // Without a line number the address is relative to the cursor
+    long line = static_cast<long>(cur_y);
+    if (!command.empty() && std::isdigit(static_cast<unsigned char>(command[0]))) {
+        line = static_cast<long>(number()) - 1;
+    } else if (!command.empty() && command[0] == '.') {
+        command.remove_prefix(1);
+    } else if (!command.empty() && command[0] == '$') {
+        command.remove_prefix(1);
+        line = static_cast<long>(buffer.size()) - 1;
+    } else if (command.size() >= 2 && command[0] == '\'' && (command[1] == '<' || command[1] == '>')) {
+        line = static_cast<long>(command[1] == '<' ? visualFirst : visualLast);
+        command.remove_prefix(2);
+    }
+
+    while (!command.empty() && (command[0] == '+' || command[0] == '-')) {
+        const long sign = command[0] == '+' ? 1 : -1;
+        command.remove_prefix(1);
+        const bool counted = !command.empty() && std::isdigit(static_cast<unsigned char>(command[0]));
+        line += sign * (counted ? static_cast<long>(number()) : 1);
+    }
+
+    if (line < 0) throw QEditor::CommandError("Invalid range");
+    return static_cast<size_t>(line);
+}
+
+void Editor::runFilterCommand(const size_t first, const size_t last, const std::string_view args, const bool keep) {
+    // :g/pattern/d, with any punctuation as the delimiter
+    if (args.empty() || std::isalnum(static_cast<unsigned char>(args[0])) || args[0] == ' ' ||
+        args[0] == '\\' || args[0] == '"') {
+        throw QEditor::CommandError("Expected :g/pattern/d");
+    }
+
+    const char delimiter = args[0];
+    std::string pattern;
+    size_t i = 1;
+    for (; i < args.size() && args[i] != delimiter; ++i) {
+        if (args[i] == '\\' && i + 1 < args.size() && args[i + 1] == delimiter) ++i;
+        pattern += args[i];
+    }
+    if (trimWhitespace(args.substr(std::min(i + 1, args.size()))) != "d") {
+        throw QEditor::CommandError("Only :g/pattern/d is supported");
+    }
+    if (pattern.empty()) {
+        throw QEditor::CommandError("Empty pattern");
+    }
+
+    // Plain text is searched for directly, which is much faster than std::regex
+    std::function<bool(const std::string&)> matches;
+    if (pattern.find_first_of(".^$|()[]{}*+?\\") == std::string::npos) {
+        matches = [pattern](const std::string& line) { return line.find(pattern) != std::string::npos; };
+    } else {
+        try {
+            auto re = std::make_shared<const std::regex>(pattern);
+            matches = [re](const std::string& line) { return std::regex_search(line, *re); };
+        } catch (const std::regex_error& e) {
+            throw QEditor::CommandError("Invalid pattern: " + pattern);
+        }
+    }
+
+    // :g deletes the matching lines, so only the others are kept. A regex
+    // can still fail on a line it is too complex to match.
+    try {
+        rewriteLines(first, last - first + 1, [&](std::vector<std::string>& lines) {
+            QEditor::filterLines(lines, matches, !keep, QEditor::ThreadPool::shared());
+        });
+    } catch (const std::regex_error&) {
+        throw QEditor::CommandError("Pattern too complex: " + pattern);
+    }
+}
+
+void Editor::filterThroughCommand(const size_t first, const size_t last, const std::string& command) {
+    if (command.empty()) {
+        throw QEditor::CommandError("Expected a command after !");
+    }
+
+    // The range is fed to the child a chunk at a time as its stdin drains
+    const QEditor::LineStore& lines = buffer;
+    size_t next = first;
+    std::vector<std::string> output;
+    const QEditor::ProcessFilter::Result result = QEditor::ProcessFilter::run(
+        command,
+        [&](std::string& chunk) {
+            chunk += lines[next++];
+            chunk += '\n';
+            return next <= last;
+        },
+        [&](std::string&& line) { output.push_back(std::move(line)); },
+        shellProgress(command, output),
+        isatty(STDIN_FILENO) ? STDIN_FILENO : -1);
+    checkShellResult(result);
+
+    replaceLines(first, last - first + 1, std::move(output));
+    setStatusMessage(std::to_string(last - first + 1) + " lines filtered");
+}
+
+void Editor::runShellCommand(const std::string& command) {
+    if (command.empty()) {
+        throw QEditor::CommandError("Expected a command after !");
+    }
+
+    // Only the end of the output can be shown, so only that much is kept
+    std::vector<std::string> output;
+    const QEditor::ProcessFilter::Result result = QEditor::ProcessFilter::run(
+        command,
+        [](std::string&) { return false; },
+        [&](std::string&& line) {
+            if (output.size() == 2 * MAX_SHELL_OUTPUT_LINES) {
+                output.erase(output.begin(), output.begin() + MAX_SHELL_OUTPUT_LINES);
+            }
+            output.push_back(std::move(line));
+        },
+        shellProgress(command, output),
+        isatty(STDIN_FILENO) ? STDIN_FILENO : -1);
+    checkShellResult(result);
+
+    infoLines = std::move(output);
+    infoLines.push_back("Press any key to continue");
+}
+
+std::function<bool()> Editor::shellProgress(const std::string& command, const std::vector<std::string>& output) {
+    auto lastDraw = std::chrono::steady_clock::now();
+    return [this, &command, &output, lastDraw]() mutable {
+        // Esc kills the command; anything else typed meanwhile is dropped
+        char c;
+        while (inputPending() && read(STDIN_FILENO, &c, 1) == 1) {
+            if (c == '\x1b') return false;
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+        if (now - lastDraw >= SHELL_PROGRESS_INTERVAL) {
+            lastDraw = now;
+            setStatusMessage("!" + command + ": " + std::to_string(output.size()) + " lines, Esc cancels");
+            drawScreen();
+        }
+        return true;
+    };
+}
+
+void Editor::checkShellResult(const QEditor::ProcessFilter::Result& result) {
+    if (result.cancelled) {
+        throw QEditor::CommandError("Shell command cancelled");
+    }
+    if (result.status != 0) {
+        const std::string reason = result.errors.substr(0, result.errors.find('\n'));
+        throw QEditor::CommandError("Shell returned " + std::to_string(result.status) +
+                                    (reason.empty() ? "" : ": " + reason));
+    }
+}
+
+void Editor::replaceLines(const size_t first, const size_t count, std::vector<std::string>&& lines) {
+    using Offset = QEditor::LineStore::difference_type;
+    beginChange(first, count);
+    buffer.erase(buffer.begin() + static_cast<Offset>(first), buffer.begin() + static_cast<Offset>(first + count));
+    buffer.insert(buffer.begin() + static_cast<Offset>(first),
+                  std::make_move_iterator(lines.begin()), std::make_move_iterator(lines.end()));
+    endChange(lines.size());
+}
+
+void Editor::rewriteLines(const size_t first, const size_t count,
+                          const std::function<void(std::vector<std::string>&)>& rewrite) {
+    beginChange(first, count);
+    const QEditor::LineSlice original = buffer.cut(first, count);
+    std::vector<std::string> lines = original.lines();
+    try {
+        rewrite(lines);
+    } catch (...) {
+        // Put the range back as it was and close the undo record
+        buffer.splice(first, original);
+        endChange(count);
+        throw;
+    }
+
+    const size_t newCount = lines.size();
+    buffer.insert(buffer.begin() + static_cast<QEditor::LineStore::difference_type>(first),
+                  std::make_move_iterator(lines.begin()), std::make_move_iterator(lines.end()));
+    endChange(newCount);
+}
+
 void Editor::clearScreen() {
     // Save cursor position
     std::cout << "\x1b[s";
@@ -521,32 +3951,35 @@ void Editor::clearScreen() {
 
 void Editor::insertNewline() {
     if (cur_y >= buffer.size()) {
+        beginChange(buffer.size(), 0);
         buffer.emplace_back("");
+        endChange(1);
         cur_y = buffer.size() - 1;
     }
 
+    beginChange(cur_y, 1);
     std::string& current_line = buffer[cur_y];
     if (cur_x > current_line.length()) {
         cur_x = current_line.length();
     }
 
-    const std::string new_line = current_line.substr(cur_x);
-    current_line = current_line.substr(0, cur_x);
+    // Split in place: the tail moves to the new line, the head keeps its storage
+    std::string new_line(current_line, cur_x);
+    current_line.erase(cur_x);
 
-    const auto it = buffer.begin() + static_cast<std::vector<std::string>::difference_type>(cur_y);
+    const auto it = buffer.begin() + static_cast<QEditor::LineStore::difference_type>(cur_y);
 
-    buffer.insert(it + 1, new_line);
+    buffer.insert(it + 1, std::move(new_line));
+    endChange(2);
 
     ++cur_y;
     cur_x = 0;
 }
 
 void Editor::deleteLine() {
-    if (cur_y < 0 || cur_y >= buffer.size()) return;
-
-    const auto it = buffer.begin() + static_cast<std::vector<std::string>::difference_type>(cur_y);
+    if (cur_y >= buffer.size()) return;
 
-    buffer.erase(it);
+    removeLines(cur_y, 1);
 
     // Move cursor up to start of previous line
     cur_x = 0;
@@ -592,42 +4025,27 @@ void Editor::updateWindowSize() {
     screenCols = ws.ws_col;
 
     // Ensure cursor is within bounds
-    if (cur_y >= screenRows - 1) {
-        cur_y = screenRows - 2;
-    }
     if (cur_x >= screenCols) {
         cur_x = screenCols - 1;
     }
 }
 
-std::string Editor::expandTabs(const std::string &line) const {
-    std::string result;
-
-    for (const char ch : line) {
-        if (ch == '\t') {
-            const size_t spaces = TAB_WIDTH;// - (result.length() % TAB_WIDTH);
-
-            result += std::string(spaces, ' ');
-        } else {
-            result += ch;
-        }
+void Editor::appendExpanded(std::string& out, const std::string_view line) const {
+    // Copy runs between tabs in one go, straight into the row being composed
+    size_t start = 0;
+    for (size_t tab = line.find('\t'); tab != std::string::npos; tab = line.find('\t', start)) {
+        out.append(line, start, tab - start);
+        out.append(TAB_WIDTH, ' ');
+        start = tab + 1;
     }
-
-    return result;
+    out.append(line, start, std::string::npos);
 }
 
-int Editor::getRenderX(const std::string &line, const size_t cur_x) const {
-    int rx = 0;
-
-    for (int i = 0; i < cur_x && i < line.size(); ++i) {
-        if (line[i] == '\t') {
-            rx += TAB_WIDTH - (rx % TAB_WIDTH);
-        } else {
-            rx += 1;
-        }
-    }
+size_t Editor::renderColumn(const size_t y, const size_t x) const {
+    if (y >= buffer.size()) return 0;
 
-    return rx;
+    columns.setTabWidth(TAB_WIDTH);
+    return columns.column(y, buffer[y], x);
 }
 
 void Editor::setStatusMessage(const std::string &msg) const {
@@ -653,70 +4071,29 @@ void Editor::normalMode() {
     setCursorShapeNormal();
 }
 
-void Editor::deleteToEol() {
-    if (cur_y >= buffer.size()) return;
-
-    if (std::string& line = buffer[cur_y]; cur_x < line.length()) {
-        line.erase(cur_x);
-    }
-}
-
-void Editor::jumpWord() {
-    if (cur_y >= buffer.size()) return;
-
-    const std::string& line = buffer[cur_y];
-    const size_t len = line.length();
-
-    if (cur_x + 1 >= len) return;
-
-    size_t i = cur_x + 1;
-
-    while (i < len) {
-        if (!std::isalnum(line[i]) || line[i] == ' ') {
-            cur_x = i;
-
-            break;
-        }
-
-        // If we've scanned the whole line and found no jump-to point,
-        // just move to EOL
-        if (i + 1 >= len) {
-            cur_x = len - 1;
-            break;
-        }
-
-        ++i;
-    }
-}
-
 void Editor::jumpToEnd() {
-    if (cur_x >= buffer[cur_y].size()) return;
-
-    buffer[cur_y].resize(buffer[cur_y].size(), ' ');
+    const std::string& line = std::as_const(buffer)[cur_y];
+    if (cur_x >= line.size()) return;
 
-    cur_x = buffer[cur_y].length();
+    cur_x = line.length();
 }
 
 void Editor::trimWhitespace(std::string &line) {
     const auto trimCharacters = " \t";
 
-    if (const size_t firstNonWhitespace = line.find_first_not_of(trimCharacters);
-        firstNonWhitespace != std::string::npos) {
-        line = line.substr(firstNonWhitespace);
-    }
-
-    if (const size_t lastNonWhitespace = line.find_last_not_of(trimCharacters);
-        lastNonWhitespace != std::string::npos) {
-        line = line.substr(lastNonWhitespace + 1, line.length());
+    // Erase in place rather than building substrings
+    line.erase(0, std::min(line.find_first_not_of(trimCharacters), line.size()));
+    if (const size_t last = line.find_last_not_of(trimCharacters); last != std::string::npos) {
+        line.erase(last + 1);
     }
 }
 
-std::string Editor::trimWhitespace(const std::string &line) {
+std::string_view Editor::trimWhitespace(const std::string_view line) {
     const auto trimCharacters = " ";
 
     const size_t first = line.find_first_not_of(trimCharacters);
-    if (first == std::string::npos)
-        return ""; // All spaces
+    if (first == std::string_view::npos)
+        return {}; // All spaces
 
     const size_t last = line.find_last_not_of(trimCharacters);
 
@@ -4,24 +4,75 @@
 
 #pragma once
 #include <string>
+#include <string_view>
 #include <vector>
 #include <chrono>
+#include <iosfwd>
 #include <csignal>
+#include <memory>
+#include <array>
+#include <functional>
+#include <map>
+#include <optional>
+#include "../lib/AllocationCounter.h"
+#include "../lib/BackgroundDiff.h"
+#include "../lib/ColumnIndex.h"
+#include "../lib/Compression.h"
 #include "../lib/Config.h"
+#include "../lib/FileIdentity.h"
+#include "../lib/FileTail.h"
+#include "../lib/FileWatcher.h"
+#include "../lib/FoldTree.h"
+#include "../lib/FrameScheduler.h"
+#include "../lib/IndexCache.h"
+#include "../lib/LineLoader.h"
+#include "../lib/LineStore.h"
+#include "../lib/ProcessFilter.h"
+#include "../lib/SymbolIndex.h"
+#include "../lib/TerminalProbe.h"
+#include "../lib/TreeSearch.h"
+#include "../lib/WindowLayout.h"
+#include "../lib/WordIndex.h"
+#include "../lib/WrapCache.h"
+#include "NormalCommand.h"
+#include "Pager.h"
+#include "UndoHistory.h"
 
-enum Mode { VIEW, EDIT, COMMAND };
+enum Mode { VIEW, EDIT, COMMAND, VISUAL };
 
 class Editor {
 public:
     Editor();
     ~Editor();
 
+    Editor(Editor&&) noexcept = default;
+    Editor& operator=(Editor&&) noexcept = default;
+
     static Editor& getInstance();
 
     void run();
     void stop();
     void loadFile(const std::string& filename);
-    void saveFile(const std::string& filename) const;
+    bool drainLoader();
+    void finishLoading();
+    void openView(const std::string& filename);
+
+    // Diff mode (-d / :diffthis file): the buffer on the left, the other
+    // file read-only on the right, rows aligned and changes highlighted.
+    // The diff is recomputed in the background as the buffer is edited.
+    void startDiff(const std::string& otherFilename);
+    void stopDiff();
+    void finishDiff();
+    void startFollow();
+    void stopFollow();
+    // events come from the file watcher; without them, as on a timer tick,
+    // the path is checked for a replaced file as well
+    bool followUpdate(unsigned events = QEditor::FileWatcher::Replaced);
+    // Soft wrap (:set wrap / :set nowrap); j and k then move by display row
+    void setWrap(bool on);
+    void saveFile(const std::string& filename, bool force = false);
+    void reloadFile();
+    bool checkExternalChange();
     void clearScreen();
     void updateWindowSize();
     void setStatusMessage(const std::string& msg) const;
@@ -37,8 +88,32 @@ public:
     void insertNewline();
     void deleteLine();
     void processCommand();
+    void undo();
+    void redo();
+
+    // Memory held by the editor, by category
+    struct MemoryUsage {
+        QEditor::LineStore::Stats lines;
+        size_t undo = 0;
+        size_t registers = 0;
+        size_t render = 0; // composed and last-sent screen rows, wrap points
+        size_t pager = 0;  // view mode page cache and line index
+        size_t words = 0;  // completion word indexes of every buffer
+        size_t buffers = 0; // lines, undo and caches of the buffers not being edited
+        size_t config = 0;
+        QEditor::AllocationStats heap;
+    };
+
+    [[nodiscard]] MemoryUsage memoryUsage() const;
+    [[nodiscard]] std::vector<std::string> memoryReport() const;
 
-    void drawScreen() const;
+    void drawScreen();
+    void invalidateScreen() const;
+    void scroll();
+
+    // Mark the screen dirty; the run loop paints it when the frame scheduler allows
+    void requestRedraw();
+    [[nodiscard]] bool isRedrawPending() const { return frames.isDirty(); }
 
     bool needsRedrawn = false;
     std::string filename;
@@ -54,18 +129,37 @@ public:
     [[nodiscard]] bool isInEditMode() const { return mode == EDIT; }
     [[nodiscard]] bool isInNormalMode() const { return mode == VIEW; }
     [[nodiscard]] bool isInCommandMode() const { return mode == COMMAND; }
+    [[nodiscard]] bool isInVisualMode() const { return mode == VISUAL; }
+    [[nodiscard]] size_t getCursorCount() const { return extraCursors.size() + 1; }
     [[nodiscard]] Mode getMode() const { return mode; }
-    [[nodiscard]] const std::vector<std::string>& getBuffer() const { return buffer; }
+    [[nodiscard]] const QEditor::LineStore& getBuffer() const { return buffer; }
     [[nodiscard]] size_t getCursorX() const { return cur_x; }
     [[nodiscard]] size_t getCursorY() const { return cur_y; }
+    [[nodiscard]] size_t getRowOffset() const { return rowOffset; }
+    [[nodiscard]] size_t getTopRow() const { return topRow; }
+    [[nodiscard]] size_t getColOffset() const { return colOffset; }
+    [[nodiscard]] bool isWrapping() const { return wrap; }
+    [[nodiscard]] const QEditor::FoldTree& getFolds() const { return folds; }
+    [[nodiscard]] size_t getWindowCount() const { return windowLayout.count(); }
+    [[nodiscard]] size_t getActiveWindow() const { return activeWindow; }
+    [[nodiscard]] size_t getBufferCount() const { return buffers.size(); }
+    [[nodiscard]] size_t getActiveBuffer() const { return activeBuffer; }
     [[nodiscard]] const std::string& getCommandBuffer() const { return commandBuffer; }
     [[nodiscard]] const std::string& getStatusMessage() const { return statusMessage; }
+    [[nodiscard]] const std::vector<std::string>& getInfoLines() const { return infoLines; }
+    [[nodiscard]] const std::vector<QEditor::DiffHunk>& getDiffHunks() const { return diffHunks; }
+    [[nodiscard]] const std::vector<std::string>& getFrameRows() const { return frameRows; }
     [[nodiscard]] const std::string& getFilename() const { return filename; }
     [[nodiscard]] bool isRunning() const { return running; }
     [[nodiscard]] bool isShowLineNumbers() const { return showLineNumbers; }
     [[nodiscard]] int getTabWidth() const { return TAB_WIDTH; }
     [[nodiscard]] size_t getScreenRows() const { return screenRows; }
     [[nodiscard]] size_t getScreenCols() const { return screenCols; }
+    [[nodiscard]] bool isViewOnly() const { return pager != nullptr; }
+    [[nodiscard]] bool isFollowing() const { return following; }
+    [[nodiscard]] bool isLoading() const { return loader != nullptr; }
+    [[nodiscard]] QEditor::Compression getCompression() const { return compression; }
+    [[nodiscard]] Pager* getPager() const { return pager.get(); }
 
     // Test-only methods - always available
     void setCursorPosition(size_t x, size_t y) {
@@ -74,6 +168,7 @@ public:
     }
     void clearBuffer() {
         buffer.clear();
+        words.reset();
         cur_x = 0;
         cur_y = 0;
     }
@@ -86,21 +181,247 @@ public:
     void setMockTerminalSize(size_t rows, size_t cols) {
         screenRows = rows;
         screenCols = cols;
+        layoutWindows();
+    }
+    void setBackgroundCacheSize(size_t bytes) {
+        backgroundCacheBytes = bytes;
+    }
+    // Add a cursor as is, like one left behind past the end of a line
+    void addStaleCursor(size_t x, size_t y) {
+        size_t primary;
+        std::vector<Cursor> all = allCursors(primary);
+        all.push_back({x, y});
+        setCursors(std::move(all), primary);
+    }
+    // Rewrite a range the way :sort and :g do
+    void rewriteRange(size_t first, size_t count, const std::function<void(std::vector<std::string>&)>& rewrite) {
+        rewriteLines(first, count, rewrite);
+    }
+    // Let a :grep finish and take its matches, as the main loop would
+    void waitForGrep() {
+        if (search) {
+            search->wait();
+            takeSearchResults();
+        }
     }
 #endif
 
 private:
-    [[nodiscard]] std::string expandTabs(const std::string& line) const;
-    [[nodiscard]] int getRenderX(const std::string& line, size_t cur_x) const;
+    // Append line to out with tabs expanded, without a temporary string
+    void appendExpanded(std::string& out, std::string_view line) const;
+    // Screen column of byte x of line y, through the column index on long lines
+    [[nodiscard]] size_t renderColumn(size_t y, size_t x) const;
 
-    void jumpWord();
     void jumpToEnd();
     void jumpBack();
 
-    void deleteToEol();
+    // A motion's target; linewise motions (j, k, G, gg, dd) cover whole lines
+    struct Motion {
+        size_t x = 0, y = 0;
+        bool linewise = false;
+    };
+
+    void runNormal(const NormalCommand& cmd);
+    void moveTo(const NormalCommand& cmd);
+    [[nodiscard]] Motion resolveMotion(const NormalCommand& cmd) const;
+    bool nextWordStart(size_t& x, size_t& y) const;
+    void applyOperator(const NormalCommand& cmd);
+
+    // Charwise text between two positions, the end excluded
+    [[nodiscard]] std::vector<std::string> copyText(const Motion& from, const Motion& to) const;
+    void eraseText(const Motion& from, const Motion& to);
+    void putRegister(bool after, size_t count, char name);
+
+    // Multiple cursors. Edits for one keystroke are applied to all of them
+    // in a single pass over the lines in position order, with the later
+    // cursors on a line shifted by what was inserted or removed before them.
+    using Cursor = UndoHistory::Cursor;
+    [[nodiscard]] std::vector<Cursor> allCursors(size_t& primary) const;
+    void setCursors(std::vector<Cursor> all, size_t primary);
+    void addCursorAtNextMatch();
+    void addCursorsOnMatches(std::string text);
+    void addCursorsOnLines(size_t first, size_t last);
+    void insertAtCursors(std::string_view text);
+    void deleteAtCursors();
+    void splitAtCursors();
+    // Marks cursors on bytes [begin, end) of the line, the part shown on the row
+    void highlightCursors(std::string& row, size_t textStart, size_t y, const std::string& line,
+                          size_t begin = 0, size_t end = std::string::npos) const;
+
+    // Visual mode: the selection runs from (visualX, visualY) to the cursor
+    void startVisual(char kind);
+    void processVisualKey(char c);
+    void applyVisual(char op, char name);
+    void shiftLines(size_t first, size_t last, bool right);
+    // Bytes [first, second) of line y that the selection covers
+    [[nodiscard]] std::pair<size_t, size_t> selectionOn(size_t y, const std::string& line) const;
+
+    void appendText(const std::string& text);
+    void watchFile(const std::string& filename);
+    void loadCompressed(const std::string& filename);
+    void saveCompressed(const std::string& filename, QEditor::Compression target);
+    static std::vector<std::string> readFileLines(const std::string& filename);
+    static std::vector<std::string> readLines(std::istream& in);
+
+    // Wrap every buffer edit so it is recorded for undo
+    void beginChange(size_t at, size_t count);
+    void endChange(size_t newCount);
+    void removeLines(size_t at, size_t count);
+    // Keep the wrap, column and fold caches in step with the lines they describe
+    void layoutChanged(size_t at, size_t count, size_t newCount);
+    void clearLayout();
+    void ensureLine(size_t y);
+    void clampCursor();
+    void enterCommandMode(const std::string& text);
+    void leaveCommandMode();
+
+    // Ex-style line commands (:sort, :uniq, :g, :v) on an optional range.
+    // Returns false when the command is not one of them.
+    bool runLineCommand(std::string_view command);
+    [[nodiscard]] std::pair<size_t, size_t> parseRange(std::string_view& command) const;
+    [[nodiscard]] size_t parseAddress(std::string_view& command) const;
+    void runFilterCommand(size_t first, size_t last, std::string_view args, bool keep);
+    // Replace lines [first, first + count) with what rewrite makes of them,
+    // as a single undo record
+    void rewriteLines(size_t first, size_t count, const std::function<void(std::vector<std::string>&)>& rewrite);
+    void replaceLines(size_t first, size_t count, std::vector<std::string>&& lines);
+
+    // :[range]!cmd pipes the range through cmd, :!cmd just shows its output.
+    // The editor polls the keyboard while the command runs, so Esc kills it.
+    void filterThroughCommand(size_t first, size_t last, const std::string& command);
+    void runShellCommand(const std::string& command);
+    [[nodiscard]] std::function<bool()> shellProgress(const std::string& command, const std::vector<std::string>& output);
+    static void checkShellResult(const QEditor::ProcessFilter::Result& result);
+
+    void processPagerKey(char c);
+    void drawPagerScreen() const;
+    void flushRows() const;
+    // Diff mode layout. Display rows pair a buffer line with a line of the
+    // other file; either side may be a filler row.
+    struct DiffRow {
+        std::optional<size_t> left, right;
+        bool changed = false; // inside a hunk
+    };
+    void refreshDiff();
+    void takeDiff();
+    [[nodiscard]] size_t diffRowOf(size_t line) const;
+    [[nodiscard]] DiffRow diffRowAt(size_t row) const;
+    void composeDiffRows(std::vector<std::string>& out, size_t lineNumWidth) const;
+    void appendDiffPane(std::string& row, const QEditor::LineStore& lines, std::optional<size_t> line,
+                        const char* color, size_t width, size_t lineNumWidth) const;
+
+    // Soft wrap layout. Display rows of a line come from the wrap cache
+    // at the width left beside the line numbers.
+    [[nodiscard]] size_t lineNumberWidth() const;
+    [[nodiscard]] const std::vector<QEditor::WrapRow>& wrapRows(size_t y) const;
+    void scrollWrapped(size_t rows);
+    void composeWrappedRows(std::vector<std::string>& out, size_t lineNumWidth, bool active) const;
+    // Where j/k lands moving count display rows rather than lines
+    [[nodiscard]] Motion moveByRows(size_t count, bool down) const;
+
+    // Windows. Each has its own cursor and scroll position over a buffer;
+    // windows on the same buffer share its lines and the wrap, column and
+    // fold caches. The active window's view is the live cursor and scroll
+    // state; the others are parked in views and swapped in while they are drawn.
+    struct View {
+        size_t x = 0, y = 0;
+        size_t rowOffset = 0, topRow = 0, colOffset = 0;
+        size_t buffer = 0;
+    };
+    [[nodiscard]] View currentView() const { return {cur_x, cur_y, rowOffset, topRow, colOffset, activeBuffer}; }
+    void loadView(const View& view);
+    // Make a window's view live, switching to its buffer first if need be
+    void enterView(const View& view);
+    void splitWindow(bool vertical);
+    void closeWindow();
+    void onlyWindow();
+    void focusWindow(size_t window);
+    void runWindowCommand(char c);
+    // Window areas for the current screen size; arrangeWindows() returns
+    // false when a window has no room left
+    void layoutWindows();
+    bool arrangeWindows();
+    [[nodiscard]] const QEditor::WindowRect& activeRect() const;
+    // Other windows keep looking at the same lines when lines above them change
+    void shiftViews(size_t at, size_t count, size_t newCount);
+    // One frame from every window's rows, status rows and dividers
+    void composeWindows();
+    // Rows of the active view into out, one per element
+    void composeView(std::vector<std::string>& out, bool active) const;
+    void composeRows(std::vector<std::string>& out, size_t lineNumWidth, bool active) const;
+
+    // Buffers. Everything that belongs to one file lives in the editor's
+    // members while the file is being edited, and is parked in a
+    // BufferState while it isn't, so switching moves a few pointers.
+    struct BufferState {
+        std::string filename;
+        QEditor::LineStore lines;
+        UndoHistory undo;
+        QEditor::Compression compression;
+        std::unique_ptr<QEditor::LineLoader> loader;
+        QEditor::FileIdentity diskIdentity;
+        bool identityKnown = false;
+        bool changeWarned = false;
+        size_t visualFirst = 0, visualLast = 0;
+
+        bool following = false;
+        bool tailTerminated = false;
+        std::unique_ptr<QEditor::FileTail> tail;
+        std::string followChunk;
+
+        std::unique_ptr<QEditor::BackgroundDiff> differ;
+        QEditor::LineStore diffOther;
+        QEditor::LineSlice diffOtherText;
+        std::string diffOtherName;
+        std::vector<QEditor::DiffHunk> diffHunks;
+        std::vector<size_t> diffExtraBefore;
+        uint64_t diffRevision = 0;
+
+        bool folding = false;
+        bool foldsStale = false;
+        QEditor::FoldTree folds;
+        QEditor::WrapCache wraps;
+        QEditor::ColumnIndex columns;
+        std::unique_ptr<QEditor::WordIndex> words;
+
+        View view;           // where the cursor was when the buffer was left
+        uint64_t lastUsed = 0;
+    };
+    // Open a file in a buffer of its own, or go to the buffer it is already in
+    void editFile(const std::string& name);
+    // Go to the next (or previous) buffer in the list
+    void cycleBuffer(bool forward);
+    // Make a buffer the one edited in the active window
+    void switchBuffer(size_t index);
+    // Swap a buffer into the editor's members, parking the one there now
+    void enterBuffer(size_t index);
+    void exchangeBuffer(BufferState& other);
+    // Hand back the caches of buffers that aren't on screen, least recently
+    // used first, until they fit background_cache_size
+    void releaseBuffers();
+    [[nodiscard]] const std::string& bufferName(size_t index) const;
+
+    // Code folding. Folds are worked out on the first z command and only
+    // shown without wrap or diff; shownFolds() is null when they aren't
+    void runFold(const NormalCommand& cmd);
+    [[nodiscard]] const QEditor::FoldTree* shownFolds() const;
+    // The line count lines below or above y on screen, closed folds counting as one
+    [[nodiscard]] size_t lineBelow(size_t y, size_t count = 1) const;
+    [[nodiscard]] size_t lineAbove(size_t y, size_t count = 1) const;
+
+    // Reverse video over the selected part of a composed row, which shows
+    // bytes [begin, end) of the line
+    void highlightSelection(std::string& row, size_t textStart, size_t y, const std::string& line,
+                            size_t begin = 0, size_t end = std::string::npos) const;
+    // Rows [top, end of the text area) moved up by shift, or down when it is negative
+    struct ScrollShift {
+        size_t top = 0;
+        long shift = 0;
+    };
+    [[nodiscard]] ScrollShift findScrollShift() const;
 
     static void trimWhitespace(std::string& line);
-    static std::string trimWhitespace(const std::string &line);
+    static std::string_view trimWhitespace(std::string_view line);
 
     // Default is View Mode
     Mode mode = VIEW;
@@ -115,12 +436,179 @@ private:
 #endif
 
     std::string commandBuffer;
-    std::vector<std::string> buffer;
+    NormalParser normalKeys;
+
+    // Deleted or yanked text, put back with p/P. Linewise registers share
+    // their blocks with the buffer, so yanking and putting a huge range
+    // costs a pointer per block rather than a copy of the text.
+    struct Register {
+        enum class Kind { Charwise, Linewise, Blockwise };
+
+        QEditor::LineSlice text;
+        Kind kind = Kind::Charwise;
+    };
+
+    // "" gets every delete and yank, "0 the last yank, "a-"z only when named;
+    // "+ is also sent to the terminal's clipboard with OSC 52
+    void storeRegister(char name, bool yank, Register reg);
+    [[nodiscard]] const Register& readRegister(char name) const;
+    void copyToClipboard(const Register& reg) const;
+    void putBlock(const std::vector<std::string>& text, bool after, size_t count);
+
+    Register unnamed;
+    Register yanked;
+    Register clipboard;
+    std::array<Register, 26> named;
+
+    // Cursors besides (cur_x, cur_y), sorted by position
+    std::vector<Cursor> extraCursors;
+    std::string cursorWord; // what Ctrl-N looks for
+    Cursor lastCursor;      // where Ctrl-N added the last cursor
+
+    char visualKind = 'v'; // 'v', 'V' or Ctrl-V
+    size_t visualX = 0, visualY = 0;
+    QEditor::LineStore buffer;
 
     mutable std::string statusMessage;
     mutable std::chrono::time_point<std::chrono::steady_clock> statusMessageTime;
 
+    // Multi-line output (:mem) shown above the status line until the next key
+    std::vector<std::string> infoLines;
+
     std::vector<std::string> history;
 
+    // Read-only pager for --view, replaces the buffer when set
+    std::unique_ptr<Pager> pager;
+    std::optional<QEditor::IndexCache> indexCache; // line indexes kept between views
+    mutable std::vector<std::string> pagerLines;
+    std::string lastSearch;
+    bool lastSearchForward = true;
+
+    // Follow mode (:follow / -f), appends bytes written to the file
+    bool following = false;
+    bool tailTerminated = false; // whether the last buffer line ended with a newline
+    std::unique_ptr<QEditor::FileWatcher> watcher;
+    std::unique_ptr<QEditor::FileTail> tail;
+    std::string followChunk;
+
+    // Diff mode
+    std::unique_ptr<QEditor::BackgroundDiff> differ;
+    QEditor::LineStore diffOther;
+    QEditor::LineSlice diffOtherText;
+    std::string diffOtherName;
+    std::vector<QEditor::DiffHunk> diffHunks;
+    std::vector<size_t> diffExtraBefore; // filler rows the left side gains before each hunk
+    uint64_t diffRevision = 0;           // buffer revision the last request was made from
+    mutable std::string diffScratch;
+
+    // Compressed files are inflated in the background and re-compressed on save
+    std::unique_ptr<QEditor::LineLoader> loader;
+    QEditor::Compression compression;
+
+    // State of the file on disk when last read or written
+    QEditor::FileIdentity diskIdentity;
+    bool identityKnown = false;
+    bool changeWarned = false;
+
+    UndoHistory undoHistory;
+    size_t commandReturnX = 0;
+    size_t visualFirst = 0, visualLast = 0; // '< and '>, the lines of the last selection
+
     size_t cur_x = 0, cur_y = cur_x;
+
+    // First buffer line shown at the top of the screen
+    size_t rowOffset = 0;
+
+    // Soft wrap: long lines continue on the rows below, and topRow is the
+    // first display row of rowOffset on screen
+    bool wrap = false;
+    size_t topRow = 0;
+    mutable QEditor::WrapCache wraps;
+
+    // Without wrap, the first screen column shown; long lines are drawn
+    // from there through the column index rather than from their start
+    size_t colOffset = 0;
+    mutable QEditor::ColumnIndex columns;
+
+    // Folds from indentation, or from braces in C-like files. Edits update
+    // them in place; undo, redo and reloads rescan them when next shown
+    bool folding = false;
+    mutable bool foldsStale = false;
+    mutable QEditor::FoldTree folds;
+
+    // Open files, the one being edited (activeBuffer) left empty in place
+    std::vector<BufferState> buffers = std::vector<BufferState>(1);
+    size_t activeBuffer = 0;
+    uint64_t bufferClock = 0;
+    size_t backgroundCacheBytes = 32 * 1024 * 1024;
+
+    // Insert mode completion (Ctrl-N / Ctrl-P) from the words of every
+    // buffer. Each buffer's index is built in the background the first time
+    // it is asked for and kept in step with edits after that.
+    void completeWord(bool forward);
+    void gatherCompletions(const std::string& prefix, std::vector<std::string>& out, bool& indexing);
+    // Count lines [at, at + count) in or out of the word index
+    void indexWords(size_t at, size_t count, bool add);
+
+    std::unique_ptr<QEditor::WordIndex> words;
+
+    // The word being completed starts at x on line y and ends at end; shown
+    // is the match in the buffer, matches.size() standing for the typed prefix
+    struct Completion {
+        bool active = false;
+        size_t x = 0, y = 0, end = 0;
+        std::string prefix;
+        std::vector<std::string> matches;
+        size_t shown = 0;
+    };
+    Completion completion;
+
+    // Jump to definition (Ctrl-], :tag) through the symbols of the working
+    // directory, indexed in the background the first time. Ctrl-T goes back
+    // to where each jump started.
+    void jumpToTag(const std::string& name);
+    void popTag();
+    // Put the cursor on line (from 1) of file, opening it if it isn't the one being edited
+    void openLocation(const std::string& file, size_t line);
+    [[nodiscard]] bool isEditing(const std::string& file) const;
+
+    std::unique_ptr<QEditor::SymbolIndex> symbols;
+    struct TagOrigin {
+        size_t buffer;
+        size_t x, y;
+    };
+    std::vector<TagOrigin> tagStack;
+
+    // Project search (:grep pattern [dir]). Matches stream into the
+    // quickfix list as files are searched, and :cn / :cp step through it
+    // while the search goes on.
+    void startSearch(const std::string& args);
+    void takeSearchResults();
+    void stepQuickfix(bool forward);
+
+    std::unique_ptr<QEditor::TreeSearch> search;
+    std::string searchPattern;
+    std::vector<QEditor::SearchMatch> quickfix;
+    std::optional<size_t> quickfixAt; // entry last gone to
+
+    QEditor::WindowLayout windowLayout;
+    size_t activeWindow = QEditor::WindowLayout::FIRST;
+    std::map<size_t, View> views; // windows other than the active one
+    std::vector<QEditor::WindowRect> windowRects;
+    std::vector<QEditor::Divider> dividers;
+    size_t arrangedRows = 0, arrangedCols = 0; // screen size windowRects were made for
+    // Text area of the window being edited or drawn
+    size_t viewRows = 23, viewCols = 80;
+    std::vector<std::vector<std::string>> paneRows; // each window's rows while a frame is composed
+    size_t changeAt = 0, changeCount = 0; // lines of the edit in progress
+
+    QEditor::FrameScheduler frames;
+
+    QEditor::TerminalCaps terminal;
+
+    // Rows as last sent to the terminal, used to skip unchanged rows
+    mutable std::vector<std::string> frameRows;
+    mutable std::vector<std::string> shadowRows;
+    mutable std::vector<char> shadowKnown;
+    mutable bool shadowValid = false;
 };
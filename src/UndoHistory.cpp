@@ -0,0 +1,138 @@
+#include "UndoHistory.h"
+#include <algorithm>
+#include <iterator>
+
+UndoHistory::Record* UndoHistory::prepare(const Lines& lines, const size_t at, const size_t count, const Cursor cursor) {
+    redoSteps.clear();
+
+    if (!open) {
+        steps.emplace_back();
+        steps.back().before = cursor;
+        open = true;
+    }
+
+    auto& records = steps.back().records;
+    if (!records.empty() && !records.back().sealed) {
+        Record& last = records.back();
+        if (at >= last.at && at + count <= last.at + last.afterCount) {
+            return &last;
+        }
+
+        seal(lines, last);
+    }
+
+    return nullptr;
+}
+
+void UndoHistory::change(const Lines& lines, const size_t at, const size_t count, const Cursor cursor) {
+    pendingCount = count;
+    if (prepare(lines, at, count, cursor)) return;
+
+    Record record;
+    record.at = at;
+    record.afterCount = count;
+    record.before = lines.slice(at, count);
+
+    steps.back().records.push_back(std::move(record));
+}
+
+void UndoHistory::removeLines(Lines& lines, const size_t at, const size_t count, const Cursor cursor) {
+    const auto first = lines.begin() + static_cast<Lines::difference_type>(at);
+    const auto last = first + static_cast<Lines::difference_type>(count);
+
+    if (Record* record = prepare(lines, at, count, cursor)) {
+        record->afterCount -= count;
+        lines.erase(first, last);
+        return;
+    }
+
+    Record removed;
+    removed.at = at;
+    removed.before = lines.cut(at, count);
+    steps.back().records.push_back(std::move(removed));
+}
+
+void UndoHistory::changed(const size_t newCount) {
+    Record& record = steps.back().records.back();
+    record.afterCount = record.afterCount + newCount - pendingCount;
+}
+
+void UndoHistory::commit(const Lines& lines, const Cursor cursor) {
+    if (!open) return;
+    open = false;
+
+    Step& step = steps.back();
+    if (step.records.empty()) {
+        steps.pop_back();
+        return;
+    }
+
+    if (!step.records.back().sealed) {
+        seal(lines, step.records.back());
+    }
+    step.after = cursor;
+}
+
+void UndoHistory::seal(const Lines& lines, Record& record) {
+    record.after = lines.slice(record.at, record.afterCount);
+    record.sealed = true;
+}
+
+void UndoHistory::replace(Lines& lines, const size_t at, const size_t count, const Snapshot& with,
+                          const Observer& observer) {
+    if (observer) observer(at, count, false);
+    const auto first = lines.begin() + static_cast<Lines::difference_type>(at);
+    lines.erase(first, first + static_cast<Lines::difference_type>(count));
+    lines.splice(at, with);
+    if (observer) observer(at, with.size(), true);
+}
+
+bool UndoHistory::undo(Lines& lines, Cursor& cursor, const Observer& observer) {
+    commit(lines, cursor);
+    if (steps.empty()) return false;
+
+    Step step = std::move(steps.back());
+    steps.pop_back();
+
+    for (auto it = step.records.rbegin(); it != step.records.rend(); ++it) {
+        replace(lines, it->at, it->after.size(), it->before, observer);
+    }
+    cursor = step.before;
+
+    redoSteps.push_back(std::move(step));
+    return true;
+}
+
+bool UndoHistory::redo(Lines& lines, Cursor& cursor, const Observer& observer) {
+    commit(lines, cursor);
+    if (redoSteps.empty()) return false;
+
+    Step step = std::move(redoSteps.back());
+    redoSteps.pop_back();
+
+    for (const Record& record : step.records) {
+        replace(lines, record.at, record.before.size(), record.after, observer);
+    }
+    cursor = step.after;
+
+    steps.push_back(std::move(step));
+    return true;
+}
+
+size_t UndoHistory::memoryUsage() const {
+    size_t total = 0;
+
+    auto add = [&total](const std::vector<Step>& list) {
+        total += list.capacity() * sizeof(Step);
+        for (const Step& step : list) {
+            total += step.records.capacity() * sizeof(Record);
+            for (const Record& record : step.records) {
+                total += record.before.memoryUsage() + record.after.memoryUsage();
+            }
+        }
+    };
+
+    add(steps);
+    add(redoSteps);
+    return total;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+#include "../lib/LineStore.h"
+
+// Undo/redo as a list of steps, each step a sequence of line-range
+// replacements. Consecutive edits that stay inside the lines touched by the
+// previous record are folded into it, so typing a line of text costs one
+// snapshot of that line rather than one record per keystroke. Snapshots
+// are LineSlices, so large ranges share their packed blocks with the buffer.
+class UndoHistory {
+public:
+    using Lines = QEditor::LineStore;
+    using Snapshot = QEditor::LineSlice;
+
+    struct Cursor {
+        size_t x = 0, y = 0;
+    };
+
+    // Lines [at, at + count) of `lines` are about to be replaced
+    void change(const Lines& lines, size_t at, size_t count, Cursor cursor);
+
+    // Erase lines [at, at + count), moving them into the record rather
+    // than copying them, whole blocks at a time
+    void removeLines(Lines& lines, size_t at, size_t count, Cursor cursor);
+
+    // The replaced range now spans newCount lines
+    void changed(size_t newCount);
+
+    // Close the open step, so the next change starts a new undo step
+    void commit(const Lines& lines, Cursor cursor);
+
+    // Told about each line range an undo or redo replaces: (at, count, false)
+    // while the old lines are still in place, then (at, newCount, true)
+    using Observer = std::function<void(size_t at, size_t count, bool replaced)>;
+
+    // Revert/reapply one step. Returns false when there is nothing to do.
+    bool undo(Lines& lines, Cursor& cursor, const Observer& observer = nullptr);
+    bool redo(Lines& lines, Cursor& cursor, const Observer& observer = nullptr);
+
+    [[nodiscard]] size_t undoDepth() const { return steps.size(); }
+    [[nodiscard]] size_t redoDepth() const { return redoSteps.size(); }
+    [[nodiscard]] size_t memoryUsage() const;
+
+private:
+    struct Record {
+        size_t at = 0;
+        Snapshot before;
+        Snapshot after;
+        size_t afterCount = 0; // size of the replacement while the record is still open
+        bool sealed = false;
+    };
+
+    struct Step {
+        std::vector<Record> records;
+        Cursor before, after;
+    };
+
+    // Open a step if needed and return the record the edit at [at, at + count)
+    // folds into, or nullptr when a new record has to be started
+    Record* prepare(const Lines& lines, size_t at, size_t count, Cursor cursor);
+    static void seal(const Lines& lines, Record& record);
+    static void replace(Lines& lines, size_t at, size_t count, const Snapshot& with, const Observer& observer);
+
+    std::vector<Step> steps;
+    std::vector<Step> redoSteps;
+    bool open = false;
+    size_t pendingCount = 0; // lines being replaced by the edit in progress
+};
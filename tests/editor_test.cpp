@@ -1,7 +1,30 @@
 #define CATCH_CONFIG_MAIN
+#ifndef TESTING
 #define TESTING  // Define TESTING before including QEditor.h
+#endif
 #include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+#include <fstream>
+#include <poll.h>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
 #include "../src/QEditor.h"
+#include "../lib/EditorError.h"
+#include "../lib/ColumnIndex.h"
+#include "../lib/FoldTree.h"
+#include "../lib/LineStore.h"
+#include "../lib/FrameScheduler.h"
+#include "../lib/IndexCache.h"
+#include "../lib/LineIndex.h"
+#include "../lib/LineDiff.h"
+#include "../lib/LineSort.h"
+#include "../lib/SymbolIndex.h"
+#include "../lib/TerminalProbe.h"
+#include "../lib/TreeSearch.h"
+#include "../lib/ThreadPool.h"
+#include "../lib/WordIndex.h"
 
 // Helper function to create a test-ready editor
 Editor createTestEditor() {
@@ -11,6 +34,35 @@ Editor createTestEditor() {
     return editor;
 }
 
+// Helper to write a numbered test file and return its path
+std::string writeNumberedFile(const std::string& name, size_t lines) {
+    const auto path = std::filesystem::temp_directory_path() / name;
+    std::ofstream out(path);
+    for (size_t i = 1; i <= lines; ++i) {
+        out << "line " << i << "\n";
+    }
+    return path.string();
+}
+
+// Helper to run keys through processKeypress as if they had been typed
+void typeKeys(Editor& editor, const std::string& keys) {
+    int fds[2];
+    REQUIRE(pipe(fds) == 0);
+    const int savedStdin = dup(STDIN_FILENO);
+    dup2(fds[0], STDIN_FILENO);
+    REQUIRE(write(fds[1], keys.data(), keys.size()) == static_cast<ssize_t>(keys.size()));
+
+    pollfd in{STDIN_FILENO, POLLIN, 0};
+    while (poll(&in, 1, 0) > 0 && (in.revents & POLLIN)) {
+        editor.processKeypress();
+    }
+
+    dup2(savedStdin, STDIN_FILENO);
+    close(savedStdin);
+    close(fds[0]);
+    close(fds[1]);
+}
+
 TEST_CASE("Basic editor initialization", "[editor]") {
     Editor editor = createTestEditor();
     REQUIRE(editor.isInNormalMode());
@@ -131,4 +183,1836 @@ TEST_CASE("Editor cursor navigation", "[editor]") {
         REQUIRE(editor.getCursorX() == 1);  // Should maintain x position
         REQUIRE(editor.getCursorY() == 2);
     }
-} 
\ No newline at end of file
+}
+
+TEST_CASE("Pager navigation", "[editor][pager]") {
+    const std::string path = writeNumberedFile("qedit_pager_test.txt", 5000);
+    Pager pager(path);
+    std::vector<std::string> rows;
+
+    SECTION("Jump to a line before and after indexing") {
+        pager.gotoLine(3999);
+        pager.visibleLines(2, rows, 80);
+        REQUIRE(rows.size() == 2);
+        REQUIRE(rows[0] == "line 4000");
+        REQUIRE(rows[1] == "line 4001");
+        REQUIRE(pager.topLineNumber() == 3999);
+    }
+
+    SECTION("Jump to end shows the last lines") {
+        pager.gotoEnd(3);
+        pager.visibleLines(3, rows, 80);
+        REQUIRE(rows.size() == 3);
+        REQUIRE(rows[2] == "line 5000");
+    }
+
+    SECTION("Scrolling and search") {
+        pager.scrollDown(10);
+        pager.visibleLines(1, rows, 80);
+        REQUIRE(rows[0] == "line 11");
+
+        REQUIRE(pager.search("line 2500", true));
+        pager.visibleLines(1, rows, 80);
+        REQUIRE(rows[0] == "line 2500");
+
+        REQUIRE(pager.search("line 12", false));
+        pager.visibleLines(1, rows, 80);
+        REQUIRE(rows[0] == "line 1299");
+
+        REQUIRE_FALSE(pager.search("missing", true));
+    }
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Read-only view mode", "[editor][pager]") {
+    const std::string path = writeNumberedFile("qedit_view_test.txt", 10);
+    Editor editor = createTestEditor();
+
+    editor.openView(path);
+    REQUIRE(editor.isViewOnly());
+    REQUIRE(editor.getBuffer().empty());
+    REQUIRE(editor.getFilename() == path);
+
+    std::vector<std::string> lines;
+    auto top = [&editor, &lines] {
+        editor.getPager()->visibleLines(1, lines, 80);
+        return lines.front();
+    };
+
+    // A lone Esc is dropped at once, an arrow key scrolls
+    typeKeys(editor, "\x1b");
+    typeKeys(editor, "\x1b[B");
+    REQUIRE(top() == "line 2");
+
+    typeKeys(editor, ":5\n");
+    REQUIRE(top() == "line 5");
+    typeKeys(editor, ":99999999999999999999999\n");
+    REQUIRE(editor.getStatusMessage() == "Command error: Invalid line number: 99999999999999999999999");
+    REQUIRE(top() == "line 5");
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Follow mode appends new bytes", "[editor][follow]") {
+    const auto path = (std::filesystem::temp_directory_path() / "qedit_follow_test.txt").string();
+    { std::ofstream out(path); out << "first\nsecond\npart"; }
+
+    Editor editor = createTestEditor();
+    editor.loadFile(path);
+    editor.startFollow();
+    REQUIRE(editor.isFollowing());
+    REQUIRE(editor.getCursorY() == 2);
+
+    SECTION("Appended bytes continue the partial line and add new ones") {
+        { std::ofstream out(path, std::ios::app); out << "ial\nthird\n"; }
+        REQUIRE(editor.followUpdate());
+
+        const auto& buffer = editor.getBuffer();
+        REQUIRE(buffer.size() == 4);
+        REQUIRE(buffer[2] == "partial");
+        REQUIRE(buffer[3] == "third");
+        REQUIRE(editor.getCursorY() == 3);
+        REQUIRE_FALSE(editor.followUpdate());
+    }
+
+    SECTION("Undo can't take back appended text") {
+        typeKeys(editor, "A!\x1b");
+        REQUIRE(editor.getBuffer()[2] == "part!");
+
+        { std::ofstream out(path, std::ios::app); out << "ial\n"; }
+        REQUIRE(editor.followUpdate());
+        typeKeys(editor, "u");
+        REQUIRE(editor.getBuffer()[2] == "part!ial");
+    }
+
+    SECTION("Truncation reloads the file") {
+        { std::ofstream out(path, std::ios::trunc); out << "new\n"; }
+        REQUIRE(editor.followUpdate());
+        REQUIRE(editor.getBuffer().size() == 1);
+        REQUIRE(editor.getBuffer()[0] == "new");
+    }
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Follow mode in the pager reopens a rotated file", "[editor][follow][pager]") {
+    const std::string path = writeNumberedFile("qedit_follow_view_test.txt", 100);
+    const std::string rotated = path + ".1";
+
+    Editor editor = createTestEditor();
+    editor.setMockTerminalSize(5, 80);
+    editor.openView(path);
+    editor.startFollow();
+    editor.followUpdate();
+
+    // Moved aside and a new file started in its place
+    std::filesystem::rename(path, rotated);
+    { std::ofstream out(path); out << "fresh 1\nfresh 2\n"; }
+
+    REQUIRE(editor.followUpdate());
+    REQUIRE(editor.getStatusMessage() == "File replaced: " + path);
+
+    std::vector<std::string> lines;
+    editor.getPager()->visibleLines(4, lines, 80);
+    REQUIRE(lines == std::vector<std::string>{"fresh 1", "fresh 2"});
+
+    // Appends to the new file are picked up from then on
+    { std::ofstream out(path, std::ios::app); out << "fresh 3\n"; }
+    REQUIRE(editor.followUpdate());
+    editor.getPager()->visibleLines(4, lines, 80);
+    REQUIRE(lines.back() == "fresh 3");
+
+    std::filesystem::remove(path);
+    std::filesystem::remove(rotated);
+}
+
+TEST_CASE("Undo and redo", "[editor][undo]") {
+    Editor editor = createTestEditor();
+
+    editor.editMode();
+    editor.insertText('a'); editor.insertText('b');
+    editor.insertNewline();
+    editor.insertText('c');
+    editor.normalMode();
+    editor.undo();
+
+    SECTION("An insert session is undone as one step") {
+        REQUIRE(editor.getBuffer().empty());
+        REQUIRE(editor.getCursorX() == 0);
+        REQUIRE(editor.getCursorY() == 0);
+    }
+
+    SECTION("Redo restores the text and cursor") {
+        editor.redo();
+        REQUIRE(editor.getBuffer() == std::vector<std::string>{"ab", "c"});
+        REQUIRE(editor.getCursorY() == 1);
+    }
+
+    SECTION("Deleting a line is undoable") {
+        editor.redo();
+        editor.setCursorPosition(0, 0);
+        editor.deleteLine();
+        REQUIRE(editor.getBuffer() == std::vector<std::string>{"c"});
+        editor.undo();
+        REQUIRE(editor.getBuffer() == std::vector<std::string>{"ab", "c"});
+    }
+}
+
+TEST_CASE("External change detection and reload", "[editor][reload]") {
+    const std::string path = writeNumberedFile("qedit_reload_test.txt", 100);
+    Editor editor = createTestEditor();
+    editor.loadFile(path);
+    editor.setCursorPosition(0, 50);
+
+    // Another process rewrites two lines and appends one
+    {
+        std::ofstream out(path);
+        for (size_t i = 1; i <= 100; ++i) {
+            out << (i == 10 || i == 80 ? "changed " : "line ") << i << "\n";
+        }
+        out << "extra\n";
+    }
+
+    SECTION("Saving over the other change is refused unless forced") {
+        REQUIRE(editor.checkExternalChange());
+        REQUIRE_THROWS_AS(editor.saveFile(path), QEditor::FileConflictError);
+        REQUIRE_NOTHROW(editor.saveFile(path, true));
+        REQUIRE_NOTHROW(editor.saveFile(path));
+    }
+
+    SECTION("Reload applies only the changed hunks as one undo step") {
+        editor.reloadFile();
+        const auto& buffer = editor.getBuffer();
+        REQUIRE(buffer.size() == 101);
+        REQUIRE(buffer[9] == "changed 10");
+        REQUIRE(buffer[79] == "changed 80");
+        REQUIRE(buffer[100] == "extra");
+        REQUIRE(editor.getCursorY() == 50);
+        REQUIRE(editor.getStatusMessage().find("3 changed hunk") != std::string::npos);
+
+        editor.undo();
+        REQUIRE(editor.getBuffer().size() == 100);
+        REQUIRE(editor.getBuffer()[9] == "line 10");
+    }
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Compressed files round trip", "[editor][compression]") {
+    // Built without zlib
+    if (!QEditor::codecAvailable(QEditor::Codec::Gzip)) return;
+
+    const auto path = (std::filesystem::temp_directory_path() / "qedit_compressed_test.gz").string();
+    std::filesystem::remove(path);
+
+    // A new .gz file is written compressed
+    {
+        Editor editor = createTestEditor();
+        editor.loadFile(path);
+        editor.clearBuffer();
+        editor.editMode();
+        for (size_t i = 0; i < 5000; ++i) {
+            for (const char c : "row " + std::to_string(i)) {
+                editor.insertText(c);
+            }
+            editor.insertNewline();
+        }
+        editor.saveFile(path);
+    }
+    REQUIRE(QEditor::detectCompression(path).codec == QEditor::Codec::Gzip);
+    REQUIRE(std::filesystem::file_size(path) < 5000 * 8);
+
+    // Detection goes by content, not by name
+    const auto renamed = (std::filesystem::temp_directory_path() / "qedit_compressed_test.txt").string();
+    std::filesystem::rename(path, renamed);
+
+    Editor editor = createTestEditor();
+    editor.loadFile(renamed);
+    REQUIRE(!editor.getBuffer().empty());
+    editor.finishLoading();
+    REQUIRE_FALSE(editor.isLoading());
+    REQUIRE(editor.getBuffer().size() == 5001);
+    REQUIRE(editor.getBuffer()[4999] == "row 4999");
+    REQUIRE(editor.getCompression().codec == QEditor::Codec::Gzip);
+
+    // Saving keeps the original codec
+    editor.saveFile(renamed);
+    REQUIRE(QEditor::detectCompression(renamed).codec == QEditor::Codec::Gzip);
+
+    std::filesystem::remove(renamed);
+}
+
+TEST_CASE("Line store packs cold blocks", "[editor][linestore]") {
+    QEditor::LineStore store;
+    std::vector<std::string> expected;
+    for (size_t i = 0; i < 100000; ++i) {
+        expected.push_back("2024-05-01 12:00:" + std::to_string(i % 60) + " INFO [worker-" + std::to_string(i % 8) +
+                           "] request " + std::to_string(i * 7919 % 100003) + " handled status=200");
+    }
+    store = std::vector<std::string>(expected);
+
+    const QEditor::LineStore::Stats stats = store.stats();
+    REQUIRE(stats.hotBlocks <= QEditor::LineStore::HOT_BLOCKS);
+    REQUIRE(stats.residentBytes * 3 <= stats.unpackedBytes);
+    REQUIRE(store == expected);
+
+    SECTION("Edits reach cold blocks") {
+        store[10] += " edited";
+        store.insert(store.begin() + 20000, "inserted");
+        store.erase(store.begin() + 50000, store.begin() + 52000);
+        expected[10] += " edited";
+        expected.insert(expected.begin() + 20000, "inserted");
+        expected.erase(expected.begin() + 50000, expected.begin() + 52000);
+
+        // Walk the whole store so every block is packed and unpacked again
+        REQUIRE(store == expected);
+        REQUIRE(store == expected);
+    }
+
+    SECTION("Slices share blocks and outlive edits") {
+        const auto first = expected.begin() + 300;
+        const std::vector<std::string> range(first, first + 40000);
+
+        const QEditor::LineSlice copy = store.slice(300, 40000);
+        REQUIRE(copy == range);
+        size_t textBytes = 0;
+        for (const std::string& line : range) textBytes += line.size();
+        REQUIRE(copy.memoryUsage() < textBytes / 2);
+
+        // Editing the store afterwards doesn't reach the slice
+        store[1000] = "changed";
+        REQUIRE(copy == range);
+
+        QEditor::LineSlice cut = store.cut(300, 40000);
+        expected.erase(first, first + 40000);
+        REQUIRE(store == expected);
+
+        store.splice(50000, copy);
+        store.splice(10, copy);
+        expected.insert(expected.begin() + 50000, range.begin(), range.end());
+        expected.insert(expected.begin() + 10, range.begin(), range.end());
+        REQUIRE(store == expected);
+        REQUIRE(cut.size() == 40000);
+    }
+}
+
+TEST_CASE("Line store appends after its last block is removed", "[editor][linestore]") {
+    QEditor::LineStore store;
+    std::vector<std::string> expected;
+    for (size_t i = 0; i < 1100; ++i) expected.push_back("line " + std::to_string(i));
+    store = std::vector<std::string>(expected);
+
+    store.erase(store.begin() + 600);
+    store.erase(store.begin() + 1023, store.end());
+    store.push_back("appended");
+    expected.erase(expected.begin() + 600);
+    expected.erase(expected.begin() + 1023, expected.end());
+    expected.push_back("appended");
+
+    REQUIRE(store.size() == 1024);
+    REQUIRE(store[1023] == "appended");
+    REQUIRE(store == expected);
+}
+
+TEST_CASE("Cursor motion leaves the buffer revision alone", "[editor][linestore]") {
+    const std::string path = writeNumberedFile("qedit_revision_test.txt", 2000);
+    Editor editor = createTestEditor();
+    editor.loadFile(path);
+
+    const uint64_t revision = editor.getBuffer().revision();
+    typeKeys(editor, "jjjjlllhw$0G" "gg\x1b:5\n");
+    REQUIRE(editor.getBuffer().revision() == revision);
+
+    typeKeys(editor, "x");
+    REQUIRE(editor.getBuffer().revision() != revision);
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Memory accounting", "[editor][mem]") {
+    const std::string path = writeNumberedFile("qedit_mem_test.txt", 1000);
+    Editor editor = createTestEditor();
+    editor.loadFile(path);
+
+    const Editor::MemoryUsage usage = editor.memoryUsage();
+    REQUIRE(usage.lines.lines == 1000);
+    // "line " plus the digits of 1..1000
+    REQUIRE(usage.lines.textBytes == 1000 * 5 + 2893);
+    REQUIRE(usage.lines.residentBytes >= usage.lines.stringBytes + usage.lines.packedBytes);
+    REQUIRE(usage.heap.allocations > 0);
+
+    const std::vector<std::string> report = editor.memoryReport();
+    REQUIRE(report.size() > 5);
+    REQUIRE(report[1].find("1000 lines") != std::string::npos);
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Typing does not allocate once warmed up", "[editor][alloc]") {
+    const std::string path = writeNumberedFile("qedit_alloc_test.txt", 100);
+    Editor editor = createTestEditor();
+    editor.loadFile(path);
+    editor.setCursorPosition(0, 10);
+    editor.editMode();
+
+    // Feed keys through stdin so the whole keypress -> edit -> render path runs
+    int keys[2];
+    REQUIRE(pipe(keys) == 0);
+    const int savedStdin = dup(STDIN_FILENO);
+    dup2(keys[0], STDIN_FILENO);
+
+    auto type = [&](const std::string& text) {
+        for (const char c : text) {
+            REQUIRE(write(keys[1], &c, 1) == 1);
+            editor.processKeypress();
+            editor.drawScreen();
+        }
+    };
+
+    // Warm up: grow the line, its screen rows and the undo record to size
+    const std::string text = "the quick brown fox jumps over the lazy dog";
+    type(text + text);
+    editor.setCursorPosition(0, 10);
+    for (size_t i = 0; i < 2 * text.size(); ++i) {
+        editor.deleteChar();
+    }
+
+    const uint64_t before = QEditor::allocationStats().allocations;
+    type(text);
+    const uint64_t after = QEditor::allocationStats().allocations;
+
+    dup2(savedStdin, STDIN_FILENO);
+    close(savedStdin);
+    close(keys[0]);
+    close(keys[1]);
+
+    REQUIRE(editor.getBuffer()[10] == text + "line 11");
+    REQUIRE(after == before);
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Frame scheduler coalesces redraws during input bursts", "[editor][frames]") {
+    using namespace std::chrono_literals;
+    QEditor::FrameScheduler frames(60);
+    const auto start = QEditor::FrameScheduler::Clock::now();
+
+    REQUIRE_FALSE(frames.shouldRender(false, start));
+    frames.markDirty();
+    REQUIRE(frames.shouldRender(true, start + 1s));
+    frames.rendered(start + 1s);
+
+    // Still typing: hold the frame until the interval has passed
+    frames.markDirty();
+    REQUIRE_FALSE(frames.shouldRender(true, start + 1s + 5ms));
+    REQUIRE(frames.timeUntilDue(start + 1s + 5ms) > 0ms);
+    REQUIRE(frames.shouldRender(true, start + 1s + 17ms));
+
+    // Input gone idle: the final state is painted straight away
+    REQUIRE(frames.shouldRender(false, start + 1s + 5ms));
+
+    // Edits ask for a frame instead of painting
+    Editor editor = createTestEditor();
+    editor.editMode();
+    REQUIRE_FALSE(editor.isRedrawPending());
+    editor.requestRedraw();
+    REQUIRE(editor.isRedrawPending());
+}
+
+TEST_CASE("Counted operators and motions", "[editor][normal]") {
+    const std::string path = writeNumberedFile("qedit_normal_test.txt", 200);
+    Editor editor = createTestEditor();
+    editor.loadFile(path);
+
+    SECTION("Counted motions") {
+        typeKeys(editor, "10j");
+        REQUIRE(editor.getCursorY() == 10);
+        typeKeys(editor, "3k");
+        REQUIRE(editor.getCursorY() == 7);
+        typeKeys(editor, "G");
+        REQUIRE(editor.getCursorY() == 199);
+        typeKeys(editor, "gg");
+        REQUIRE(editor.getCursorY() == 0);
+        typeKeys(editor, "50G");
+        REQUIRE(editor.getCursorY() == 49);
+        typeKeys(editor, "$");
+        REQUIRE(editor.getCursorX() == 6);
+        typeKeys(editor, "0w");
+        REQUIRE(editor.getCursorX() == 5);
+    }
+
+    SECTION("A counted dd is one erase and one undo step") {
+        typeKeys(editor, "150dd");
+        REQUIRE(editor.getBuffer().size() == 50);
+        REQUIRE(editor.getBuffer()[0] == "line 151");
+
+        typeKeys(editor, "u");
+        REQUIRE(editor.getBuffer().size() == 200);
+        REQUIRE(editor.getBuffer()[149] == "line 150");
+
+        // More than there is stops at the last line
+        typeKeys(editor, "G3dd");
+        REQUIRE(editor.getBuffer().size() == 199);
+        REQUIRE(editor.getBuffer().back() == "line 199");
+    }
+
+    SECTION("Linewise motions") {
+        typeKeys(editor, "5Gdj");
+        REQUIRE(editor.getBuffer()[4] == "line 7");
+        typeKeys(editor, "dk");
+        REQUIRE(editor.getBuffer()[3] == "line 8");
+        typeKeys(editor, "dG");
+        REQUIRE(editor.getBuffer().size() == 3);
+        typeKeys(editor, "dgg");
+        REQUIRE(editor.getBuffer().empty());
+    }
+
+    SECTION("Yank and put") {
+        typeKeys(editor, "2yyGp");
+        REQUIRE(editor.getBuffer().size() == 202);
+        REQUIRE(editor.getBuffer()[200] == "line 1");
+        REQUIRE(editor.getBuffer()[201] == "line 2");
+        REQUIRE(editor.getCursorY() == 200);
+    }
+
+    SECTION("Charwise operators") {
+        editor.clearBuffer();
+        typeKeys(editor, "ione two, three four\x1b" "0");
+        typeKeys(editor, "dw");
+        REQUIRE(editor.getBuffer()[0] == "two, three four");
+        typeKeys(editor, "d2w");
+        REQUIRE(editor.getBuffer()[0] == "three four");
+        typeKeys(editor, "cwTHREE\x1b");
+        REQUIRE(editor.getBuffer()[0] == "THREE four");
+        typeKeys(editor, "0y$$p");
+        REQUIRE(editor.getBuffer()[0] == "THREE fourTHREE four");
+        typeKeys(editor, "0D");
+        REQUIRE(editor.getBuffer()[0].empty());
+        typeKeys(editor, "u");
+        REQUIRE(editor.getBuffer()[0] == "THREE fourTHREE four");
+        typeKeys(editor, "03x");
+        REQUIRE(editor.getBuffer()[0] == "EE fourTHREE four");
+    }
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Visual selections", "[editor][visual]") {
+    const std::string path = writeNumberedFile("qedit_visual_test.txt", 20);
+    Editor editor = createTestEditor();
+    editor.loadFile(path);
+
+    SECTION("Line selections delete as one range") {
+        typeKeys(editor, "2GV2j");
+        REQUIRE(editor.isInVisualMode());
+        typeKeys(editor, "d");
+        REQUIRE(editor.isInNormalMode());
+        REQUIRE(editor.getBuffer().size() == 17);
+        REQUIRE(editor.getBuffer()[1] == "line 5");
+
+        typeKeys(editor, "u");
+        REQUIRE(editor.getBuffer().size() == 20);
+
+        // Selecting upwards covers the same lines
+        typeKeys(editor, "4GV2kyGp");
+        REQUIRE(editor.getBuffer().size() == 23);
+        REQUIRE(editor.getBuffer()[20] == "line 2");
+        REQUIRE(editor.getBuffer()[22] == "line 4");
+    }
+
+    SECTION("Indent, outdent and case") {
+        typeKeys(editor, "Vj>");
+        REQUIRE(editor.getBuffer()[0] == "    line 1");
+        REQUIRE(editor.getBuffer()[1] == "    line 2");
+        REQUIRE(editor.getBuffer()[2] == "line 3");
+        typeKeys(editor, "Vj<");
+        REQUIRE(editor.getBuffer()[1] == "line 2");
+
+        typeKeys(editor, "VjU");
+        REQUIRE(editor.getBuffer()[0] == "LINE 1");
+        typeKeys(editor, "0lvl~");
+        REQUIRE(editor.getBuffer()[0] == "LinE 1");
+        typeKeys(editor, "u");
+        REQUIRE(editor.getBuffer()[0] == "LINE 1");
+    }
+
+    SECTION("Charwise selections span lines") {
+        typeKeys(editor, "0llvjd");
+        REQUIRE(editor.getBuffer()[0] == "lie 2");
+        REQUIRE(editor.getBuffer().size() == 19);
+        typeKeys(editor, "u");
+        REQUIRE(editor.getBuffer()[0] == "line 1");
+    }
+
+    SECTION("Block selections") {
+        typeKeys(editor, std::string(1, 22) + "2jld");
+        REQUIRE(editor.getBuffer()[0] == "ne 1");
+        REQUIRE(editor.getBuffer()[2] == "ne 3");
+        REQUIRE(editor.getBuffer()[3] == "line 4");
+
+        // Put the block back in front of the same rows
+        typeKeys(editor, "P");
+        REQUIRE(editor.getBuffer()[0] == "line 1");
+        REQUIRE(editor.getBuffer()[2] == "line 3");
+    }
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Named registers and the clipboard", "[editor][registers]") {
+    const std::string path = writeNumberedFile("qedit_register_test.txt", 20);
+    Editor editor = createTestEditor();
+    editor.loadFile(path);
+
+    typeKeys(editor, "\"ayyj\"byy");
+    typeKeys(editor, "G\"ap\"bP");
+    REQUIRE(editor.getBuffer().size() == 22);
+    REQUIRE(editor.getBuffer()[20] == "line 2");
+    REQUIRE(editor.getBuffer()[21] == "line 1");
+
+    // A delete doesn't disturb "0, which keeps the last yank
+    typeKeys(editor, "ggyyjjddgg\"0P");
+    REQUIRE(editor.getBuffer()[0] == "line 1");
+    typeKeys(editor, "p");
+    REQUIRE(editor.getBuffer()[1] == "line 3");
+
+    // Visual selections take a register too
+    typeKeys(editor, "gg0v$\"cygg\"cP");
+    REQUIRE(editor.getBuffer()[0] == "line 1line 1");
+
+    // "+ goes out to the terminal as OSC 52
+    std::ostringstream out;
+    std::streambuf* saved = std::cout.rdbuf(out.rdbuf());
+    typeKeys(editor, "5G\"+yy");
+    std::cout.rdbuf(saved);
+    REQUIRE(out.str().find("\x1b]52;c;bGluZSA0Cg==\x07") != std::string::npos);
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Large registers share the buffer's blocks", "[editor][registers]") {
+    const std::string path = writeNumberedFile("qedit_big_register_test.txt", 100000);
+    Editor editor = createTestEditor();
+    editor.loadFile(path);
+
+    typeKeys(editor, "yGG3p");
+    REQUIRE(editor.getBuffer().size() == 400000);
+    REQUIRE(editor.getBuffer()[100000] == "line 1");
+    REQUIRE(editor.getBuffer()[399999] == "line 100000");
+
+    // The register and the undo record hold packed blocks, not strings
+    const Editor::MemoryUsage usage = editor.memoryUsage();
+    REQUIRE(usage.registers < usage.lines.unpackedBytes / 8);
+
+    typeKeys(editor, "u");
+    REQUIRE(editor.getBuffer().size() == 100000);
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Multiple cursors", "[editor][cursors]") {
+    const std::string path = writeNumberedFile("qedit_cursor_test.txt", 20);
+    Editor editor = createTestEditor();
+    editor.loadFile(path);
+
+    SECTION("Matches of a word") {
+        typeKeys(editor, ":cursors line 1\n");
+        REQUIRE(editor.getCursorCount() == 11);
+        typeKeys(editor, "iX\x1b");
+        REQUIRE(editor.getBuffer()[0] == "Xline 1");
+        REQUIRE(editor.getBuffer()[9] == "Xline 10");
+        REQUIRE(editor.getBuffer()[1] == "line 2");
+
+        // Motions carry every cursor, and one undo takes the edit back
+        typeKeys(editor, "$a!\x1b");
+        REQUIRE(editor.getBuffer()[0] == "Xline 1!");
+        REQUIRE(editor.getBuffer()[12] == "Xline 13!");
+        typeKeys(editor, "uu");
+        REQUIRE(editor.getBuffer()[0] == "line 1");
+        REQUIRE(editor.getBuffer()[12] == "line 13");
+    }
+
+    SECTION("Ctrl-N adds the next match") {
+        typeKeys(editor, "ggw\x0e\x0e");
+        REQUIRE(editor.getCursorCount() == 3);
+        typeKeys(editor, "a+\x1b");
+        REQUIRE(editor.getBuffer()[0] == "line 1+");
+        REQUIRE(editor.getBuffer()[9] == "line 1+0");
+        REQUIRE(editor.getBuffer()[10] == "line 1+1");
+
+        // A lone Esc drops the extra cursors
+        typeKeys(editor, "\x1b");
+        REQUIRE(editor.getCursorCount() == 1);
+    }
+
+    SECTION("A cursor per selected line") {
+        typeKeys(editor, "Vjj\x0e");
+        REQUIRE(editor.isInNormalMode());
+        REQUIRE(editor.getCursorCount() == 3);
+        typeKeys(editor, "i- \x1b");
+        REQUIRE(editor.getBuffer()[2] == "- line 3");
+        REQUIRE(editor.getBuffer()[3] == "line 4");
+
+        // A fresh set of cursors replaces the old one
+        typeKeys(editor, ":cursors e\n" "i\x7f\x1b");
+        REQUIRE(editor.getCursorCount() == 20);
+        REQUIRE(editor.getBuffer()[0] == "- lin 1");
+        REQUIRE(editor.getBuffer()[3] == "lin 4");
+
+        // Every line splits in the one change
+        typeKeys(editor, "i\n\x1b");
+        REQUIRE(editor.getBuffer().size() == 40);
+        REQUIRE(editor.getBuffer()[0] == "- li");
+        REQUIRE(editor.getBuffer()[1] == "n 1");
+        typeKeys(editor, "u");
+        REQUIRE(editor.getBuffer().size() == 20);
+    }
+
+    SECTION("Deleting with a cursor left past the end of an empty line") {
+        typeKeys(editor, "gg0Di");
+        editor.addStaleCursor(2, 0);
+        REQUIRE(editor.getCursorCount() == 2);
+
+        // Nothing to delete, and the stale cursor lands on the primary
+        typeKeys(editor, "\x7f");
+        REQUIRE(editor.getBuffer()[0].empty());
+        REQUIRE(editor.getCursorCount() == 1);
+        typeKeys(editor, "Z\x1b");
+        REQUIRE(editor.getBuffer()[0] == "Z");
+    }
+
+    SECTION("Enter splits a line at each of its cursors") {
+        typeKeys(editor, ":cursors 1\n" "i\n\x1b");
+        const auto& buffer = editor.getBuffer();
+        REQUIRE(buffer.size() == 20 + 12);
+        REQUIRE(buffer[0] == "line ");
+        REQUIRE(buffer[1] == "1");
+        REQUIRE(buffer[2] == "line 2");
+        REQUIRE(buffer[9] == "line 9");
+        REQUIRE(buffer[10] == "line ");
+        REQUIRE(buffer[11] == "10");
+        REQUIRE(buffer[12] == "line ");
+        REQUIRE(buffer[13] == "1");
+        REQUIRE(buffer[14] == "1");
+        REQUIRE(buffer.back() == "line 20");
+        REQUIRE(editor.getCursorY() == 1);
+        typeKeys(editor, "u");
+        REQUIRE(editor.getBuffer().size() == 20);
+    }
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Sort, uniq and line filters", "[editor][sort]") {
+    const std::string path = writeNumberedFile("qedit_sort_test.txt", 20);
+    Editor editor = createTestEditor();
+    editor.loadFile(path);
+
+    SECTION("Text and numeric order") {
+        typeKeys(editor, ":sort\n");
+        REQUIRE(editor.getBuffer()[0] == "line 1");
+        REQUIRE(editor.getBuffer()[1] == "line 10");
+        REQUIRE(editor.getBuffer()[19] == "line 9");
+
+        typeKeys(editor, ":sort nr\n");
+        REQUIRE(editor.getBuffer()[0] == "line 20");
+        REQUIRE(editor.getBuffer()[19] == "line 1");
+
+        // The whole sort is one undo step
+        typeKeys(editor, "u");
+        REQUIRE(editor.getBuffer()[1] == "line 10");
+    }
+
+    SECTION("Ranges, key fields and uniq") {
+        typeKeys(editor, ":2,4g/line/d\n");
+        REQUIRE(editor.getBuffer().size() == 17);
+        REQUIRE(editor.getBuffer()[1] == "line 5");
+
+        typeKeys(editor, ":%v/1/d\n");
+        REQUIRE(editor.getBuffer().size() == 11);
+        typeKeys(editor, "u");
+        REQUIRE(editor.getBuffer().size() == 17);
+
+        // A selection fills in its own range
+        typeKeys(editor, "ggjVj:sort r k2\n");
+        REQUIRE(editor.getBuffer()[0] == "line 1");
+        REQUIRE(editor.getBuffer()[1] == "line 6");
+        REQUIRE(editor.getBuffer()[2] == "line 5");
+
+        typeKeys(editor, "yyP:.,+1uniq\n");
+        REQUIRE(editor.getBuffer().size() == 17);
+        REQUIRE(editor.getBuffer()[2] == "line 5");
+
+        typeKeys(editor, ":g/[/d\n");
+        REQUIRE(editor.getBuffer().size() == 17);
+    }
+
+    SECTION("A rewrite that throws leaves the range as it was") {
+        const std::vector<std::string> before = editor.getBuffer().slice(0, 20).lines();
+        REQUIRE_THROWS_AS(editor.rewriteRange(2, 10, [](std::vector<std::string>& lines) {
+            std::sort(lines.begin(), lines.end(), std::greater<>());
+            lines.pop_back();
+            throw QEditor::BufferError("Too many lines to sort");
+        }), QEditor::BufferError);
+        REQUIRE(editor.getBuffer() == before);
+
+        // The undo record was closed, so later edits undo on their own
+        typeKeys(editor, ":%sort r\n");
+        REQUIRE(editor.getBuffer()[0] == "line 9");
+        typeKeys(editor, "u");
+        REQUIRE(editor.getBuffer() == before);
+    }
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Parallel sort matches a stable sort", "[editor][sort]") {
+    std::mt19937 random(7);
+    std::vector<std::string> lines;
+    for (size_t i = 0; i < 200000; ++i) {
+        lines.push_back(std::to_string(random() % 5000) + "," + std::to_string(i));
+    }
+
+    QEditor::ThreadPool pool(4);
+    QEditor::SortOptions options = QEditor::parseSortOptions("n u");
+    const std::vector<std::string> unique = QEditor::sortLines(lines, options, pool);
+    REQUIRE(unique.size() == 5000);
+    REQUIRE(unique.front().rfind("0,", 0) == 0);
+
+    // Equal keys keep their order, here the second field
+    options = QEditor::parseSortOptions("k1,");
+    const std::vector<std::string> sorted = QEditor::sortLines(lines, options, pool);
+    std::vector<std::string> expected = lines;
+    std::stable_sort(expected.begin(), expected.end(), [](const std::string& a, const std::string& b) {
+        return a.substr(0, a.find(',')) < b.substr(0, b.find(','));
+    });
+    REQUIRE(sorted == expected);
+
+    REQUIRE_THROWS_AS(QEditor::parseSortOptions("q"), QEditor::CommandError);
+}
+
+TEST_CASE("Filtering through shell commands", "[editor][shell]") {
+    const std::string path = writeNumberedFile("qedit_filter_test.txt", 20);
+    Editor editor = createTestEditor();
+    editor.loadFile(path);
+
+    typeKeys(editor, ":2,3!tr a-z A-Z\n");
+    REQUIRE(editor.getBuffer()[0] == "line 1");
+    REQUIRE(editor.getBuffer()[1] == "LINE 2");
+    REQUIRE(editor.getBuffer()[2] == "LINE 3");
+    typeKeys(editor, "u");
+    REQUIRE(editor.getBuffer()[1] == "line 2");
+
+    // A failing command leaves the buffer alone
+    typeKeys(editor, ":%!echo oops >&2; exit 3\n");
+    REQUIRE(editor.getBuffer().size() == 20);
+    REQUIRE(editor.getStatusMessage() == "Command error: Shell returned 3: oops");
+
+    typeKeys(editor, ":!echo hello\n");
+    REQUIRE(editor.getInfoLines().front() == "hello");
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Filters stream more than a pipe holds", "[editor][shell]") {
+    const std::string path = writeNumberedFile("qedit_big_filter_test.txt", 300000);
+    Editor editor = createTestEditor();
+    editor.loadFile(path);
+
+    // cat writes back while it is still being fed, which would deadlock a
+    // write-everything-then-read filter
+    typeKeys(editor, ":%!cat\n");
+    REQUIRE(editor.getBuffer().size() == 300000);
+    REQUIRE(editor.getBuffer()[299999] == "line 300000");
+
+    typeKeys(editor, ":%!tail -n 2\n");
+    REQUIRE(editor.getBuffer().size() == 2);
+    REQUIRE(editor.getBuffer()[0] == "line 299999");
+    typeKeys(editor, "u");
+    REQUIRE(editor.getBuffer().size() == 300000);
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Diff mode", "[editor][diff]") {
+    const std::string left = writeNumberedFile("qedit_diff_left.txt", 20);
+    const auto right = std::filesystem::temp_directory_path() / "qedit_diff_right.txt";
+    {
+        std::ofstream out(right);
+        for (size_t i = 1; i <= 20; ++i) {
+            if (i == 3) out << "line three\n";
+            else if (i != 10) out << "line " << i << "\n";
+            if (i == 15) out << "extra\n";
+        }
+    }
+
+    Editor editor = createTestEditor();
+    editor.loadFile(left);
+    editor.startDiff(right.string());
+    editor.finishDiff();
+
+    const std::vector<QEditor::DiffHunk>& hunks = editor.getDiffHunks();
+    REQUIRE(hunks.size() == 3);
+    REQUIRE(hunks[0].oldStart == 2);
+    REQUIRE(hunks[1].oldStart == 9);
+    REQUIRE(hunks[1].newCount == 0);
+    REQUIRE(hunks[2].newStart == 14);
+    REQUIRE(hunks[2].oldCount == 0);
+
+    // Both sides share each row, with filler across from a missing line
+    editor.drawScreen();
+    REQUIRE(editor.getFrameRows()[0].find("line 1") < editor.getFrameRows()[0].find('|'));
+    REQUIRE(editor.getFrameRows()[0].find("line 1", editor.getFrameRows()[0].find('|')) != std::string::npos);
+    REQUIRE(editor.getFrameRows()[9].find("---") > editor.getFrameRows()[9].find('|'));
+
+    // Editing the buffer updates the diff
+    typeKeys(editor, "3Gccline three\x1b");
+    REQUIRE(editor.getBuffer()[2] == "line three");
+    editor.finishDiff();
+    REQUIRE(editor.getDiffHunks().size() == 2);
+
+    std::filesystem::remove(left);
+    std::filesystem::remove(right);
+}
+
+TEST_CASE("Diffs rebuild the new text", "[editor][diff]") {
+    std::mt19937 random(11);
+    for (int round = 0; round < 50; ++round) {
+        std::vector<uint32_t> a, b;
+        for (size_t i = 0; i < 200; ++i) a.push_back(random() % 40);
+        for (size_t i = 0; i < 200; ++i) b.push_back(random() % 3 ? a[i] : 40 + random() % 40);
+
+        // Applying the hunks to a gives b
+        const std::vector<QEditor::DiffHunk> hunks = QEditor::diffSequences(a, b);
+        std::vector<uint32_t> rebuilt;
+        size_t i = 0;
+        for (const QEditor::DiffHunk& hunk : hunks) {
+            rebuilt.insert(rebuilt.end(), a.begin() + static_cast<long>(i), a.begin() + static_cast<long>(hunk.oldStart));
+            rebuilt.insert(rebuilt.end(), b.begin() + static_cast<long>(hunk.newStart),
+                           b.begin() + static_cast<long>(hunk.newStart + hunk.newCount));
+            i = hunk.oldStart + hunk.oldCount;
+        }
+        rebuilt.insert(rebuilt.end(), a.begin() + static_cast<long>(i), a.end());
+        REQUIRE(rebuilt == b);
+    }
+}
+
+TEST_CASE("Line indexes are reused from the cache", "[editor][indexcache]") {
+    namespace fs = std::filesystem;
+    const fs::path dir = fs::temp_directory_path() / "qedit_index_cache_test";
+    fs::remove_all(dir);
+    const std::string path = writeNumberedFile("qedit_index_cache_test.txt", 5000);
+    const QEditor::IndexCache cache(dir.string(), 1024 * 1024, 0);
+
+    const auto waitFor = [](const QEditor::LineIndex& index) {
+        while (!index.isComplete()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    };
+
+    QEditor::LineIndex scanned;
+    scanned.build(path, cache);
+    waitFor(scanned);
+    REQUIRE_FALSE(scanned.isCached());
+    REQUIRE(fs::exists(cache.entryFor(path)));
+
+    SECTION("A reopened file is indexed without a scan") {
+        QEditor::LineIndex reopened;
+        reopened.build(path, cache);
+        REQUIRE(reopened.isCached());
+        REQUIRE(reopened.isComplete());
+        REQUIRE(reopened.lineCount() == 5000);
+        REQUIRE(reopened.checkpointForLine(3000) == scanned.checkpointForLine(3000));
+        REQUIRE(reopened.checkpointForOffset(40000) == scanned.checkpointForOffset(40000));
+
+        // Appended bytes are scanned on top of the mapped index
+        std::ofstream(path, std::ios::app) << "line 5001\n";
+        reopened.extend(path);
+        waitFor(reopened);
+        REQUIRE(reopened.lineCount() == 5001);
+    }
+
+    SECTION("A changed file is scanned again") {
+        std::ofstream(path, std::ios::app) << "line 5001\n";
+        QEditor::LineIndex changed;
+        changed.build(path, cache);
+        REQUIRE_FALSE(changed.isCached());
+        waitFor(changed);
+        REQUIRE(changed.lineCount() == 5001);
+    }
+
+    SECTION("The least recently used entries are evicted") {
+        const std::string other = writeNumberedFile("qedit_index_cache_other.txt", 5000);
+        const uint64_t entrySize = fs::file_size(cache.entryFor(path));
+        fs::last_write_time(cache.entryFor(path), fs::file_time_type::clock::now() - std::chrono::hours(1));
+
+        QEditor::LineIndex next;
+        next.build(other, QEditor::IndexCache(dir.string(), entrySize + entrySize / 2, 0));
+        waitFor(next);
+        REQUIRE_FALSE(fs::exists(cache.entryFor(path)));
+        REQUIRE(fs::exists(cache.entryFor(other)));
+
+        fs::remove(other);
+    }
+
+    SECTION("Symbol indexes count against the limit and stale temporary files go") {
+        const uint64_t entrySize = fs::file_size(cache.entryFor(path));
+        const fs::path symbols = dir / "0123456789abcdef.tags";
+        std::ofstream(symbols) << std::string(entrySize, 's');
+        fs::last_write_time(symbols, fs::file_time_type::clock::now() - std::chrono::hours(1));
+
+        // Left by a writer that is gone (past any pid_max), and one still running
+        const fs::path stale = dir / "left.idx.tmp999999999";
+        const fs::path writing = dir / ("busy.tags.tmp" + std::to_string(getpid()));
+        std::ofstream(stale) << "partial";
+        std::ofstream(writing) << "partial";
+
+        QEditor::IndexCache(dir.string(), entrySize + entrySize / 2, 0).evict();
+        REQUIRE_FALSE(fs::exists(symbols));
+        REQUIRE(fs::exists(cache.entryFor(path)));
+        REQUIRE_FALSE(fs::exists(stale));
+        REQUIRE(fs::exists(writing));
+    }
+
+    fs::remove(path);
+    fs::remove_all(dir);
+}
+
+TEST_CASE("Soft wrap", "[editor][wrap]") {
+    const auto path = std::filesystem::temp_directory_path() / "qedit_wrap_test.txt";
+    {
+        std::ofstream out(path);
+        out << "short\n" << std::string(200, 'a') << "\n" << '\t' << std::string(199, 'b') << "\nend\n";
+    }
+    Editor editor = createTestEditor();
+    editor.loadFile(path.string());
+    editor.setWrap(true);
+    editor.drawScreen();
+
+    SECTION("Long lines continue on the rows below") {
+        const std::vector<std::string>& rows = editor.getFrameRows();
+        REQUIRE(rows[0] == "short");
+        REQUIRE(rows[1] == std::string(80, 'a'));
+        REQUIRE(rows[3] == std::string(40, 'a'));
+        // The tab takes four cells, so the first row holds 76 more
+        REQUIRE(rows[4] == "    " + std::string(76, 'b'));
+        REQUIRE(rows[7] == "end");
+    }
+
+    SECTION("j and k move by display row") {
+        typeKeys(editor, "j");
+        REQUIRE(editor.getCursorY() == 1);
+        typeKeys(editor, "5lj");
+        REQUIRE(editor.getCursorY() == 1);
+        REQUIRE(editor.getCursorX() == 85);
+        typeKeys(editor, "2j");
+        REQUIRE(editor.getCursorY() == 2);
+        REQUIRE(editor.getCursorX() == 2); // column 5, past the tab
+        typeKeys(editor, "k");
+        REQUIRE(editor.getCursorX() == 165);
+
+        // Operators still take whole lines
+        typeKeys(editor, "dj");
+        REQUIRE(editor.getBuffer().size() == 2);
+    }
+
+    SECTION("A resize reflows the lines on screen") {
+        editor.setMockTerminalSize(24, 50);
+        editor.drawScreen();
+        REQUIRE(editor.getFrameRows()[1] == std::string(50, 'a'));
+        REQUIRE(editor.getFrameRows()[4] == std::string(50, 'a'));
+    }
+
+    SECTION("Edits renumber the cached lines") {
+        // The tabbed line moves up to where the plain one was cached
+        typeKeys(editor, "jdd");
+        editor.drawScreen();
+        REQUIRE(editor.getFrameRows()[1] == "    " + std::string(76, 'b'));
+    }
+
+    SECTION("The screen follows the cursor through a line taller than it") {
+        typeKeys(editor, "ccx\x1b");
+        typeKeys(editor, "j");
+        editor.setMockTerminalSize(5, 10);
+        for (int i = 0; i < 12; ++i) typeKeys(editor, "j");
+        editor.scroll();
+        REQUIRE(editor.getCursorY() == 1);
+        REQUIRE(editor.getRowOffset() == 1);
+        REQUIRE(editor.getTopRow() == 9);
+        typeKeys(editor, "gg");
+        editor.scroll();
+        REQUIRE(editor.getRowOffset() == 0);
+        REQUIRE(editor.getTopRow() == 0);
+    }
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Long lines scroll sideways", "[editor][longline]") {
+    const auto path = std::filesystem::temp_directory_path() / "qedit_long_line_test.txt";
+    std::string longLine;
+    for (int i = 0; i < 2000; ++i) longLine += "w" + std::to_string(i) + (i % 100 == 0 ? "\t" : " ");
+    {
+        std::ofstream out(path);
+        out << "short\n" << longLine << "\n";
+    }
+    Editor editor = createTestEditor();
+    editor.loadFile(path.string());
+
+    typeKeys(editor, "j$");
+    editor.scroll();
+    editor.drawScreen();
+    const size_t column = editor.getColOffset() + 79;
+    REQUIRE(editor.getColOffset() > 0);
+
+    // The last cell on screen is the end of the line
+    const std::string& row = editor.getFrameRows()[1];
+    REQUIRE(row.size() == 80);
+    REQUIRE(row.substr(row.size() - 6) == "w1999 ");
+    REQUIRE(editor.getFrameRows()[0].empty());
+
+    typeKeys(editor, "0");
+    editor.scroll();
+    REQUIRE(editor.getColOffset() == 0);
+
+    QEditor::ColumnIndex index;
+    REQUIRE(index.column(1, longLine, longLine.size() - 1) == column);
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Column index agrees with a walk from the line start", "[editor][longline]") {
+    std::mt19937 random(5);
+    const std::string pieces[] = {"a", "bc", "\t", "\xc3\xa9", "\xe2\x82\xac", " "};
+    std::string line;
+    while (line.size() < 20000) line += pieces[random() % 6];
+
+    QEditor::ColumnIndex index;
+    index.setTabWidth(4);
+    for (size_t x = 0; x <= line.size(); x += 1 + random() % 37) {
+        const size_t expected = QEditor::WrapCache::cells(line, 0, x, 4);
+        REQUIRE(index.column(0, line, x) == expected);
+
+        // Back from the column to the start of the character holding x
+        size_t start = x;
+        while (start > 0 && start < line.size() && (static_cast<unsigned char>(line[start]) & 0xc0) == 0x80) --start;
+        REQUIRE(index.byteAt(0, line, index.column(0, line, start)) == start);
+    }
+}
+
+TEST_CASE("Moved rows are shifted by the terminal", "[editor][frames]") {
+    const std::string path = writeNumberedFile("qedit_scroll_region_test.txt", 100);
+    Editor editor = createTestEditor();
+    editor.loadFile(path);
+    editor.drawScreen();
+
+    auto frame = [&editor](const std::string& keys) {
+        std::ostringstream out;
+        std::streambuf* saved = std::cout.rdbuf(out.rdbuf());
+        typeKeys(editor, keys);
+        editor.scroll();
+        editor.drawScreen();
+        std::cout.rdbuf(saved);
+        return out.str();
+    };
+    auto painted = [](const std::string& output) {
+        size_t count = 0;
+        for (size_t at = output.find("\x1b[2K"); at != std::string::npos; at = output.find("\x1b[2K", at + 1)) ++count;
+        return count - 1; // the status line is always cleared
+    };
+
+    SECTION("Deleting a line moves only the rows below it") {
+        const std::string output = frame("5Gdd");
+        REQUIRE(output.find("\x1b[5;23r\x1b[1S\x1b[r") != std::string::npos);
+        REQUIRE(painted(output) == 1);
+    }
+
+    SECTION("Scrolling back up shifts the screen down") {
+        frame("30G");
+        frame("22k");
+        const std::string output = frame("k");
+        REQUIRE(output.find("\x1b[1;23r\x1b[1T\x1b[r") != std::string::npos);
+        REQUIRE(painted(output) == 1);
+    }
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Terminal probe replies", "[editor][terminal]") {
+    REQUIRE(QEditor::parseProbeReplies("\x1b[?2026;2$y\x1b[?62;22c").synchronizedOutput);
+    REQUIRE(QEditor::parseProbeReplies("\x1b[?2026;1$y").synchronizedOutput);
+    REQUIRE_FALSE(QEditor::parseProbeReplies("\x1b[?2026;0$y\x1b[?1;2c").synchronizedOutput);
+    REQUIRE_FALSE(QEditor::parseProbeReplies("\x1b[?1;2c").synchronizedOutput);
+
+    REQUIRE(QEditor::probeFinished("\x1b[?2026;2$y\x1b[?62;22c"));
+    REQUIRE_FALSE(QEditor::probeFinished("\x1b[?2026;2$y"));
+    REQUIRE_FALSE(QEditor::probeFinished("\x1b[?62;2"));
+}
+
+TEST_CASE("Folding", "[editor][fold]") {
+    const auto dir = std::filesystem::temp_directory_path();
+    Editor editor = createTestEditor();
+
+    auto shown = [&editor](const size_t row) {
+        editor.scroll();
+        editor.drawScreen();
+        return editor.getFrameRows()[row];
+    };
+
+    SECTION("Indentation folds") {
+        const auto path = dir / "qedit_fold_test.py";
+        {
+            std::ofstream out(path);
+            out << "def a():\n    x = 1\n    if x:\n        y = 2\n\n    return x\ndef b():\n    pass\n";
+        }
+        editor.loadFile(path.string());
+
+        typeKeys(editor, "jjjzc");
+        REQUIRE(editor.getCursorY() == 2);
+        REQUIRE(shown(2) == "+-- 2 lines: if x:");
+        REQUIRE(shown(3) == "");
+
+        // zc again closes the fold around it
+        typeKeys(editor, "zc");
+        REQUIRE(editor.getCursorY() == 0);
+        REQUIRE(shown(0) == "+-- 6 lines: def a():");
+        REQUIRE(shown(1) == "def b():");
+
+        typeKeys(editor, "j");
+        REQUIRE(editor.getCursorY() == 6);
+        typeKeys(editor, "k");
+        REQUIRE(editor.getCursorY() == 0);
+
+        // zo opens one level
+        typeKeys(editor, "zo");
+        REQUIRE(shown(2) == "+-- 2 lines: if x:");
+        REQUIRE(shown(4) == "    return x");
+
+        typeKeys(editor, "zR");
+        REQUIRE(shown(3) == "        y = 2");
+        typeKeys(editor, "zM");
+        REQUIRE(shown(1) == "+-- 2 lines: def b():");
+
+        // An operator takes a closed fold whole
+        typeKeys(editor, "dd");
+        REQUIRE(editor.getBuffer().size() == 2);
+        REQUIRE(editor.getBuffer()[0] == "def b():");
+    }
+
+    SECTION("Brace folds") {
+        const auto path = dir / "qedit_fold_test.cpp";
+        {
+            std::ofstream out(path);
+            out << "int main() {\n    if (x) {\n        a();\n    } else {\n        b();\n    }\n"
+                   "    // { not a fold\n    return \"}\";\n}\n";
+        }
+        editor.loadFile(path.string());
+        typeKeys(editor, "zR");
+
+        const std::vector<QEditor::Fold>& folds = editor.getFolds().getFolds();
+        REQUIRE(folds.size() == 3);
+        REQUIRE((folds[0].start == 0 && folds[0].end == 8 && folds[0].depth == 0));
+        REQUIRE((folds[1].start == 1 && folds[1].end == 2 && folds[1].depth == 1));
+        REQUIRE((folds[2].start == 3 && folds[2].end == 5 && folds[2].depth == 1));
+
+        typeKeys(editor, "3jzc");
+        REQUIRE(shown(3) == "+-- 3 lines: } else {");
+        REQUIRE(shown(4) == "    // { not a fold");
+
+        // Edits above the fold move it and keep it closed
+        typeKeys(editor, "ggo{\x1b");
+        REQUIRE(shown(4) == "+-- 3 lines: } else {");
+    }
+}
+
+TEST_CASE("Fold updates match a full rescan", "[editor][fold]") {
+    std::mt19937 random(7);
+    auto randomLine = [&random](const QEditor::FoldTree::Method method) {
+        const std::string indent(random() % 4 * 4, ' ');
+        if (random() % 6 == 0) return std::string();
+        if (method == QEditor::FoldTree::Method::Indent) return indent + "x";
+        static const char* const bodies[] = {"x", "x {", "}", "} else {", "{ }", "\"{\"", "// }"};
+        return indent + bodies[random() % 7];
+    };
+
+    for (const auto method : {QEditor::FoldTree::Method::Indent, QEditor::FoldTree::Method::Braces}) {
+        QEditor::LineStore lines;
+        for (int i = 0; i < 200; ++i) lines.push_back(randomLine(method));
+
+        QEditor::FoldTree folds;
+        folds.build(lines, method, 4);
+        for (int edit = 0; edit < 300; ++edit) {
+            const size_t at = random() % (lines.size() + 1);
+            const size_t count = std::min<size_t>(random() % 4, lines.size() - at);
+            std::vector<std::string> added(random() % 4);
+            for (std::string& line : added) line = randomLine(method);
+
+            lines.erase(lines.begin() + static_cast<long>(at), lines.begin() + static_cast<long>(at + count));
+            lines.insert(lines.begin() + static_cast<long>(at), added.begin(), added.end());
+            folds.update(lines, at, count, added.size());
+            if (edit % 3 == 0 && !lines.empty()) folds.close(random() % lines.size());
+            if (edit % 50 == 49) folds.openAll();
+
+            QEditor::FoldTree expected;
+            expected.build(lines, method, 4);
+            REQUIRE(folds.getFolds().size() == expected.getFolds().size());
+            for (size_t i = 0; i < expected.getFolds().size(); ++i) {
+                const QEditor::Fold& a = folds.getFolds()[i];
+                const QEditor::Fold& b = expected.getFolds()[i];
+                REQUIRE(std::tie(a.start, a.end, a.depth) == std::tie(b.start, b.end, b.depth));
+            }
+
+            // The patched hidden ranges agree with the closed folds
+            std::vector<bool> hidden(lines.size() + 1);
+            for (const QEditor::Fold& fold : folds.getFolds()) {
+                if (fold.closed) std::fill(hidden.begin() + static_cast<long>(fold.start + 1),
+                                           hidden.begin() + static_cast<long>(fold.end + 1), true);
+            }
+            size_t shown = 0;
+            for (size_t line = 0; line < lines.size(); ++line) {
+                REQUIRE(folds.isHidden(line) == hidden[line]);
+                if (hidden[line]) continue;
+                REQUIRE(folds.visibleIndex(line) == shown);
+                REQUIRE(folds.lineAtVisibleIndex(shown) == line);
+                ++shown;
+            }
+        }
+    }
+}
+
+TEST_CASE("Split windows", "[editor][windows]") {
+    Editor editor = createTestEditor();
+    const std::string path = writeNumberedFile("qedit_split_test.txt", 100);
+    editor.loadFile(path);
+
+    auto frame = [&editor]() {
+        editor.scroll();
+        editor.drawScreen();
+        return editor.getFrameRows();
+    };
+
+    SECTION(":split shows the buffer twice, each window with its own view") {
+        typeKeys(editor, ":split\n");
+        REQUIRE(editor.getWindowCount() == 2);
+
+        // The new window is on top, 11 text rows and its status row
+        std::vector<std::string> rows = frame();
+        REQUIRE(rows[0] == "line 1");
+        REQUIRE(rows[11].find(path + "  1") != std::string::npos);
+        REQUIRE(rows[12] == "line 1");
+
+        typeKeys(editor, "50G");
+        rows = frame();
+        REQUIRE(rows[10] == "line 50");
+        REQUIRE(rows[12] == "line 1");
+
+        // Ctrl-W j goes down, the cursor there where it was left
+        typeKeys(editor, "\x17j");
+        REQUIRE(editor.getCursorY() == 0);
+        typeKeys(editor, "\x17w");
+        REQUIRE(editor.getCursorY() == 49);
+
+        // An edit above the other window keeps it on the same lines
+        typeKeys(editor, "\x17jGkdd");
+        REQUIRE(editor.getBuffer().size() == 99);
+        typeKeys(editor, "\x17kggdd");
+        rows = frame();
+        REQUIRE(rows[0] == "line 2");
+        REQUIRE(rows[12] == "line 90");
+        REQUIRE(rows[21] == "line 100");
+
+        typeKeys(editor, ":q\n");
+        REQUIRE(editor.isRunning());
+        REQUIRE(editor.getWindowCount() == 1);
+        REQUIRE(frame()[0] == "line 90");
+    }
+
+    SECTION(":vsplit puts windows side by side") {
+        typeKeys(editor, ":vsplit\n");
+        const std::vector<std::string> rows = frame();
+        REQUIRE(rows[0] == "line 1" + std::string(34, ' ') + "|line 1");
+
+        typeKeys(editor, ":only\n");
+        REQUIRE(editor.getWindowCount() == 1);
+        REQUIRE(frame()[0] == "line 1");
+    }
+
+    SECTION("A split needs room for another window") {
+        editor.setMockTerminalSize(4, 80);
+        typeKeys(editor, ":split\n");
+        typeKeys(editor, ":split\n");
+        REQUIRE(editor.getWindowCount() == 2);
+        REQUIRE(editor.getStatusMessage().find("Not enough room") != std::string::npos);
+
+        typeKeys(editor, ":close\n:close\n");
+        REQUIRE(editor.getWindowCount() == 1);
+        REQUIRE(editor.getStatusMessage().find("Can't close the last window") != std::string::npos);
+    }
+}
+
+TEST_CASE("Multiple buffers", "[editor][buffers]") {
+    Editor editor = createTestEditor();
+    const std::string first = writeNumberedFile("qedit_buffer_a.txt", 100);
+    const std::string second = writeNumberedFile("qedit_buffer_b.txt", 20);
+    editor.loadFile(first);
+
+    auto frame = [&editor]() {
+        editor.scroll();
+        editor.drawScreen();
+        return editor.getFrameRows();
+    };
+
+    SECTION("Each buffer keeps its lines, cursor and undo") {
+        typeKeys(editor, "50Gdd");
+        typeKeys(editor, ":e " + second + "\n");
+        REQUIRE(editor.getBufferCount() == 2);
+        REQUIRE(editor.getFilename() == second);
+        REQUIRE(editor.getBuffer().size() == 20);
+        REQUIRE(editor.getCursorY() == 0);
+
+        typeKeys(editor, "5Gdd");
+        REQUIRE(editor.getBuffer().size() == 19);
+
+        typeKeys(editor, ":bn\n");
+        REQUIRE(editor.getFilename() == first);
+        REQUIRE(editor.getBuffer().size() == 99);
+        REQUIRE(editor.getCursorY() == 49);
+        typeKeys(editor, "u");
+        REQUIRE(editor.getBuffer().size() == 100);
+        REQUIRE(editor.getBuffer()[49] == "line 50");
+
+        // Opening a file that is already open goes to its buffer
+        typeKeys(editor, ":e " + second + "\n");
+        REQUIRE(editor.getBufferCount() == 2);
+        REQUIRE(editor.getBuffer().size() == 19);
+        typeKeys(editor, "u");
+        REQUIRE(editor.getBuffer().size() == 20);
+
+        typeKeys(editor, ":bp\n");
+        REQUIRE(editor.getFilename() == first);
+        typeKeys(editor, ":e\n");
+        REQUIRE(editor.getStatusMessage().find("Expected a file to edit") != std::string::npos);
+    }
+
+    SECTION("Windows can show different buffers") {
+        typeKeys(editor, ":split\n");
+        typeKeys(editor, ":e " + second + "\n");
+        typeKeys(editor, "10G");
+
+        std::vector<std::string> rows = frame();
+        REQUIRE(rows[0] == "line 1");
+        REQUIRE(rows[11].find(second + "  10") != std::string::npos);
+        REQUIRE(rows[12] == "line 1");
+
+        // Edits in one buffer leave the other window's view alone
+        typeKeys(editor, "ggdd");
+        REQUIRE(frame()[12] == "line 1");
+
+        typeKeys(editor, "\x17j");
+        REQUIRE(editor.getFilename() == first);
+        REQUIRE(editor.getBuffer().size() == 100);
+        typeKeys(editor, "\x17k");
+        REQUIRE(editor.getFilename() == second);
+        REQUIRE(editor.getCursorY() == 0);
+        REQUIRE(editor.getBuffer()[0] == "line 2");
+    }
+
+    SECTION("Buffers out of sight give up their caches past the limit") {
+        const std::string big = writeNumberedFile("qedit_buffer_c.txt", 20000);
+        typeKeys(editor, ":e " + big + "\n");
+        typeKeys(editor, "G:bn\n");
+        REQUIRE(editor.getFilename() == first);
+        const size_t kept = editor.memoryUsage().buffers;
+
+        editor.setBackgroundCacheSize(0);
+        typeKeys(editor, ":bp\nG:bn\n");
+        REQUIRE(editor.memoryUsage().buffers < kept);
+
+        typeKeys(editor, ":bp\n");
+        REQUIRE(editor.getBuffer()[19999] == "line 20000");
+    }
+}
+
+TEST_CASE("Insert mode completion", "[editor][complete]") {
+    Editor editor = createTestEditor();
+    const auto path = std::filesystem::temp_directory_path() / "qedit_complete_test.txt";
+    {
+        std::ofstream out(path);
+        out << "alphabet alpine\nalpha beta\n\n";
+    }
+    editor.loadFile(path.string());
+
+    SECTION("Ctrl-N and Ctrl-P cycle through the matches and back to the prefix") {
+        typeKeys(editor, "Gialp\x0e");
+        REQUIRE(editor.getBuffer()[2] == "alpha");
+        REQUIRE(editor.getStatusMessage() == "match 1 of 3");
+        typeKeys(editor, "\x0e\x0e");
+        REQUIRE(editor.getBuffer()[2] == "alpine");
+        typeKeys(editor, "\x0e");
+        REQUIRE(editor.getBuffer()[2] == "alp");
+        typeKeys(editor, "\x10");
+        REQUIRE(editor.getBuffer()[2] == "alpine");
+
+        // Typing on keeps the match and ends the completion
+        typeKeys(editor, "s\x0e");
+        REQUIRE(editor.getBuffer()[2] == "alpines");
+        REQUIRE(editor.getStatusMessage() == "No completions for alpines");
+        REQUIRE(editor.getCursorX() == 7);
+    }
+
+    SECTION("The index follows edits and undo") {
+        typeKeys(editor, "ddGoalpi\x0e");
+        REQUIRE(editor.getStatusMessage() == "No completions for alpi");
+
+        typeKeys(editor, "\x1buu");
+        REQUIRE(editor.getBuffer()[0] == "alphabet alpine");
+        typeKeys(editor, "Goalpi\x0e");
+        REQUIRE(editor.getBuffer()[editor.getCursorY()] == "alpine");
+    }
+
+    SECTION("Words come from every open buffer") {
+        const std::string other = writeNumberedFile("qedit_complete_other.txt", 3);
+        typeKeys(editor, ":e " + other + "\n");
+        typeKeys(editor, ":bn\n");
+        typeKeys(editor, "Gili\x0e");
+        REQUIRE(editor.getBuffer()[2] == "line");
+    }
+}
+
+TEST_CASE("Word index updates match a full rebuild", "[editor][complete]") {
+    std::mt19937 random(11);
+    static const char* const vocabulary[] = {"foo", "foobar", "food", "bar", "baz", "qux", "x", "fo", "42abc", "_tmp"};
+    auto randomLine = [&random]() {
+        std::string line;
+        for (size_t n = random() % 5; n > 0; --n) {
+            line += vocabulary[random() % 10];
+            line += random() % 3 == 0 ? "." : " ";
+        }
+        return line;
+    };
+
+    auto all = [](QEditor::WordIndex& index) {
+        REQUIRE(index.waitReady(std::chrono::milliseconds(10000)));
+        std::vector<std::string> words;
+        index.complete("", 1000, words);
+        return words;
+    };
+
+    QEditor::LineStore lines;
+    for (int i = 0; i < 100; ++i) lines.push_back(randomLine());
+
+    QEditor::WordIndex index;
+    index.build(lines.slice(0, lines.size()));
+    for (int edit = 0; edit < 300; ++edit) {
+        const size_t at = random() % (lines.size() + 1);
+        const size_t count = std::min<size_t>(random() % 4, lines.size() - at);
+        std::vector<std::string> added(random() % 4);
+        for (std::string& line : added) line = randomLine();
+
+        for (size_t y = at; y < at + count; ++y) index.remove(std::as_const(lines)[y]);
+        lines.erase(lines.begin() + static_cast<long>(at), lines.begin() + static_cast<long>(at + count));
+        lines.insert(lines.begin() + static_cast<long>(at), added.begin(), added.end());
+        for (const std::string& line : added) index.add(line);
+
+        if (edit % 30 == 0) {
+            QEditor::WordIndex expected;
+            expected.build(lines.slice(0, lines.size()));
+            REQUIRE(all(index) == all(expected));
+        }
+    }
+
+    std::vector<std::string> words;
+    index.complete("foo", 10, words);
+    for (const std::string& word : words) REQUIRE(word.rfind("foo", 0) == 0);
+    REQUIRE(std::find(words.begin(), words.end(), "foo") == words.end());
+}
+
+TEST_CASE("Definitions found by the symbol scanner", "[editor][tags]") {
+    const std::string source =
+        "#define LIMIT 10\n"
+        "namespace outer::inner {\n"
+        "    struct Point { int x, y; };\n"
+        "    enum class Color : char { Red };\n"
+        "    typedef void (*Callback)(int);\n"
+        "    using Names = std::vector<std::string>;\n"
+        "    class Shape : public Base<int> {\n"
+        "    public:\n"
+        "        Shape() : width(0), height{1} { if (width) { draw(); } }\n"
+        "        int area() const noexcept { return width * height; }\n"
+        "        void declared(int a);\n"
+        "        bool operator==(const Shape&) const { return true; }\n"
+        "    };\n"
+        "}\n"
+        "static const char* text = \"void fake() {\"; /* void hidden() { */\n"
+        "auto lambda = [](int x) { return x; };\n"
+        "Shape::~Shape() {}\n"
+        "std::vector<int> outer::inner::Shape::make(int a,\n"
+        "                                           int b) {\n"
+        "}\n";
+
+    std::vector<QEditor::Definition> found;
+    QEditor::scanDefinitions(source, found);
+
+    std::vector<std::pair<std::string, uint32_t>> names;
+    for (const QEditor::Definition& definition : found) names.emplace_back(definition.name, definition.line);
+    REQUIRE(names == std::vector<std::pair<std::string, uint32_t>>{
+        {"LIMIT", 1}, {"inner", 2}, {"Point", 3}, {"Color", 4}, {"Callback", 5}, {"Names", 6},
+        {"Shape", 7}, {"Shape", 9}, {"area", 10}, {"~Shape", 17}, {"make", 18},
+    });
+}
+
+TEST_CASE("Symbol index", "[editor][tags]") {
+    namespace fs = std::filesystem;
+    const fs::path root = fs::temp_directory_path() / "qedit_symbols_test";
+    const fs::path cache = fs::temp_directory_path() / "qedit_symbols_cache";
+    fs::remove_all(root);
+    fs::remove_all(cache);
+    fs::create_directories(root / "src");
+    fs::create_directories(root / ".git");
+    fs::create_directories(root / "build");
+    {
+        std::ofstream(root / "src" / "shape.h") << "struct Shape {\n    int area() const { return 0; }\n};\n";
+        std::ofstream(root / "src" / "main.cpp") << "#include \"shape.h\"\n\nint main() {\n    return 0;\n}\n";
+        std::ofstream(root / "notes.txt") << "void notCode() {}\n";
+        std::ofstream(root / ".git" / "hidden.c") << "void hidden() {}\n";
+        std::ofstream(root / "build" / "CMakeCache.txt") << "\n";
+        std::ofstream(root / "build" / "generated.cpp") << "void generated() {}\n";
+    }
+
+    auto lines = [](const std::vector<QEditor::SymbolIndex::Location>& found) {
+        std::vector<uint32_t> result;
+        for (const auto& location : found) result.push_back(location.line);
+        return result;
+    };
+
+    {
+        QEditor::SymbolIndex index(root.string(), QEditor::IndexCache(cache.string()));
+        index.refresh();
+        REQUIRE(index.waitRefreshed(std::chrono::milliseconds(10000)));
+        REQUIRE(index.isReady());
+        REQUIRE(index.fileCount() == 2);
+        REQUIRE(index.find("main").size() == 1);
+        REQUIRE(index.find("main")[0].file == (root / "src" / "main.cpp").string());
+        REQUIRE(lines(index.find("area")) == std::vector<uint32_t>{2});
+        REQUIRE(index.find("notCode").empty());
+        REQUIRE(index.find("hidden").empty());
+        REQUIRE(index.find("generated").empty());
+        REQUIRE(index.find("Missing").empty());
+
+        // Only the changed file is read again
+        std::ofstream(root / "src" / "main.cpp") << "int helper() { return 1; }\n\nint main() {\n}\n";
+        index.refresh();
+        REQUIRE(index.waitRefreshed(std::chrono::milliseconds(10000)));
+        REQUIRE(lines(index.find("main")) == std::vector<uint32_t>{3});
+        REQUIRE(lines(index.find("helper")) == std::vector<uint32_t>{1});
+        REQUIRE(lines(index.find("Shape")) == std::vector<uint32_t>{1});
+    }
+
+    SECTION("An index saved earlier is mapped straight away") {
+        REQUIRE(fs::exists(QEditor::SymbolIndex::entryFor(root.string(), cache.string())));
+        QEditor::SymbolIndex index(root.string(), QEditor::IndexCache(cache.string()));
+        index.refresh();
+        REQUIRE(index.isReady());
+        REQUIRE(lines(index.find("helper")) == std::vector<uint32_t>{1});
+        REQUIRE(index.waitRefreshed(std::chrono::milliseconds(10000)));
+        REQUIRE(index.symbolCount() == 4);
+    }
+
+    SECTION("A tags file is used when there is one") {
+        std::ofstream(root / "tags") << "!_TAG_FILE_SORTED\t1\t/0=unsorted/\n"
+                                     << "Shape\tsrc/shape.h\t/^struct Shape {$/;\"\ts\n"
+                                     << "area\tsrc/shape.h\t/^    int area() const { return 0; }$/;\"\tf\n"
+                                     << "main\tsrc/main.cpp\t3;\"\tf\n"
+                                     << "tagged\tsrc/main.cpp\t/^\\/\\/ gone$/;\"\tf\n";
+        QEditor::SymbolIndex index(root.string(), std::nullopt);
+        index.refresh();
+        REQUIRE(index.waitRefreshed(std::chrono::milliseconds(10000)));
+        REQUIRE(index.symbolCount() == 4);
+        REQUIRE(lines(index.find("Shape")) == std::vector<uint32_t>{1});
+        REQUIRE(lines(index.find("area")) == std::vector<uint32_t>{2});
+        REQUIRE(lines(index.find("main")) == std::vector<uint32_t>{3});
+        REQUIRE(lines(index.find("tagged")) == std::vector<uint32_t>{1});
+        REQUIRE(index.find("helper").empty());
+    }
+
+    fs::remove_all(root);
+    fs::remove_all(cache);
+}
+
+TEST_CASE("Jump to definition", "[editor][tags]") {
+    namespace fs = std::filesystem;
+    const fs::path root = fs::temp_directory_path() / "qedit_tags_test";
+    fs::remove_all(root);
+    fs::create_directories(root);
+    {
+        std::ofstream(root / "shape.h") << "struct Shape {\n    int area() const;\n};\n";
+        std::ofstream(root / "shape.cpp") << "#include \"shape.h\"\n\nint Shape::area() const {\n"
+                                          << "    return 0;\n}\n\nint total(Shape s) {\n    return s.area();\n}\n";
+    }
+
+    // Run from inside the tree, with the index kept out of the real cache
+    const fs::path saved = fs::current_path();
+    const char* xdg = std::getenv("XDG_CACHE_HOME");
+    const std::string savedXdg = xdg ? xdg : "";
+    setenv("XDG_CACHE_HOME", (root / ".cache").c_str(), 1);
+    fs::current_path(root);
+
+    {
+        Editor editor = createTestEditor();
+        editor.loadFile("shape.cpp");
+
+        // Ctrl-] on s.area() goes to the definition in this file
+        typeKeys(editor, "8G$hhhh\x1d");
+        REQUIRE(editor.getCursorY() == 2);
+        REQUIRE(editor.getCursorX() == 11);
+        REQUIRE(editor.getStatusMessage() == "\"shape.cpp\" line 3");
+
+        // To another file, and back with Ctrl-T
+        typeKeys(editor, "7G3w\x1d");
+        REQUIRE(editor.getFilename() == "shape.h");
+        REQUIRE(editor.getCursorY() == 0);
+        REQUIRE(editor.getCursorX() == 7);
+        typeKeys(editor, "\x14");
+        REQUIRE(editor.getFilename() == "shape.cpp");
+        REQUIRE(editor.getCursorY() == 6);
+        typeKeys(editor, "\x14\x14");
+        REQUIRE(editor.getCursorY() == 7);
+        REQUIRE(editor.getStatusMessage() == "At bottom of tag stack");
+
+        typeKeys(editor, ":tag total\n");
+        REQUIRE(editor.getCursorY() == 6);
+        typeKeys(editor, ":tag nothing\n");
+        REQUIRE(editor.getStatusMessage() == "Command error: Tag not found: nothing");
+        typeKeys(editor, ":tag\n");
+        REQUIRE(editor.getStatusMessage() == "Command error: Expected a tag name");
+
+        // A saved file is indexed again
+        typeKeys(editor, "ggOint added() {}\x1b:w\n");
+        typeKeys(editor, "G:tag added\n");
+        REQUIRE(editor.getCursorY() == 0);
+    }
+
+    fs::current_path(saved);
+    if (xdg) {
+        setenv("XDG_CACHE_HOME", savedXdg.c_str(), 1);
+    } else {
+        unsetenv("XDG_CACHE_HOME");
+    }
+    fs::remove_all(root);
+}
+
+TEST_CASE("Literals required by a search pattern", "[editor][grep]") {
+    using QEditor::TreeSearch;
+    REQUIRE(TreeSearch::requiredLiteral("plain text") == "plain text");
+    REQUIRE(TreeSearch::requiredLiteral("foo\\d+barbaz") == "barbaz");
+    REQUIRE(TreeSearch::requiredLiteral("colou?r") == "colo");
+    REQUIRE(TreeSearch::requiredLiteral("x(abcdef)?yz") == "yz");
+    REQUIRE(TreeSearch::requiredLiteral("[abcdef]+ab") == "ab");
+    REQUIRE(TreeSearch::requiredLiteral("std::vector<\\w+>") == "std::vector<");
+    REQUIRE(TreeSearch::requiredLiteral("a\\.b\\(c") == "a.b(c");
+    REQUIRE(TreeSearch::requiredLiteral("^\\s*$").empty());
+    REQUIRE(TreeSearch::requiredLiteral("alpha|beta").empty());
+    REQUIRE(TreeSearch::requiredLiteral("(alpha|beta)gamma") == "gamma");
+}
+
+TEST_CASE("Tree search", "[editor][grep]") {
+    namespace fs = std::filesystem;
+    const fs::path root = fs::temp_directory_path() / "qedit_grep_test";
+    fs::remove_all(root);
+    fs::create_directories(root / "src" / "deep");
+    fs::create_directories(root / "build");
+    fs::create_directories(root / ".git");
+    {
+        std::ofstream(root / "a.txt") << "one needle\nnothing\n  needle twice needle\n";
+        std::ofstream(root / "src" / "b.cpp") << "int x;\r\nint needle = 1;\r\n";
+        std::ofstream(root / "src" / "deep" / "c.h") << "// needle\n";
+        std::ofstream(root / "src" / "deep" / "keep.log") << "needle\n";
+        std::ofstream(root / "debug.log") << "needle\n";
+        std::ofstream(root / "build" / "out.txt") << "needle\n";
+        std::ofstream(root / ".git" / "config") << "needle\n";
+        std::ofstream(root / ".gitignore") << "# build output\n*.log\nbuild/\n";
+        std::ofstream(root / "src" / ".gitignore") << "!keep.log\n/deep/c.h\n";
+        std::string binary = "needle";
+        binary += '\0';
+        std::ofstream(root / "data.bin", std::ios::binary) << binary;
+    }
+
+    auto run = [&root](const std::string& pattern) {
+        QEditor::TreeSearch search;
+        search.start(pattern, root.string());
+        std::vector<QEditor::SearchMatch> found;
+        search.wait();
+        REQUIRE_FALSE(search.take(found));
+        std::vector<std::string> lines;
+        for (const QEditor::SearchMatch& match : found) {
+            lines.push_back(fs::path(match.file).lexically_relative(root).string() + ":" +
+                            std::to_string(match.line) + ":" + std::to_string(match.column) + ":" + match.text);
+        }
+        std::sort(lines.begin(), lines.end());
+        return lines;
+    };
+
+    REQUIRE(run("needle") == std::vector<std::string>{
+        "a.txt:1:4:one needle", "a.txt:3:2:  needle twice needle", "src/b.cpp:2:4:int needle = 1;",
+        "src/deep/keep.log:1:0:needle",
+    });
+    REQUIRE(run("ne+dle =") == std::vector<std::string>{"src/b.cpp:2:4:int needle = 1;"});
+    REQUIRE(run("^(one|int) ").size() == 3);
+    REQUIRE(run("missing").empty());
+    REQUIRE_THROWS_AS(QEditor::TreeSearch().start("(unclosed", root.string()), std::regex_error);
+
+    fs::remove_all(root);
+}
+
+TEST_CASE("Grep into the quickfix list", "[editor][grep]") {
+    namespace fs = std::filesystem;
+    const fs::path root = fs::temp_directory_path() / "qedit_quickfix_test";
+    fs::remove_all(root);
+    fs::create_directories(root / "sub");
+    {
+        std::ofstream(root / "first.txt") << "alpha\nbeta target\n";
+        std::ofstream(root / "sub" / "second.txt") << "target\n\n\n  the target\n";
+    }
+
+    const fs::path saved = fs::current_path();
+    fs::current_path(root);
+    {
+        Editor editor = createTestEditor();
+        editor.loadFile("first.txt");
+
+        typeKeys(editor, ":cn\n");
+        REQUIRE(editor.getStatusMessage() == "Command error: No matches");
+
+        typeKeys(editor, ":grep target\n");
+        editor.waitForGrep();
+        REQUIRE(editor.getStatusMessage() == "3 matches for target in 2 files");
+
+        // Walk the list forward and back, whatever order the files came in
+        std::vector<std::pair<std::string, size_t>> visited;
+        for (int i = 0; i < 3; ++i) {
+            typeKeys(editor, ":cn\n");
+            visited.emplace_back(editor.getFilename(), editor.getCursorY());
+            REQUIRE(editor.getBuffer()[editor.getCursorY()].substr(editor.getCursorX(), 6) == "target");
+        }
+        std::sort(visited.begin(), visited.end());
+        REQUIRE(visited == std::vector<std::pair<std::string, size_t>>{
+            {"first.txt", 1}, {"sub/second.txt", 0}, {"sub/second.txt", 3},
+        });
+        typeKeys(editor, ":cn\n");
+        REQUIRE(editor.getStatusMessage() == "Command error: No more items");
+
+        typeKeys(editor, ":cp\n");
+        REQUIRE(editor.getStatusMessage().rfind("(2 of 3) ", 0) == 0);
+
+        typeKeys(editor, ":grep 'the target' sub\n");
+        editor.waitForGrep();
+        typeKeys(editor, ":cn\n");
+        REQUIRE(editor.getStatusMessage() == "(1 of 1) sub/second.txt:4: the target");
+        REQUIRE(editor.getCursorX() == 2);
+
+        typeKeys(editor, ":grep (x\n");
+        REQUIRE(editor.getStatusMessage() == "Command error: Invalid pattern: (x");
+        typeKeys(editor, ":grep x nowhere\n");
+        REQUIRE(editor.getStatusMessage() == "Command error: No such directory: nowhere");
+    }
+    fs::current_path(saved);
+    fs::remove_all(root);
+}